@@ -0,0 +1,208 @@
+/**
+ * Microbenchmark of the scheduling overhead per rule. The file system and process spawner are
+ * replaced with stubs that do no work, so the timings only include planning, work stealing and
+ * dependency release. Also times loading a compacted build log holding a record per rule, and
+ * marking dirty rules in a layered graph with ten edges per rule.
+ * Usage: ./my_make_bench [rule count]
+ */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/concurrency/work_stealing_pool.hpp"
+#include "src/dictionaries/rules.hpp"
+#include "src/history/build_log.hpp"
+#include "src/rule_graph.hpp"
+#include "src/rule_runner.hpp"
+
+/** Every file exists, with outputs ('.o' files and the final link) newer than sources */
+class StubFSGateway : public FSGateway {
+   public:
+    bool exists(std::string) const override { return true; }
+
+    std::filesystem::file_time_type last_write_time(std::string filename) const override {
+        const bool is_source = filename.ends_with(".cpp");
+        return std::filesystem::file_time_type{} + std::chrono::seconds(is_source ? 1 : 2);
+    }
+
+    void touch(std::string) override {}
+
+    std::optional<uint64_t> hash_contents(const std::string&) const override { return 0; }
+
+    void set_write_time(const std::string&, std::filesystem::file_time_type) override {}
+};
+
+/** Every process succeeds the moment it is spawned */
+class StubProcSpawner : public ProcessSpawner {
+   public:
+    int run(std::vector<std::string>&) override { return 0; }
+
+    ProcessId spawn(std::vector<std::string>&) override {
+        std::lock_guard lock(mtx);
+        completed.push_back(ProcessResult{next_id, 0, nullptr, nullptr});
+        cv.notify_all();
+        return next_id++;
+    }
+
+    std::vector<ProcessResult> wait_any(std::optional<std::chrono::milliseconds>) override {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [&] { return !completed.empty() || interrupted; });
+        interrupted = false;
+        return std::exchange(completed, {});
+    }
+
+    void interrupt() override {
+        std::lock_guard lock(mtx);
+        interrupted = true;
+        cv.notify_all();
+    }
+
+    void cancel(ProcessId) override {}
+
+   private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<ProcessResult> completed;
+    ProcessId next_id = 1;
+    bool interrupted = false;
+};
+
+/** The shape produced by partitioning a large MultiRule: N compiles feeding one link */
+std::shared_ptr<RuleGraph> make_graph(size_t rule_count) {
+    std::vector<std::unique_ptr<Rule>> rules;
+    std::vector<std::string> objs;
+    for (size_t i = 0; i < rule_count; i++) {
+        const std::string name = "obj_" + std::to_string(i);
+        rules.push_back(std::make_unique<SingleRule>(name, std::vector<std::string>{name + ".cpp"},
+                                                     Step::COMPILE, Location{}));
+        objs.push_back(name);
+    }
+    rules.push_back(std::make_unique<SingleRule>("app", objs, Step::LINK, Location{}));
+    return std::make_shared<RuleGraph>(std::move(rules));
+}
+
+/**
+ * Layers of rules where each rule depends on FAN_IN rules of the layer below, which is the shape
+ * that makes dirty marking follow the most edges per rule. Only the first rule is stale
+ */
+constexpr size_t LAYER_WIDTH = 1000;
+constexpr size_t FAN_IN = 10;
+std::shared_ptr<RuleGraph> make_layered_graph(size_t rule_count) {
+    std::vector<std::unique_ptr<Rule>> rules;
+    auto name = [](size_t i) { return "layer_" + std::to_string(i) + ".o"; };
+    for (size_t i = 0; i < rule_count; i++) {
+        std::vector<std::string> deps;
+        if (i < LAYER_WIDTH) {
+            deps.push_back(name(i) + ".cpp");
+        } else {
+            for (size_t j = 0; j < FAN_IN; j++) {
+                const size_t below = (i / LAYER_WIDTH - 1) * LAYER_WIDTH;
+                deps.push_back(name(below + (i + j * 97) % LAYER_WIDTH));
+            }
+        }
+        rules.push_back(std::make_unique<SingleRule>(name(i), deps, Step::LINK, Location{}));
+    }
+    std::vector<std::string> top;
+    for (size_t i = rule_count - std::min(rule_count, LAYER_WIDTH); i < rule_count; i++) {
+        top.push_back(name(i));
+    }
+    rules.push_back(std::make_unique<SingleRule>("top", top, Step::LINK, Location{}));
+    return std::make_shared<RuleGraph>(std::move(rules));
+}
+
+/** As StubFSGateway, except the source of the first rule is newer than everything */
+class OneStaleFSGateway : public StubFSGateway {
+   public:
+    std::filesystem::file_time_type last_write_time(std::string filename) const override {
+        if (filename == "layer_0.o.cpp") {
+            return std::filesystem::file_time_type{} + std::chrono::seconds(3);
+        }
+        return StubFSGateway::last_write_time(filename);
+    }
+};
+
+double ns_per(std::chrono::steady_clock::duration d, size_t count) {
+    return std::chrono::duration<double, std::nano>(d).count() / static_cast<double>(count);
+}
+
+int main(int argc, char** argv) {
+    const size_t rule_count = (argc > 1) ? std::stoul(argv[1]) : 100000;
+    const std::vector<size_t> worker_counts = {1, 8, 64};
+
+    auto graph = make_graph(rule_count);
+    auto cfg = std::make_shared<Config>(Config{"cfg", "clang++", {}, {}, "app"});
+    auto fs = std::make_shared<StubFSGateway>();
+    auto spawner = std::make_shared<StubProcSpawner>();
+
+    std::cout << "Rules: " << rule_count << "\n";
+    std::cout << std::left << std::setw(10) << "workers" << std::setw(22) << "pool ns/task"
+              << std::setw(22) << "no-op build ns/rule" << "\n";
+
+    for (size_t workers : worker_counts) {
+        // Raw pool overhead with tasks that fan out from inside the pool like released rules do
+        WorkStealingPool pool(workers);
+        auto pool_start = std::chrono::steady_clock::now();
+        pool.submit([&pool, rule_count] {
+            for (size_t i = 0; i < rule_count; i++) {
+                pool.submit([] {});
+            }
+        });
+        pool.wait_idle();
+        auto pool_time = std::chrono::steady_clock::now() - pool_start;
+
+        RunnerOptions opts;
+        opts.max_jobs = workers;
+        opts.planning_workers = workers;
+        RuleRunner runner(graph, cfg, spawner, fs, opts);
+        auto run_start = std::chrono::steady_clock::now();
+        runner.run_rule("app");
+        auto run_time = std::chrono::steady_clock::now() - run_start;
+
+        std::cout << std::left << std::setw(10) << workers << std::setw(22) << std::fixed
+                  << std::setprecision(1) << ns_per(pool_time, rule_count) << std::setw(22)
+                  << ns_per(run_time, rule_count + 1) << "\n";
+    }
+
+    const auto log_path = std::filesystem::temp_directory_path() / "my_make_bench_build_log";
+    std::filesystem::remove(log_path);
+    {
+        BuildLog log(log_path);
+        for (size_t i = 0; i < rule_count; i++) {
+            log.record("obj_" + std::to_string(i), BuildLogEntry{i, 0, 0});
+        }
+        log.compact_if_needed();
+    }
+    auto load_start = std::chrono::steady_clock::now();
+    {
+        BuildLog log(log_path);
+        log.get("obj_0");
+    }
+    auto load_time = std::chrono::steady_clock::now() - load_start;
+    std::filesystem::remove(log_path);
+    std::cout << "Build log load: " << std::chrono::duration<double, std::micro>(load_time).count()
+              << " us\n";
+
+    auto layered = make_layered_graph(rule_count);
+    RunnerOptions opts;
+    opts.planning_workers = 8;
+    RuleRunner runner(layered, cfg, spawner, std::make_shared<OneStaleFSGateway>(), opts);
+    const BuildPlan plan = runner.plan_build("top");
+    size_t edge_count = 0;
+    for (const std::vector<size_t>& dependants : plan.dependants) {
+        edge_count += dependants.size();
+    }
+    auto mark_start = std::chrono::steady_clock::now();
+    const DirtySet marks = runner.mark_dirty(plan);
+    auto mark_time = std::chrono::steady_clock::now() - mark_start;
+    const size_t dirty_count = static_cast<size_t>(std::ranges::count(marks.dirty, true));
+    std::cout << "Dirty marking: " << edge_count << " edges, " << dirty_count << " dirty, "
+              << std::chrono::duration<double, std::milli>(mark_time).count() << " ms\n";
+}
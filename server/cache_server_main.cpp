@@ -0,0 +1,75 @@
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pthread.h"
+#include "src/history/artifact_cache.hpp"
+#include "src/remote/cache_server.hpp"
+#include "src/remote/http.hpp"
+
+/** Parse the value of '--max-size' in MiB (e.g. the "512" in "--max-size=512") */
+uint64_t parse_size(const std::string& val) {
+    size_t parsed_len = 0;
+    unsigned long long mib = 0;
+    try {
+        mib = std::stoull(val, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len != val.size() || val.starts_with('-')) {
+        throw std::invalid_argument("Invalid size '" + val + "'. Must be a size in MiB");
+    }
+    return static_cast<uint64_t>(mib) << 20;
+}
+
+int main(int argc, char** argv) {
+    const std::string usage = "<" + std::string(argv[0]) +
+                              "> [--listen=<host:port|unix:path>] [--max-size=<MiB>] <dir>";
+
+    Endpoint endpoint = Endpoint::parse("127.0.0.1:7878");
+    uint64_t max_bytes = ArtifactCache::DEFAULT_MAX_BYTES;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.starts_with("--listen=")) {
+            endpoint = Endpoint::parse(arg.substr(arg.find('=') + 1));
+        } else if (arg.starts_with("--max-size=")) {
+            max_bytes = parse_size(arg.substr(arg.find('=') + 1));
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 1) {
+        throw std::invalid_argument("Invalid CLI arguments. Usage:\n " + usage);
+    }
+
+    // Blocked before any thread starts so every thread inherits the mask, and the signals are
+    // only ever taken by the thread waiting for them below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    CacheServer server(positional[0], endpoint, max_bytes);
+    std::jthread stopper([&] {
+        int sig;
+        sigwait(&signals, &sig);
+        server.stop();
+    });
+
+    std::cout << "Serving '" << positional[0] << "' on " << server.get_endpoint().to_string()
+              << std::endl;
+    try {
+        server.serve();
+    } catch (...) {
+        // The stopper is still waiting for a signal, and joining it would hang instead of exiting
+        pthread_kill(stopper.native_handle(), SIGTERM);
+        throw;
+    }
+    return 0;
+}
@@ -6,6 +6,9 @@
 #include "built_in/func_registry.hpp"
 #include "dictionaries/qualified_dicts.hpp"
 #include "errors/error.hpp"
+#include "history/compiled_buildfile.hpp"
+#include "io/content_hash.hpp"
+#include "io/file_utils.hpp"
 #include "io/fs_gateway.hpp"
 #include "io/proc_spawner.hpp"
 #include "lexer.hpp"
@@ -14,34 +17,96 @@
 #include "rule_runner.hpp"
 #include "variable_evaluator.hpp"
 
-BuildOrchestrator::BuildOrchestrator(std::shared_ptr<FSGateway> fs,
-                                     std::shared_ptr<ProcessSpawner> spawner,
-                                     std::string src_file) try {
-    src_filename = src_file;
-
-    Lexer lexer{src_file};
+namespace {
+/**
+ * Evaluate a configuration, recording every directory listed by 'files' along the way. Only the
+ * variables that could differ from those retained are evaluated, if any are
+ */
+QualifiedDicts evaluate(std::string contents, std::vector<ListedDir>& listed,
+                        RetainedVars* retained) {
+    Lexer lexer = Lexer::from_contents(std::move(contents));
     std::vector<Lexeme> lexed = lexer.lex();
 
     Parser parser(lexed);
     std::vector<ParsedVariable> parsed = parser.parse();
 
-    FuncRegistry fn_reg;
-    VariableEvaluator evaluator(std::move(parsed), fn_reg);
-    QualifiedDicts qualifiers = evaluator.evaluate();
+    FnMap fns = FuncRegistry::DEFAULT_FN_MAP;
+    fns["files"] = [&listed](const std::vector<Value>& args) {
+        return BuiltIn::list_files(args, listed);
+    };
+    VariableEvaluator evaluator(std::move(parsed), FuncRegistry(fns), &listed);
+    return evaluator.evaluate(retained);
+}
+}  // namespace
+
+BuildOrchestrator::BuildOrchestrator(std::shared_ptr<FSGateway> fs,
+                                     std::shared_ptr<ProcessSpawner> spawner,
+                                     std::string src_file, RunnerOptions opts,
+                                     std::optional<std::filesystem::path> compiled_dir,
+                                     RetainedVars* retained) try {
+    src_filename = src_file;
+    err_output = opts.job_output != nullptr ? opts.job_output : &std::cerr;
+
+    // The contents are read once, so what is evaluated is exactly what the saved evaluation is
+    // keyed on even if the file is being edited
+    std::string contents = FileUtils::read_all(src_file);
+    const uint64_t src_hash = content_hash(contents);
+    std::optional<std::filesystem::path> compiled;
+    if (compiled_dir.has_value()) {
+        compiled = CompiledBuildfile::path_for(*compiled_dir, src_file);
+    }
+
+    // Saved evaluations only save time, so any failure to use one falls back to evaluating
+    std::optional<QualifiedDicts> loaded;
+    if (compiled.has_value()) {
+        try {
+            loaded = CompiledBuildfile::load(*compiled, src_hash, listed);
+        } catch (const std::exception&) {
+        }
+    }
+    QualifiedDicts qualifiers;
+    if (loaded.has_value()) {
+        qualifiers = std::move(*loaded);
+    } else {
+        listed.clear();
+        qualifiers = evaluate(std::move(contents), listed, retained);
+        if (compiled.has_value()) {
+            try {
+                CompiledBuildfile::save(*compiled, src_hash, listed, qualifiers);
+            } catch (const std::exception&) {
+            }
+        }
+    }
 
     std::shared_ptr<RuleGraph> graph = std::make_shared<RuleGraph>(std::move(qualifiers.rules));
-    runner =
-        std::make_unique<RuleRunner>(graph, std::make_shared<Config>(qualifiers.cfg), spawner, fs);
+    runner = std::make_unique<RuleRunner>(graph, std::make_shared<Config>(qualifiers.cfg), spawner,
+                                          fs, opts);
 } catch (const Error& err) {
-    std::cerr << err.format(src_file) << std::endl;
+    // Members can't be used once construction has failed, so the stream is found again
+    std::ostream& err_out = opts.job_output != nullptr ? *opts.job_output : std::cerr;
+    err_out << err.format(src_file) << std::endl;
 } catch (const std::exception& err) {
-    std::cerr << "Failed to parse '" << src_file << "' Error: " << err.what() << std::endl;
+    std::ostream& err_out = opts.job_output != nullptr ? *opts.job_output : std::cerr;
+    err_out << "Failed to parse '" << src_file << "' Error: " << err.what() << std::endl;
 }
 
-void BuildOrchestrator::run_rule(std::string cmd) const try {
-    runner->run_rule(cmd);
+bool BuildOrchestrator::listing_changed() const { return !ListedDir::unchanged(listed); }
+
+const std::vector<ListedDir>& BuildOrchestrator::get_listed() const { return listed; }
+
+bool BuildOrchestrator::run_rule(std::string cmd) const { return run_rules({cmd}); }
+
+bool BuildOrchestrator::run_rules(const std::vector<std::string>& cmds) const try {
+    // The configuration failed to evaluate, which has already been reported
+    if (runner == nullptr) return false;
+
+    runner->run_rules(cmds);
+    return true;
 } catch (const Error& err) {
-    std::cerr << err.format(src_filename) << std::endl;
+    *err_output << err.format(src_filename) << std::endl;
+    return false;
 } catch (const std::exception& err) {
-    std::cerr << "Failed to parse '" << src_filename << "' Error: " << err.what() << std::endl;
-}
\ No newline at end of file
+    *err_output << "Failed to parse '" << src_filename << "' Error: " << err.what() << std::endl;
+    return false;
+}
+
@@ -1,11 +1,17 @@
 #ifndef BUILD_ORCHESTRATOR_H
 #define BUILD_ORCHESTRATOR_H
 
+#include <filesystem>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
 
 #include "io/fs_gateway.hpp"
 #include "io/proc_spawner.hpp"
 #include "rule_runner.hpp"
+#include "variable_evaluator.hpp"
 
 /**
  * @brief A controller for managing orchestrating all steps of the build process
@@ -19,9 +25,17 @@ class BuildOrchestrator {
      * @param fs The file system abstraction that all FS interactions will occur through
      * @param spawner The process spawning abstraction that all processes will be spawned wth
      * @param src_file The file containing the build configuration
+     * @param opts Options controlling how rules are scheduled (e.g. the job count). Errors are
+     * reported to it's job output if set, and stderr otherwise
+     * @param compiled_dir Where the evaluation of the configuration is saved, and loaded from
+     * instead of evaluating it again while it still holds. Always evaluated if not set
+     * @param retained The variables of the configuration's last evaluation, kept between
+     * orchestrators so evaluating it again only evaluates the variables that could have changed
      */
     BuildOrchestrator(std::shared_ptr<FSGateway> fs, std::shared_ptr<ProcessSpawner> spawner,
-                      std::string src_file);
+                      std::string src_file, RunnerOptions opts = {},
+                      std::optional<std::filesystem::path> compiled_dir = std::nullopt,
+                      RetainedVars* retained = nullptr);
 
     /**
      * @brief Perform all pre-processing that must occur before command execution
@@ -30,14 +44,38 @@ class BuildOrchestrator {
     void setup();
 
     /**
-     * @brief Execute a command
+     * @brief Execute a command. Errors are reported to stderr rather than propagated
      *
      * @param cmd As of now, a command is just an identifier to a rule
+     * @return true if and only if the rule was built successfully
      */
-    void run_rule(std::string cmd) const;
+    bool run_rule(std::string cmd) const;
+
+    /**
+     * @brief Build several rules as a single schedule, so shared dependencies are only checked
+     * once and work for every rule overlaps. Errors are reported to stderr rather than propagated
+     *
+     * @param cmds The identifiers of the rules to build
+     * @return true if and only if every rule was built successfully
+     */
+    bool run_rules(const std::vector<std::string>& cmds) const;
+
+    /**
+     * @brief Whether a directory listed by 'files' while evaluating the configuration has changed
+     * since, so evaluating it again could find other files
+     */
+    bool listing_changed() const;
+
+    /**
+     * @brief The directories listed by 'files' while evaluating the configuration, which it could
+     * find other files in once an entry is added to or removed from them
+     */
+    const std::vector<ListedDir>& get_listed() const;
 
    private:
     std::string src_filename;
+    std::vector<ListedDir> listed;
+    std::ostream* err_output;
     std::unique_ptr<RuleRunner> runner;
 };
 
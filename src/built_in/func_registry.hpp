@@ -28,11 +28,11 @@ class FuncRegistry {
      */
     Value call(const std::string& name, const std::vector<Value>& args) const;
 
-   private:
-    FnMap func_map;
-
     inline static const FnMap DEFAULT_FN_MAP = {{"file_names", BuiltIn::file_names},
                                                 {"files", BuiltIn::files}};
+
+   private:
+    FnMap func_map;
 };
 
 #endif
\ No newline at end of file
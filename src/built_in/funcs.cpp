@@ -1,5 +1,6 @@
 #include "funcs.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <memory>
 #include <unordered_set>
@@ -7,6 +8,7 @@
 
 #include "../errors/error.hpp"
 #include "../value.hpp"
+#include "sys/stat.h"
 
 Value BuiltIn::file_names(const std::vector<Value>& args) try {
     if (args.size() != 1) {
@@ -38,7 +40,31 @@ Value BuiltIn::file_names(const std::vector<Value>& args) try {
     Error::update_and_throw(excep, "Calling function 'file_names'");
 }
 
-Value BuiltIn::files(const std::vector<Value>& args) try {
+ListedDir ListedDir::stamp(const std::string& path, std::vector<std::string> extensions) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        throw SystemError("Failed to stat directory '" + path + "'");
+    }
+    return ListedDir{path, info.st_mtim.tv_sec * 1'000'000'000 + info.st_mtim.tv_nsec,
+                     static_cast<uint64_t>(info.st_ino), std::move(extensions)};
+}
+
+bool ListedDir::unchanged(const std::vector<ListedDir>& dirs) {
+    try {
+        return std::ranges::all_of(
+            dirs, [](const ListedDir& dir) { return stamp(dir.path, dir.extensions) == dir; });
+    } catch (const std::exception&) {
+        // Removed since
+        return false;
+    }
+}
+
+Value BuiltIn::files(const std::vector<Value>& args) {
+    std::vector<ListedDir> listed;
+    return list_files(args, listed);
+}
+
+Value BuiltIn::list_files(const std::vector<Value>& args, std::vector<ListedDir>& listed) try {
     if (args.size() != 2) {
         throw ValueError("Invalid argument count. 2 required: <path> <extensions>");
     }
@@ -62,8 +88,16 @@ Value BuiltIn::files(const std::vector<Value>& args) try {
         extensions.insert(v.get<std::string>());
     }
 
+    // Sorted so a listing is stamped the same however the extensions are hashed
+    std::vector<std::string> sorted_exts(extensions.begin(), extensions.end());
+    std::ranges::sort(sorted_exts);
     std::vector<std::unique_ptr<Value>> files;
+    listed.push_back(ListedDir::stamp(path, sorted_exts));
     for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+        // Yielded before the iterator descends into it. Links to directories are not followed
+        if (entry.is_directory() && !entry.is_symlink()) {
+            listed.push_back(ListedDir::stamp(entry.path().string(), sorted_exts));
+        }
         if (!entry.is_regular_file()) {
             continue;
         }
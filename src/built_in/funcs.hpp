@@ -1,8 +1,39 @@
 #ifndef BUILT_IN_FUNCS_H
 #define BUILT_IN_FUNCS_H
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "../value.hpp"
 
+/**
+ * A directory as it was when 'files' listed it. A directory's write time changes whenever an
+ * entry is added, removed or renamed in it, so a listing still holds while every directory it
+ * visited has the same write time and inode
+ */
+struct ListedDir {
+    std::string path;
+    int64_t mtime_ns;
+    uint64_t inode;
+    /**
+     * The extensions the listing looked for. Only adding or removing an entry with one of them,
+     * or a directory, can change what listing it again finds
+     */
+    std::vector<std::string> extensions;
+
+    bool operator==(const ListedDir&) const = default;
+
+    /**
+     * Stamp a directory as it is now
+     * @throws If it can not be queried
+     */
+    static ListedDir stamp(const std::string& path, std::vector<std::string> extensions = {});
+
+    /** True if every directory still exists and is as it was when stamped */
+    static bool unchanged(const std::vector<ListedDir>& dirs);
+};
+
 namespace BuiltIn {
 /**
  * Strips all file extensions off a list of file names
@@ -17,6 +48,13 @@ Value file_names(const std::vector<Value>& arg);
  */
 Value files(const std::vector<Value>& args);
 
+/**
+ * 'files', recording every directory visited. Each is stamped before it is read, so a change
+ * made while listing it makes the stamp stale rather than going unnoticed
+ * @param listed Where each directory visited is added
+ */
+Value list_files(const std::vector<Value>& args, std::vector<ListedDir>& listed);
+
 }  // namespace BuiltIn
 
 #endif
@@ -0,0 +1,185 @@
+#include "jobserver.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "../errors/error.hpp"
+#include "fcntl.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+/** Parse a file descriptor number, returning -1 if it isn't one */
+int parse_fd(const std::string& str) {
+    size_t parsed_len = 0;
+    int fd = -1;
+    try {
+        fd = std::stoi(str, &parsed_len);
+    } catch (const std::exception&) {
+        return -1;
+    }
+    return parsed_len == str.size() ? fd : -1;
+}
+}  // namespace
+
+std::unique_ptr<JobServerClient> JobServerClient::from_makeflags(const std::string& makeflags) try {
+    // The last advertisement wins, as a sub-make appends it's own after anything inherited
+    std::istringstream words(makeflags);
+    std::string word;
+    std::string auth;
+    while (words >> word) {
+        for (const std::string prefix : {"--jobserver-auth=", "--jobserver-fds="}) {
+            if (word.starts_with(prefix)) {
+                auth = word.substr(prefix.size());
+            }
+        }
+    }
+    if (auth.empty()) return nullptr;
+
+    if (auth.starts_with("fifo:")) {
+        const std::string path = auth.substr(std::string("fifo:").size());
+        const int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            throw SystemError("Failed to open jobserver FIFO '" + path + "'");
+        }
+        return std::unique_ptr<JobServerClient>(new JobServerClient(fd, fd));
+    }
+
+    const size_t comma = auth.find(',');
+    const int parent_read = parse_fd(auth.substr(0, comma));
+    const int parent_write = comma == std::string::npos ? -1 : parse_fd(auth.substr(comma + 1));
+    if (parent_read < 0 || parent_write < 0) {
+        throw ValueError("Malformed jobserver auth '" + auth + "'");
+    }
+    if (fcntl(parent_read, F_GETFD) < 0 || fcntl(parent_write, F_GETFD) < 0) {
+        throw SystemError(
+            "Jobserver file descriptors were not inherited. Mark the recipe with '+'");
+    }
+
+    // The inherited descriptors share their file description with make, so making them
+    // non-blocking would affect make too. Reopening the pipe gives this process it's own
+    const std::string fd_dir = "/proc/self/fd/";
+    const int read_fd =
+        open((fd_dir + std::to_string(parent_read)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    const int write_fd =
+        open((fd_dir + std::to_string(parent_write)).c_str(), O_WRONLY | O_CLOEXEC);
+    if (read_fd < 0 || write_fd < 0) {
+        if (read_fd >= 0) close(read_fd);
+        if (write_fd >= 0) close(write_fd);
+        throw SystemError("Failed to reopen jobserver pipe");
+    }
+    return std::unique_ptr<JobServerClient>(new JobServerClient(read_fd, write_fd));
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Connecting to jobserver");
+}
+
+JobServerClient::JobServerClient(int _read_fd, int _write_fd)
+    : read_fd(_read_fd), write_fd(_write_fd) {}
+
+JobServerClient::~JobServerClient() {
+    // Tokens lost here would shrink the limit for the rest of the build
+    while (held() > 0) {
+        try {
+            release();
+        } catch (const std::exception&) {
+            break;
+        }
+    }
+    close(read_fd);
+    if (write_fd != read_fd) close(write_fd);
+}
+
+bool JobServerClient::try_acquire() {
+    std::lock_guard lock(mtx);
+    char token;
+    if (read(read_fd, &token, 1) != 1) {
+        return false;
+    }
+    tokens.push_back(token);
+    return true;
+}
+
+void JobServerClient::release() {
+    std::lock_guard lock(mtx);
+    if (tokens.empty()) return;
+
+    ssize_t written;
+    do {
+        written = write(write_fd, &tokens.back(), 1);
+    } while (written < 0 && errno == EINTR);
+    if (written != 1) {
+        throw SystemError("Failed to return jobserver token");
+    }
+    tokens.pop_back();
+}
+
+size_t JobServerClient::held() const {
+    std::lock_guard lock(mtx);
+    return tokens.size();
+}
+
+JobServer::JobServer(size_t _jobs, Style _style) try : jobs(std::max<size_t>(_jobs, 1)),
+                                                        style(_style) {
+    if (style == Style::PIPE) {
+        // Deliberately inheritable, as children find the pipe through it's descriptor numbers
+        int fds[2];
+        if (pipe(fds) != 0) {
+            throw SystemError("Failed to create jobserver pipe");
+        }
+        read_fd = fds[0];
+        write_fd = fds[1];
+        fill(write_fd);
+        return;
+    }
+
+    std::string dir_template = (std::filesystem::temp_directory_path() / "my_make-XXXXXX").string();
+    if (mkdtemp(dir_template.data()) == nullptr) {
+        throw SystemError("Failed to create jobserver directory");
+    }
+    fifo_dir = dir_template;
+
+    const std::filesystem::path fifo = fifo_dir / "jobserver";
+    if (mkfifo(fifo.c_str(), S_IRUSR | S_IWUSR) != 0) {
+        throw SystemError("Failed to create jobserver FIFO '" + fifo.string() + "'");
+    }
+    // A FIFO drops it's contents once nothing has it open, so it's held open for our lifetime
+    read_fd = open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+    if (read_fd < 0) {
+        throw SystemError("Failed to open jobserver FIFO '" + fifo.string() + "'");
+    }
+    write_fd = read_fd;
+    fill(write_fd);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Creating jobserver");
+}
+
+JobServer::~JobServer() {
+    if (read_fd >= 0) close(read_fd);
+    if (write_fd >= 0 && write_fd != read_fd) close(write_fd);
+    if (!fifo_dir.empty()) {
+        std::error_code err;
+        std::filesystem::remove_all(fifo_dir, err);
+    }
+}
+
+std::string JobServer::makeflags() const {
+    const std::string auth = style == Style::FIFO
+                                 ? "fifo:" + (fifo_dir / "jobserver").string()
+                                 : std::to_string(read_fd) + "," + std::to_string(write_fd);
+    return "-j" + std::to_string(jobs) + " --jobserver-auth=" + auth;
+}
+
+void JobServer::fill(int fd) const {
+    // The first job of every process runs on it's implicit token
+    const std::string tokens(jobs - 1, '+');
+    size_t written = 0;
+    while (written < tokens.size()) {
+        const ssize_t n = write(fd, tokens.data() + written, tokens.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to fill jobserver");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * A client of a GNU make jobserver, which shares one limit on parallel jobs between every tool in
+ * a nested build. Each process may always run one job on an implicit token, and must take a token
+ * (a byte) from the jobserver for every additional job, writing it back once the job is done.
+ */
+class JobServerClient {
+   public:
+    /**
+     * Connect to the jobserver advertised in a MAKEFLAGS value, which is either a named FIFO
+     * ('--jobserver-auth=fifo:PATH') or a pair of inherited pipe file descriptors
+     * ('--jobserver-auth=R,W' or the older '--jobserver-fds=R,W')
+     * @return The client, or nullptr if no jobserver is advertised
+     * @throws If a jobserver is advertised but can not be used (e.g. the descriptors were not
+     * inherited), in which case make expects the build to run one job at a time
+     */
+    static std::unique_ptr<JobServerClient> from_makeflags(const std::string& makeflags);
+
+    /** Gives back every token still held */
+    ~JobServerClient();
+
+    JobServerClient(const JobServerClient&) = delete;
+    JobServerClient& operator=(const JobServerClient&) = delete;
+
+    /** Take a token without blocking. Returns true if and only if one was taken */
+    bool try_acquire();
+
+    /**
+     * Give back the most recently taken token
+     * @throws If the token can not be written back
+     */
+    void release();
+
+    /** The number of tokens currently held, not counting the implicit token */
+    size_t held() const;
+
+   private:
+    JobServerClient(int read_fd, int write_fd);
+
+    /** Both non-blocking and private to this client, so other processes are unaffected */
+    int read_fd;
+    int write_fd;
+
+    mutable std::mutex mtx;
+    /** The tokens taken, which must be returned unchanged */
+    std::vector<char> tokens;
+};
+
+/**
+ * A GNU make jobserver for a top level build. The tokens are shared with every child through
+ * MAKEFLAGS, so nested make (or my_make) invocations take part in the same limit.
+ */
+class JobServer {
+   public:
+    enum class Style {
+        /** A named FIFO, understood by GNU make 4.4 and later */
+        FIFO,
+        /** An inherited anonymous pipe, understood by every GNU make version */
+        PIPE
+    };
+
+    /**
+     * Create a jobserver holding a token for every job after the first
+     * @param jobs The total number of jobs that may run at once across the whole build
+     * @param style How children connect to the jobserver
+     * @throws If the FIFO or pipe can not be created
+     */
+    JobServer(size_t jobs, Style style = Style::FIFO);
+
+    /** Removes the FIFO */
+    ~JobServer();
+
+    JobServer(const JobServer&) = delete;
+    JobServer& operator=(const JobServer&) = delete;
+
+    /** The MAKEFLAGS arguments advertising this jobserver to children */
+    std::string makeflags() const;
+
+   private:
+    size_t jobs;
+    Style style;
+    std::filesystem::path fifo_dir;
+    int read_fd = -1;
+    int write_fd = -1;
+
+    /** Fill the jobserver with one token per job after the first */
+    void fill(int fd) const;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "load_monitor.hpp"
+
+#include <fstream>
+#include <sstream>
+
+PressureLoadMonitor::PressureLoadMonitor(PressureThresholds _limits,
+                                         std::filesystem::path _proc_root)
+    : limits(_limits), proc_root(std::move(_proc_root)) {}
+
+bool PressureLoadMonitor::can_start(size_t) {
+    const std::optional<double> memory = read_pressure("memory");
+    if (memory.has_value() && *memory >= limits.max_memory_pressure) return false;
+
+    const std::optional<double> cpu = read_pressure("cpu");
+    if (cpu.has_value() && *cpu >= limits.max_cpu_pressure) return false;
+
+    const std::optional<uint64_t> available = read_available_memory();
+    return !available.has_value() || *available >= limits.min_available_bytes;
+}
+
+std::optional<double> PressureLoadMonitor::read_pressure(const std::string& resource) const {
+    // e.g. "some avg10=1.53 avg60=0.87 avg300=0.21 total=58761459"
+    std::ifstream in(proc_root / "pressure" / resource);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        std::string avg10;
+        if (!(fields >> kind >> avg10) || kind != "some" || !avg10.starts_with("avg10=")) {
+            continue;
+        }
+
+        try {
+            return std::stod(avg10.substr(avg10.find('=') + 1));
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<uint64_t> PressureLoadMonitor::read_available_memory() const {
+    // e.g. "MemAvailable:   12345678 kB"
+    std::ifstream in(proc_root / "meminfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        uint64_t kib;
+        if (fields >> key >> kib && key == "MemAvailable:") {
+            return kib * 1024;
+        }
+    }
+
+    return std::nullopt;
+}
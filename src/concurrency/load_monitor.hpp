@@ -0,0 +1,63 @@
+#ifndef LOAD_MONITOR_H
+#define LOAD_MONITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+/**
+ * Decides whether the machine has capacity for another job, on top of the fixed job limit.
+ * Primarily useful for enabling dependency injection
+ */
+class LoadMonitor {
+   public:
+    virtual ~LoadMonitor() = default;
+
+    /**
+     * Check whether another job may start. Only asked while at least one job is running, so a
+     * busy machine slows the build down rather than stopping it
+     * @param running The number of jobs currently running
+     */
+    virtual bool can_start(size_t running) = 0;
+};
+
+/** The pressure above which a PressureLoadMonitor holds back new jobs */
+struct PressureThresholds {
+    /** Hold back jobs when tasks were stalled on memory for this % of the last 10 seconds */
+    double max_memory_pressure = 10.0;
+    /** Hold back jobs when tasks were waiting for a CPU for this % of the last 10 seconds */
+    double max_cpu_pressure = 90.0;
+    /** Hold back jobs when less memory than this is available */
+    uint64_t min_available_bytes = uint64_t{512} << 20;
+};
+
+/**
+ * Holds back jobs while Linux reports the machine is under pressure. Reads the pressure stall
+ * information (PSI) in /proc/pressure and the available memory in /proc/meminfo before each job.
+ * Any source the kernel does not provide is ignored.
+ */
+class PressureLoadMonitor : public LoadMonitor {
+   public:
+    /**
+     * @param limits The pressure above which no new jobs are started
+     * @param proc_root Where procfs is mounted. Only changed by tests
+     */
+    explicit PressureLoadMonitor(PressureThresholds limits = {},
+                                 std::filesystem::path proc_root = "/proc");
+
+    bool can_start(size_t running) override;
+
+   private:
+    PressureThresholds limits;
+    std::filesystem::path proc_root;
+
+    /** Read the 10 second "some" average from a PSI file, if the kernel provides it */
+    std::optional<double> read_pressure(const std::string& resource) const;
+
+    /** Read MemAvailable from /proc/meminfo in bytes, if the kernel provides it */
+    std::optional<uint64_t> read_available_memory() const;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(size_t worker_count) {
+    worker_count = std::max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.emplace_back([this, i](std::stop_token stop) { worker_loop(stop, i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait_idle();
+    for (std::jthread& w : workers) {
+        w.request_stop();
+    }
+    // Taking the lock ensures no worker is between checking it's predicate and sleeping
+    { std::lock_guard lock(sleep_mtx); }
+    sleep_cv.notify_all();
+}
+
+void WorkStealingPool::submit(Task task) {
+    const size_t idx = (current_pool == this) ? current_idx : next_queue++ % queues.size();
+
+    outstanding++;
+    {
+        std::lock_guard lock(queues[idx]->mtx);
+        queues[idx]->tasks.push_back(std::move(task));
+        // Counted under the deque's lock so a thief can never take the task before it is counted
+        queued++;
+    }
+
+    // Only a sleeping worker needs waking, so busy pools never share a lock between submissions.
+    // Workers are counted before they check for tasks, and tasks before sleepers are read here, so
+    // either the worker sees the task or the task's submitter sees the worker
+    if (sleepers > 0) {
+        { std::lock_guard lock(sleep_mtx); }
+        sleep_cv.notify_one();
+    }
+}
+
+void WorkStealingPool::wait_idle() {
+    std::unique_lock lock(sleep_mtx);
+    idle_cv.wait(lock, [&] { return outstanding == 0; });
+}
+
+size_t WorkStealingPool::size() const { return workers.size(); }
+
+bool WorkStealingPool::try_take(size_t idx, Task& out) {
+    {
+        WorkerQueue& own = *queues[idx];
+        std::lock_guard lock(own.mtx);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        WorkerQueue& victim = *queues[(idx + offset) % queues.size()];
+        std::lock_guard lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            out = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::worker_loop(std::stop_token stop, size_t idx) {
+    current_pool = this;
+    current_idx = idx;
+
+    Task task;
+    while (true) {
+        if (try_take(idx, task)) {
+            task();
+            task = nullptr;
+            if (--outstanding == 0) {
+                std::lock_guard lock(sleep_mtx);
+                idle_cv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mtx);
+        sleepers++;
+        const bool woken = sleep_cv.wait(lock, stop, [&] { return queued > 0; });
+        sleepers--;
+        if (!woken) return;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+/**
+ * A thread pool where every worker owns a deque of tasks. Workers pop their newest task first so
+ * that work spawned by a task stays hot in the same thread, and only when their own deque is empty
+ * do they steal the oldest task of another worker. Each deque has it's own lock so submissions and
+ * steals rarely contend with each other, unlike a single shared queue.
+ */
+class WorkStealingPool {
+   public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Start the pool's workers
+     *
+     * @param worker_count The number of threads to run tasks on (at least 1 is always started)
+     */
+    explicit WorkStealingPool(size_t worker_count);
+
+    /** Finishes any queued tasks then joins all workers */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Queue a task. When called from one of the pool's own workers the task goes onto that
+     * worker's deque, otherwise submissions are spread across the deques round robin
+     *
+     * @param task The task to run
+     * @note Tasks must not throw. Any failure should be captured by the task itself
+     */
+    void submit(Task task);
+
+    /**
+     * Block until every submitted task (including tasks submitted by tasks) has completed
+     * @note Must not be called from one of the pool's own workers
+     */
+    void wait_idle();
+
+    /** Get the number of worker threads */
+    size_t size() const;
+
+   private:
+    struct WorkerQueue {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::jthread> workers;
+
+    /** Tasks that have been submitted but have not finished running */
+    std::atomic<size_t> outstanding = 0;
+    /** Tasks sitting in a deque that have not been picked up yet */
+    std::atomic<size_t> queued = 0;
+    std::atomic<size_t> next_queue = 0;
+    /** Workers asleep or about to sleep, waiting for a task to be queued */
+    std::atomic<size_t> sleepers = 0;
+
+    std::mutex sleep_mtx;
+    std::condition_variable_any sleep_cv;
+    std::condition_variable idle_cv;
+
+    /** The pool the current thread works for (if any) and it's index in that pool */
+    inline static thread_local const WorkStealingPool* current_pool = nullptr;
+    inline static thread_local size_t current_idx = 0;
+
+    void worker_loop(std::stop_token stop, size_t idx);
+
+    /** Take the newest task from a worker's own deque, otherwise steal the oldest from another */
+    bool try_take(size_t idx, Task& out);
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "build_daemon.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "../errors/error.hpp"
+#include "../remote/wire.hpp"
+
+namespace {
+/** Parse an id or offset in a request target, which is only ever plain decimal digits */
+std::optional<uint64_t> parse_number(const std::string& val) {
+    if (val.empty() || val.size() > 19 || !std::ranges::all_of(val, ::isdigit)) {
+        return std::nullopt;
+    }
+    return std::stoull(val);
+}
+
+std::string join(const std::vector<std::string>& strs) {
+    std::string joined;
+    for (const std::string& str : strs) {
+        if (!joined.empty()) joined += ' ';
+        joined += str;
+    }
+    return joined;
+}
+}  // namespace
+
+std::string encode_request(const DaemonRequest& request) {
+    WireWriter out;
+    out.strs(request.options);
+    out.strs(request.targets);
+    return std::move(out.data);
+}
+
+DaemonRequest decode_request(const std::string& data) try {
+    WireReader in(data);
+    DaemonRequest request;
+    request.options = in.strs();
+    request.targets = in.strs();
+    in.finish();
+    return request;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Decoding build request");
+}
+
+std::string encode_progress(const DaemonProgress& progress) {
+    WireWriter out;
+    out.num(progress.finished);
+    out.num(progress.succeeded);
+    out.str(progress.output);
+    return std::move(out.data);
+}
+
+DaemonProgress decode_progress(const std::string& data) try {
+    WireReader in(data);
+    DaemonProgress progress;
+    progress.finished = in.num() != 0;
+    progress.succeeded = in.num() != 0;
+    progress.output = in.str();
+    in.finish();
+    return progress;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Decoding build progress");
+}
+
+BuildDaemon::OutputBuf::OutputBuf(BuildDaemon& _daemon) : daemon(_daemon) {}
+
+BuildDaemon::OutputBuf::int_type BuildDaemon::OutputBuf::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        const char chr = traits_type::to_char_type(ch);
+        xsputn(&chr, 1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize BuildDaemon::OutputBuf::xsputn(const char* str, std::streamsize len) {
+    std::lock_guard lock(daemon.mtx);
+    if (daemon.running == nullptr) {
+        std::cout.write(str, len).flush();
+        return len;
+    }
+    daemon.running->output.append(str, static_cast<size_t>(len));
+    daemon.progressed.notify_all();
+    return len;
+}
+
+BuildDaemon::BuildDaemon(Endpoint endpoint, std::vector<std::string> _options, BuildFn _run_build)
+    : HttpServer(std::move(endpoint)),
+      options(std::move(_options)),
+      run_build(std::move(_run_build)),
+      output_buf(*this),
+      output(&output_buf) {}
+
+BuildDaemon::~BuildDaemon() { close_connections(); }
+
+std::ostream& BuildDaemon::get_output() { return output; }
+
+HttpResponse BuildDaemon::handle(const HttpRequest& request) try {
+    if (request.target == "/builds") {
+        if (request.method != "POST") return HttpResponse{405, ""};
+        DaemonRequest build_request;
+        try {
+            build_request = decode_request(request.body);
+        } catch (const std::exception&) {
+            return HttpResponse{400, ""};
+        }
+        return start_build(build_request);
+    }
+
+    if (!request.target.starts_with("/builds/")) return HttpResponse{404, ""};
+    if (request.method != "GET") return HttpResponse{405, ""};
+    const std::string query = "?from=";
+    const size_t sep = request.target.find(query);
+    const std::optional<uint64_t> id = parse_number(request.target.substr(8, sep - 8));
+    const std::optional<uint64_t> from =
+        sep == std::string::npos ? 0 : parse_number(request.target.substr(sep + query.size()));
+    if (!id.has_value() || !from.has_value()) return HttpResponse{400, ""};
+    return poll_build(*id, *from);
+} catch (const std::exception&) {
+    return HttpResponse{500, ""};
+}
+
+HttpResponse BuildDaemon::start_build(const DaemonRequest& request) {
+    if (request.options != options) {
+        return HttpResponse{409, "The build server in this directory runs builds with '" +
+                                     join(options) + "' rather than '" + join(request.options) +
+                                     "'. Stop it or ask with the same options"};
+    }
+
+    std::lock_guard lock(mtx);
+    auto build = std::make_shared<Build>();
+    build->id = next_id++;
+    build->targets = request.targets;
+    const size_t ahead = queue.size() + (running != nullptr ? 1 : 0);
+    if (ahead > 0) {
+        build->output = "Waiting for " + std::to_string(ahead) + " other build(s) to finish\n";
+    }
+    builds.emplace(build->id, build);
+    queue.push_back(build);
+    queued.notify_one();
+    return HttpResponse{200, std::to_string(build->id)};
+}
+
+HttpResponse BuildDaemon::poll_build(uint64_t id, size_t from) {
+    std::unique_lock lock(mtx);
+    auto itm = builds.find(id);
+    if (itm == builds.end()) return HttpResponse{404, ""};
+    const std::shared_ptr<Build> build = itm->second;
+    if (from > build->output.size()) return HttpResponse{400, ""};
+
+    progressed.wait_for(lock, POLL_TIMEOUT,
+                        [&] { return build->finished || build->output.size() > from; });
+    const DaemonProgress progress{build->finished, build->succeeded, build->output.substr(from)};
+    // Once the client has seen the end of the build there is nothing left to keep it for
+    if (build->finished) {
+        builds.erase(id);
+        std::erase(finished, id);
+    }
+    return HttpResponse{200, encode_progress(progress)};
+}
+
+bool BuildDaemon::run_next(std::chrono::milliseconds timeout) {
+    {
+        std::unique_lock lock(mtx);
+        if (!queued.wait_for(lock, timeout, [&] { return !queue.empty(); })) return false;
+        running = queue.front();
+        queue.pop_front();
+    }
+
+    bool succeeded = false;
+    try {
+        succeeded = run_build(running->targets);
+    } catch (const std::exception& excep) {
+        output << excep.what() << std::endl;
+    }
+
+    std::lock_guard lock(mtx);
+    running->finished = true;
+    running->succeeded = succeeded;
+    finished.push_back(running->id);
+    // Builds whose clients went away are dropped eventually, rather than kept forever
+    while (finished.size() > MAX_FINISHED) {
+        builds.erase(finished.front());
+        finished.pop_front();
+    }
+    running = nullptr;
+    progressed.notify_all();
+    return true;
+}
+
+std::optional<bool> build_on_daemon(const Endpoint& endpoint, const DaemonRequest& request,
+                                    std::ostream& out) try {
+    std::optional<HttpConnection> conn;
+    try {
+        conn.emplace(HttpConnection::connect(endpoint));
+    } catch (const std::exception&) {
+        // Nothing is listening, or only the socket of a daemon that is no longer running is left
+        return std::nullopt;
+    }
+
+    conn->send_request(HttpRequest{"POST", "/builds", encode_request(request)});
+    const HttpResponse started = conn->read_response();
+    if (started.status == 409) {
+        throw LogicError(started.body);
+    }
+    if (started.status != 200) {
+        throw IOError("Build server answered " + std::to_string(started.status));
+    }
+
+    const std::string target = "/builds/" + started.body + "?from=";
+    size_t from = 0;
+    while (true) {
+        conn->send_request(HttpRequest{"GET", target + std::to_string(from), ""});
+        const HttpResponse polled = conn->read_response();
+        if (polled.status != 200) {
+            throw IOError("Build server answered " + std::to_string(polled.status));
+        }
+        const DaemonProgress progress = decode_progress(polled.body);
+        out << progress.output << std::flush;
+        from += progress.output.size();
+        if (progress.finished) return progress.succeeded;
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Building on build server '" + endpoint.to_string() + "'");
+}
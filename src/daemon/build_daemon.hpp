@@ -0,0 +1,154 @@
+#ifndef BUILD_DAEMON_H
+#define BUILD_DAEMON_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../remote/http.hpp"
+
+/** A build a client asks of a build daemon */
+struct DaemonRequest {
+    /**
+     * Everything on the client's command line besides the targets. Builds are only run for
+     * clients asking with the options the daemon was started with
+     */
+    std::vector<std::string> options;
+    std::vector<std::string> targets;
+
+    bool operator==(const DaemonRequest&) const = default;
+};
+
+/** What a client has not seen yet of a build */
+struct DaemonProgress {
+    bool finished = false;
+    /** Only meaningful once finished */
+    bool succeeded = false;
+    /** Everything written since the offset the client asked from */
+    std::string output;
+
+    bool operator==(const DaemonProgress&) const = default;
+};
+
+std::string encode_request(const DaemonRequest& request);
+
+/** @throws If the data is not a well formed request */
+DaemonRequest decode_request(const std::string& data);
+
+std::string encode_progress(const DaemonProgress& progress);
+
+/** @throws If the data is not well formed progress */
+DaemonProgress decode_progress(const std::string& data);
+
+/**
+ * Keeps a workspace's evaluated rules, file queries and histories in memory, and builds it's
+ * targets for any number of clients over HTTP/1.1 (usually on a Unix socket in the workspace). A
+ * build is POSTed to "/builds" and answered with it's id, then it's output is polled from
+ * "/builds/<id>?from=<offset>" until it finishes. Each poll waits until there is output past the
+ * offset, so output arrives as it is written. Builds share every file and all state, so they are
+ * queued and run one at a time on the thread calling 'run_next'
+ */
+class BuildDaemon : public HttpServer {
+   public:
+    /**
+     * Build the targets, writing everything the client should see to 'get_output'
+     * @returns Whether every target was built
+     */
+    using BuildFn = std::function<bool(const std::vector<std::string>& targets)>;
+
+    /**
+     * Start listening
+     * @param endpoint Where to listen
+     * @param options The options builds are run with, which clients must ask with
+     * @param run_build Runs each build
+     * @throws If the endpoint can not be bound
+     */
+    BuildDaemon(Endpoint endpoint, std::vector<std::string> options, BuildFn run_build);
+
+    ~BuildDaemon() override;
+
+    HttpResponse handle(const HttpRequest& request) override;
+
+    /**
+     * Run the next queued build on the calling thread, waiting for one to be queued if none are
+     * @param timeout The longest time to wait for a build
+     * @returns Whether a build was run
+     */
+    bool run_next(std::chrono::milliseconds timeout);
+
+    /** Where the running build's output goes, so it reaches the client that asked for it */
+    std::ostream& get_output();
+
+    /** The longest a poll waits for new output before answering with none */
+    constexpr static std::chrono::milliseconds POLL_TIMEOUT{1000};
+
+    /** How many finished builds are kept for clients that have not polled their end yet */
+    constexpr static size_t MAX_FINISHED = 16;
+
+   private:
+    struct Build {
+        uint64_t id;
+        std::vector<std::string> targets;
+        std::string output;
+        bool finished = false;
+        bool succeeded = false;
+    };
+
+    /**
+     * Appends everything written to the running build's output, waking it's client. Anything
+     * written while no build is running goes to stdout instead
+     */
+    class OutputBuf : public std::streambuf {
+       public:
+        explicit OutputBuf(BuildDaemon& daemon);
+
+       protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* str, std::streamsize len) override;
+
+       private:
+        BuildDaemon& daemon;
+    };
+
+    std::vector<std::string> options;
+    BuildFn run_build;
+    OutputBuf output_buf;
+    std::ostream output;
+
+    std::mutex mtx;
+    /** Notified when a build is queued */
+    std::condition_variable queued;
+    /** Notified when a build writes output or finishes */
+    std::condition_variable progressed;
+    uint64_t next_id = 0;
+    std::unordered_map<uint64_t, std::shared_ptr<Build>> builds;
+    std::deque<std::shared_ptr<Build>> queue;
+    /** The ids of finished builds whose end no client has polled yet, oldest first */
+    std::deque<uint64_t> finished;
+    std::shared_ptr<Build> running;
+
+    HttpResponse start_build(const DaemonRequest& request);
+
+    HttpResponse poll_build(uint64_t id, size_t from);
+};
+
+/**
+ * Run a build on the daemon listening at an endpoint, writing it's output as it arrives
+ * @returns Whether every target was built, or nothing if no daemon is listening
+ * @throws If the daemon was started with other options, or the connection is lost mid build
+ */
+std::optional<bool> build_on_daemon(const Endpoint& endpoint, const DaemonRequest& request,
+                                    std::ostream& out);
+
+#endif
@@ -1,15 +1,28 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <cstddef>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+/** How compile rules find the headers each source includes */
+enum class HeaderDeps {
+    /** Headers are not tracked, so only the listed dependencies are checked */
+    NONE,
+    /** The compiler writes a make style depfile of the headers it read ('-MD -MF') */
+    GCC
+};
+
 struct Config {
     std::string name;
     std::string compiler;
     std::vector<std::string> compilation_flags;
     std::vector<std::string> link_flags;
     std::string default_rule;
+    /** The maximum number of jobs each named pool may run at once */
+    std::unordered_map<std::string, size_t> pools = {};
+    HeaderDeps header_deps = HeaderDeps::NONE;
 };
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "config_factory.hpp"
 
+#include <string>
+
+#include "../errors/error.hpp"
 #include "config.hpp"
 
 Config ConfigFactory::make_config(std::string id, Value cfg_val) const {
@@ -28,6 +31,58 @@ Config ConfigFactory::make_config(std::string id, Value cfg_val) const {
         default_rule = dict.get(DEFAULT_FIELD).get<std::string>();
     }
 
-    return {std::move(id), std::move(compiler), std::move(compilation_flags), std::move(link_flags),
-            std::move(default_rule)};
+    std::unordered_map<std::string, size_t> pools;
+    if (dict.contains(POOLS_FIELD)) {
+        dict.assert_contains({{POOLS_FIELD, ValueType::Dictionary}});
+        pools = make_pools(dict.get(POOLS_FIELD).get<Dictionary>());
+    }
+
+    HeaderDeps header_deps = HeaderDeps::NONE;
+    if (dict.contains(HEADER_DEPS_FIELD)) {
+        dict.assert_contains({{HEADER_DEPS_FIELD, ValueType::STRING}});
+        header_deps = make_header_deps(dict.get(HEADER_DEPS_FIELD).get<std::string>());
+    }
+
+    return {std::move(id),         std::move(compiler),     std::move(compilation_flags),
+            std::move(link_flags), std::move(default_rule), std::move(pools),
+            header_deps};
+}
+
+std::unordered_map<std::string, size_t> ConfigFactory::make_pools(
+    const Dictionary& pools_dict) const {
+    std::unordered_map<std::string, size_t> pools;
+    for (const std::string& pool : pools_dict.keys()) {
+        const Value& size_val = pools_dict.get(pool);
+
+        // The language has no number literals so sizes are usually written as strings
+        int size = 0;
+        if (size_val.get_type() == ValueType::INT) {
+            size = size_val.get<int>();
+        } else {
+            pools_dict.assert_contains({{pool, ValueType::STRING}});
+            const std::string& size_str = size_val.get<std::string>();
+            size_t parsed_len = 0;
+            try {
+                size = std::stoi(size_str, &parsed_len);
+            } catch (const std::exception&) {
+                parsed_len = 0;
+            }
+            if (parsed_len != size_str.size()) {
+                size = 0;
+            }
+        }
+
+        if (size < 1) {
+            throw ValueError("Invalid size for pool '" + pool + "'. Must be a positive integer");
+        }
+        pools[pool] = static_cast<size_t>(size);
+    }
+
+    return pools;
+}
+
+HeaderDeps ConfigFactory::make_header_deps(const std::string& mode) const {
+    if (mode == "gcc") return HeaderDeps::GCC;
+    if (mode == "none") return HeaderDeps::NONE;
+    throw ValueError("Invalid header dependency mode '" + mode + "'. Must be 'gcc' or 'none'");
 }
@@ -10,6 +10,8 @@ class ConfigFactory {
     inline const static std::string COMPILATION_FLAGS_FIELD = "compilation_flags";
     inline const static std::string LINK_FLAGS_FIELD = "link_flags";
     inline const static std::string DEFAULT_FIELD = "default_rule";
+    inline const static std::string POOLS_FIELD = "pools";
+    inline const static std::string HEADER_DEPS_FIELD = "header_deps";
 
     /**
      * Create a configuration object using a parsed and evaluated value
@@ -17,6 +19,19 @@ class ConfigFactory {
      * @param cfg_val The parsed and evaluated configuration dictionary with all required fields
      */
     Config make_config(std::string id, Value cfg_val) const;
+
+   private:
+    /**
+     * Read the size of each pool from a dictionary of pool names to sizes
+     * @throws If any size is not a positive integer
+     */
+    std::unordered_map<std::string, size_t> make_pools(const Dictionary& pools_dict) const;
+
+    /**
+     * Read how headers are tracked, which is either "gcc" or "none"
+     * @throws If the mode is not recognised
+     */
+    HeaderDeps make_header_deps(const std::string& mode) const;
 };
 
 #endif
\ No newline at end of file
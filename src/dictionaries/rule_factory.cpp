@@ -56,7 +56,7 @@ std::unique_ptr<MultiRule> RuleFactory::make_multi_rule(std::string name, Value
 
     const auto step = resolve_enum<Step>(dict.get(RuleFields::STEP).get<ScopedEnumValue>());
 
-    return std::make_unique<MultiRule>(name, deps, out, step, loc);
+    return std::make_unique<MultiRule>(name, deps, out, step, loc, get_pool(dict));
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "MultiRule factory method for '<MultiRule> " + name + "'", loc);
 }
@@ -72,7 +72,16 @@ std::unique_ptr<SingleRule> RuleFactory::make_single_rule(std::string name, Valu
         ValueUtils::vectorise<std::string>(dict.get(RuleFields::DEPS).get<ValueList>());
     const auto step = resolve_enum<Step>(dict.get(RuleFields::STEP).get<ScopedEnumValue>());
 
-    return std::make_unique<SingleRule>(name, deps, step, loc);
+    return std::make_unique<SingleRule>(name, deps, step, loc, get_pool(dict));
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "SingleRule factory method for '<Rule> " + name + "'", loc);
-}
\ No newline at end of file
+}
+
+std::string RuleFactory::get_pool(const Dictionary& dict) const {
+    if (!dict.contains(RuleFields::POOL)) {
+        return "";
+    }
+
+    dict.assert_contains({{RuleFields::POOL, ValueType::STRING}});
+    return dict.get(RuleFields::POOL).get<std::string>();
+}
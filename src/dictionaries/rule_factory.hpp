@@ -27,6 +27,9 @@ class RuleFactory {
     std::unique_ptr<MultiRule> make_multi_rule(std::string name, Value obj, Location loc) const;
 
     std::unique_ptr<CleanRule> make_clean_rule(std::string name, Value obj, Location loc) const;
+
+    /** Get the optional pool of a rule, or an empty string if it is not in a pool */
+    std::string get_pool(const Dictionary& dict) const;
 };
 
 #endif
\ No newline at end of file
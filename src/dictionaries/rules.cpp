@@ -4,31 +4,58 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <filesystem>
 #include <ranges>
 #include <string>
 
 #include "../errors/error.hpp"
 #include "config.hpp"
 
-Rule::Rule(std::string _qualifier, std::string _name, std::vector<std::string> _deps, Location _loc)
-    : qualifier("<" + _qualifier + ">"), name(_name), deps(_deps), loc(_loc) {};
+Rule::Rule(std::string _qualifier, std::string _name, std::vector<std::string> _deps, Location _loc,
+           std::string _pool)
+    : qualifier("<" + _qualifier + ">"), name(_name), deps(_deps), loc(_loc), pool(_pool) {};
 
 const std::vector<std::string>& Rule::get_deps() const { return deps; };
 const std::string& Rule::get_name() const { return name; };
 const Location& Rule::get_loc() const { return loc; };
+const std::string& Rule::get_pool() const { return pool; };
+
+std::vector<std::string> Rule::get_outputs() const { return {name}; }
+
+bool Rule::builds_outputs() const { return true; }
+
+std::vector<std::string> Rule::get_depfile_outputs(const Config&) const { return {}; }
+
+bool Rule::exports_interface() const { return false; }
+
+std::string Rule::get_depfile(const std::string& output) { return output + ".d"; }
+
+bool Rule::should_run_by_content(FSGateway& fs, HashDatabase&) const { return should_run(fs); }
 
 bool Rule::has_updated_dep(FSGateway& fs) const {
-    if (!fs.exists(name)) return true;
+    const auto target_write_t = fs.modified_time(name);
+    if (!target_write_t.has_value()) return true;
 
-    auto target_write_t = fs.last_write_time(name);
-    return std::ranges::any_of(deps, [&](std::string d) {
-        return !fs.exists(d) || fs.last_write_time(d) > target_write_t;
+    return std::ranges::any_of(deps, [&](const std::string& d) {
+        const auto dep_write_t = fs.modified_time(d);
+        return !dep_write_t.has_value() || *dep_write_t > *target_write_t;
     });
 }
 
+bool Rule::has_changed_dep(FSGateway& fs, HashDatabase& hashes) const {
+    const std::optional<bool> changed = hashes.changed_since_build(name, deps);
+    if (changed.has_value()) return *changed;
+
+    const bool stale = has_updated_dep(fs);
+    if (!stale) {
+        hashes.record_build(name, deps);
+    }
+    return stale;
+}
+
 SingleRule::SingleRule(std::string _name, std::vector<std::string> deps, Step _step,
-                       Location _loc) try
-    : Rule("Rule", std::move(_name), std::move(deps), _loc), step(_step) {
+                       Location _loc, std::string _pool) try
+    : Rule("Rule", std::move(_name), std::move(deps), _loc, std::move(_pool)), step(_step) {
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "Constructing '<Rule> " + _name + "'", _loc);
 }
@@ -48,6 +75,10 @@ std::vector<Command> SingleRule::get_commands(const Config& cfg) const try {
     cmd.push_back("-o");
     cmd.push_back(name);
 
+    if (!get_depfile_outputs(cfg).empty()) {
+        cmd.insert(cmd.end(), {"-MD", "-MF", get_depfile(name)});
+    }
+
     return {cmd};
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "Building command for '<Rule> " + name + "'", loc);
@@ -55,15 +86,49 @@ std::vector<Command> SingleRule::get_commands(const Config& cfg) const try {
 
 bool SingleRule::should_run(FSGateway& fs) const { return has_updated_dep(fs); }
 
+bool SingleRule::should_run_by_content(FSGateway& fs, HashDatabase& hashes) const {
+    return has_changed_dep(fs, hashes);
+}
+
+std::vector<std::string> SingleRule::get_depfile_outputs(const Config& cfg) const {
+    // Given several sources the compiler only lists the headers of the last in the depfile
+    if (step != Step::COMPILE || cfg.header_deps != HeaderDeps::GCC || deps.size() != 1) {
+        return {};
+    }
+    return {name};
+}
+
+bool SingleRule::exports_interface() const {
+    if (step != Step::LINK) return false;
+    const std::string filename = std::filesystem::path(name).filename().string();
+    return filename.ends_with(".so") || filename.find(".so.") != std::string::npos;
+}
+
+Step SingleRule::get_step() const { return step; }
+
 MultiRule::MultiRule(std::string _name, std::vector<std::string> _deps,
-                     std::vector<std::string> _out, Step _step, Location _loc) try
-    : Rule("MultiRule", std::move(_name), std::move(_deps), _loc), output(_out), step(_step) {
+                     std::vector<std::string> _out, Step _step, Location _loc,
+                     std::string _pool) try
+    : Rule("MultiRule", std::move(_name), std::move(_deps), _loc, std::move(_pool)),
+      output(_out),
+      step(_step) {
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "Constructing '<MultiRule> " + _name + "'", _loc);
 }
 
 bool MultiRule::should_run(FSGateway& fs) const { return has_updated_dep(fs); }
 
+bool MultiRule::should_run_by_content(FSGateway& fs, HashDatabase& hashes) const {
+    return has_changed_dep(fs, hashes);
+}
+
+std::vector<std::string> MultiRule::get_outputs() const { return output; }
+
+std::vector<std::string> MultiRule::get_depfile_outputs(const Config& cfg) const {
+    if (step != Step::COMPILE || cfg.header_deps != HeaderDeps::GCC) return {};
+    return output;
+}
+
 std::vector<Command> MultiRule::get_commands(const Config& cfg) const try {
     std::vector<Command> cmds;
     for (size_t i = 0; i < deps.size(); i++) {
@@ -76,6 +141,9 @@ std::vector<Command> MultiRule::get_commands(const Config& cfg) const try {
         cmd.push_back(deps[i]);
         cmd.push_back("-o");
         cmd.push_back(output[i]);
+        if (step == Step::COMPILE && cfg.header_deps == HeaderDeps::GCC) {
+            cmd.insert(cmd.end(), {"-MD", "-MF", get_depfile(output[i])});
+        }
 
         cmds.push_back(cmd);
     }
@@ -88,7 +156,7 @@ std::vector<Command> MultiRule::get_commands(const Config& cfg) const try {
 std::vector<SingleRule> MultiRule::partition() const {
     std::vector<SingleRule> parts;
     for (const auto& [dep, out] : std::ranges::views::zip(deps, output)) {
-        parts.push_back(SingleRule(out, {dep}, step, loc));
+        parts.push_back(SingleRule(out, {dep}, step, loc, pool));
     }
     return parts;
 };
@@ -111,5 +179,9 @@ std::vector<Command> CleanRule::get_commands(const Config&) const try {
 }
 
 bool CleanRule::should_run(FSGateway& fs) const {
-    return std::ranges::any_of(deps, [&](std::string d) { return fs.exists(d); });
-}
\ No newline at end of file
+    return std::ranges::any_of(deps, [&](const std::string& d) { return fs.exists(d); });
+}
+
+std::vector<std::string> CleanRule::get_outputs() const { return deps; }
+
+bool CleanRule::builds_outputs() const { return false; }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include "../built_in/enums.hpp"
 #include "../errors/error.hpp"
+#include "../history/hash_database.hpp"
 #include "../io/fs_gateway.hpp"
 #include "config.hpp"
 
@@ -19,15 +20,19 @@ inline constexpr static std::string STEP = "step";
 inline constexpr static std::string DEPS = "deps";
 inline constexpr static std::string OUTPUT = "output";
 inline constexpr static std::string TARGETS = "targets";
+inline constexpr static std::string POOL = "pool";
 }  // namespace RuleFields
 
 class Rule {
    public:
-    Rule(std::string _qualifier, std::string _name, std::vector<std::string>, Location _loc);
+    Rule(std::string _qualifier, std::string _name, std::vector<std::string>, Location _loc,
+         std::string _pool = "");
 
     const std::string& get_name() const;
     const std::vector<std::string>& get_deps() const;
     const Location& get_loc() const;
+    /** The pool limiting how many jobs like this rule run at once. Empty if not in a pool */
+    const std::string& get_pool() const;
 
     virtual ~Rule() = default;
 
@@ -49,11 +54,46 @@ class Rule {
      */
     virtual bool should_run(FSGateway& fs) const = 0;
 
+    /**
+     * Determine if it's necessary to run the rule by comparing the contents of files with those
+     * it was last built from, rather than their write times. Rules that do not build a file fall
+     * back to 'should_run'
+     * @note The same postorder requirement as 'should_run' applies
+     */
+    virtual bool should_run_by_content(FSGateway& fs, HashDatabase& hashes) const;
+
+    /** The files written (or removed) by running the rule's commands */
+    virtual std::vector<std::string> get_outputs() const;
+
+    /**
+     * Whether running the rule creates it's outputs from it's dependencies, so the outputs are out
+     * of date once the commands change. False for rules that only remove files
+     */
+    virtual bool builds_outputs() const;
+
+    /**
+     * The outputs whose commands write a depfile listing the headers they read. Empty unless the
+     * rule compiles with header tracking enabled in the config
+     * @param cfg The config that should be considered when building the command
+     */
+    virtual std::vector<std::string> get_depfile_outputs(const Config& cfg) const;
+
+    /**
+     * Whether dependants only rely on the interface the rule's outputs export rather than their
+     * whole contents (e.g. programs linked against a shared library), so a rebuild that keeps
+     * the interface need not rebuild them
+     */
+    virtual bool exports_interface() const;
+
+    /** The depfile written alongside an output (e.g. 'app.o.d') */
+    static std::string get_depfile(const std::string& output);
+
    protected:
     std::string qualifier;
     std::string name;
     std::vector<std::string> deps;
     Location loc;
+    std::string pool;
 
     /**
      * Returns true if and only if an immediate dependency's file output is newer then the 'name'
@@ -61,16 +101,35 @@ class Rule {
      * @param fs The file system abstraction used for comparing dependencies
      */
     bool has_updated_dep(FSGateway& fs) const;
+
+    /**
+     * Returns true if and only if the 'name' file or an immediate dependency's contents differ
+     * from when the rule was last built. Rules never built while tracking contents are compared
+     * by write time instead, and become the baseline for later builds if up to date
+     * @param fs The file system abstraction used when falling back to write times
+     * @param hashes The contents each rule was last built from
+     */
+    bool has_changed_dep(FSGateway& fs, HashDatabase& hashes) const;
 };
 
 class SingleRule : public Rule {
    public:
-    SingleRule(std::string _name, std::vector<std::string> _deps, Step step, Location _loc);
+    SingleRule(std::string _name, std::vector<std::string> _deps, Step step, Location _loc,
+               std::string _pool = "");
 
     std::vector<Command> get_commands(const Config& cfg) const override;
 
     bool should_run(FSGateway& fs) const override;
 
+    bool should_run_by_content(FSGateway& fs, HashDatabase& hashes) const override;
+
+    std::vector<std::string> get_depfile_outputs(const Config& cfg) const override;
+
+    /** True for links producing a shared library (e.g. 'libcore.so' or 'libcore.so.1') */
+    bool exports_interface() const override;
+
+    Step get_step() const;
+
    protected:
     Step step;
 };
@@ -78,12 +137,18 @@ class SingleRule : public Rule {
 class MultiRule : public Rule {
    public:
     MultiRule(std::string _name, std::vector<std::string> deps, std::vector<std::string> out,
-              Step step, Location _loc);
+              Step step, Location _loc, std::string _pool = "");
 
     std::vector<Command> get_commands(const Config& cfg) const override;
 
     bool should_run(FSGateway& fs) const override;
 
+    bool should_run_by_content(FSGateway& fs, HashDatabase& hashes) const override;
+
+    std::vector<std::string> get_outputs() const override;
+
+    std::vector<std::string> get_depfile_outputs(const Config& cfg) const override;
+
     /** Get a SingleRule for each rule in the MultiRule */
     std::vector<SingleRule> partition() const;
 
@@ -100,6 +165,10 @@ class CleanRule : public Rule {
     std::vector<Command> get_commands(const Config& cfg) const override;
 
     bool should_run(FSGateway& fs) const override;
+
+    std::vector<std::string> get_outputs() const override;
+
+    bool builds_outputs() const override;
 };
 
 #endif
\ No newline at end of file
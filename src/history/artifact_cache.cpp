@@ -0,0 +1,447 @@
+#include "artifact_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#include "../errors/error.hpp"
+#include "../io/content_hash.hpp"
+#include "../io/file_utils.hpp"
+#include "fcntl.h"
+#include "linux/fs.h"
+#include "sys/ioctl.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+std::string to_hex(uint64_t val) {
+    std::ostringstream out;
+    out << std::hex << val;
+    return out.str();
+}
+
+/**
+ * Create a copy of a file sharing it's data where the file system allows (a reflink), so
+ * restoring a large output costs no more than creating an empty file. Other file systems get a
+ * plain copy. Permissions are kept, so restored programs are still executable
+ */
+void clone_file(const std::filesystem::path& from, const std::filesystem::path& to) {
+    const int src = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) {
+        throw SystemError("Failed to open '" + from.string() + "'");
+    }
+    struct stat info;
+    if (fstat(src, &info) != 0) {
+        close(src);
+        throw SystemError("Failed to stat '" + from.string() + "'");
+    }
+    const int dst =
+        open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 07777);
+    if (dst < 0) {
+        close(src);
+        throw SystemError("Failed to create '" + to.string() + "'");
+    }
+    const bool cloned = ioctl(dst, FICLONE, src) == 0;
+    close(src);
+    close(dst);
+    if (!cloned) {
+        std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing);
+    }
+}
+}  // namespace
+
+ArtifactCache::ArtifactCache(std::filesystem::path _dir, uint64_t _max_bytes,
+                             std::shared_ptr<RemoteStore> _remote)
+    : dir(std::move(_dir)), max_bytes(_max_bytes), remote(std::move(_remote)) {
+    if (remote != nullptr) {
+        transfers = std::make_unique<WorkStealingPool>(TRANSFER_WORKERS);
+    }
+}
+
+ArtifactCache::~ArtifactCache() { flush(); }
+
+uint64_t ArtifactCache::program_identity(const std::string& program) {
+    {
+        std::lock_guard lock(identity_mtx);
+        auto itm = identities.find(program);
+        if (itm != identities.end()) return itm->second;
+    }
+
+    std::vector<std::filesystem::path> candidates;
+    if (program.find('/') != std::string::npos) {
+        candidates.push_back(program);
+    } else if (const char* path_var = std::getenv("PATH"); path_var != nullptr) {
+        std::istringstream dirs(path_var);
+        std::string path_dir;
+        while (std::getline(dirs, path_dir, ':')) {
+            candidates.push_back(std::filesystem::path(path_dir.empty() ? "." : path_dir) /
+                                 program);
+        }
+    }
+
+    // Unknown programs are only identified by name, so they still get a stable key
+    std::string identity = program;
+    for (const std::filesystem::path& candidate : candidates) {
+        struct stat info;
+        if (stat(candidate.c_str(), &info) != 0 || !S_ISREG(info.st_mode) ||
+            access(candidate.c_str(), X_OK) != 0) {
+            continue;
+        }
+        identity = candidate.string() + " " + std::to_string(info.st_size) + " " +
+                   std::to_string(info.st_mtim.tv_sec) + "." + std::to_string(info.st_mtim.tv_nsec);
+        break;
+    }
+
+    const uint64_t hash = content_hash(identity);
+    std::lock_guard lock(identity_mtx);
+    identities[program] = hash;
+    return hash;
+}
+
+bool ArtifactCache::has_remote() const { return remote != nullptr; }
+
+void ArtifactCache::prefetch(uint64_t key) {
+    if (remote != nullptr && remote_errors == 0) {
+        start_pull(key, false);
+    }
+}
+
+std::optional<CacheEntry> ArtifactCache::fetch(
+    uint64_t key, const std::function<bool(const CacheEntry&)>& usable) try {
+    std::optional<CacheEntry> entry = restore(key, usable);
+    if (!entry.has_value() && remote != nullptr && remote_errors == 0) {
+        // Waits on a prefetch of the key if one is in flight, rather than downloading it twice
+        start_pull(key, true).wait();
+        entry = restore(key, usable);
+    }
+    if (entry.has_value() && remote != nullptr) {
+        // Prefetched builds are found locally, but were still only there thanks to the remote
+        std::lock_guard lock(pulls_mtx);
+        auto itm = downloaded.find(key);
+        if (itm != downloaded.end() &&
+            std::ranges::find(itm->second, *entry) != itm->second.end()) {
+            remote_hits++;
+        }
+    }
+
+    (entry.has_value() ? hits : misses)++;
+    return entry;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Restoring cached outputs");
+}
+
+void ArtifactCache::store(uint64_t key,
+                          const std::vector<std::pair<std::string, uint64_t>>& headers,
+                          const std::vector<std::string>& outputs) try {
+    const std::filesystem::path objects = dir / "objects";
+    std::filesystem::create_directories(objects);
+    std::filesystem::create_directories(dir / "entries");
+
+    CacheEntry entry{headers, {}};
+    for (const std::string& output : outputs) {
+        const std::string contents = FileUtils::read_all(output);
+        // Identical outputs (e.g. the same object built on two branches) are only stored once
+        const std::string object = object_name(contents);
+        if (!std::filesystem::exists(objects / object)) {
+            const std::filesystem::path tmp = FileUtils::temp_path(objects / object);
+            clone_file(output, tmp);
+            std::filesystem::rename(tmp, objects / object);
+        }
+        entry.outputs.push_back(CachedOutput{
+            output, object,
+            std::filesystem::status(output).permissions() & std::filesystem::perms::mask});
+    }
+
+    // Builds that read the same headers with the same contents are replaced by this one
+    const std::filesystem::path path = entry_path(key);
+    std::vector<CacheEntry> entries = read_entries(path);
+    std::erase_if(entries, [&](const CacheEntry& old) { return old.headers == headers; });
+    entries.insert(entries.begin(), std::move(entry));
+    entries.resize(std::min(entries.size(), MAX_BUILDS_PER_KEY));
+
+    write_entries(path, entries);
+    stores++;
+
+    if (remote != nullptr && remote_errors == 0) {
+        transfers->submit([this, key] { push(key); });
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Storing outputs in the artifact cache");
+}
+
+void ArtifactCache::flush() {
+    if (transfers != nullptr) {
+        transfers->wait_idle();
+    }
+}
+
+void ArtifactCache::trim() try {
+    flush();
+    const std::filesystem::path entries_dir = dir / "entries";
+    const std::filesystem::path objects_dir = dir / "objects";
+    if (!std::filesystem::exists(entries_dir) || !std::filesystem::exists(objects_dir)) return;
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> paths;
+    for (const auto& file : std::filesystem::directory_iterator(entries_dir)) {
+        paths.emplace_back(file.last_write_time(), file.path());
+    }
+    std::ranges::sort(paths, std::greater{});
+
+    // The most recently used builds are kept while their outputs fit, counting each object once
+    std::unordered_set<std::string> kept;
+    uint64_t kept_bytes = 0;
+    for (const auto& [used, path] : paths) {
+        std::unordered_set<std::string> added;
+        uint64_t added_bytes = 0;
+        for (const CacheEntry& entry : read_entries(path)) {
+            for (const CachedOutput& output : entry.outputs) {
+                if (kept.contains(output.object) || !added.insert(output.object).second) continue;
+                std::error_code err;
+                const uintmax_t size = std::filesystem::file_size(objects_dir / output.object, err);
+                added_bytes += err ? 0 : size;
+            }
+        }
+        if (kept_bytes + added_bytes > max_bytes) {
+            std::filesystem::remove(path);
+            continue;
+        }
+        kept_bytes += added_bytes;
+        kept.merge(added);
+    }
+
+    // Objects still being written by another process are left alone, unless they were abandoned
+    const auto abandoned = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    for (const auto& file : std::filesystem::directory_iterator(objects_dir)) {
+        const std::string name = file.path().filename().string();
+        if (kept.contains(name)) continue;
+        if (name.find(".tmp-") != std::string::npos && file.last_write_time() > abandoned) {
+            continue;
+        }
+        std::filesystem::remove(file.path());
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Trimming the artifact cache");
+}
+
+CacheStats ArtifactCache::stats() const {
+    return CacheStats{hits, misses, stores, remote_hits, uploads, remote_errors};
+}
+
+std::string ArtifactCache::format_entries(const std::vector<CacheEntry>& entries) {
+    // Paths go last on each line as they may contain spaces
+    std::ostringstream out;
+    for (const CacheEntry& build : entries) {
+        out << "C " << build.outputs.size() << " " << build.headers.size() << "\n";
+        for (const CachedOutput& output : build.outputs) {
+            out << "O " << output.object << " " << std::oct << static_cast<unsigned>(output.perms)
+                << std::dec << " " << output.filename << "\n";
+        }
+        for (const auto& [header, hash] : build.headers) {
+            out << "H " << to_hex(hash) << " " << header << "\n";
+        }
+    }
+    return out.str();
+}
+
+bool ArtifactCache::is_object_of(const std::string& object, const std::string& contents) {
+    return object == object_name(contents);
+}
+
+std::string ArtifactCache::object_name(const std::string& contents) {
+    return to_hex(content_hash(contents)) + "-" + std::to_string(contents.size());
+}
+
+std::string ArtifactCache::key_name(uint64_t key) { return to_hex(key); }
+
+std::filesystem::path ArtifactCache::entry_path(uint64_t key) const {
+    return dir / "entries" / key_name(key);
+}
+
+std::optional<std::vector<CacheEntry>> ArtifactCache::parse_entries(const std::string& text) {
+    std::vector<CacheEntry> entries;
+    std::istringstream in(text);
+    std::string line;
+    size_t outputs_left = 0;
+    size_t headers_left = 0;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        std::string field;
+        std::string name;
+        if (!(fields >> kind)) break;
+
+        if (kind == "C") {
+            if (outputs_left != 0 || headers_left != 0 ||
+                !(fields >> outputs_left >> headers_left)) {
+                return std::nullopt;
+            }
+            entries.emplace_back();
+            continue;
+        }
+        if (entries.empty() || !(fields >> field) || !std::getline(fields >> std::ws, name) ||
+            name.empty()) {
+            return std::nullopt;
+        }
+        if (kind == "O" && outputs_left > 0) {
+            // e.g. "O 1a2b3c-1024 755 build/app"
+            std::istringstream perms_name(name);
+            unsigned perms = 0;
+            std::string filename;
+            if (!(perms_name >> std::oct >> perms) ||
+                !std::getline(perms_name >> std::ws, filename) || filename.empty()) {
+                return std::nullopt;
+            }
+            entries.back().outputs.push_back(CachedOutput{
+                filename, field,
+                static_cast<std::filesystem::perms>(perms) & std::filesystem::perms::mask});
+            outputs_left--;
+        } else if (kind == "H" && headers_left > 0) {
+            size_t parsed_len = 0;
+            uint64_t hash = 0;
+            try {
+                hash = std::stoull(field, &parsed_len, 16);
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+            if (parsed_len != field.size()) return std::nullopt;
+            entries.back().headers.emplace_back(name, hash);
+            headers_left--;
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (outputs_left != 0 || headers_left != 0) return std::nullopt;
+    return entries;
+}
+
+std::vector<CacheEntry> ArtifactCache::read_entries(const std::filesystem::path& path) const {
+    std::ifstream in(path);
+    if (!in) return {};
+    const std::string text{std::istreambuf_iterator<char>(in), {}};
+    // Entries that don't parse are treated as a miss, and replaced by the next store
+    return parse_entries(text).value_or(std::vector<CacheEntry>{});
+}
+
+void ArtifactCache::write_entries(const std::filesystem::path& path,
+                                  const std::vector<CacheEntry>& entries) const {
+    FileUtils::write_atomically(path, format_entries(entries));
+}
+
+std::optional<CacheEntry> ArtifactCache::restore(
+    uint64_t key, const std::function<bool(const CacheEntry&)>& usable) {
+    const std::filesystem::path path = entry_path(key);
+    for (const CacheEntry& entry : read_entries(path)) {
+        if (!usable(entry)) continue;
+
+        for (const CachedOutput& output : entry.outputs) {
+            const std::filesystem::path output_path(output.filename);
+            if (output_path.has_parent_path()) {
+                std::filesystem::create_directories(output_path.parent_path());
+            }
+            // Renamed into place so a build interrupted mid-copy never leaves half an output
+            const std::filesystem::path tmp = FileUtils::temp_path(output_path);
+            clone_file(dir / "objects" / output.object, tmp);
+            std::filesystem::permissions(tmp, output.perms);
+            std::filesystem::rename(tmp, output_path);
+        }
+
+        // The write time of an entry is when it was last used, which trimming goes by
+        std::error_code err;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(),
+                                         err);
+        return entry;
+    }
+    return std::nullopt;
+}
+
+std::shared_future<void> ArtifactCache::start_pull(uint64_t key, bool now) {
+    auto done = std::make_shared<std::promise<void>>();
+    std::shared_future<void> pulled = done->get_future().share();
+    {
+        std::lock_guard lock(pulls_mtx);
+        auto [itm, inserted] = pulls.try_emplace(key, pulled);
+        if (!inserted) return itm->second;
+    }
+
+    auto task = [this, key, done] {
+        pull(key);
+        done->set_value();
+    };
+    if (now) {
+        task();
+    } else {
+        transfers->submit(std::move(task));
+    }
+    return pulled;
+}
+
+void ArtifactCache::pull(uint64_t key) {
+    try {
+        const std::optional<std::string> text = remote->get("ac/" + key_name(key));
+        if (!text.has_value()) return;
+        std::optional<std::vector<CacheEntry>> remote_entries = parse_entries(*text);
+        if (!remote_entries.has_value()) return;
+
+        // Builds are only usable once every object they need is stored locally
+        const std::filesystem::path objects = dir / "objects";
+        std::filesystem::create_directories(objects);
+        std::filesystem::create_directories(dir / "entries");
+        std::erase_if(*remote_entries, [&](const CacheEntry& entry) {
+            for (const CachedOutput& output : entry.outputs) {
+                const std::filesystem::path object = objects / output.object;
+                if (std::filesystem::exists(object)) continue;
+                const std::optional<std::string> contents = remote->get("cas/" + output.object);
+                if (!contents.has_value() || !is_object_of(output.object, *contents)) return true;
+
+                FileUtils::write_atomically(object, *contents);
+            }
+            return false;
+        });
+
+        // Local builds come first, as they were built or used on this machine most recently
+        const std::filesystem::path path = entry_path(key);
+        std::vector<CacheEntry> entries = read_entries(path);
+        std::vector<CacheEntry> added;
+        for (CacheEntry& entry : *remote_entries) {
+            if (std::ranges::none_of(entries, [&](const CacheEntry& local) {
+                    return local.headers == entry.headers;
+                })) {
+                added.push_back(entry);
+                entries.push_back(std::move(entry));
+            }
+        }
+        entries.resize(std::min(entries.size(), MAX_BUILDS_PER_KEY));
+        write_entries(path, entries);
+
+        std::lock_guard lock(pulls_mtx);
+        downloaded[key] = std::move(added);
+    } catch (const std::exception&) {
+        // An unreachable store would slow every rule down, so it isn't used again
+        remote_errors++;
+    }
+}
+
+void ArtifactCache::push(uint64_t key) {
+    try {
+        const std::vector<CacheEntry> entries = read_entries(entry_path(key));
+        if (entries.empty()) return;
+
+        // Objects go first, so the remote store never lists a build it can't restore
+        std::unordered_set<std::string> sent;
+        for (const CacheEntry& entry : entries) {
+            for (const CachedOutput& output : entry.outputs) {
+                const std::string& object = output.object;
+                if (!sent.insert(object).second || remote->contains("cas/" + object)) continue;
+                remote->put("cas/" + object, FileUtils::read_all(dir / "objects" / object));
+            }
+        }
+        remote->put("ac/" + key_name(key), format_entries(entries));
+        uploads++;
+    } catch (const std::exception&) {
+        remote_errors++;
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef ARTIFACT_CACHE_H
+#define ARTIFACT_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../concurrency/work_stealing_pool.hpp"
+#include "../remote/remote_store.hpp"
+
+/** An output of a cached build */
+struct CachedOutput {
+    std::string filename;
+    /** The name of the object holding it's contents */
+    std::string object;
+    /** The permissions it was written with, so restored programs are still executable */
+    std::filesystem::perms perms;
+
+    bool operator==(const CachedOutput&) const = default;
+};
+
+/** One cached build of a rule */
+struct CacheEntry {
+    /** Each header the build read, with the hash of it's contents at the time */
+    std::vector<std::pair<std::string, uint64_t>> headers;
+    std::vector<CachedOutput> outputs;
+
+    bool operator==(const CacheEntry&) const = default;
+};
+
+/** How the cache has been used since it was opened */
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stores = 0;
+    /** Hits on builds that were only found in the remote store */
+    size_t remote_hits = 0;
+    /** Keys whose builds were sent to the remote store */
+    size_t uploads = 0;
+    /** Transfers that failed, after the first of which the remote store is no longer used */
+    size_t remote_errors = 0;
+};
+
+/**
+ * A local cache of build outputs, so switching back to sources built before restores their
+ * outputs instead of running the compiler again. Outputs are stored once per distinct contents
+ * under 'objects', and each key (a hash of a rule's commands and inputs) lists the outputs it
+ * produced under 'entries'. A key may hold several builds that read different headers. Safe to
+ * share between threads, and between processes as every file is written then renamed into place.
+ *
+ * With a remote store, builds missing locally are looked for remotely and downloaded into the local
+ * cache, and every build stored locally is uploaded. Transfers run on background threads, so an
+ * upload never holds up the build
+ */
+class ArtifactCache {
+   public:
+    /**
+     * @param dir The directory holding the cache, created when first stored to
+     * @param max_bytes The size the stored outputs are trimmed back to, least recently used first
+     * @param remote Where builds are shared with other machines. Nothing is shared if not set
+     */
+    explicit ArtifactCache(std::filesystem::path dir, uint64_t max_bytes = DEFAULT_MAX_BYTES,
+                           std::shared_ptr<RemoteStore> remote = nullptr);
+
+    /** Waits for every transfer still running */
+    ~ArtifactCache();
+
+    ArtifactCache(const ArtifactCache&) = delete;
+    ArtifactCache& operator=(const ArtifactCache&) = delete;
+
+    /**
+     * Identify the build of a program, so outputs are not shared between compiler versions. The
+     * program is looked up on PATH if it is not a path, and identified by where it was found along
+     * with it's size and write time. Each program is only looked up once
+     */
+    uint64_t program_identity(const std::string& program);
+
+    /** Whether builds are shared through a remote store, which is worth prefetching from */
+    bool has_remote() const;
+
+    /**
+     * Start downloading the builds stored remotely under a key in the background, so a later
+     * 'fetch' of the key finds them locally or waits on the download already in flight
+     */
+    void prefetch(uint64_t key);
+
+    /**
+     * Restore the outputs of the most recent build stored under a key that is still usable,
+     * looking in the remote store if none are stored locally. Each output is cloned from the
+     * cache where the file system supports it, and copied otherwise
+     * @param usable Decides whether a build applies, e.g. by checking the headers it read
+     * @returns The build restored, or nothing if there was none. Counted as a hit or a miss
+     * @throws If an output can not be restored
+     */
+    std::optional<CacheEntry> fetch(uint64_t key,
+                                    const std::function<bool(const CacheEntry&)>& usable);
+
+    /**
+     * Store the outputs of a build under a key, ahead of any other build stored under it. The key
+     * is uploaded to the remote store in the background
+     * @param headers The headers the build read, with the hash of each
+     * @param outputs The files the build wrote
+     * @throws If an output can not be read or the cache can not be written
+     */
+    void store(uint64_t key, const std::vector<std::pair<std::string, uint64_t>>& headers,
+               const std::vector<std::string>& outputs);
+
+    /** Wait for every upload and prefetch to finish */
+    void flush();
+
+    /**
+     * Remove the least recently used builds until the stored outputs fit in 'max_bytes', then
+     * every output no build refers to. Waits for transfers first, as they may still need them
+     * @throws If the cache can not be read
+     */
+    void trim();
+
+    CacheStats stats() const;
+
+    /**
+     * Parse the builds stored under a key, in the format written to disk and sent to remote
+     * stores. Each build is "C <output count> <header count>", followed by an
+     * "O <object> <octal permissions> <output>" line per output and an "H <hash> <header>" line
+     * per header
+     * @returns The builds, or nothing if the text is malformed
+     */
+    static std::optional<std::vector<CacheEntry>> parse_entries(const std::string& text);
+
+    static std::string format_entries(const std::vector<CacheEntry>& entries);
+
+    /** Check whether an object's name matches it's contents, as it must for every object stored */
+    static bool is_object_of(const std::string& object, const std::string& contents);
+
+    /** The name of the object holding some contents */
+    static std::string object_name(const std::string& contents);
+
+    /** The name a key's builds are stored under */
+    static std::string key_name(uint64_t key);
+
+    constexpr static uint64_t DEFAULT_MAX_BYTES = uint64_t{2} << 30;
+    /** The most builds kept under one key, as a source may be built against many headers */
+    constexpr static size_t MAX_BUILDS_PER_KEY = 4;
+    /** The number of transfers to and from the remote store that run at once */
+    constexpr static size_t TRANSFER_WORKERS = 8;
+
+   private:
+    std::filesystem::path dir;
+    uint64_t max_bytes;
+
+    std::mutex identity_mtx;
+    std::unordered_map<std::string, uint64_t> identities;
+
+    std::atomic<size_t> hits = 0;
+    std::atomic<size_t> misses = 0;
+    std::atomic<size_t> stores = 0;
+    std::atomic<size_t> remote_hits = 0;
+    std::atomic<size_t> uploads = 0;
+    std::atomic<size_t> remote_errors = 0;
+
+    std::shared_ptr<RemoteStore> remote;
+    /** Runs every remote transfer, so builds never wait on uploads */
+    std::unique_ptr<WorkStealingPool> transfers;
+    std::mutex pulls_mtx;
+    /** The download of each key started by this process, finished or still in flight */
+    std::unordered_map<uint64_t, std::shared_future<void>> pulls;
+    /** The builds under each key that were downloaded, so their hits are counted as remote */
+    std::unordered_map<uint64_t, std::vector<CacheEntry>> downloaded;
+
+    std::filesystem::path entry_path(uint64_t key) const;
+
+    /** Read the builds stored under a key, most recent first. Empty if none are */
+    std::vector<CacheEntry> read_entries(const std::filesystem::path& path) const;
+
+    /** Write the builds stored under a key, replacing those stored before */
+    void write_entries(const std::filesystem::path& path,
+                       const std::vector<CacheEntry>& entries) const;
+
+    /** Restore the most recent usable build stored locally under a key */
+    std::optional<CacheEntry> restore(uint64_t key,
+                                      const std::function<bool(const CacheEntry&)>& usable);
+
+    /**
+     * Start downloading a key's builds, unless this process already has
+     * @param now Download on the calling thread rather than in the background
+     * @returns The download, which is ready once the builds are stored locally
+     */
+    std::shared_future<void> start_pull(uint64_t key, bool now);
+
+    /** Download a key's builds, and every object they need, into the local cache */
+    void pull(uint64_t key);
+
+    /** Upload a key's builds, and every object they need that the remote store is missing */
+    void push(uint64_t key);
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "build_log.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+#include "../errors/error.hpp"
+#include "../io/content_hash.hpp"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+constexpr char MAGIC[8] = {'M', 'Y', 'M', 'K', 'L', 'O', 'G', '1'};
+/** Seeds the check of each record's name, so it differs from the name's slot hash */
+constexpr uint64_t CHECK_SEED = 0x6c6f67;
+constexpr uint64_t MIN_SLOTS = 16;
+
+/** Found at the start of the file, followed by the hash table and then the records */
+struct FileHeader {
+    char magic[8];
+    /** The number of slots in the hash table. Always a power of 2, or 0 if there is no table */
+    uint64_t slot_count;
+    /** Where records appended since the table was written start */
+    uint64_t tail_offset;
+};
+
+/** A hash table slot pointing at the record of a rule. Empty if the offset is 0 */
+struct Slot {
+    uint64_t name_hash;
+    uint64_t record_offset;
+};
+
+/** Precedes the name of each record, which is padded to keep the next header aligned */
+struct RecordHeader {
+    uint64_t command_hash;
+    int64_t start_ns;
+    int64_t end_ns;
+    uint32_t name_len;
+    /** Detects records cut short or left half written by an interrupted build */
+    uint32_t check;
+};
+
+uint32_t name_check(std::string_view name) {
+    return static_cast<uint32_t>(content_hash(name, CHECK_SEED));
+}
+
+size_t record_size(size_t name_len) { return sizeof(RecordHeader) + ((name_len + 7) & ~size_t{7}); }
+
+void encode_record(std::string& buf, std::string_view name, const BuildLogEntry& entry) {
+    const RecordHeader header{entry.command_hash, entry.start_ns, entry.end_ns,
+                              static_cast<uint32_t>(name.size()), name_check(name)};
+    const size_t start = buf.size();
+    buf.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buf.append(name);
+    buf.resize(start + record_size(name.size()), '\0');
+}
+
+/** Decode the record at an offset, or nothing if it is cut short or corrupt */
+std::optional<std::pair<std::string_view, BuildLogEntry>> decode_record(const char* data,
+                                                                        size_t len,
+                                                                        uint64_t offset) {
+    RecordHeader header;
+    if (offset + sizeof(header) > len) return std::nullopt;
+    std::memcpy(&header, data + offset, sizeof(header));
+    if (offset + record_size(header.name_len) > len) return std::nullopt;
+
+    const std::string_view name(data + offset + sizeof(header), header.name_len);
+    if (name_check(name) != header.check) return std::nullopt;
+    return std::pair{name, BuildLogEntry{header.command_hash, header.start_ns, header.end_ns}};
+}
+
+void write_all(int fd, const std::string& buf, uint64_t offset) {
+    size_t written = 0;
+    while (written < buf.size()) {
+        const ssize_t n = pwrite(fd, buf.data() + written, buf.size() - written,
+                                 static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to write build log");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+}  // namespace
+
+BuildLog::BuildLog(std::filesystem::path path) try : file(path) {
+    load();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Loading build log '" + path.string() + "'");
+}
+
+BuildLog::~BuildLog() { unload(); }
+
+std::optional<BuildLogEntry> BuildLog::get(const std::string& rule_name) const {
+    std::lock_guard lock(mtx);
+    auto itm = tail.find(rule_name);
+    if (itm != tail.end()) return itm->second;
+    return find_in_table(rule_name);
+}
+
+void BuildLog::record(const std::string& rule_name, const BuildLogEntry& entry) try {
+    std::lock_guard lock(mtx);
+    if (file.has_value()) {
+        if (append_fd < 0) {
+            if (file->has_parent_path()) {
+                std::filesystem::create_directories(file->parent_path());
+            }
+            append_fd = open(file->c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (append_fd < 0) {
+                throw SystemError("Failed to open build log '" + file->string() + "'");
+            }
+        }
+
+        std::string buf;
+        if (end_offset == 0) {
+            FileHeader header{{}, 0, sizeof(FileHeader)};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            buf.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        encode_record(buf, rule_name, entry);
+        write_all(append_fd, buf, end_offset);
+        end_offset += buf.size();
+    }
+
+    tail[rule_name] = entry;
+    tail_records++;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Recording '" + rule_name + "' in build log");
+}
+
+void BuildLog::compact_if_needed() try {
+    std::lock_guard lock(mtx);
+    if (!file.has_value() || tail_records <= COMPACTION_THRESHOLD) return;
+
+    // Only the latest record of each rule survives, with appended records replacing the table's
+    std::unordered_map<std::string, BuildLogEntry> live = tail;
+    for (uint64_t i = 0; i < slot_count; i++) {
+        Slot slot;
+        std::memcpy(&slot, mapping + sizeof(FileHeader) + i * sizeof(Slot), sizeof(slot));
+        if (slot.record_offset == 0) continue;
+        const auto record = decode_record(mapping, mapping_len, slot.record_offset);
+        if (record.has_value()) {
+            live.try_emplace(std::string(record->first), record->second);
+        }
+    }
+
+    // At most half full, so probes stay short
+    const uint64_t slots = std::bit_ceil(std::max<uint64_t>(MIN_SLOTS, live.size() * 2));
+    std::vector<Slot> table(slots, Slot{0, 0});
+    std::string records;
+    const uint64_t records_start = sizeof(FileHeader) + slots * sizeof(Slot);
+    for (const auto& [name, entry] : live) {
+        const uint64_t name_hash = content_hash(name);
+        uint64_t idx = name_hash & (slots - 1);
+        while (table[idx].record_offset != 0) {
+            idx = (idx + 1) & (slots - 1);
+        }
+        table[idx] = Slot{name_hash, records_start + records.size()};
+        encode_record(records, name, entry);
+    }
+
+    FileHeader header{{}, slots, records_start + records.size()};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+
+    // Write then rename so an interrupted compaction never leaves a truncated log behind
+    const std::filesystem::path tmp = file->string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc | std::ios::binary);
+        if (!out.is_open()) {
+            throw IOError("Failed to open '" + tmp.string() + "' for writing");
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.data()),
+                  static_cast<std::streamsize>(table.size() * sizeof(Slot)));
+        out.write(records.data(), static_cast<std::streamsize>(records.size()));
+        if (!out) {
+            throw IOError("Failed to write '" + tmp.string() + "'");
+        }
+    }
+    std::filesystem::rename(tmp, *file);
+
+    unload();
+    load();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Compacting build log");
+}
+
+uint64_t BuildLog::hash_commands(const std::vector<std::vector<std::string>>& cmds) {
+    // Separators keep e.g. {"ab", "c"} and {"a", "bc"} apart
+    std::string joined;
+    for (const auto& cmd : cmds) {
+        for (const std::string& token : cmd) {
+            joined += token;
+            joined += '\0';
+        }
+        joined += '\n';
+    }
+    return content_hash(joined);
+}
+
+void BuildLog::load() {
+    const int fd = open(file->c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return;
+        throw SystemError("Failed to open build log");
+    }
+    append_fd = fd;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        throw SystemError("Failed to stat build log");
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    if (size >= sizeof(FileHeader)) {
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            throw SystemError("Failed to map build log");
+        }
+        mapping = static_cast<const char*>(data);
+        mapping_len = size;
+    }
+
+    FileHeader header;
+    if (mapping != nullptr) {
+        std::memcpy(&header, mapping, sizeof(header));
+    }
+    const bool valid = mapping != nullptr &&
+                       std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                       (header.slot_count == 0 || std::has_single_bit(header.slot_count)) &&
+                       header.slot_count <= size / sizeof(Slot) &&
+                       sizeof(FileHeader) + header.slot_count * sizeof(Slot) <=
+                           header.tail_offset &&
+                       header.tail_offset <= size;
+    if (valid) {
+        slot_count = header.slot_count;
+        end_offset = header.tail_offset;
+        while (const auto record = decode_record(mapping, mapping_len, end_offset)) {
+            tail[std::string(record->first)] = record->second;
+            tail_records++;
+            end_offset += record_size(record->first.size());
+        }
+    }
+
+    // Anything after the last whole record is overwritten by the next one, so it is dropped now
+    // rather than left to confuse the next load
+    if (end_offset < size && ftruncate(fd, static_cast<off_t>(end_offset)) != 0) {
+        throw SystemError("Failed to truncate build log");
+    }
+}
+
+void BuildLog::unload() {
+    if (mapping != nullptr) {
+        munmap(const_cast<char*>(mapping), mapping_len);
+    }
+    if (append_fd >= 0) {
+        close(append_fd);
+    }
+    mapping = nullptr;
+    mapping_len = 0;
+    slot_count = 0;
+    tail.clear();
+    tail_records = 0;
+    end_offset = 0;
+    append_fd = -1;
+}
+
+std::optional<BuildLogEntry> BuildLog::find_in_table(std::string_view rule_name) const {
+    if (slot_count == 0) return std::nullopt;
+
+    const uint64_t name_hash = content_hash(rule_name);
+    for (uint64_t probe = 0, idx = name_hash & (slot_count - 1); probe < slot_count;
+         probe++, idx = (idx + 1) & (slot_count - 1)) {
+        Slot slot;
+        std::memcpy(&slot, mapping + sizeof(FileHeader) + idx * sizeof(Slot), sizeof(slot));
+        if (slot.record_offset == 0) return std::nullopt;
+        if (slot.name_hash != name_hash) continue;
+
+        const auto record = decode_record(mapping, mapping_len, slot.record_offset);
+        if (record.has_value() && record->first == rule_name) {
+            return record->second;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,102 @@
+#ifndef BUILD_LOG_H
+#define BUILD_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/** What the build log knows about the last successful run of a rule */
+struct BuildLogEntry {
+    /** Hash of every command the rule ran, see BuildLog::hash_commands */
+    uint64_t command_hash;
+    /**
+     * Wall clock time the rule started and finished, in nanoseconds since the Unix epoch. Both
+     * are 0 for rules recorded without being run (e.g. up to date when the log was created)
+     */
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+/**
+ * A persisted, append-only log of the commands each rule was last built with, keyed by rule name
+ * (the output file). Lets a rule be rebuilt when it's command changes (e.g. new compilation flags)
+ * even though no file did.
+ *
+ * The file is memory mapped when loaded. Records are appended to it as rules finish, and once
+ * enough have been appended it is compacted into an on-disk hash table followed by an empty
+ * tail. Loading then only needs to map the file and scan the tail, regardless of how many rules
+ * the table holds. Safe to share between threads, but not between processes
+ */
+class BuildLog {
+   public:
+    /** Create an in memory log that is never persisted */
+    BuildLog() = default;
+
+    /**
+     * Create a log backed by a file, loading any existing records. A file that is not a build
+     * log, or was cut short mid-record, is discarded from that point as the log only caches
+     * what a rebuild would recreate
+     * @param path The file the log is loaded from and appended to
+     * @throws If the file exists but can not be read
+     */
+    explicit BuildLog(std::filesystem::path path);
+
+    ~BuildLog();
+
+    BuildLog(const BuildLog&) = delete;
+    BuildLog& operator=(const BuildLog&) = delete;
+
+    /** Get the latest record of a rule, if it has ever been recorded */
+    std::optional<BuildLogEntry> get(const std::string& rule_name) const;
+
+    /**
+     * Record a run of a rule, replacing any earlier record
+     * @throws If the record can not be appended to the file
+     */
+    void record(const std::string& rule_name, const BuildLogEntry& entry);
+
+    /**
+     * Rewrite the file as a hash table of the latest record of each rule if more than
+     * COMPACTION_THRESHOLD records have been appended since it was last rewritten
+     * @throws If the file cannot be rewritten
+     */
+    void compact_if_needed();
+
+    /** Hash a rule's commands, so a change to any token (or their order) changes the hash */
+    static uint64_t hash_commands(const std::vector<std::vector<std::string>>& cmds);
+
+    /** The number of appended records that trigger compaction */
+    constexpr static size_t COMPACTION_THRESHOLD = 4096;
+
+   private:
+    std::optional<std::filesystem::path> file;
+
+    mutable std::mutex mtx;
+    /** The file as it was when loaded. Only the hash table at it's start is read through it */
+    const char* mapping = nullptr;
+    size_t mapping_len = 0;
+    uint64_t slot_count = 0;
+    /** Records appended after the hash table, including those appended by this process */
+    std::unordered_map<std::string, BuildLogEntry> tail;
+    size_t tail_records = 0;
+    /** Where the next record is written */
+    uint64_t end_offset = 0;
+    int append_fd = -1;
+
+    /** Map the file and scan it's tail. Expects the log to be empty */
+    void load();
+
+    /** Release the mapping and file descriptor, forgetting every record */
+    void unload();
+
+    /** Look a rule up in the mapped hash table */
+    std::optional<BuildLogEntry> find_in_table(std::string_view rule_name) const;
+};
+
+#endif
@@ -0,0 +1,301 @@
+#include "compiled_buildfile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string_view>
+
+#include "../errors/error.hpp"
+#include "../io/content_hash.hpp"
+#include "../io/file_utils.hpp"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+constexpr char MAGIC[8] = {'M', 'Y', 'M', 'K', 'E', 'V', 'L', '2'};
+/** Seeds the check of the body, so it differs from the hash of the build file */
+constexpr uint64_t CHECK_SEED = 0x6576616c;
+
+/** Found at the start of the file, followed by the body */
+struct FileHeader {
+    char magic[8];
+    /** The hash of the build file's contents that were evaluated */
+    uint64_t src_hash;
+    uint64_t body_size;
+    /** Detects a body that is cut short or corrupt */
+    uint64_t body_check;
+};
+
+enum class RuleKind : uint64_t { SINGLE, CLEAN };
+
+/**
+ * Writes the body as 8 byte numbers and length prefixed strings, each padded to keep the next
+ * field aligned
+ */
+class BodyWriter {
+   public:
+    void num(uint64_t val) { data.append(reinterpret_cast<const char*>(&val), sizeof(val)); }
+
+    void str(std::string_view val) {
+        num(val.size());
+        data.append(val);
+        data.resize((data.size() + 7) & ~size_t{7}, '\0');
+    }
+
+    void strs(const std::vector<std::string>& vals) {
+        num(vals.size());
+        for (const std::string& val : vals) {
+            str(val);
+        }
+    }
+
+    void loc(const Location& loc) {
+        num(loc.line_no);
+        num(loc.col_no);
+        num(loc.file_idx);
+    }
+
+    std::string data;
+};
+
+/** Reads a body written by a BodyWriter, bounds checking every read as the file may be corrupt */
+class BodyReader {
+   public:
+    explicit BodyReader(std::string_view _data) : data(_data) {}
+
+    uint64_t num() {
+        if (data.size() - pos < sizeof(uint64_t)) {
+            throw IOError("Truncated compiled build file");
+        }
+        uint64_t val;
+        std::memcpy(&val, data.data() + pos, sizeof(val));
+        pos += sizeof(val);
+        return val;
+    }
+
+    std::string str() {
+        const uint64_t len = num();
+        if (len > data.size() - pos) {
+            throw IOError("Truncated compiled build file");
+        }
+        std::string val(data.substr(pos, len));
+        pos = std::min(data.size(), pos + ((len + 7) & ~uint64_t{7}));
+        return val;
+    }
+
+    std::vector<std::string> strs() {
+        std::vector<std::string> vals(count());
+        for (std::string& val : vals) {
+            val = str();
+        }
+        return vals;
+    }
+
+    /** The size of a list, which can't be more than the fields left as every item takes one */
+    size_t count() {
+        const uint64_t val = num();
+        if (val > (data.size() - pos) / sizeof(uint64_t)) {
+            throw IOError("Invalid list size in compiled build file");
+        }
+        return static_cast<size_t>(val);
+    }
+
+    Location loc() {
+        Location loc;
+        loc.line_no = num();
+        loc.col_no = num();
+        loc.file_idx = num();
+        return loc;
+    }
+
+    bool at_end() const { return pos == data.size(); }
+
+   private:
+    std::string_view data;
+    size_t pos = 0;
+};
+
+void write_config(BodyWriter& out, const Config& cfg) {
+    out.str(cfg.name);
+    out.str(cfg.compiler);
+    out.strs(cfg.compilation_flags);
+    out.strs(cfg.link_flags);
+    out.str(cfg.default_rule);
+    out.num(cfg.pools.size());
+    for (const auto& [pool, limit] : cfg.pools) {
+        out.str(pool);
+        out.num(limit);
+    }
+    out.num(static_cast<uint64_t>(cfg.header_deps));
+}
+
+Config read_config(BodyReader& in) {
+    Config cfg;
+    cfg.name = in.str();
+    cfg.compiler = in.str();
+    cfg.compilation_flags = in.strs();
+    cfg.link_flags = in.strs();
+    cfg.default_rule = in.str();
+    for (size_t i = in.count(); i > 0; i--) {
+        std::string pool = in.str();
+        cfg.pools[std::move(pool)] = in.num();
+    }
+    const uint64_t header_deps = in.num();
+    if (header_deps > static_cast<uint64_t>(HeaderDeps::GCC)) {
+        throw IOError("Invalid header tracking in compiled build file");
+    }
+    cfg.header_deps = static_cast<HeaderDeps>(header_deps);
+    return cfg;
+}
+
+/** Evaluation only ever produces single and clean rules, as multi rules are split up */
+void write_rule(BodyWriter& out, const Rule& rule) {
+    if (const auto* single = dynamic_cast<const SingleRule*>(&rule)) {
+        out.num(static_cast<uint64_t>(RuleKind::SINGLE));
+        out.str(single->get_name());
+        out.strs(single->get_deps());
+        out.loc(single->get_loc());
+        out.num(static_cast<uint64_t>(single->get_step()));
+        out.str(single->get_pool());
+    } else if (dynamic_cast<const CleanRule*>(&rule) != nullptr) {
+        out.num(static_cast<uint64_t>(RuleKind::CLEAN));
+        out.str(rule.get_name());
+        out.strs(rule.get_deps());
+        out.loc(rule.get_loc());
+    } else {
+        throw LogicError("Rule '" + rule.get_name() + "' can not be saved");
+    }
+}
+
+std::unique_ptr<Rule> read_rule(BodyReader& in) {
+    const uint64_t kind = in.num();
+    std::string name = in.str();
+    std::vector<std::string> deps = in.strs();
+    const Location loc = in.loc();
+    if (kind == static_cast<uint64_t>(RuleKind::CLEAN)) {
+        return std::make_unique<CleanRule>(std::move(name), std::move(deps), loc);
+    }
+    if (kind != static_cast<uint64_t>(RuleKind::SINGLE)) {
+        throw IOError("Invalid rule kind in compiled build file");
+    }
+    const uint64_t step = in.num();
+    if (step > static_cast<uint64_t>(Step::LINK)) {
+        throw IOError("Invalid step in compiled build file");
+    }
+    return std::make_unique<SingleRule>(std::move(name), std::move(deps),
+                                        static_cast<Step>(step), loc, in.str());
+}
+
+/**
+ * Decode a saved evaluation, checking it still holds
+ * @returns Nothing if it is stale or malformed
+ */
+std::optional<QualifiedDicts> decode(std::string_view data, uint64_t src_hash,
+                                     std::vector<ListedDir>& listed) {
+    FileHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    const std::string_view body = data.substr(sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.src_hash != src_hash ||
+        header.body_size != body.size() || header.body_check != content_hash(body, CHECK_SEED)) {
+        return std::nullopt;
+    }
+
+    try {
+        BodyReader in(body);
+        // Directories come first, so a stale evaluation is found before any rule is decoded
+        listed.resize(in.count());
+        for (ListedDir& dir : listed) {
+            dir.path = in.str();
+            dir.mtime_ns = static_cast<int64_t>(in.num());
+            dir.inode = in.num();
+            dir.extensions = in.strs();
+        }
+        if (!ListedDir::unchanged(listed)) return std::nullopt;
+
+        QualifiedDicts dicts;
+        dicts.cfg = read_config(in);
+        dicts.rules.resize(in.count());
+        for (std::unique_ptr<Rule>& rule : dicts.rules) {
+            rule = read_rule(in);
+        }
+        if (!in.at_end()) return std::nullopt;
+        return dicts;
+    } catch (const std::exception&) {
+        // Including a listed directory that no longer exists
+        return std::nullopt;
+    }
+}
+}  // namespace
+
+std::filesystem::path CompiledBuildfile::path_for(const std::filesystem::path& dir,
+                                                  const std::string& src_file) {
+    std::ostringstream name;
+    name << std::hex << content_hash(src_file);
+    return dir / name.str();
+}
+
+std::optional<QualifiedDicts> CompiledBuildfile::load(const std::filesystem::path& path,
+                                                      uint64_t src_hash,
+                                                      std::vector<ListedDir>& listed) try {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return std::nullopt;
+        throw SystemError("Failed to open compiled build file");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw SystemError("Failed to stat compiled build file");
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    if (size < sizeof(FileHeader)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw SystemError("Failed to map compiled build file");
+    }
+    std::optional<QualifiedDicts> dicts =
+        decode(std::string_view(static_cast<const char*>(data), size), src_hash, listed);
+    munmap(data, size);
+    return dicts;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Loading compiled build file '" + path.string() + "'");
+}
+
+void CompiledBuildfile::save(const std::filesystem::path& path, uint64_t src_hash,
+                             const std::vector<ListedDir>& listed,
+                             const QualifiedDicts& dicts) try {
+    BodyWriter body;
+    body.num(listed.size());
+    for (const ListedDir& dir : listed) {
+        body.str(dir.path);
+        body.num(static_cast<uint64_t>(dir.mtime_ns));
+        body.num(dir.inode);
+        body.strs(dir.extensions);
+    }
+    write_config(body, dicts.cfg);
+    body.num(dicts.rules.size());
+    for (const std::unique_ptr<Rule>& rule : dicts.rules) {
+        write_rule(body, *rule);
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.src_hash = src_hash;
+    header.body_size = body.data.size();
+    header.body_check = content_hash(body.data, CHECK_SEED);
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data += body.data;
+    std::filesystem::create_directories(path.parent_path());
+    FileUtils::write_atomically(path.string(), data);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Saving compiled build file '" + path.string() + "'");
+}
@@ -0,0 +1,51 @@
+#ifndef COMPILED_BUILDFILE_H
+#define COMPILED_BUILDFILE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../built_in/funcs.hpp"
+#include "../dictionaries/qualified_dicts.hpp"
+
+/**
+ * The rules and config a build file evaluated to, saved so later builds skip lexing, parsing and
+ * evaluating it while it is unchanged. A saved evaluation holds while the build file has the same
+ * contents and every directory a 'files' call listed is unchanged. Each build file is saved to
+ * it's own file as a single binary block, which is mapped and decoded straight into rules
+ */
+namespace CompiledBuildfile {
+/**
+ * Where the evaluation of a build file is saved
+ * @param dir The directory holding every saved evaluation
+ * @param src_file The build file, as it is named to the build
+ */
+std::filesystem::path path_for(const std::filesystem::path& dir, const std::string& src_file);
+
+/**
+ * Load a saved evaluation
+ * @param path Where it was saved
+ * @param src_hash The hash of the build file's contents now
+ * @param listed Set to every directory listed by 'files' during the evaluation, if it is loaded
+ * @returns Nothing if none was saved, it was saved for other contents, a listed directory has
+ * changed, or it was written by another version
+ * @throws If the file exists but can not be read
+ */
+std::optional<QualifiedDicts> load(const std::filesystem::path& path, uint64_t src_hash,
+                                   std::vector<ListedDir>& listed);
+
+/**
+ * Save an evaluation, replacing any saved before
+ * @param path Where to save it
+ * @param src_hash The hash of the build file's contents that were evaluated
+ * @param listed Every directory listed by 'files' during the evaluation
+ * @param dicts What the build file evaluated to
+ * @throws If the file can not be written
+ */
+void save(const std::filesystem::path& path, uint64_t src_hash,
+          const std::vector<ListedDir>& listed, const QualifiedDicts& dicts);
+}  // namespace CompiledBuildfile
+
+#endif
@@ -0,0 +1,267 @@
+#include "deps_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "../errors/error.hpp"
+#include "fcntl.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+constexpr char MAGIC[8] = {'M', 'Y', 'M', 'K', 'D', 'E', 'P', '1'};
+/**
+ * Each record starts with a 4 byte head holding the length of it's payload. The top bit is set
+ * for deps records, which hold the output's id followed by the id of each input. Path records
+ * hold the path padded with '\0' to a multiple of 4 bytes, followed by the bitwise not of it's id
+ */
+constexpr uint32_t DEPS_FLAG = 1u << 31;
+/** Longer payloads can only come from a corrupt file */
+constexpr uint32_t MAX_PAYLOAD = 1u << 24;
+
+void put32(std::string& buf, uint32_t val) {
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+uint32_t get32(const char* ptr) {
+    uint32_t val;
+    std::memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+void encode_path(std::string& buf, const std::string& path, uint32_t id) {
+    const size_t padded_len = (path.size() + 3) & ~size_t{3};
+    put32(buf, static_cast<uint32_t>(padded_len + sizeof(uint32_t)));
+    buf += path;
+    buf.append(padded_len - path.size(), '\0');
+    put32(buf, ~id);
+}
+
+void encode_deps(std::string& buf, uint32_t output, const std::vector<uint32_t>& inputs) {
+    put32(buf, DEPS_FLAG | static_cast<uint32_t>((inputs.size() + 1) * sizeof(uint32_t)));
+    put32(buf, output);
+    for (uint32_t input : inputs) {
+        put32(buf, input);
+    }
+}
+
+void write_all(int fd, const std::string& buf, uint64_t offset) {
+    size_t written = 0;
+    while (written < buf.size()) {
+        const ssize_t n = pwrite(fd, buf.data() + written, buf.size() - written,
+                                 static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to write deps log");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+}  // namespace
+
+DepsLog::DepsLog(std::filesystem::path path) try : file(path) {
+    load();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Loading deps log '" + path.string() + "'");
+}
+
+DepsLog::~DepsLog() { unload(); }
+
+std::optional<std::vector<std::string>> DepsLog::get(const std::string& output) const {
+    std::lock_guard lock(mtx);
+    auto itm = ids.find(output);
+    if (itm == ids.end() || !deps[itm->second].has_value()) return std::nullopt;
+
+    std::vector<std::string> inputs;
+    inputs.reserve(deps[itm->second]->size());
+    for (uint32_t input : *deps[itm->second]) {
+        inputs.push_back(paths[input]);
+    }
+    return inputs;
+}
+
+void DepsLog::record(const std::string& output, const std::vector<std::string>& inputs) try {
+    std::lock_guard lock(mtx);
+    std::string buf;
+    if (file.has_value() && end_offset == 0) {
+        buf.append(MAGIC, sizeof(MAGIC));
+    }
+
+    const uint32_t output_id = intern(output, buf);
+    std::vector<uint32_t> input_ids;
+    input_ids.reserve(inputs.size());
+    for (const std::string& input : inputs) {
+        input_ids.push_back(intern(input, buf));
+    }
+    // Most compiles read the same headers as last time, which needs no new record
+    if (deps[output_id] == input_ids) return;
+
+    if (file.has_value()) {
+        encode_deps(buf, output_id, input_ids);
+        if (fd < 0) {
+            if (file->has_parent_path()) {
+                std::filesystem::create_directories(file->parent_path());
+            }
+            fd = open(file->c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw SystemError("Failed to open deps log '" + file->string() + "'");
+            }
+        }
+        write_all(fd, buf, end_offset);
+        end_offset += buf.size();
+    }
+
+    if (!deps[output_id].has_value()) {
+        live_records++;
+    }
+    deps[output_id] = std::move(input_ids);
+    deps_records++;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Recording dependencies of '" + output + "' in deps log");
+}
+
+void DepsLog::compact_if_needed() try {
+    std::lock_guard lock(mtx);
+    const size_t replaced = deps_records - live_records;
+    if (!file.has_value() || replaced < COMPACTION_THRESHOLD || replaced <= live_records) return;
+
+    // Paths no longer referenced by any record are dropped, and the rest renumbered
+    std::string buf(MAGIC, sizeof(MAGIC));
+    std::unordered_map<uint32_t, uint32_t> new_ids;
+    auto renumber = [&](uint32_t id) {
+        auto [itm, inserted] = new_ids.try_emplace(id, static_cast<uint32_t>(new_ids.size()));
+        if (inserted) {
+            encode_path(buf, paths[id], itm->second);
+        }
+        return itm->second;
+    };
+    for (uint32_t output = 0; output < deps.size(); output++) {
+        if (!deps[output].has_value()) continue;
+        const uint32_t new_output = renumber(output);
+        std::vector<uint32_t> inputs;
+        for (uint32_t input : *deps[output]) {
+            inputs.push_back(renumber(input));
+        }
+        encode_deps(buf, new_output, inputs);
+    }
+
+    // Write then rename so an interrupted compaction never leaves a truncated log behind
+    const std::filesystem::path tmp = file->string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc | std::ios::binary);
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!out) {
+            throw IOError("Failed to write '" + tmp.string() + "'");
+        }
+    }
+    std::filesystem::rename(tmp, *file);
+
+    unload();
+    load();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Compacting deps log");
+}
+
+void DepsLog::load() {
+    fd = open(file->c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return;
+        throw SystemError("Failed to open deps log");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        throw SystemError("Failed to stat deps log");
+    }
+    std::string data(static_cast<size_t>(info.st_size), '\0');
+    size_t read_len = 0;
+    while (read_len < data.size()) {
+        const ssize_t n = pread(fd, data.data() + read_len, data.size() - read_len,
+                                static_cast<off_t>(read_len));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to read deps log");
+        }
+        if (n == 0) break;
+        read_len += static_cast<size_t>(n);
+    }
+    data.resize(read_len);
+
+    if (data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0) {
+        end_offset = sizeof(MAGIC);
+    }
+    while (end_offset != 0 && end_offset + sizeof(uint32_t) <= data.size()) {
+        const uint32_t head = get32(data.data() + end_offset);
+        const uint32_t len = head & ~DEPS_FLAG;
+        const char* payload = data.data() + end_offset + sizeof(uint32_t);
+        if (len % sizeof(uint32_t) != 0 || len > MAX_PAYLOAD ||
+            end_offset + sizeof(uint32_t) + len > data.size()) {
+            break;
+        }
+
+        if (head & DEPS_FLAG) {
+            const size_t count = len / sizeof(uint32_t);
+            std::vector<uint32_t> record;
+            for (size_t i = 0; i < count; i++) {
+                record.push_back(get32(payload + i * sizeof(uint32_t)));
+            }
+            if (record.empty() || std::ranges::any_of(record, [&](uint32_t id) {
+                    return id >= paths.size();
+                })) {
+                break;
+            }
+            const uint32_t output = record.front();
+            record.erase(record.begin());
+            if (!deps[output].has_value()) {
+                live_records++;
+            }
+            deps[output] = std::move(record);
+            deps_records++;
+        } else {
+            if (len < 2 * sizeof(uint32_t)) break;
+            const uint32_t check = get32(payload + len - sizeof(uint32_t));
+            std::string path(payload, len - sizeof(uint32_t));
+            path.erase(path.find_last_not_of('\0') + 1);
+            if (check != ~static_cast<uint32_t>(paths.size()) || path.empty()) break;
+
+            ids[path] = static_cast<uint32_t>(paths.size());
+            paths.push_back(std::move(path));
+            deps.emplace_back();
+        }
+        end_offset += sizeof(uint32_t) + len;
+    }
+
+    // Anything after the last whole record is overwritten by the next one, so it is dropped now
+    // rather than left to confuse the next load
+    if (end_offset < data.size() && ftruncate(fd, static_cast<off_t>(end_offset)) != 0) {
+        throw SystemError("Failed to truncate deps log");
+    }
+}
+
+void DepsLog::unload() {
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = -1;
+    paths.clear();
+    ids.clear();
+    deps.clear();
+    deps_records = 0;
+    live_records = 0;
+    end_offset = 0;
+}
+
+uint32_t DepsLog::intern(const std::string& path, std::string& buf) {
+    auto itm = ids.find(path);
+    if (itm != ids.end()) return itm->second;
+
+    const uint32_t id = static_cast<uint32_t>(paths.size());
+    ids[path] = id;
+    paths.push_back(path);
+    deps.emplace_back();
+    if (file.has_value()) {
+        encode_path(buf, path, id);
+    }
+    return id;
+}
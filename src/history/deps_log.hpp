@@ -0,0 +1,84 @@
+#ifndef DEPS_LOG_H
+#define DEPS_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A persisted, append-only log of the implicit inputs of each output (e.g. the headers a compile
+ * read, taken from it's depfile). Paths are interned, so each is written once and every record
+ * after refers to it by a 4 byte id. Safe to share between threads, but not between processes
+ */
+class DepsLog {
+   public:
+    /** Create an in memory log that is never persisted */
+    DepsLog() = default;
+
+    /**
+     * Create a log backed by a file, loading any existing records. A file that is not a deps log,
+     * or was cut short mid-record, is discarded from that point
+     * @param path The file the log is loaded from and appended to
+     * @throws If the file exists but can not be read
+     */
+    explicit DepsLog(std::filesystem::path path);
+
+    ~DepsLog();
+
+    DepsLog(const DepsLog&) = delete;
+    DepsLog& operator=(const DepsLog&) = delete;
+
+    /** Get the implicit inputs last recorded for an output, if any have been */
+    std::optional<std::vector<std::string>> get(const std::string& output) const;
+
+    /**
+     * Record the implicit inputs of an output, replacing any earlier record. Nothing is written if
+     * they are unchanged
+     * @throws If the record can not be appended to the file
+     */
+    void record(const std::string& output, const std::vector<std::string>& inputs);
+
+    /**
+     * Rewrite the file with only the latest record of each output once more than half of it's
+     * records have been replaced (and at least COMPACTION_THRESHOLD have)
+     * @throws If the file cannot be rewritten
+     */
+    void compact_if_needed();
+
+    /** The number of replaced records that may trigger compaction */
+    constexpr static size_t COMPACTION_THRESHOLD = 1024;
+
+   private:
+    std::optional<std::filesystem::path> file;
+
+    mutable std::mutex mtx;
+    /** The path of each id, and the id of each path */
+    std::vector<std::string> paths;
+    std::unordered_map<std::string, uint32_t> ids;
+    /** The implicit inputs of each output, indexed by the output's id */
+    std::vector<std::optional<std::vector<uint32_t>>> deps;
+    size_t deps_records = 0;
+    size_t live_records = 0;
+    /** Where the next record is written */
+    uint64_t end_offset = 0;
+    int fd = -1;
+
+    /** Read the file. Expects the log to be empty */
+    void load();
+
+    /** Close the file, forgetting every record */
+    void unload();
+
+    /**
+     * Get the id of a path, interning it if it has none
+     * @param buf Where the record interning the path is encoded, if it is new
+     */
+    uint32_t intern(const std::string& path, std::string& buf);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "duration_history.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "../errors/error.hpp"
+
+DurationHistory::DurationHistory(std::filesystem::path path) try : file(path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return;
+
+    // Each line is "<seconds> <rule name>". Names go last as they may contain spaces. The history
+    // is only a scheduling hint, so a damaged line (e.g. from an interrupted save) is dropped
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        double seconds;
+        std::string name;
+        if (!(fields >> seconds) || !std::isfinite(seconds) || seconds < 0 ||
+            !std::getline(fields >> std::ws, name) || name.empty() || durations.contains(name)) {
+            continue;
+        }
+        durations[name] = seconds;
+        total += seconds;
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Loading duration history '" + path.string() + "'");
+}
+
+std::optional<double> DurationHistory::get(const std::string& rule_name) const {
+    std::lock_guard lock(mtx);
+    auto itm = durations.find(rule_name);
+    if (itm == durations.end()) return std::nullopt;
+    return itm->second;
+}
+
+double DurationHistory::estimate(const std::string& rule_name) const {
+    std::lock_guard lock(mtx);
+    auto itm = durations.find(rule_name);
+    if (itm != durations.end()) return itm->second;
+    if (durations.empty()) return DEFAULT_ESTIMATE;
+    return total / static_cast<double>(durations.size());
+}
+
+void DurationHistory::record(const std::string& rule_name, double seconds) {
+    std::lock_guard lock(mtx);
+    auto [itm, inserted] = durations.try_emplace(rule_name, seconds);
+    if (!inserted) {
+        total -= itm->second;
+        itm->second = SMOOTHING * seconds + (1 - SMOOTHING) * itm->second;
+    }
+    total += itm->second;
+}
+
+void DurationHistory::save() const try {
+    if (!file.has_value()) return;
+
+    if (file->has_parent_path()) {
+        std::filesystem::create_directories(file->parent_path());
+    }
+
+    // Write then rename so an interrupted save never leaves a truncated history behind
+    const std::filesystem::path tmp = file->string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out.is_open()) {
+            throw IOError("Failed to open '" + tmp.string() + "' for writing");
+        }
+
+        std::lock_guard lock(mtx);
+        for (const auto& [name, seconds] : durations) {
+            out << seconds << ' ' << name << '\n';
+        }
+    }
+    std::filesystem::rename(tmp, *file);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Saving duration history");
+}
@@ -0,0 +1,59 @@
+#ifndef DURATION_HISTORY_H
+#define DURATION_HISTORY_H
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * A persisted record of how long each rule took to run in past builds, keyed by rule name (the
+ * output file). Used to estimate the critical path of a build before it runs.
+ */
+class DurationHistory {
+   public:
+    /** Create an in memory history that is never persisted */
+    DurationHistory() = default;
+
+    /**
+     * Create a history backed by a file, loading any existing records. Malformed records are
+     * skipped, as the history is only used to order jobs
+     * @param path The file the history is loaded from and saved to
+     */
+    explicit DurationHistory(std::filesystem::path path);
+
+    /** Get the expected duration of a rule in seconds, if it has run before */
+    std::optional<double> get(const std::string& rule_name) const;
+
+    /**
+     * Get the expected duration of a rule in seconds. Rules that have never run are assumed to
+     * take the average of all known rules, or 1 second if nothing is known
+     */
+    double estimate(const std::string& rule_name) const;
+
+    /**
+     * Record a new run of a rule. Estimates are smoothed so a single slow run (e.g. due to a busy
+     * machine) does not dominate
+     */
+    void record(const std::string& rule_name, double seconds);
+
+    /**
+     * Write the history back to the file it was loaded from. Does nothing for in memory histories
+     * @throws If the file cannot be written
+     */
+    void save() const;
+
+   private:
+    /** Weight of the newest run in the smoothed estimate */
+    constexpr static double SMOOTHING = 0.5;
+    constexpr static double DEFAULT_ESTIMATE = 1.0;
+
+    std::optional<std::filesystem::path> file;
+
+    mutable std::mutex mtx;
+    std::unordered_map<std::string, double> durations;
+    double total = 0;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "hash_database.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include "../errors/error.hpp"
+#include "../io/content_hash.hpp"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace {
+/** Hashes are written in hex, and files that did not exist as '-' */
+std::string format_hash(std::optional<uint64_t> hash) {
+    if (!hash.has_value()) return "-";
+    std::ostringstream out;
+    out << std::hex << *hash;
+    return out.str();
+}
+
+std::optional<uint64_t> parse_hash(const std::string& field) {
+    if (field == "-") return std::nullopt;
+    size_t parsed_len = 0;
+    const uint64_t hash = std::stoull(field, &parsed_len, 16);
+    if (parsed_len != field.size()) {
+        throw IOError("Malformed hash '" + field + "'");
+    }
+    return hash;
+}
+}  // namespace
+
+HashDatabase::HashDatabase(std::filesystem::path path) try : file(path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return;
+
+    // File records are "F <hash> <mtime> <size> <inode> <path>". Build records are
+    // "B <hash> <input count> <output>", followed by an "I <hash> <input>" line per input. Paths
+    // go last as they may contain spaces
+    std::string line;
+    size_t lno = 0;
+    BuildRecord* build = nullptr;
+    size_t inputs_left = 0;
+    auto malformed = [&] {
+        return IOError("Malformed hash record on line " + std::to_string(lno));
+    };
+    while (std::getline(in, line)) {
+        lno++;
+        if (line.empty()) continue;
+
+        std::istringstream fields(line);
+        std::string kind;
+        std::string hash;
+        std::string name;
+        if (!(fields >> kind >> hash)) throw malformed();
+
+        if (kind == "F") {
+            FileRecord record;
+            if (!(fields >> record.stamp.mtime_ns >> record.stamp.size >> record.stamp.inode) ||
+                !std::getline(fields >> std::ws, name) || name.empty()) {
+                throw malformed();
+            }
+            const std::optional<uint64_t> parsed = parse_hash(hash);
+            if (!parsed.has_value()) throw malformed();
+            record.hash = *parsed;
+            files[name] = record;
+        } else if (kind == "B") {
+            if (!(fields >> inputs_left) || !std::getline(fields >> std::ws, name) ||
+                name.empty()) {
+                throw malformed();
+            }
+            build = &builds[name];
+            *build = BuildRecord{parse_hash(hash), {}};
+        } else if (kind == "I") {
+            if (build == nullptr || inputs_left == 0 || !std::getline(fields >> std::ws, name) ||
+                name.empty()) {
+                throw malformed();
+            }
+            build->inputs.emplace_back(name, parse_hash(hash));
+            inputs_left--;
+        } else {
+            throw malformed();
+        }
+    }
+    if (inputs_left != 0) {
+        throw IOError("Truncated hash record on line " + std::to_string(lno));
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Loading hash database '" + path.string() + "'");
+}
+
+std::optional<uint64_t> HashDatabase::hash(const std::string& filename) try {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+        if (errno == ENOENT || errno == ENOTDIR) return std::nullopt;
+        throw SystemError("Failed to stat file '" + filename + "'");
+    }
+    const FileStamp stamp{info.st_mtim.tv_sec * 1'000'000'000 + info.st_mtim.tv_nsec,
+                          static_cast<uint64_t>(info.st_size), info.st_ino};
+    {
+        std::lock_guard lock(mtx);
+        auto itm = files.find(filename);
+        if (itm != files.end() && itm->second.stamp == stamp) {
+            return itm->second.hash;
+        }
+    }
+
+    // Hashed without the lock so planners can hash different files at once
+    const std::optional<FileRecord> record = read_file(filename);
+    if (!record.has_value()) return std::nullopt;
+
+    std::lock_guard lock(mtx);
+    files[filename] = *record;
+    return record->hash;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Hashing file '" + filename + "'");
+}
+
+std::optional<bool> HashDatabase::changed_since_build(const std::string& output,
+                                                      const std::vector<std::string>& inputs) {
+    BuildRecord record;
+    {
+        std::lock_guard lock(mtx);
+        auto itm = builds.find(output);
+        if (itm == builds.end()) return std::nullopt;
+        record = itm->second;
+    }
+
+    if (record.inputs.size() != inputs.size()) return true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (record.inputs[i].first != inputs[i]) return true;
+    }
+
+    const std::optional<uint64_t> output_hash = hash(output);
+    if (!output_hash.has_value() || output_hash != record.output) return true;
+
+    for (const auto& [input, input_hash] : record.inputs) {
+        // A missing input always needs building, as it does when comparing write times
+        const std::optional<uint64_t> current = hash(input);
+        if (!current.has_value() || current != input_hash) return true;
+    }
+    return false;
+}
+
+void HashDatabase::record_build(const std::string& output, const std::vector<std::string>& inputs) {
+    BuildRecord record{hash(output), {}};
+    if (!record.output.has_value()) return;
+
+    for (const std::string& input : inputs) {
+        record.inputs.emplace_back(input, hash(input));
+    }
+    std::lock_guard lock(mtx);
+    builds[output] = std::move(record);
+}
+
+void HashDatabase::save() const try {
+    if (!file.has_value()) return;
+
+    if (file->has_parent_path()) {
+        std::filesystem::create_directories(file->parent_path());
+    }
+
+    // Write then rename so an interrupted save never leaves a truncated database behind
+    const std::filesystem::path tmp = file->string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out.is_open()) {
+            throw IOError("Failed to open '" + tmp.string() + "' for writing");
+        }
+
+        std::lock_guard lock(mtx);
+        for (const auto& [name, record] : files) {
+            out << "F " << format_hash(record.hash) << ' ' << record.stamp.mtime_ns << ' '
+                << record.stamp.size << ' ' << record.stamp.inode << ' ' << name << '\n';
+        }
+        for (const auto& [name, record] : builds) {
+            out << "B " << format_hash(record.output) << ' ' << record.inputs.size() << ' '
+                << name << '\n';
+            for (const auto& [input, hash] : record.inputs) {
+                out << "I " << format_hash(hash) << ' ' << input << '\n';
+            }
+        }
+    }
+    std::filesystem::rename(tmp, *file);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Saving hash database");
+}
+
+std::optional<HashDatabase::FileRecord> HashDatabase::read_file(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) return std::nullopt;
+        throw SystemError("Failed to open file '" + filename + "'");
+    }
+
+    // The stamp comes from the descriptor that is read, so it always matches the hashed contents
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw SystemError("Failed to stat file '" + filename + "'");
+    }
+    FileRecord record{{info.st_mtim.tv_sec * 1'000'000'000 + info.st_mtim.tv_nsec,
+                       static_cast<uint64_t>(info.st_size), info.st_ino},
+                      0};
+
+    // Directories and devices have no contents to compare, so they change with their write time
+    if (!S_ISREG(info.st_mode)) {
+        close(fd);
+        const int64_t mtime_ns = record.stamp.mtime_ns;
+        record.hash = content_hash({reinterpret_cast<const char*>(&mtime_ns), sizeof(mtime_ns)});
+        return record;
+    }
+
+    const size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        close(fd);
+        record.hash = content_hash({});
+        return record;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw SystemError("Failed to map file '" + filename + "'");
+    }
+    record.hash = content_hash({static_cast<const char*>(data), size});
+    munmap(data, size);
+    return record;
+}
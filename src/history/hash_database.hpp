@@ -0,0 +1,92 @@
+#ifndef HASH_DATABASE_H
+#define HASH_DATABASE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * A persisted record of the contents of files, and of the inputs each rule was last built from.
+ * Lets staleness be decided by content rather than write time, so a 'touch' or 'git checkout'
+ * that leaves a file unchanged does not cause a rebuild. Contents are hashed with XXH64 and only
+ * re-hashed when a file's write time, size or inode changes. Safe to share between threads
+ */
+class HashDatabase {
+   public:
+    /** Create an in memory database that is never persisted */
+    HashDatabase() = default;
+
+    /**
+     * Create a database backed by a file, loading any existing records
+     * @param path The file the database is loaded from and saved to
+     * @throws If the file exists but is malformed
+     */
+    explicit HashDatabase(std::filesystem::path path);
+
+    /**
+     * Get the hash of a file's contents
+     * @returns The hash, or nothing if the file does not exist
+     * @throws If the file exists but can not be read
+     */
+    std::optional<uint64_t> hash(const std::string& filename);
+
+    /**
+     * Check whether an output or any of it's inputs differ from when the output was last built
+     * @param output The file built from the inputs
+     * @param inputs The files the output is built from
+     * @returns Whether anything changed, or nothing if no build of the output has been recorded
+     * @throws If a file can not be read
+     */
+    std::optional<bool> changed_since_build(const std::string& output,
+                                            const std::vector<std::string>& inputs);
+
+    /**
+     * Record that an output was just built from the current contents of it's inputs. Nothing is
+     * recorded if the output does not exist (e.g. for a clean rule)
+     * @throws If a file can not be read
+     */
+    void record_build(const std::string& output, const std::vector<std::string>& inputs);
+
+    /**
+     * Write the database back to the file it was loaded from. Does nothing for in memory databases
+     * @throws If the file cannot be written
+     */
+    void save() const;
+
+   private:
+    /** What identifies a version of a file without reading it */
+    struct FileStamp {
+        int64_t mtime_ns;
+        uint64_t size;
+        uint64_t inode;
+
+        bool operator==(const FileStamp&) const = default;
+    };
+
+    struct FileRecord {
+        FileStamp stamp;
+        uint64_t hash;
+    };
+
+    /** The hash of an output and of each input when it was last built. Missing files are empty */
+    struct BuildRecord {
+        std::optional<uint64_t> output;
+        std::vector<std::pair<std::string, std::optional<uint64_t>>> inputs;
+    };
+
+    std::optional<std::filesystem::path> file;
+
+    mutable std::mutex mtx;
+    std::unordered_map<std::string, FileRecord> files;
+    std::unordered_map<std::string, BuildRecord> builds;
+
+    /** Read and hash a file's contents, returning it's stamp at the time it was read */
+    static std::optional<FileRecord> read_file(const std::string& filename);
+};
+
+#endif
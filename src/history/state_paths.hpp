@@ -0,0 +1,18 @@
+#ifndef STATE_PATHS_H
+#define STATE_PATHS_H
+
+#include <filesystem>
+
+/** Locations of the state persisted between builds. Relative to the directory builds run in */
+namespace StatePaths {
+inline const static std::filesystem::path ROOT = ".my_make";
+inline const static std::filesystem::path DURATIONS = ROOT / "durations";
+inline const static std::filesystem::path HASHES = ROOT / "hashes";
+inline const static std::filesystem::path BUILD_LOG = ROOT / "build_log";
+inline const static std::filesystem::path DEPS_LOG = ROOT / "deps";
+inline const static std::filesystem::path CACHE = ROOT / "cache";
+inline const static std::filesystem::path COMPILED = ROOT / "compiled";
+inline const static std::filesystem::path SERVER_SOCKET = ROOT / "server.sock";
+}  // namespace StatePaths
+
+#endif
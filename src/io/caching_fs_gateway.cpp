@@ -0,0 +1,128 @@
+#include "caching_fs_gateway.hpp"
+
+#include <mutex>
+
+CachingFSGateway::CachingFSGateway(std::shared_ptr<FSGateway> _inner) : inner(std::move(_inner)) {}
+
+bool CachingFSGateway::exists(std::string filename) const {
+    return modified_time(filename).has_value();
+}
+
+std::filesystem::file_time_type CachingFSGateway::last_write_time(std::string filename) const {
+    const auto write_t = modified_time(filename);
+    // A missing file fails in whatever way the underlying gateway fails
+    return write_t.has_value() ? *write_t : inner->last_write_time(filename);
+}
+
+std::optional<std::filesystem::file_time_type> CachingFSGateway::modified_time(
+    const std::string& filename) const {
+    uint64_t epoch;
+    {
+        std::shared_lock lock(mtx);
+        auto entry = cache.find(filename);
+        if (entry != cache.end()) return entry->second;
+        epoch = invalidations;
+    }
+
+    // Queried without the lock so planners don't wait on each other's syscalls. Two planners
+    // missing on the same file at once both query it, which is harmless
+    const auto write_t = inner->modified_time(filename);
+    std::unique_lock lock(mtx);
+    // A file invalidated while it was queried may have been written since, so what was found
+    // can't be kept
+    if (invalidations == epoch) {
+        cache.try_emplace(filename, write_t);
+    }
+    return write_t;
+}
+
+std::vector<std::optional<std::filesystem::file_time_type>> CachingFSGateway::stat_many(
+    std::span<const std::string> filenames) const {
+    std::vector<std::optional<std::filesystem::file_time_type>> times(filenames.size());
+    std::vector<std::string> missed;
+    std::vector<size_t> missed_idx;
+    uint64_t epoch;
+    {
+        std::shared_lock lock(mtx);
+        epoch = invalidations;
+        for (size_t i = 0; i < filenames.size(); i++) {
+            auto entry = cache.find(filenames[i]);
+            if (entry != cache.end()) {
+                times[i] = entry->second;
+            } else {
+                missed.push_back(filenames[i]);
+                missed_idx.push_back(i);
+            }
+        }
+    }
+    if (missed.empty()) return times;
+
+    const auto queried = inner->stat_many(missed);
+    std::unique_lock lock(mtx);
+    const bool keep = invalidations == epoch;
+    for (size_t i = 0; i < missed.size(); i++) {
+        if (keep) {
+            cache.try_emplace(missed[i], queried[i]);
+        }
+        times[missed_idx[i]] = queried[i];
+    }
+    return times;
+}
+
+void CachingFSGateway::prefetch(std::span<const std::string> filenames) {
+    try {
+        stat_many(filenames);
+    } catch (const std::exception&) {
+        // Every file is queried again individually, reporting the failure against the rule
+    }
+}
+
+void CachingFSGateway::touch(std::string filename) {
+    inner->touch(filename);
+    invalidate(filename);
+}
+
+std::optional<uint64_t> CachingFSGateway::hash_contents(const std::string& filename) const {
+    return inner->hash_contents(filename);
+}
+
+std::optional<uint64_t> CachingFSGateway::hash_interface(const std::string& filename) const {
+    return inner->hash_interface(filename);
+}
+
+void CachingFSGateway::set_write_time(const std::string& filename,
+                                      std::filesystem::file_time_type time) {
+    inner->set_write_time(filename, time);
+    invalidate(filename);
+}
+
+void CachingFSGateway::invalidate(const std::string& filename) {
+    inner->invalidate(filename);
+    std::unique_lock lock(mtx);
+    cache.erase(filename);
+    invalidations++;
+}
+
+std::vector<std::string> CachingFSGateway::cached_files() const {
+    std::shared_lock lock(mtx);
+    std::vector<std::string> files;
+    files.reserve(cache.size());
+    for (const auto& [filename, time] : cache) {
+        files.push_back(filename);
+    }
+    return files;
+}
+
+bool CachingFSGateway::refresh(const std::string& filename) {
+    std::optional<std::optional<std::filesystem::file_time_type>> remembered;
+    {
+        std::shared_lock lock(mtx);
+        auto entry = cache.find(filename);
+        if (entry != cache.end()) {
+            remembered = entry->second;
+        }
+    }
+    invalidate(filename);
+    const auto write_t = modified_time(filename);
+    return !remembered.has_value() || *remembered != write_t;
+}
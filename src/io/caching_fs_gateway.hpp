@@ -0,0 +1,77 @@
+#ifndef CACHING_FS_GATEWAY_H
+#define CACHING_FS_GATEWAY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fs_gateway.hpp"
+
+/**
+ * Decorates another FSGateway, remembering the existence and write time of every file it is asked
+ * about. Headers and objects shared by many rules are then only queried once per build. Safe to
+ * share between planning threads, and entries are discarded through 'invalidate' when a job
+ * writes the file
+ */
+class CachingFSGateway : public FSGateway {
+   public:
+    explicit CachingFSGateway(std::shared_ptr<FSGateway> inner);
+
+    bool exists(std::string filename) const override;
+
+    std::filesystem::file_time_type last_write_time(std::string filename) const override;
+
+    std::optional<std::filesystem::file_time_type> modified_time(
+        const std::string& filename) const override;
+
+    /** Only files not already remembered are passed on to the underlying gateway */
+    std::vector<std::optional<std::filesystem::file_time_type>> stat_many(
+        std::span<const std::string> filenames) const override;
+
+    void prefetch(std::span<const std::string> filenames) override;
+
+    void touch(std::string filename) override;
+
+    /** Contents are not cached, as they are only hashed around jobs that may rewrite them */
+    std::optional<uint64_t> hash_contents(const std::string& filename) const override;
+
+    std::optional<uint64_t> hash_interface(const std::string& filename) const override;
+
+    void set_write_time(const std::string& filename,
+                        std::filesystem::file_time_type time) override;
+
+    void invalidate(const std::string& filename) override;
+
+    /**
+     * Every file whose write time (or absence) is remembered, i.e. every file that must be
+     * invalidated when it changes for later queries to stay correct
+     */
+    std::vector<std::string> cached_files() const;
+
+    /**
+     * Query a file again in place of what is remembered of it, as 'invalidate' followed by
+     * 'modified_time' would
+     * @returns Whether it's write time or existence differs from what was remembered, which it
+     * always does if nothing was
+     */
+    bool refresh(const std::string& filename);
+
+   private:
+    std::shared_ptr<FSGateway> inner;
+
+    mutable std::shared_mutex mtx;
+    /** The write time of each file queried, or nothing if it did not exist */
+    mutable std::unordered_map<std::string, std::optional<std::filesystem::file_time_type>> cache;
+    /**
+     * Counts every invalidation. A query only remembers what it found if none happened while it
+     * ran, as it could otherwise put back the write time of a file from before it was written
+     */
+    uint64_t invalidations = 0;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "content_hash.hpp"
+
+#include <bit>
+#include <cstring>
+
+namespace {
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t read64(const char* ptr) {
+    uint64_t val;
+    std::memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+uint32_t read32(const char* ptr) {
+    uint32_t val;
+    std::memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+uint64_t lane_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME_2;
+    acc = std::rotl(acc, 31);
+    return acc * PRIME_1;
+}
+
+uint64_t merge_round(uint64_t acc, uint64_t val) {
+    acc ^= lane_round(0, val);
+    return acc * PRIME_1 + PRIME_4;
+}
+}  // namespace
+
+uint64_t content_hash(std::string_view data, uint64_t seed) {
+    static_assert(std::endian::native == std::endian::little, "XXH64 reads little endian words");
+
+    const char* ptr = data.data();
+    const char* const end = ptr + data.size();
+    uint64_t hash;
+
+    if (data.size() >= 32) {
+        // Four independent lanes, so consecutive stripes don't wait on each other's multiplies
+        uint64_t v1 = seed + PRIME_1 + PRIME_2;
+        uint64_t v2 = seed + PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME_1;
+        const char* const limit = end - 32;
+        do {
+            v1 = lane_round(v1, read64(ptr));
+            v2 = lane_round(v2, read64(ptr + 8));
+            v3 = lane_round(v3, read64(ptr + 16));
+            v4 = lane_round(v4, read64(ptr + 24));
+            ptr += 32;
+        } while (ptr <= limit);
+
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else {
+        hash = seed + PRIME_5;
+    }
+    hash += data.size();
+
+    for (; ptr + 8 <= end; ptr += 8) {
+        hash ^= lane_round(0, read64(ptr));
+        hash = std::rotl(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (ptr + 4 <= end) {
+        hash ^= read32(ptr) * PRIME_1;
+        hash = std::rotl(hash, 23) * PRIME_2 + PRIME_3;
+        ptr += 4;
+    }
+    for (; ptr < end; ptr++) {
+        hash ^= static_cast<uint8_t>(*ptr) * PRIME_5;
+        hash = std::rotl(hash, 11) * PRIME_1;
+    }
+
+    // Mix every input bit into every output bit
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
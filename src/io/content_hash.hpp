@@ -0,0 +1,15 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Hash a block of memory with XXH64. Fast (several GB/s) and well distributed, but not
+ * cryptographic, so only suitable for detecting accidental changes
+ * @param data The bytes to hash
+ * @param seed Changes the hash of every input, e.g. to separate different kinds of data
+ */
+uint64_t content_hash(std::string_view data, uint64_t seed = 0);
+
+#endif
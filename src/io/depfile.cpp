@@ -0,0 +1,67 @@
+#include "depfile.hpp"
+
+#include <unordered_set>
+
+#include "../errors/error.hpp"
+
+std::vector<std::string> parse_depfile(std::string_view contents) try {
+    std::vector<std::string> prereqs;
+    std::unordered_set<std::string> seen;
+    bool in_prereqs = false;
+    bool seen_target = false;
+    std::string token;
+
+    // A rule ends at a newline that is not escaped. Targets come first, up to the ':'
+    auto end_token = [&] {
+        if (token.empty()) return;
+        if (in_prereqs) {
+            if (seen.insert(token).second) {
+                prereqs.push_back(token);
+            }
+        } else if (token.back() == ':') {
+            in_prereqs = true;
+        } else {
+            seen_target = true;
+        }
+        token.clear();
+    };
+
+    for (size_t i = 0; i < contents.size(); i++) {
+        const char c = contents[i];
+        const char next = i + 1 < contents.size() ? contents[i + 1] : '\0';
+        if (c == '\\' && (next == '\n' || next == '\r')) {
+            // A line continuation, which separates tokens like any other whitespace
+            end_token();
+            i += (next == '\r' && i + 2 < contents.size() && contents[i + 2] == '\n') ? 2 : 1;
+        } else if (c == '\\' && (next == ' ' || next == '#')) {
+            token += next;
+            i++;
+        } else if (c == '$' && next == '$') {
+            token += '$';
+            i++;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            end_token();
+        } else if (c == '\n') {
+            end_token();
+            if (seen_target && !in_prereqs) {
+                throw ValueError("Expected ':' after depfile target");
+            }
+            in_prereqs = false;
+            seen_target = false;
+        } else if (c == ':' && !in_prereqs && (next == ' ' || next == '\t' || next == '\n' ||
+                                                next == '\r' || next == '\0')) {
+            token += c;
+            end_token();
+        } else {
+            token += c;
+        }
+    }
+    end_token();
+    if (seen_target && !in_prereqs) {
+        throw ValueError("Expected ':' after depfile target");
+    }
+
+    return prereqs;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Parsing depfile");
+}
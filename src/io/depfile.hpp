@@ -0,0 +1,18 @@
+#ifndef DEPFILE_H
+#define DEPFILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Parse a Makefile style depfile, as written by GCC and Clang with '-MD -MF <file>'
+ * (e.g. "a.o: a.cpp include/a.h \<newline> include/b.h")
+ * @param contents The contents of the depfile
+ * @returns Every prerequisite of every target, in order and without duplicates. Escaped spaces,
+ * '#' and '$' are unescaped
+ * @throws If a target is not followed by ':'
+ */
+std::vector<std::string> parse_depfile(std::string_view contents);
+
+#endif
@@ -0,0 +1,141 @@
+#include "elf_interface.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "content_hash.hpp"
+#include "elf.h"
+
+namespace {
+/** Seeds the hash, so an interface never hashes the same as a file holding the same bytes */
+constexpr uint64_t INTERFACE_SEED = 0x746f63;
+
+/** Copy a structure out of the image, or nothing if it runs past the end */
+template <typename T>
+std::optional<T> read_at(std::string_view image, uint64_t offset) {
+    if (offset > image.size() || image.size() - offset < sizeof(T)) return std::nullopt;
+    T val;
+    std::memcpy(&val, image.data() + offset, sizeof(T));
+    return val;
+}
+
+/** The NUL terminated string at an offset into a string table, or nothing if it is unterminated */
+std::optional<std::string_view> string_at(std::string_view table, uint64_t offset) {
+    if (offset >= table.size()) return std::nullopt;
+    const size_t end = table.find('\0', offset);
+    if (end == std::string_view::npos) return std::nullopt;
+    return table.substr(offset, end - offset);
+}
+
+/** The layouts of one ELF class (32 or 64 bit) */
+template <typename Ehdr, typename Shdr, typename Sym, typename Dyn>
+struct ElfClass {
+    using Header = Ehdr;
+    using Section = Shdr;
+    using Symbol = Sym;
+    using Dynamic = Dyn;
+};
+using Elf32 = ElfClass<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, Elf32_Dyn>;
+using Elf64 = ElfClass<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, Elf64_Dyn>;
+
+template <typename Elf>
+std::optional<uint64_t> hash_interface(std::string_view image) {
+    const auto header = read_at<typename Elf::Header>(image, 0);
+    if (!header.has_value() || header->e_type != ET_DYN ||
+        header->e_shentsize != sizeof(typename Elf::Section)) {
+        return std::nullopt;
+    }
+
+    std::vector<typename Elf::Section> sections;
+    for (size_t i = 0; i < header->e_shnum; i++) {
+        const auto section = read_at<typename Elf::Section>(
+            image, header->e_shoff + i * sizeof(typename Elf::Section));
+        if (!section.has_value()) return std::nullopt;
+        sections.push_back(*section);
+    }
+    auto contents = [&](size_t idx) -> std::optional<std::string_view> {
+        if (idx >= sections.size() || sections[idx].sh_type == SHT_NOBITS) return std::nullopt;
+        const uint64_t offset = sections[idx].sh_offset;
+        const uint64_t size = sections[idx].sh_size;
+        if (offset > image.size() || image.size() - offset < size) return std::nullopt;
+        return image.substr(offset, size);
+    };
+
+    // Each entry is what a program linked against the library may rely on for one symbol
+    std::vector<std::string> entries;
+    std::string soname;
+    bool has_dynsym = false;
+    for (size_t i = 0; i < sections.size(); i++) {
+        const uint32_t type = sections[i].sh_type;
+        if (type != SHT_DYNSYM && type != SHT_DYNAMIC) continue;
+        const auto data = contents(i);
+        const auto strings = contents(sections[i].sh_link);
+        if (!data.has_value() || !strings.has_value()) return std::nullopt;
+
+        if (type == SHT_DYNAMIC) {
+            for (size_t off = 0; off + sizeof(typename Elf::Dynamic) <= data->size();
+                 off += sizeof(typename Elf::Dynamic)) {
+                const auto dyn = read_at<typename Elf::Dynamic>(*data, off);
+                if (dyn->d_tag == DT_NULL) break;
+                if (dyn->d_tag != DT_SONAME) continue;
+                const auto name = string_at(*strings, dyn->d_un.d_val);
+                if (!name.has_value()) return std::nullopt;
+                soname = *name;
+            }
+            continue;
+        }
+
+        has_dynsym = true;
+        // The first symbol is always the reserved null symbol
+        for (size_t off = sizeof(typename Elf::Symbol);
+             off + sizeof(typename Elf::Symbol) <= data->size();
+             off += sizeof(typename Elf::Symbol)) {
+            const auto sym = read_at<typename Elf::Symbol>(*data, off);
+            const unsigned bind = sym->st_info >> 4;
+            const unsigned kind = sym->st_info & 0xf;
+            const unsigned visibility = sym->st_other & 0x3;
+            if (sym->st_shndx == SHN_UNDEF ||
+                (bind != STB_GLOBAL && bind != STB_WEAK && bind != STB_GNU_UNIQUE) ||
+                visibility == STV_HIDDEN || visibility == STV_INTERNAL) {
+                continue;
+            }
+            const auto name = string_at(*strings, sym->st_name);
+            if (!name.has_value()) return std::nullopt;
+
+            // Programs copy data symbols into themselves, so their size is part of the interface
+            const uint64_t size = (kind == STT_OBJECT || kind == STT_TLS) ? sym->st_size : 0;
+            entries.push_back(std::string(*name) + ' ' + std::to_string(kind) + ' ' +
+                              std::to_string(bind) + ' ' + std::to_string(size));
+        }
+    }
+    if (!has_dynsym) return std::nullopt;
+
+    std::ranges::sort(entries);
+    std::string summary = soname + '\n';
+    for (const std::string& entry : entries) {
+        summary += entry + '\n';
+    }
+    return content_hash(summary, INTERFACE_SEED);
+}
+}  // namespace
+
+std::optional<uint64_t> elf_interface_hash(std::string_view image) {
+    if (image.size() < EI_NIDENT || std::memcmp(image.data(), ELFMAG, SELFMAG) != 0) {
+        return std::nullopt;
+    }
+    const unsigned char host_data =
+        std::endian::native == std::endian::little ? ELFDATA2LSB : ELFDATA2MSB;
+    if (static_cast<unsigned char>(image[EI_DATA]) != host_data) return std::nullopt;
+
+    switch (image[EI_CLASS]) {
+        case ELFCLASS32:
+            return hash_interface<Elf32>(image);
+        case ELFCLASS64:
+            return hash_interface<Elf64>(image);
+        default:
+            return std::nullopt;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef ELF_INTERFACE_H
+#define ELF_INTERFACE_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/**
+ * Hash the interface a shared library exports to the programs linked against it: it's SONAME
+ * and every defined, visible symbol in it's dynamic symbol table ('.dynsym'), along with the
+ * symbol's type, binding and (for data) size. Code and private symbols are left out, so a change
+ * to a function's body leaves the hash as it was. Symbol order does not matter
+ * @param image The contents of the library
+ * @returns The hash, or nothing if the image is not a shared object in the host's byte order
+ * with a dynamic symbol table
+ */
+std::optional<uint64_t> elf_interface_hash(std::string_view image);
+
+#endif
@@ -2,9 +2,12 @@
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "../errors/error.hpp"
+#include "unistd.h"
 
 namespace fs = std::filesystem;
 
@@ -44,3 +47,22 @@ std::string FileUtils::read_all(std::string path) {
 
     return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
 }
+
+std::string FileUtils::temp_path(const std::string& path) {
+    std::ostringstream name;
+    name << path << ".tmp-" << getpid() << "-"
+         << std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return name.str();
+}
+
+void FileUtils::write_atomically(const std::string& path, std::string_view contents) {
+    const std::string tmp = temp_path(path);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!out) {
+            throw IOError("Failed to write '" + tmp + "'");
+        }
+    }
+    fs::rename(tmp, path);
+}
@@ -2,6 +2,7 @@
 #define FILE_UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace FileUtils {
@@ -24,6 +25,19 @@ std::vector<std::string> read_chunk(std::string path, size_t start_pos,
  * @throws If the file does not exist or cannot be opened successfully
  */
 std::string read_all(std::string path);
+
+/**
+ * A path next to a file that is unique to the calling thread of this process, for writing the
+ * file before renaming it into place
+ */
+std::string temp_path(const std::string& path);
+
+/**
+ * Replace a file's contents by writing them to a temporary file renamed over it, so concurrent
+ * readers (including other processes) see either the old or new contents but never part of them
+ * @throws If the file can not be written
+ */
+void write_atomically(const std::string& path, std::string_view contents);
 }  // namespace FileUtils
 
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "file_watcher.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <unordered_set>
+
+#include "../errors/error.hpp"
+#include "poll.h"
+#include "sys/inotify.h"
+#include "unistd.h"
+
+namespace {
+/** Every event that can leave a file with different contents or a different write time */
+constexpr uint32_t CHANGE_EVENTS = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO;
+
+/** Every event that adds an entry to a directory or removes one from it */
+constexpr uint32_t LISTING_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+/** The directory holding a normalised path, where "." stands for the working directory */
+std::string dir_of(const std::filesystem::path& path) {
+    return path.has_parent_path() ? path.parent_path().string() : ".";
+}
+
+/** A directory as a normalised path, without the trailing separator it may have been given with */
+std::string normal_dir(const std::string& name) {
+    const std::filesystem::path path = std::filesystem::path(name).lexically_normal();
+    if (path.has_filename()) return path.string();
+    return path.has_parent_path() ? path.parent_path().string() : ".";
+}
+}  // namespace
+
+FileWatcher::FileWatcher() try {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        throw SystemError("Failed to create inotify instance");
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Creating file watcher");
+}
+
+FileWatcher::~FileWatcher() {
+    if (fd >= 0) close(fd);
+}
+
+void FileWatcher::watch(const std::vector<std::string>& names,
+                        const std::vector<Listing>& dir_listings) try {
+    files.clear();
+    listings.clear();
+    unwatched.clear();
+    std::unordered_set<std::string> dirs;
+    for (const std::string& name : names) {
+        const std::filesystem::path path = std::filesystem::path(name).lexically_normal();
+        files[path.string()].push_back(name);
+        dirs.insert(dir_of(path));
+    }
+    for (const Listing& listing : dir_listings) {
+        const std::string dir = normal_dir(listing.dir);
+        listings[dir].push_back(listing);
+        dirs.insert(dir);
+    }
+
+    for (auto itm = dir_watches.begin(); itm != dir_watches.end();) {
+        if (dirs.contains(itm->first)) {
+            itm++;
+            continue;
+        }
+        inotify_rm_watch(fd, itm->second);
+        watch_dirs.erase(itm->second);
+        itm = dir_watches.erase(itm);
+    }
+    for (const std::string& dir : dirs) {
+        if (dir_watches.contains(dir)) continue;
+
+        const int wd = inotify_add_watch(fd, dir.c_str(), CHANGE_EVENTS | IN_ONLYDIR);
+        if (wd < 0) {
+            // A file in a directory that doesn't exist yet can't be read by the build either
+            if (errno == ENOENT || errno == ENOTDIR) continue;
+            throw SystemError("Failed to watch directory '" + dir + "'");
+        }
+        dir_watches.emplace(dir, wd);
+        watch_dirs.emplace(wd, dir);
+    }
+    for (const auto& [path, file_names] : files) {
+        if (!dir_watches.contains(dir_of(path))) {
+            unwatched.insert(unwatched.end(), file_names.begin(), file_names.end());
+        }
+    }
+    for (const auto& [dir, dir_listings] : listings) {
+        if (dir_watches.contains(dir)) continue;
+        for (const Listing& listing : dir_listings) {
+            unwatched.push_back(listing.dir);
+        }
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Watching files for changes");
+}
+
+std::vector<std::string> FileWatcher::wait(std::optional<std::chrono::milliseconds> timeout) try {
+    std::vector<std::string> changed;
+    int timeout_ms = timeout.has_value() ? static_cast<int>(timeout->count()) : -1;
+    while (true) {
+        pollfd pfd{fd, POLLIN, 0};
+        const int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) {
+            throw SystemError("Failed to wait for file changes");
+        }
+        if (ready == 0) break;
+
+        read_events(changed);
+        // Events for files nobody is watching (e.g. an editor's swap file) keep waiting
+        if (!changed.empty()) {
+            timeout_ms = static_cast<int>(SETTLE.count());
+        }
+    }
+
+    std::unordered_set<std::string> seen;
+    std::erase_if(changed, [&](const std::string& name) { return !seen.insert(name).second; });
+    return changed;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Waiting for file changes");
+}
+
+const std::vector<std::string>& FileWatcher::get_unwatched() const { return unwatched; }
+
+void FileWatcher::read_events(std::vector<std::string>& changed) {
+    alignas(inotify_event) std::array<char, 1 << 16> buf;
+    while (true) {
+        const ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            throw SystemError("Failed to read file change events");
+        }
+
+        for (ssize_t off = 0; off < n;) {
+            const auto* ev = reinterpret_cast<const inotify_event*>(buf.data() + off);
+            off += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (const auto& [path, names] : files) {
+                    changed.insert(changed.end(), names.begin(), names.end());
+                }
+                for (const auto& [path, dir_listings] : listings) {
+                    for (const Listing& listing : dir_listings) {
+                        changed.push_back(listing.dir);
+                    }
+                }
+                continue;
+            }
+            auto dir = watch_dirs.find(ev->wd);
+            if (dir == watch_dirs.end()) continue;
+
+            // The directory was removed (or it's file system unmounted), taking the watch with it
+            if (ev->mask & IN_IGNORED) {
+                for (const auto& [path, names] : files) {
+                    if (dir_of(path) != dir->second) continue;
+                    changed.insert(changed.end(), names.begin(), names.end());
+                    unwatched.insert(unwatched.end(), names.begin(), names.end());
+                }
+                auto dir_listings = listings.find(dir->second);
+                if (dir_listings != listings.end()) {
+                    for (const Listing& listing : dir_listings->second) {
+                        changed.push_back(listing.dir);
+                        unwatched.push_back(listing.dir);
+                    }
+                }
+                dir_watches.erase(dir->second);
+                watch_dirs.erase(dir);
+                continue;
+            }
+            if (ev->len == 0) continue;
+
+            // Entries listing the directory again wouldn't find, such as the build's own outputs,
+            // are left out
+            auto dir_listings = listings.find(dir->second);
+            if (dir_listings != listings.end() && (ev->mask & LISTING_EVENTS)) {
+                const std::filesystem::path entry(ev->name);
+                for (const Listing& listing : dir_listings->second) {
+                    if ((ev->mask & IN_ISDIR) || listing.extensions.empty() ||
+                        (entry.has_extension() &&
+                         std::ranges::contains(listing.extensions, entry.extension().string()))) {
+                        changed.push_back(listing.dir);
+                    }
+                }
+            }
+
+            const std::filesystem::path path =
+                (std::filesystem::path(dir->second) / ev->name).lexically_normal();
+            auto file = files.find(path.string());
+            if (file != files.end()) {
+                changed.insert(changed.end(), file->second.begin(), file->second.end());
+            }
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Reports changes to a set of files through inotify. The directory holding each file is watched
+ * rather than the file itself, so a file replaced by renaming another over it (as most editors
+ * save) is still followed, and a file that does not exist yet is reported once it is created
+ */
+class FileWatcher {
+   public:
+    /** A directory whose listing is watched */
+    struct Listing {
+        /** Reported by 'wait' as it is given here */
+        std::string dir;
+        /**
+         * Only creating, removing or renaming an entry with one of these extensions, or a
+         * directory, changes the listing. Any entry does if there are none
+         */
+        std::vector<std::string> extensions;
+    };
+
+    /** @throws If inotify is unavailable */
+    FileWatcher();
+
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /**
+     * Watch exactly these files and directories from now on. Directories no longer holding a
+     * watched file stop being watched, and files in directories that do not exist are skipped
+     * @param files The files, reported by 'wait' as they are given here
+     * @param dirs The directories whose listing is watched
+     * @throws If a directory can not be watched for any other reason (e.g. too many watches)
+     */
+    void watch(const std::vector<std::string>& files, const std::vector<Listing>& dirs = {});
+
+    /**
+     * The files and directories whose changes can't be reported until they are watched again, as
+     * the directory holding them (or the directory itself) did not exist when they were watched
+     * or has been removed since. Those removed are reported by 'wait' once
+     */
+    const std::vector<std::string>& get_unwatched() const;
+
+    /**
+     * Block until a watched file is created, written, removed or has it's write time changed, or
+     * the listing of a watched directory changes. Changes are collected until none arrive for
+     * SETTLE, so a save touching several files (or one file several times) is reported once
+     * @param timeout The longest time to block for. Blocks indefinitely if not set
+     * @returns Every watched file and directory that changed, each once. Empty if the timeout
+     * expired
+     * @throws If the events can not be read
+     */
+    std::vector<std::string> wait(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+    /** How long changes are collected for after the last one before being reported */
+    constexpr static std::chrono::milliseconds SETTLE{5};
+
+   private:
+    int fd = -1;
+    /** The watch descriptor of each watched directory, and the directory of each descriptor */
+    std::unordered_map<std::string, int> dir_watches;
+    std::unordered_map<int, std::string> watch_dirs;
+    /** Each watched file as a normalised path, mapped to the names it was given as */
+    std::unordered_map<std::string, std::vector<std::string>> files;
+    /** Each directory whose listing is watched as a normalised path, mapped to it's listings */
+    std::unordered_map<std::string, std::vector<Listing>> listings;
+    std::vector<std::string> unwatched;
+
+    /**
+     * Read every queued event without blocking, adding the names of the watched files they
+     * concern and of the watched directories whose listing they change. Everything
+     * watched is added if the kernel dropped events, and everything in or of a removed directory
+     */
+    void read_events(std::vector<std::string>& changed);
+};
+
+#endif
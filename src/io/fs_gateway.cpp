@@ -1,9 +1,94 @@
 #include "fs_gateway.hpp"
 
+#include <algorithm>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <thread>
 
 #include "../errors/error.hpp"
+#include "content_hash.hpp"
+#include "elf_interface.hpp"
+#include "fcntl.h"
+#include "stat_ring.hpp"
+#include "sys/stat.h"
+
+namespace {
+/** The most file queries a StatRing keeps in flight at once */
+constexpr unsigned RING_ENTRIES = 256;
+/** The fewest files each thread queries when io_uring is unavailable */
+constexpr size_t FILES_PER_THREAD = 64;
+/** The most threads querying files when io_uring is unavailable */
+constexpr size_t MAX_STAT_THREADS = 16;
+
+/**
+ * Interpret the outcome of a statx call
+ * @param err The errno of the call, or 0 if it succeeded
+ * @returns The last write time, or nothing if the file does not exist
+ * @throws If the file could not be queried for any other reason
+ */
+std::optional<std::filesystem::file_time_type> to_modified_time(const std::string& filename,
+                                                                const struct statx& buf, int err) {
+    if (err == ENOENT || err == ENOTDIR) return std::nullopt;
+    if (err != 0) {
+        errno = err;
+        throw SystemError("Failed to stat file '" + filename + "'");
+    }
+
+    // The same conversion std::filesystem::last_write_time makes, so times from both compare
+    const auto since_epoch = std::chrono::seconds(buf.stx_mtime.tv_sec) +
+                             std::chrono::nanoseconds(buf.stx_mtime.tv_nsec);
+    const std::chrono::sys_time<std::chrono::nanoseconds> sys_time(since_epoch);
+    return std::chrono::time_point_cast<std::filesystem::file_time_type::duration>(
+        std::chrono::file_clock::from_sys(sys_time));
+}
+
+/**
+ * Read the whole of a file
+ * @returns The contents, or nothing if the file does not exist
+ */
+std::optional<std::string> read_contents(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        if (!std::filesystem::exists(filename)) return std::nullopt;
+        throw IOError("Failed to open file '" + filename + "'");
+    }
+    std::string contents{std::istreambuf_iterator<char>(file), {}};
+    if (file.bad()) {
+        throw IOError("Failed to read file '" + filename + "'");
+    }
+    return contents;
+}
+
+/** Query a single file with statx, returning the errno of the call or 0 if it succeeded */
+int statx_one(const std::string& filename, struct statx& buf) {
+    return statx(AT_FDCWD, filename.c_str(), 0, STATX_MTIME, &buf) == 0 ? 0 : errno;
+}
+}  // namespace
+
+std::optional<std::filesystem::file_time_type> FSGateway::modified_time(
+    const std::string& filename) const {
+    if (!exists(filename)) return std::nullopt;
+    return last_write_time(filename);
+}
+
+std::vector<std::optional<std::filesystem::file_time_type>> FSGateway::stat_many(
+    std::span<const std::string> filenames) const {
+    std::vector<std::optional<std::filesystem::file_time_type>> times;
+    times.reserve(filenames.size());
+    for (const std::string& filename : filenames) {
+        times.push_back(modified_time(filename));
+    }
+    return times;
+}
+
+std::optional<uint64_t> FSGateway::hash_interface(const std::string& filename) const {
+    return hash_contents(filename);
+}
+
+void FSGateway::prefetch(std::span<const std::string>) {}
+
+void FSGateway::invalidate(const std::string&) {}
 
 bool ProdFSGateway::exists(std::string filename) const try {
     return std::filesystem::exists(filename);
@@ -17,6 +102,48 @@ std::filesystem::file_time_type ProdFSGateway::last_write_time(std::string filen
     Error::update_and_throw(excep, "Checking last write time of file '" + filename + "'");
 }
 
+std::optional<std::filesystem::file_time_type> ProdFSGateway::modified_time(
+    const std::string& filename) const try {
+    struct statx buf;
+    const int err = statx_one(filename, buf);
+    return to_modified_time(filename, buf, err);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Checking last write time of file '" + filename + "'");
+}
+
+std::vector<std::optional<std::filesystem::file_time_type>> ProdFSGateway::stat_many(
+    std::span<const std::string> filenames) const try {
+    std::vector<struct statx> bufs(filenames.size());
+    std::vector<int> errors(filenames.size(), 0);
+
+    std::unique_ptr<StatRing> ring = StatRing::create(RING_ENTRIES);
+    if (ring != nullptr) {
+        ring->statx_all(filenames, bufs, errors);
+    } else {
+        // Without io_uring the latency of each query still overlaps with the others on threads
+        const size_t thread_count = std::clamp<size_t>(filenames.size() / FILES_PER_THREAD, 1,
+                                                       MAX_STAT_THREADS);
+        std::vector<std::jthread> threads;
+        for (size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t] {
+                for (size_t i = t; i < filenames.size(); i += thread_count) {
+                    errors[i] = statx_one(filenames[i], bufs[i]);
+                }
+            });
+        }
+    }
+
+    std::vector<std::optional<std::filesystem::file_time_type>> times;
+    times.reserve(filenames.size());
+    for (size_t i = 0; i < filenames.size(); i++) {
+        times.push_back(to_modified_time(filenames[i], bufs[i], errors[i]));
+    }
+    return times;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Checking last write times of " +
+                                       std::to_string(filenames.size()) + " files");
+}
+
 void ProdFSGateway::touch(std::string filename) try {
     std::ofstream file(filename);
     if (!file) {
@@ -24,4 +151,28 @@ void ProdFSGateway::touch(std::string filename) try {
     }
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "Scanning for cyclical dependency in rules");
-}
\ No newline at end of file
+}
+
+std::optional<uint64_t> ProdFSGateway::hash_contents(const std::string& filename) const try {
+    const std::optional<std::string> contents = read_contents(filename);
+    if (!contents.has_value()) return std::nullopt;
+    return content_hash(*contents);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Hashing file '" + filename + "'");
+}
+
+std::optional<uint64_t> ProdFSGateway::hash_interface(const std::string& filename) const try {
+    const std::optional<std::string> contents = read_contents(filename);
+    if (!contents.has_value()) return std::nullopt;
+    const std::optional<uint64_t> interface = elf_interface_hash(*contents);
+    return interface.has_value() ? *interface : content_hash(*contents);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Hashing interface of file '" + filename + "'");
+}
+
+void ProdFSGateway::set_write_time(const std::string& filename,
+                                   std::filesystem::file_time_type time) try {
+    std::filesystem::last_write_time(filename, time);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Setting last write time of file '" + filename + "'");
+}
@@ -1,8 +1,12 @@
 #ifndef FS_GATEWAY_H
 #define FS_GATEWAY_H
 
+#include <cstdint>
 #include <filesystem>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
 /** Interface between program and file system. Primarily useful for enabling dependency injection */
 class FSGateway {
@@ -13,12 +17,65 @@ class FSGateway {
 
     virtual std::filesystem::file_time_type last_write_time(std::string filename) const = 0;
 
+    /**
+     * Get the last write time of a file in a single query where the file system allows it
+     * @param filename The file to query
+     * @returns The last write time, or nothing if the file does not exist
+     */
+    virtual std::optional<std::filesystem::file_time_type> modified_time(
+        const std::string& filename) const;
+
+    /**
+     * Get the last write time of many files, overlapping the queries where the file system allows
+     * @param filenames The files to query
+     * @returns The result of 'modified_time' for each file, in the same order
+     * @throws If any file can not be queried
+     */
+    virtual std::vector<std::optional<std::filesystem::file_time_type>> stat_many(
+        std::span<const std::string> filenames) const;
+
+    /**
+     * Hint that the given files are about to be queried, letting a caching gateway look them all
+     * up in one batch. Does nothing unless the gateway caches, and never throws as any failure is
+     * reported by the later query instead
+     */
+    virtual void prefetch(std::span<const std::string> filenames);
+
     /**
      * Create a file
      * @param filename The filename of the new file
      * @throws If the file cannot be created successfully
      */
     virtual void touch(std::string filename) = 0;
+
+    /**
+     * Hash the contents of a file
+     * @returns The XXH64 hash of the contents, or nothing if the file does not exist
+     * @throws If the file exists but can not be read
+     */
+    virtual std::optional<uint64_t> hash_contents(const std::string& filename) const = 0;
+
+    /**
+     * Hash the interface a shared library exports, which only changes when programs linked
+     * against it would need relinking. Files that are not shared libraries are hashed by contents,
+     * as they are by gateways that can't read libraries
+     * @returns The hash, or nothing if the file does not exist
+     * @throws If the file exists but can not be read
+     */
+    virtual std::optional<uint64_t> hash_interface(const std::string& filename) const;
+
+    /**
+     * Change the last write time of a file without touching it's contents
+     * @throws If the file does not exist or it's write time can not be changed
+     */
+    virtual void set_write_time(const std::string& filename,
+                                std::filesystem::file_time_type time) = 0;
+
+    /**
+     * Discard anything remembered about a file, as it may have been written by a job. Does
+     * nothing unless the gateway caches
+     */
+    virtual void invalidate(const std::string& filename);
 };
 
 /** FS Gateway to use in production that interacts with the real filesystem */
@@ -27,7 +84,23 @@ class ProdFSGateway : public FSGateway {
 
     std::filesystem::file_time_type last_write_time(std::string filename) const override;
 
+    /** Uses a single 'statx' call rather than checking existence and write time separately */
+    std::optional<std::filesystem::file_time_type> modified_time(
+        const std::string& filename) const override;
+
+    /** Submits every query through io_uring, or spreads them over threads if it's unavailable */
+    std::vector<std::optional<std::filesystem::file_time_type>> stat_many(
+        std::span<const std::string> filenames) const override;
+
     void touch(std::string filename) override;
+
+    std::optional<uint64_t> hash_contents(const std::string& filename) const override;
+
+    /** Reads the SONAME and dynamic symbol table of ELF shared objects */
+    std::optional<uint64_t> hash_interface(const std::string& filename) const override;
+
+    void set_write_time(const std::string& filename,
+                        std::filesystem::file_time_type time) override;
 };
 
 #endif
@@ -0,0 +1,67 @@
+#include "output_buffer.hpp"
+
+#include <array>
+
+#include "../errors/error.hpp"
+
+OutputBuffer::OutputBuffer(size_t _cap) : cap(_cap) {}
+
+void OutputBuffer::append(std::string_view data) try {
+    if (data.empty()) return;
+
+    if (!spill && mem.size() + data.size() > cap) {
+        spill_to_disk();
+    }
+
+    if (spill) {
+        if (std::fwrite(data.data(), 1, data.size(), spill.get()) != data.size()) {
+            throw SystemError("Failed to write to temporary file");
+        }
+    } else {
+        mem.append(data);
+    }
+    total += data.size();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Buffering job output");
+}
+
+size_t OutputBuffer::size() const { return total; }
+
+bool OutputBuffer::empty() const { return total == 0; }
+
+bool OutputBuffer::spilled() const { return spill != nullptr; }
+
+void OutputBuffer::write_to(std::ostream& os) const try {
+    if (!spill) {
+        os << mem;
+        return;
+    }
+
+    std::fflush(spill.get());
+    std::rewind(spill.get());
+    std::array<char, 1 << 16> chunk;
+    size_t read;
+    while ((read = std::fread(chunk.data(), 1, chunk.size(), spill.get())) > 0) {
+        os.write(chunk.data(), static_cast<std::streamsize>(read));
+    }
+    if (std::ferror(spill.get())) {
+        throw SystemError("Failed to read temporary file");
+    }
+    // Later appends must go to the end rather than where reading stopped
+    std::fseek(spill.get(), 0, SEEK_END);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Printing buffered job output");
+}
+
+void OutputBuffer::spill_to_disk() {
+    spill.reset(std::tmpfile());
+    if (!spill) {
+        throw SystemError("Failed to create temporary file");
+    }
+
+    if (std::fwrite(mem.data(), 1, mem.size(), spill.get()) != mem.size()) {
+        throw SystemError("Failed to write to temporary file");
+    }
+    mem.clear();
+    mem.shrink_to_fit();
+}
@@ -0,0 +1,59 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/**
+ * Accumulates the output of a single job so it can be printed in one block once the job finishes.
+ * Output is held in memory up to a cap, after which everything is moved to an anonymous temporary
+ * file so a very noisy job cannot exhaust memory.
+ */
+class OutputBuffer {
+   public:
+    /** The default number of bytes held in memory before spilling to disk */
+    constexpr static size_t DEFAULT_CAP = 1 << 20;
+
+    /** @param cap The number of bytes held in memory before spilling to disk */
+    explicit OutputBuffer(size_t cap = DEFAULT_CAP);
+
+    /**
+     * Add output to the end of the buffer
+     * @throws If the buffer has spilled and the temporary file cannot be written
+     */
+    void append(std::string_view data);
+
+    /** The total number of bytes appended */
+    size_t size() const;
+
+    bool empty() const;
+
+    /** Returns true if and only if the output has been moved to a temporary file */
+    bool spilled() const;
+
+    /**
+     * Write the whole buffer to a stream, streaming from disk if it has spilled
+     * @throws If the temporary file cannot be read
+     */
+    void write_to(std::ostream& os) const;
+
+   private:
+    struct FileCloser {
+        void operator()(std::FILE* file) const { std::fclose(file); }
+    };
+
+    size_t cap;
+    size_t total = 0;
+    std::string mem;
+    /** Removed by the OS as soon as it is closed */
+    std::unique_ptr<std::FILE, FileCloser> spill;
+
+    /** Move the in memory output to a new temporary file */
+    void spill_to_disk();
+};
+
+#endif
@@ -1,11 +1,98 @@
 #include "proc_spawner.hpp"
 
+#include <array>
+#include <csignal>
+#include <cstdlib>
+
 #include "../errors/error.hpp"
 #include "spawn.h"
+#include "sys/epoll.h"
+#include "fcntl.h"
+#include "sys/eventfd.h"
+#include "sys/signalfd.h"
+#include "sys/syscall.h"
 #include "sys/wait.h"
 #include "unistd.h"
 
-int PosixProcSpawner::run(std::vector<std::string>& cmd) try {
+namespace {
+/** Open a pidfd for a process, returning -1 if the kernel does not support them */
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/** Convert a wait status into an exit code, with signals reported like a shell would */
+int decode_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return status;
+}
+}  // namespace
+
+ProcessId ProcessSpawner::spawn_remote(std::vector<std::string>&, const RemoteFiles&) {
+    throw LogicError("Commands can not be run remotely without any build workers");
+}
+
+PosixProcSpawner::PosixProcSpawner(size_t _output_cap) try : output_cap(_output_cap) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        throw SystemError("Failed to create process event loop");
+    }
+
+    epoll_event wake_ev{.events = EPOLLIN, .data = {.u64 = WAKE_KEY}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_ev) != 0) {
+        throw SystemError("Failed to watch wake event");
+    }
+
+    const int probe = open_pidfd(getpid());
+    use_pidfd = probe >= 0;
+    if (use_pidfd) {
+        close(probe);
+    }
+
+    // Signals are blocked so they are queued for the signalfd instead of being delivered. Without
+    // pidfds we are also told about exits through SIGCHLD
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int sig : TERMINATION_SIGNALS) {
+        sigaddset(&mask, sig);
+    }
+    if (!use_pidfd) {
+        sigaddset(&mask, SIGCHLD);
+    }
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        throw SystemError("Failed to create signalfd");
+    }
+
+    epoll_event sig_ev{.events = EPOLLIN, .data = {.u64 = SIGNAL_KEY}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &sig_ev) != 0) {
+        throw SystemError("Failed to watch signalfd");
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Creating POSIX process spawner");
+}
+
+PosixProcSpawner::~PosixProcSpawner() {
+    for (const auto& [id, proc] : running) {
+        if (proc.pidfd >= 0) close(proc.pidfd);
+        if (proc.out_fd >= 0) close(proc.out_fd);
+    }
+    for (int fd : {epoll_fd, wake_fd, signal_fd}) {
+        if (fd >= 0) close(fd);
+    }
+    // Any termination signal that arrived while nothing was waiting is delivered here
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+}
+
+pid_t PosixProcSpawner::start_process(std::vector<std::string>& cmd, int out_fd) const {
     std::vector<char*> raw_args;
     raw_args.reserve(cmd.size());
     for (std::string& s : cmd) {
@@ -13,13 +100,48 @@ int PosixProcSpawner::run(std::vector<std::string>& cmd) try {
     }
     raw_args.push_back(nullptr);
 
+    // Children must not inherit a blocked SIGCHLD from the fallback reaper
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    // A new process group led by the child, so the whole group can be signalled when cancelling
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+    }
+
+    std::vector<char*> raw_env;
+    if (!env.empty()) {
+        for (const std::string& entry : env) {
+            raw_env.push_back(const_cast<char*>(entry.c_str()));
+        }
+        raw_env.push_back(nullptr);
+    }
+
     const char* proc = cmd[0].data();
     pid_t pid;
-    int spawn_res = posix_spawnp(&pid, proc, nullptr, nullptr, raw_args.data(), environ);
+    int spawn_res = posix_spawnp(&pid, proc, &actions, &attr, raw_args.data(),
+                                 env.empty() ? environ : raw_env.data());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
     if (spawn_res != 0) {
+        errno = spawn_res;
         throw SystemError("Process execution failed for command '" + cmd_str(cmd) + "'");
     }
 
+    return pid;
+}
+
+int PosixProcSpawner::run(std::vector<std::string>& cmd) try {
+    const pid_t pid = start_process(cmd);
+
     int status;
     waitpid(pid, &status, 0);
     if (status != 0) {
@@ -31,6 +153,208 @@ int PosixProcSpawner::run(std::vector<std::string>& cmd) try {
     Error::update_and_throw(excep, "Executing command via POSIX spawn");
 }
 
+ProcessId PosixProcSpawner::spawn(std::vector<std::string>& cmd) try {
+    // Only the read end is non-blocking. The child inherits the write end as stdout and stderr
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        throw SystemError("Failed to create output pipe for command '" + cmd_str(cmd) + "'");
+    }
+    fcntl(out_pipe[0], F_SETFL, O_NONBLOCK);
+
+    pid_t pid;
+    try {
+        pid = start_process(cmd, out_pipe[1]);
+    } catch (...) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        throw;
+    }
+    // Only the child may hold the write end, otherwise the pipe never reaches EOF
+    close(out_pipe[1]);
+
+    RunningProcess proc{pid, -1, out_pipe[0], cmd_str(cmd),
+                        std::make_shared<OutputBuffer>(output_cap)};
+    if (use_pidfd) {
+        proc.pidfd = open_pidfd(pid);
+        if (proc.pidfd < 0) {
+            abandon(proc);
+            throw SystemError("Failed to open pidfd for command '" + proc.cmd + "'");
+        }
+    }
+
+    std::lock_guard lock(mtx);
+    const ProcessId id = next_id++;
+    epoll_event out_ev{.events = EPOLLIN, .data = {.u64 = id | OUTPUT_KEY_BIT}};
+    epoll_event proc_ev{.events = EPOLLIN, .data = {.u64 = id}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, proc.out_fd, &out_ev) != 0 ||
+        (proc.pidfd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, proc.pidfd, &proc_ev) != 0)) {
+        abandon(proc);
+        throw SystemError("Failed to watch command '" + proc.cmd + "'");
+    }
+    running.emplace(id, std::move(proc));
+
+    return id;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Spawning command via POSIX spawn");
+}
+
+void PosixProcSpawner::abandon(const RunningProcess& proc) {
+    killpg(proc.pid, SIGKILL);
+    while (waitpid(proc.pid, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    close(proc.out_fd);
+    if (proc.pidfd >= 0) close(proc.pidfd);
+}
+
+std::vector<ProcessResult> PosixProcSpawner::wait_any(
+    std::optional<std::chrono::milliseconds> timeout) try {
+    int timeout_ms = timeout.has_value() ? static_cast<int>(timeout->count()) : -1;
+    if (!use_pidfd && (timeout_ms < 0 || timeout_ms > FALLBACK_POLL_MS)) {
+        timeout_ms = FALLBACK_POLL_MS;
+    }
+
+    epoll_event events[MAX_EVENTS];
+    const int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return {};
+        throw SystemError("Waiting for process events failed");
+    }
+
+    std::vector<ProcessResult> results;
+    std::lock_guard lock(mtx);
+    for (int i = 0; i < n; i++) {
+        const uint64_t key = events[i].data.u64;
+        if (key == WAKE_KEY) {
+            uint64_t count;
+            while (read(wake_fd, &count, sizeof(count)) > 0) {
+            }
+            continue;
+        }
+        if (key == SIGNAL_KEY) {
+            signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) > 0) {
+                if (info.ssi_signo != SIGCHLD) {
+                    terminate(static_cast<int>(info.ssi_signo));
+                }
+            }
+            continue;
+        }
+
+        auto itm = running.find(key & ~OUTPUT_KEY_BIT);
+        if (itm == running.end()) continue;
+        if (key & OUTPUT_KEY_BIT) {
+            drain_output(itm->second);
+            continue;
+        }
+
+        // A readable pidfd means the process has exited so this never blocks
+        int status;
+        waitpid(itm->second.pid, &status, 0);
+        close(itm->second.pidfd);
+        results.push_back(make_result(itm->first, itm->second, status));
+        running.erase(itm);
+    }
+
+    if (!use_pidfd) {
+        // SIGCHLD only says that some child exited, so check each of ours without blocking
+        for (auto itm = running.begin(); itm != running.end();) {
+            int status;
+            if (waitpid(itm->second.pid, &status, WNOHANG) == itm->second.pid) {
+                results.push_back(make_result(itm->first, itm->second, status));
+                itm = running.erase(itm);
+            } else {
+                itm++;
+            }
+        }
+    }
+
+    return results;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Waiting for spawned processes");
+}
+
+void PosixProcSpawner::interrupt() {
+    const uint64_t one = 1;
+    [[maybe_unused]] ssize_t res = write(wake_fd, &one, sizeof(one));
+}
+
+void PosixProcSpawner::set_env(const std::string& name, const std::string& value) {
+    std::lock_guard lock(mtx);
+    if (env.empty()) {
+        for (char** entry = environ; *entry != nullptr; entry++) {
+            env.emplace_back(*entry);
+        }
+    }
+
+    const std::string prefix = name + "=";
+    std::erase_if(env, [&](const std::string& entry) { return entry.starts_with(prefix); });
+    env.push_back(prefix + value);
+}
+
+void PosixProcSpawner::cancel(ProcessId id) {
+    std::lock_guard lock(mtx);
+    auto itm = running.find(id);
+    if (itm == running.end()) return;
+
+    // The process is not reaped until it is reported, so it's pid can not have been reused.
+    // SIGTERM rather than SIGKILL so compilers can remove their partially written outputs
+    killpg(itm->second.pid, SIGTERM);
+}
+
+void PosixProcSpawner::terminate(int sig) {
+    for (const auto& [id, proc] : running) {
+        killpg(proc.pid, SIGTERM);
+    }
+
+    signal(sig, SIG_DFL);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, sig);
+    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+    raise(sig);
+    std::_Exit(128 + sig);
+}
+
+void PosixProcSpawner::drain_output(RunningProcess& proc) const {
+    if (proc.out_fd < 0) return;
+
+    std::array<char, 1 << 16> chunk;
+    while (true) {
+        const ssize_t n = read(proc.out_fd, chunk.data(), chunk.size());
+        if (n > 0) {
+            proc.output->append(std::string_view(chunk.data(), static_cast<size_t>(n)));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // End of file or an unrecoverable error. Closing also removes it from the epoll set
+        close(proc.out_fd);
+        proc.out_fd = -1;
+        break;
+    }
+}
+
+ProcessResult PosixProcSpawner::make_result(ProcessId id, RunningProcess& proc, int status) const {
+    // Everything the process wrote before exiting is already in the pipe. Anything still holding
+    // the write end (e.g. a daemonised grandchild) is not waited for
+    drain_output(proc);
+    if (proc.out_fd >= 0) close(proc.out_fd);
+
+    const int code = decode_status(status);
+    if (code == 0) {
+        return ProcessResult{id, 0, nullptr, proc.output};
+    }
+
+    // A failing command is not a failed system call, so don't report a stale errno from the loop
+    errno = 0;
+    SystemError err("Process execution failed for command '" + proc.cmd + "' (exit status " +
+                    std::to_string(code) + ")");
+    err.add_ctx("Executing command via POSIX spawn");
+    err.set_what_str(err.format());
+    return ProcessResult{id, code, std::make_exception_ptr(err), proc.output};
+}
+
 std::string PosixProcSpawner::cmd_str(const std::vector<std::string>& cmd) const {
     std::string str;
     for (const std::string& tok : cmd) {
@@ -1,9 +1,43 @@
 #ifndef proc_spawner_H
 #define proc_spawner_H
 
+#include <signal.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "output_buffer.hpp"
+
+/** Identifies a process started with ProcessSpawner::spawn */
+using ProcessId = uint64_t;
+
+/** The outcome of a process started with ProcessSpawner::spawn */
+struct ProcessResult {
+    ProcessId id;
+    /** The exit status of the process */
+    int status;
+    /** Set if and only if the process did not exit successfully */
+    std::exception_ptr err;
+    /** Everything the process wrote to stdout and stderr. Not set if output is not captured */
+    std::shared_ptr<const OutputBuffer> output;
+};
+
+/** The files a command run elsewhere reads and writes, as they must be sent there and back */
+struct RemoteFiles {
+    /** Relative to the directory the build runs in */
+    std::vector<std::string> inputs;
+    /** Relative to the directory the build runs in. Those the command does not write are skipped */
+    std::vector<std::string> outputs;
+};
+
 /** Interface between program and processes. Primarily useful for enabling dependency injection */
 class ProcessSpawner {
    public:
@@ -17,15 +51,151 @@ class ProcessSpawner {
      * @throws If there is an error spawning the process
      */
     virtual int run(std::vector<std::string>& cmd) = 0;
+
+    /**
+     * @brief Start a process without waiting for it. It's completion is reported by 'wait_any'
+     *
+     * @param cmd The command tokens to run
+     * @return ProcessId A handle identifying the process in the results of 'wait_any'
+     * @throws If the process cannot be spawned
+     */
+    virtual ProcessId spawn(std::vector<std::string>& cmd) = 0;
+
+    /**
+     * @brief Block until at least one spawned process finishes, the timeout expires or another
+     * thread calls 'interrupt'. A single thread can drive any number of processes this way
+     *
+     * @param timeout The longest time to block for. Blocks indefinitely if not set
+     * @return The results of every process that finished. May be empty
+     */
+    virtual std::vector<ProcessResult> wait_any(
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) = 0;
+
+    /** Wake a thread blocked in 'wait_any'. Safe to call from any thread */
+    virtual void interrupt() = 0;
+
+    /**
+     * Stop a spawned process and everything it started. It's result is still reported by
+     * 'wait_any'. Does nothing if the process has already been reported
+     */
+    virtual void cancel(ProcessId id) = 0;
+
+    /**
+     * The number of commands that may run elsewhere at once through 'spawn_remote', on top of
+     * those spawned locally. Zero unless the spawner has somewhere else to run commands
+     */
+    virtual size_t remote_capacity() const { return 0; }
+
+    /**
+     * @brief Start a command elsewhere without waiting for it. It's inputs are sent along with
+     * it, and it's outputs are written back before it's completion is reported by 'wait_any'
+     *
+     * @param cmd The command tokens to run
+     * @param files The files the command reads and writes
+     * @return ProcessId A handle identifying the command in the results of 'wait_any'
+     * @throws If the spawner has no remote capacity
+     */
+    virtual ProcessId spawn_remote(std::vector<std::string>& cmd, const RemoteFiles& files);
 };
 
+/**
+ * Spawns processes with the POSIX spawn API. Completions are reported through a single epoll
+ * instance watching a pidfd per process. On kernels without pidfd_open, a signalfd receiving
+ * SIGCHLD is watched instead. The stdout and stderr of spawned processes are connected to a pipe
+ * that is drained by the same event loop, so their output can be reported in one piece.
+ *
+ * Every process is started in it's own process group so that cancelling it also stops anything it
+ * started. As those groups no longer receive the terminal's signals, SIGINT, SIGTERM and SIGHUP
+ * are also received through the event loop. They terminate every running process group before
+ * the signal is re-raised with it's default action.
+ * @note Construct before starting any other threads so the signals can be blocked in all of them
+ */
 class PosixProcSpawner : public ProcessSpawner {
    public:
+    /** @param output_cap Bytes of output held in memory per process before spilling to disk */
+    explicit PosixProcSpawner(size_t output_cap = OutputBuffer::DEFAULT_CAP);
+
+    ~PosixProcSpawner() override;
+
+    PosixProcSpawner(const PosixProcSpawner&) = delete;
+    PosixProcSpawner& operator=(const PosixProcSpawner&) = delete;
+
     int run(std::vector<std::string>& cmd) override;
 
+    ProcessId spawn(std::vector<std::string>& cmd) override;
+
+    std::vector<ProcessResult> wait_any(
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+
+    void interrupt() override;
+
+    void cancel(ProcessId id) override;
+
+    /**
+     * Set an environment variable for every process spawned from now on, without changing the
+     * environment of this process (e.g. MAKEFLAGS advertising a jobserver)
+     */
+    void set_env(const std::string& name, const std::string& value);
+
    private:
+    struct RunningProcess {
+        pid_t pid;
+        /** -1 when reaping through the SIGCHLD fallback */
+        int pidfd;
+        /** The read end of the process's output pipe. -1 once it has been closed */
+        int out_fd;
+        std::string cmd;
+        std::shared_ptr<OutputBuffer> output;
+    };
+
+    /** epoll user data for the non-process file descriptors */
+    constexpr static uint64_t WAKE_KEY = 0;
+    constexpr static uint64_t SIGNAL_KEY = UINT64_MAX;
+    /** Set in the epoll user data of output pipes, which otherwise hold the process id */
+    constexpr static uint64_t OUTPUT_KEY_BIT = uint64_t{1} << 63;
+    constexpr static int MAX_EVENTS = 64;
+    /** Signals that stop the build, terminating every running process first */
+    constexpr static int TERMINATION_SIGNALS[] = {SIGINT, SIGTERM, SIGHUP};
+    /** Signals can be coalesced or lost to other threads, so the fallback also polls */
+    constexpr static int FALLBACK_POLL_MS = 50;
+
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int signal_fd = -1;
+    bool use_pidfd = false;
+    size_t output_cap;
+    /** "NAME=value" entries passed to children. The inherited environment is used if empty */
+    std::vector<std::string> env;
+    /** The signal mask of the constructing thread before the spawner's signals were blocked */
+    sigset_t old_mask;
+
+    std::mutex mtx;
+    std::unordered_map<ProcessId, RunningProcess> running;
+    ProcessId next_id = 1;
+
+    /**
+     * Spawn the process for a command and return it's pid
+     * @param out_fd If set, the process's stdout and stderr are redirected to it
+     */
+    pid_t start_process(std::vector<std::string>& cmd, int out_fd = -1) const;
+
+    /**
+     * Kill and reap a started process that could not be tracked, closing it's descriptors, so
+     * it is neither left running out of reach nor left as a zombie
+     */
+    static void abandon(const RunningProcess& proc);
+
+    /** Terminate every running process group, then die from a received termination signal */
+    [[noreturn]] void terminate(int sig);
+
+    /** Read everything currently available from a process's output pipe without blocking */
+    void drain_output(RunningProcess& proc) const;
+
+    /** Build the result for a process that has been reaped, collecting the last of it's output */
+    ProcessResult make_result(ProcessId id, RunningProcess& proc, int status) const;
+
     /** Join the command into a single space separated string */
     std::string cmd_str(const std::vector<std::string>& cmd) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,146 @@
+#include "stat_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include "../errors/error.hpp"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/syscall.h"
+#include "unistd.h"
+
+namespace {
+// Called directly as glibc provides no wrappers and liburing is not a dependency
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* at_offset(void* base, size_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+}  // namespace
+
+std::unique_ptr<StatRing> StatRing::create(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const int fd = io_uring_setup(entries, &params);
+    if (fd < 0) return nullptr;
+
+    std::unique_ptr<StatRing> ring(new StatRing());
+    ring->ring_fd = fd;
+    // Statx arrived in 5.6, the same release as this feature. Older kernels would fail every query
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) return nullptr;
+
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        ring->sq_ring_len = std::max(ring->sq_ring_len, ring->cq_ring_len);
+    }
+
+    ring->sq_ring = mmap(nullptr, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = nullptr;
+        return nullptr;
+    }
+    if (single_mmap) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(nullptr, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = nullptr;
+            return nullptr;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return nullptr;
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head = at_offset<unsigned>(ring->sq_ring, params.sq_off.head);
+    ring->sq_tail = at_offset<unsigned>(ring->sq_ring, params.sq_off.tail);
+    ring->sq_mask = at_offset<unsigned>(ring->sq_ring, params.sq_off.ring_mask);
+    ring->sq_array = at_offset<unsigned>(ring->sq_ring, params.sq_off.array);
+    ring->cq_head = at_offset<unsigned>(ring->cq_ring, params.cq_off.head);
+    ring->cq_tail = at_offset<unsigned>(ring->cq_ring, params.cq_off.tail);
+    ring->cq_mask = at_offset<unsigned>(ring->cq_ring, params.cq_off.ring_mask);
+    ring->cqes = at_offset<io_uring_cqe>(ring->cq_ring, params.cq_off.cqes);
+    return ring;
+}
+
+StatRing::~StatRing() {
+    if (sqes != nullptr) munmap(sqes, sqes_len);
+    if (cq_ring != nullptr && cq_ring != sq_ring) munmap(cq_ring, cq_ring_len);
+    if (sq_ring != nullptr) munmap(sq_ring, sq_ring_len);
+    if (ring_fd >= 0) close(ring_fd);
+}
+
+void StatRing::statx_all(std::span<const std::string> filenames, std::span<struct statx> out,
+                         std::span<int> errors) try {
+    // The kernel reads the tails and writes the heads shared with us, so they are accessed
+    // atomically to order them with the entries they guard
+    std::atomic_ref<unsigned> sq_tail_ref(*sq_tail);
+    std::atomic_ref<unsigned> cq_head_ref(*cq_head);
+    std::atomic_ref<unsigned> cq_tail_ref(*cq_tail);
+
+    size_t queued = 0;
+    size_t completed = 0;
+    unsigned unsubmitted = 0;
+    unsigned in_flight = 0;
+    while (completed < filenames.size()) {
+        // The completion queue is at least as large as the submission queue, so keeping no more
+        // than a submission queue's worth in flight means completions are never dropped
+        unsigned tail = sq_tail_ref.load(std::memory_order_relaxed);
+        while (in_flight < sq_entries && queued < filenames.size()) {
+            const unsigned slot = tail & *sq_mask;
+            io_uring_sqe& sqe = sqes[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_STATX;
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<uint64_t>(filenames[queued].c_str());
+            sqe.len = STATX_MTIME;
+            sqe.addr2 = reinterpret_cast<uint64_t>(&out[queued]);
+            sqe.user_data = queued;
+            sq_array[slot] = slot;
+
+            tail++;
+            queued++;
+            unsubmitted++;
+            in_flight++;
+        }
+        sq_tail_ref.store(tail, std::memory_order_release);
+
+        const int submitted = io_uring_enter(ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            throw SystemError("Failed to submit file queries");
+        }
+        unsubmitted -= static_cast<unsigned>(submitted);
+
+        unsigned head = cq_head_ref.load(std::memory_order_relaxed);
+        const unsigned ready = cq_tail_ref.load(std::memory_order_acquire);
+        for (; head != ready; head++) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            errors[cqe.user_data] = cqe.res < 0 ? -cqe.res : 0;
+            completed++;
+            in_flight--;
+        }
+        cq_head_ref.store(head, std::memory_order_release);
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Querying files through io_uring");
+}
@@ -0,0 +1,64 @@
+#ifndef STAT_RING_H
+#define STAT_RING_H
+
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+
+/**
+ * An io_uring instance used to 'statx' many files at once. Every query is submitted before
+ * waiting for any of them, so their latency overlaps rather than adds up (which matters most on
+ * network and overlay file systems)
+ */
+class StatRing {
+   public:
+    /**
+     * Set up a ring
+     * @param entries The most queries in flight at once
+     * @returns The ring, or nullptr if io_uring or it's statx operation is unavailable (e.g.
+     * kernels before 5.6, or blocked by a seccomp filter)
+     */
+    static std::unique_ptr<StatRing> create(unsigned entries);
+
+    ~StatRing();
+
+    StatRing(const StatRing&) = delete;
+    StatRing& operator=(const StatRing&) = delete;
+
+    /**
+     * Query the write time of every file
+     * @param filenames The files to query
+     * @param out Filled with the result of querying each file
+     * @param errors Filled with the errno of each query, or 0 if it succeeded
+     * @throws If the ring itself fails
+     */
+    void statx_all(std::span<const std::string> filenames, std::span<struct statx> out,
+                   std::span<int> errors);
+
+   private:
+    StatRing() = default;
+
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    size_t sq_ring_len = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_len = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_len = 0;
+
+    unsigned sq_entries = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+};
+
+#endif
@@ -8,6 +8,10 @@
 
 Lexer::Lexer(const std::string input) { src = FileUtils::read_all(input); }
 
+Lexer::Lexer(Contents contents) : src(std::move(contents.src)) {}
+
+Lexer Lexer::from_contents(std::string contents) { return Lexer(Contents{std::move(contents)}); }
+
 std::vector<Lexeme> Lexer::lex() try {
     std::vector<Lexeme> lexemes;
     loc = Location{.line_no = 1, .col_no = 1, .file_idx = 0};
@@ -42,10 +42,20 @@ class Lexer {
      */
     Lexer(const std::string input = DEFAULT_SRC_FILE_NAME);
 
+    /** Lex contents already read from a file, so they are known to be what was lexed */
+    static Lexer from_contents(std::string contents);
+
     /** Convert a file to lexemes */
     std::vector<Lexeme> lex();
 
    private:
+    /** Distinguishes contents from the name of a file to read them from */
+    struct Contents {
+        std::string src;
+    };
+
+    explicit Lexer(Contents contents);
+
     constexpr static char BLOCK_START = '{';
     constexpr static char BLOCK_END = '}';
     constexpr static char LIST_START = '[';
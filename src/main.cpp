@@ -1,19 +1,349 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "build_orchestrator.hpp"
+#include "concurrency/jobserver.hpp"
+#include "concurrency/load_monitor.hpp"
+#include "daemon/build_daemon.hpp"
+#include "history/artifact_cache.hpp"
+#include "history/build_log.hpp"
+#include "history/deps_log.hpp"
+#include "history/duration_history.hpp"
+#include "history/hash_database.hpp"
+#include "history/state_paths.hpp"
+#include "io/caching_fs_gateway.hpp"
+#include "io/file_watcher.hpp"
 #include "io/fs_gateway.hpp"
 #include "io/proc_spawner.hpp"
+#include "remote/remote_spawner.hpp"
+#include "remote/remote_store.hpp"
+#include "rule_runner.hpp"
+#include "variable_evaluator.hpp"
+
+/** The remote slots given to each '--worker' unless '--remote-jobs' says otherwise */
+constexpr size_t DEFAULT_REMOTE_JOBS = 4;
+
+/**
+ * How often a watching build checks for termination signals, which the process spawner blocks and
+ * only takes while waiting on jobs
+ */
+constexpr std::chrono::milliseconds SIGNAL_RECHECK{100};
+
+/** Parse the value of a job count flag (e.g. the "8" in "-j 8") */
+size_t parse_job_count(const std::string& val) {
+    size_t parsed_len = 0;
+    int jobs = 0;
+    try {
+        jobs = std::stoi(val, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len != val.size() || jobs < 1) {
+        throw std::invalid_argument("Invalid job count '" + val + "'. Must be a positive integer");
+    }
+    return static_cast<size_t>(jobs);
+}
+
+/** Parse the value of '--cache-size' in MiB (e.g. the "512" in "--cache-size=512") */
+uint64_t parse_cache_size(const std::string& val) {
+    size_t parsed_len = 0;
+    unsigned long long mib = 0;
+    try {
+        mib = std::stoull(val, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len != val.size() || val.starts_with('-')) {
+        throw std::invalid_argument("Invalid cache size '" + val + "'. Must be a size in MiB");
+    }
+    return static_cast<uint64_t>(mib) << 20;
+}
+
+/** Parse the value of '--jobserver-style' */
+JobServer::Style parse_jobserver_style(const std::string& val) {
+    if (val == "fifo") return JobServer::Style::FIFO;
+    if (val == "pipe") return JobServer::Style::PIPE;
+    throw std::invalid_argument("Invalid jobserver style '" + val + "'. Must be 'fifo' or 'pipe'");
+}
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::string use_one = "<" + std::string(argv[0]) + "> <file>" + "<rule> ...";
-        throw std::invalid_argument("Invalid CLI arguments. Usage:\n <" + use_one);
+    const std::string usage = "<" + std::string(argv[0]) +
+                              "> [-j <jobs>] [-k] [--content-hash] [--restat] [--cache] "
+                              "[--cache-size=<MiB>] [--remote-cache=<host:port|unix:path>] "
+                              "[--worker=<host:port|unix:path> ...] [--remote-jobs=<N>] "
+                              "[--jobserver-style=fifo|pipe] [--watch | --server] <file> "
+                              "<rule> ...";
+
+    RunnerOptions opts;
+    opts.max_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+    JobServer::Style jobserver_style = JobServer::Style::FIFO;
+    bool content_hash = false;
+    bool use_cache = false;
+    bool watch = false;
+    bool serve = false;
+    uint64_t cache_size = ArtifactCache::DEFAULT_MAX_BYTES;
+    std::shared_ptr<RemoteStore> remote;
+    std::vector<Endpoint> workers;
+    std::optional<size_t> remote_jobs;
+    // Every flag as it was given, which a build server must have been started with to build for us
+    std::vector<std::string> options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const int first = i;
+        if (arg == "-j") {
+            if (i + 1 == argc) {
+                throw std::invalid_argument("Missing value for '-j'. Usage:\n " + usage);
+            }
+            opts.max_jobs = parse_job_count(argv[++i]);
+        } else if (arg.starts_with("-j")) {
+            opts.max_jobs = parse_job_count(arg.substr(2));
+        } else if (arg == "-k") {
+            opts.keep_going = true;
+        } else if (arg == "--content-hash") {
+            content_hash = true;
+        } else if (arg == "--restat") {
+            opts.restat = true;
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg.starts_with("--cache-size=")) {
+            cache_size = parse_cache_size(arg.substr(arg.find('=') + 1));
+        } else if (arg.starts_with("--remote-cache=")) {
+            // Builds fetched remotely are restored through the local cache, so it is implied
+            use_cache = true;
+            remote = std::make_shared<HttpRemoteStore>(
+                Endpoint::parse(arg.substr(arg.find('=') + 1)));
+        } else if (arg.starts_with("--worker=")) {
+            workers.push_back(Endpoint::parse(arg.substr(arg.find('=') + 1)));
+        } else if (arg.starts_with("--remote-jobs=")) {
+            remote_jobs = parse_job_count(arg.substr(arg.find('=') + 1));
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--server") {
+            serve = true;
+            continue;
+        } else if (arg.starts_with("--jobserver-style=")) {
+            jobserver_style = parse_jobserver_style(arg.substr(arg.find('=') + 1));
+        } else {
+            positional.push_back(arg);
+            continue;
+        }
+        options.insert(options.end(), argv + first, argv + i + 1);
+    }
+
+    if (positional.empty()) {
+        throw std::invalid_argument("Invalid CLI arguments. Usage:\n " + usage);
+    }
+    const std::string src = positional[0];
+    // Every target is built in one schedule so shared dependencies are only visited once
+    const std::vector<std::string> targets(positional.begin() + 1, positional.end());
+    options.push_back(src);
+    if (serve && (watch || !targets.empty())) {
+        throw std::invalid_argument("'--server' takes no rules and can't watch, as clients ask "
+                                    "for builds. Usage:\n " + usage);
+    }
+
+    // A build server in this directory already has everything below loaded, so nothing else is
+    // read or started before handing it the build
+    const Endpoint server_endpoint = Endpoint::parse("unix:" + StatePaths::SERVER_SOCKET.string());
+    if (!serve && std::filesystem::exists(StatePaths::SERVER_SOCKET)) {
+        const std::optional<bool> built =
+            build_on_daemon(server_endpoint, DaemonRequest{options, targets}, std::cout);
+        if (built.has_value()) {
+            return *built ? 0 : 1;
+        }
+    }
+
+    opts.planning_workers = opts.max_jobs;
+    opts.history = std::make_shared<DurationHistory>(StatePaths::DURATIONS);
+    opts.build_log = std::make_shared<BuildLog>(StatePaths::BUILD_LOG);
+    opts.deps_log = std::make_shared<DepsLog>(StatePaths::DEPS_LOG);
+    opts.load_monitor = std::make_shared<PressureLoadMonitor>();
+    if (content_hash) {
+        opts.hashes = std::make_shared<HashDatabase>(StatePaths::HASHES);
     }
+    if (use_cache) {
+        opts.cache = std::make_shared<ArtifactCache>(StatePaths::CACHE, cache_size, remote);
+    }
+
+    // The spawner blocks signals for the whole process, so it must exist before any other thread
+    auto spawner = std::make_shared<PosixProcSpawner>();
+
+    // Under a parent make the job limit is shared with the rest of the build. At the top level we
+    // serve tokens ourselves, so nested builds started by rules share our limit instead of adding
+    // their own on top
+    const char* inherited = std::getenv("MAKEFLAGS");
+    const std::string makeflags = inherited == nullptr ? "" : inherited;
+    std::unique_ptr<JobServer> server;
+    try {
+        opts.jobserver = JobServerClient::from_makeflags(makeflags);
+        if (opts.jobserver == nullptr && opts.max_jobs > 1) {
+            server = std::make_unique<JobServer>(opts.max_jobs, jobserver_style);
+            const std::string advertised = server->makeflags();
+            spawner->set_env("MAKEFLAGS",
+                             makeflags.empty() ? advertised : makeflags + " " + advertised);
+            opts.jobserver = JobServerClient::from_makeflags(advertised);
+        }
+    } catch (const std::exception& excep) {
+        // As make does when it can't reach the jobserver
+        std::cerr << "Warning: " << excep.what() << "\nRunning one job at a time" << std::endl;
+        opts.jobserver = nullptr;
+        opts.max_jobs = 1;
+    }
+
+    // Remote slots come on top of '-j', as the jobs they hold run on the workers' machines
+    std::shared_ptr<ProcessSpawner> runner = spawner;
+    if (!workers.empty()) {
+        const size_t slots = remote_jobs.value_or(DEFAULT_REMOTE_JOBS * workers.size());
+        runner = std::make_shared<RemoteProcSpawner>(spawner, workers, slots);
+    }
+
+    // Each file is queried once per build, however many rules depend on it. When watching or
+    // serving, the queries are also kept between builds, and only the files that changed are
+    // queried again
+    auto fs = std::make_shared<CachingFSGateway>(std::make_shared<ProdFSGateway>());
+
+    // When watching or serving, each variable's value is kept between loads, so an edit to the
+    // configuration or a listed directory only evaluates again the variables it affects
+    RetainedVars retained;
+    // Errors evaluating the configuration are reported as it is loaded, leaving nothing to build
+    auto load = [&]() -> std::unique_ptr<BuildOrchestrator> {
+        try {
+            return std::make_unique<BuildOrchestrator>(fs, runner, src, opts, StatePaths::COMPILED,
+                                                       watch || serve ? &retained : nullptr);
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    };
+    std::unique_ptr<BuildOrchestrator> orchestrator;
+
+    auto build = [&](const std::vector<std::string>& rules, std::ostream& out) {
+        const bool succeeded = orchestrator != nullptr && orchestrator->run_rules(rules);
+
+        opts.history->save();
+        opts.build_log->compact_if_needed();
+        opts.deps_log->compact_if_needed();
+        if (opts.hashes != nullptr) {
+            opts.hashes->save();
+        }
+        if (opts.cache != nullptr) {
+            opts.cache->trim();
+            const CacheStats stats = opts.cache->stats();
+            out << "Artifact cache: " << stats.hits << " hit(s), " << stats.misses
+                << " miss(es), " << stats.stores << " stored";
+            if (opts.cache->has_remote()) {
+                out << ". Remote: " << stats.remote_hits << " hit(s), " << stats.uploads
+                    << " uploaded, " << stats.remote_errors << " error(s)";
+            }
+            out << std::endl;
+        }
+        return succeeded;
+    };
+
+    if (!watch && !serve) {
+        orchestrator = load();
+        return build(targets, std::cout) ? 0 : 1;
+    }
+
+    // Every file queried is watched, so a query is kept until the file changes. The configuration
+    // is watched before it is first read, so no edit to it can be missed. The state directory is
+    // made first, so making it isn't taken for a change to a directory listing it
+    std::filesystem::create_directories(StatePaths::ROOT);
+    FileWatcher watcher;
+    watcher.watch({src});
+    std::unordered_set<std::string> watched = {src};
+    // Compiles can read different headers after every build, so the files are found again. The
+    // directories listed by 'files' are watched too, so a source added to one is built
+    auto watch_queried = [&] {
+        std::vector<std::string> files = fs->cached_files();
+        files.push_back(src);
+        std::vector<FileWatcher::Listing> listings;
+        if (orchestrator != nullptr) {
+            for (const ListedDir& dir : orchestrator->get_listed()) {
+                listings.push_back(FileWatcher::Listing{dir.path, dir.extensions});
+            }
+        }
+        watcher.watch(files, listings);
+        // Files first queried by this build could have changed before their watch started, so
+        // they are queried again and those that did are returned
+        std::vector<std::string> missed;
+        for (const std::string& file : files) {
+            if (!watched.contains(file) && fs->refresh(file)) {
+                missed.push_back(file);
+            }
+        }
+        watched = std::unordered_set<std::string>(files.begin(), files.end());
+        return missed;
+    };
+
+    if (serve) {
+        std::unique_ptr<BuildDaemon> daemon;
+        daemon = std::make_unique<BuildDaemon>(server_endpoint, options, [&](const auto& rules) {
+            std::vector<std::string> changed = watcher.wait(std::chrono::milliseconds(0));
+            const std::vector<std::string>& unwatched = watcher.get_unwatched();
+            changed.insert(changed.end(), unwatched.begin(), unwatched.end());
+            for (const std::string& file : changed) {
+                fs->invalidate(file);
+            }
+            if (orchestrator == nullptr || std::ranges::find(changed, src) != changed.end() ||
+                orchestrator->listing_changed()) {
+                orchestrator = load();
+            }
+            const bool succeeded = build(rules, daemon->get_output());
+            watch_queried();
+            return succeeded;
+        });
+        // Job output and errors reach the client of the build running when they are written
+        opts.job_output = &daemon->get_output();
+
+        std::jthread serving([&] { daemon->serve(); });
+        std::cout << "Serving builds of '" << src << "' on " << server_endpoint.to_string()
+                  << std::endl;
+        while (true) {
+            if (!daemon->run_next(SIGNAL_RECHECK)) {
+                spawner->wait_any(std::chrono::milliseconds(0));
+            }
+        }
+    }
+
+    // The evaluated rules and every file query stay in memory, so a rebuild starts straight from
+    // the changed files without lexing, parsing or querying the rest of the tree again
+    orchestrator = load();
+    build(targets, std::cout);
+    while (true) {
+        std::vector<std::string> changed = watch_queried();
+        std::cout << "Watching for changes..." << std::endl;
 
-    const std::string src = argv[1];
-    BuildOrchestrator orchestrator(std::make_shared<ProdFSGateway>(),
-                                   std::make_shared<PosixProcSpawner>(), src);
-    for (int i = 2; i < argc; i++) {
-        orchestrator.run_rule(argv[i]);
+        // Outputs the build wrote are reported too, but were queried again once written, so only
+        // files whose write time differs from the one remembered start a rebuild. Listed
+        // directories are only reported for entries listing them again would find
+        while (changed.empty()) {
+            changed = watcher.wait(SIGNAL_RECHECK);
+            spawner->wait_any(std::chrono::milliseconds(0));
+            std::erase_if(changed, [&](const std::string& file) {
+                return watched.contains(file) && !fs->refresh(file);
+            });
+        }
+        for (const std::string& file : watcher.get_unwatched()) {
+            fs->invalidate(file);
+        }
+        std::cout << changed.size() << " file(s) changed, starting with '" << changed.front()
+                  << "'. Rebuilding" << std::endl;
+        if (orchestrator == nullptr || std::ranges::find(changed, src) != changed.end() ||
+            orchestrator->listing_changed()) {
+            orchestrator = load();
+        }
+        build(targets, std::cout);
     }
-}
\ No newline at end of file
+}
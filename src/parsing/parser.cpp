@@ -5,8 +5,21 @@
 #include <string>
 
 #include "../errors/error.hpp"
+#include "../io/content_hash.hpp"
 #include "../lexer.hpp"
 
+namespace {
+uint64_t fingerprint(const VarLexemes& var) {
+    std::string key = std::to_string(static_cast<int>(var.category));
+    for (const Lexeme& lex : var.lexemes) {
+        // Length prefixed, so no two different sequences of lexemes give the same key
+        key += ' ' + std::to_string(static_cast<int>(lex.type)) + ':' +
+               std::to_string(lex.value.size()) + ':' + lex.value;
+    }
+    return content_hash(key);
+}
+}  // namespace
+
 Parser::Parser(std::vector<Lexeme> _lexemes) : lexemes(_lexemes) {};
 
 std::vector<ParsedVariable> Parser::parse() try {
@@ -30,8 +43,9 @@ std::vector<ParsedVariable> Parser::parse() try {
 
     std::vector<ParsedVariable> var_exprs;
     for (VarLexemes v : var_lexes) {
+        const uint64_t var_fingerprint = fingerprint(v);
         change_lexeme_source(std::move(v.lexemes));
-        var_exprs.push_back({v.identifier, parse_expr(), v.category, v.start_loc});
+        var_exprs.push_back({v.identifier, parse_expr(), v.category, v.start_loc, var_fingerprint});
     }
     return var_exprs;
 } catch (std::exception& excep) {
@@ -91,7 +105,7 @@ std::vector<Lexeme> Parser::consume_dict_lexemes() try {
 
     while (!open_paren_locs.empty() && !at_end()) {
         if (match_type({LexemeType::BLOCK_START})) {
-            open_paren_locs.push_back(consume(LexemeType::BLOCK_START).loc);
+            open_paren_locs.push_back(peek().loc);
         } else if (match_type({LexemeType::BLOCK_END})) {
             if (open_paren_locs.empty()) {
                 throw SyntaxError("Closing parenthesis without opening parenthesis", peek().loc);
@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -28,6 +29,11 @@ struct ParsedVariable {
     std::unique_ptr<Expr> expr;
     VarCategory category;
     Location loc;
+    /**
+     * A hash of the category and every lexeme of the expression, ignoring where they are. Equal
+     * for variables written the same way
+     */
+    uint64_t fingerprint = 0;
 };
 
 class Parser {
@@ -0,0 +1,193 @@
+#include "build_worker.hpp"
+
+#include <algorithm>
+
+#include "../errors/error.hpp"
+#include "../history/artifact_cache.hpp"
+#include "../io/file_utils.hpp"
+#include "fcntl.h"
+#include "spawn.h"
+#include "sys/wait.h"
+#include "unistd.h"
+
+namespace {
+/** Whether a path stays inside the directory it is relative to, so a job can't escape it */
+bool is_contained(const std::string& path) {
+    const std::filesystem::path rel(path);
+    if (path.empty() || rel.is_absolute()) return false;
+    return std::ranges::none_of(rel, [](const std::filesystem::path& part) {
+        return part == "..";
+    });
+}
+
+bool is_object_name(const std::string& name) {
+    return !name.empty() && name.find('/') == std::string::npos && name != "." && name != "..";
+}
+
+/** Releases a slot once the job holding it is done, however it finishes */
+template <typename Semaphore>
+struct SlotGuard {
+    Semaphore& slots;
+    ~SlotGuard() { slots.release(); }
+};
+}  // namespace
+
+BuildWorker::BuildWorker(std::filesystem::path _dir, Endpoint endpoint, size_t jobs) try
+    : HttpServer(std::move(endpoint)),
+      dir(std::move(_dir)),
+      slots(std::clamp<ptrdiff_t>(static_cast<ptrdiff_t>(jobs), 1, MAX_JOBS)) {
+    // Inputs are only kept for the lifetime of the worker, as builds send them again if missing.
+    // Only the worker's own directories are emptied, never anything else kept in dir
+    for (const char* own : {"objects", "jobs"}) {
+        std::filesystem::remove_all(dir / own);
+        std::filesystem::create_directories(dir / own);
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Starting build worker");
+}
+
+BuildWorker::~BuildWorker() { close_connections(); }
+
+HttpResponse BuildWorker::handle(const HttpRequest& request) try {
+    if (request.target == "/run") {
+        if (request.method != "POST") return HttpResponse{405, ""};
+        RemoteJob job;
+        try {
+            job = decode_job(request.body);
+        } catch (const std::exception&) {
+            return HttpResponse{400, ""};
+        }
+        return HttpResponse{200, encode_result(run(job))};
+    }
+
+    if (!request.target.starts_with("/cas/") || !is_object_name(request.target.substr(5))) {
+        return HttpResponse{404, ""};
+    }
+    const std::string object = request.target.substr(5);
+    const std::filesystem::path path = dir / "objects" / object;
+    if (request.method == "HEAD" || request.method == "GET") {
+        if (!std::filesystem::exists(path)) return HttpResponse{404, ""};
+        return HttpResponse{200, request.method == "GET" ? FileUtils::read_all(path) : ""};
+    }
+    if (request.method == "PUT") {
+        if (!ArtifactCache::is_object_of(object, request.body)) return HttpResponse{400, ""};
+        FileUtils::write_atomically(path, request.body);
+        return HttpResponse{201, ""};
+    }
+    return HttpResponse{405, ""};
+} catch (const std::exception&) {
+    return HttpResponse{500, ""};
+}
+
+RemoteResult BuildWorker::run(const RemoteJob& job) {
+    slots.acquire();
+    SlotGuard<decltype(slots)> guard{slots};
+
+    const std::filesystem::path scratch = dir / "jobs" / std::to_string(next_job++);
+    RemoteResult result;
+    try {
+        if (job.cmd.empty()) {
+            throw ValueError("Empty command");
+        }
+        std::filesystem::create_directories(scratch);
+        for (const std::string& path : job.outputs) {
+            if (!is_contained(path)) {
+                throw ValueError("Output '" + path + "' is outside the build");
+            }
+            std::filesystem::create_directories((scratch / path).parent_path());
+        }
+        for (const RemoteInput& input : job.inputs) {
+            if (!is_contained(input.path) || !is_object_name(input.object)) {
+                throw ValueError("Input '" + input.path + "' is outside the build");
+            }
+            const std::filesystem::path object = dir / "objects" / input.object;
+            if (!std::filesystem::exists(object)) {
+                throw IOError("Input '" + input.path + "' was not sent");
+            }
+            const std::filesystem::path target = scratch / input.path;
+            std::filesystem::create_directories(target.parent_path());
+            // Copied rather than linked, so a job changing an input can't change the stored one
+            std::filesystem::copy_file(object, target);
+            std::filesystem::permissions(target, input.perms);
+        }
+
+        result.status = run_command(job, scratch, result.output);
+        for (const std::string& path : job.outputs) {
+            const std::filesystem::path output = scratch / path;
+            if (!std::filesystem::is_regular_file(output)) continue;
+            result.files.push_back(RemoteOutput{
+                path, FileUtils::read_all(output),
+                std::filesystem::status(output).permissions() & std::filesystem::perms::mask});
+        }
+    } catch (const std::exception& excep) {
+        result = RemoteResult{-1, excep.what(), {}};
+    }
+
+    std::error_code err;
+    std::filesystem::remove_all(scratch, err);
+    return result;
+}
+
+int BuildWorker::run_command(const RemoteJob& job, const std::filesystem::path& cwd,
+                             std::string& output) const {
+    int out_fds[2];
+    if (pipe2(out_fds, O_CLOEXEC) != 0) {
+        throw SystemError("Failed to create output pipe");
+    }
+
+    std::vector<std::string> cmd = job.cmd;
+    std::vector<char*> raw_args;
+    for (std::string& arg : cmd) {
+        raw_args.push_back(arg.data());
+    }
+    raw_args.push_back(nullptr);
+    std::vector<char*> raw_env;
+    for (const std::string& entry : job.env) {
+        raw_env.push_back(const_cast<char*>(entry.c_str()));
+    }
+    raw_env.push_back(nullptr);
+
+    // The worker blocks it's shutdown signals to wait for them, which jobs must not inherit
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addchdir_np(&actions, cwd.c_str());
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDERR_FILENO);
+
+    // The program is found on the worker's own PATH, as the job's may not make sense here
+    pid_t pid;
+    const int spawn_res = posix_spawnp(&pid, raw_args[0], &actions, &attr, raw_args.data(),
+                                       job.env.empty() ? environ : raw_env.data());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(out_fds[1]);
+    if (spawn_res != 0) {
+        close(out_fds[0]);
+        errno = spawn_res;
+        throw SystemError("Failed to start '" + job.cmd[0] + "'");
+    }
+
+    char chunk[1 << 14];
+    ssize_t n;
+    while ((n = read(out_fds[0], chunk, sizeof(chunk))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        output.append(chunk, static_cast<size_t>(n));
+    }
+    close(out_fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return status;
+}
@@ -0,0 +1,60 @@
+#ifndef BUILD_WORKER_H
+#define BUILD_WORKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <semaphore>
+#include <string>
+
+#include "http.hpp"
+#include "remote_job.hpp"
+
+/**
+ * Runs jobs sent by other builds over HTTP/1.1. A job's inputs are first sent to "/cas/<object>"
+ * (checked with HEAD and stored with PUT, as on a cache server), so a header shared by many jobs
+ * is only sent once. The job itself is then POSTed to "/run". It runs in a scratch directory
+ * holding it's inputs at their paths in the build, and the outputs it wrote come back in the
+ * response. Compilers and anything else referred to by absolute path are the worker's own
+ */
+class BuildWorker : public HttpServer {
+   public:
+    /**
+     * Start listening
+     * @param dir Where inputs and scratch directories are kept, in it's "objects" and "jobs"
+     * directories. Those are emptied first, anything else in dir is left alone
+     * @param endpoint Where to listen. A TCP port of 0 picks a free port
+     * @param jobs The most jobs run at once. Further jobs wait for one to finish
+     * @throws If the endpoint can not be bound
+     */
+    BuildWorker(std::filesystem::path dir, Endpoint endpoint, size_t jobs);
+
+    ~BuildWorker() override;
+
+    HttpResponse handle(const HttpRequest& request) override;
+
+    /**
+     * Run a job once a slot is free. Failures to set the job up (e.g. a missing input) are
+     * reported in the result rather than thrown, as they are the sending build's to report
+     */
+    RemoteResult run(const RemoteJob& job);
+
+    /** The largest number of jobs a worker runs at once */
+    constexpr static ptrdiff_t MAX_JOBS = 4096;
+
+   private:
+    std::filesystem::path dir;
+    std::counting_semaphore<MAX_JOBS> slots;
+    std::atomic<uint64_t> next_job = 0;
+
+    /**
+     * Run a command in a directory and collect everything it writes to stdout and stderr
+     * @returns The exit status
+     * @throws If the command can not be started
+     */
+    int run_command(const RemoteJob& job, const std::filesystem::path& cwd,
+                    std::string& output) const;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "cache_server.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include "../errors/error.hpp"
+#include "../io/file_utils.hpp"
+
+namespace {
+bool is_hex(const std::string& str) {
+    return !str.empty() && str.size() <= 16 && std::ranges::all_of(str, [](unsigned char c) {
+               return std::isdigit(c) || (c >= 'a' && c <= 'f');
+           });
+}
+
+/** Whether a name could be an object, i.e. "<hex hash>-<size>", so it is safe as a file name */
+bool is_object_name(const std::string& name) {
+    const size_t dash = name.find('-');
+    if (dash == std::string::npos || !is_hex(name.substr(0, dash)) || dash + 1 == name.size()) {
+        return false;
+    }
+    return std::ranges::all_of(name.substr(dash + 1),
+                               [](unsigned char c) { return std::isdigit(c); });
+}
+}  // namespace
+
+CacheServer::CacheServer(std::filesystem::path _dir, Endpoint endpoint, uint64_t _max_bytes) try
+    // No output larger than the whole cache is ever kept, so none is read
+    : HttpServer(std::move(endpoint),
+                 std::min<uint64_t>(_max_bytes, HttpConnection::MAX_BODY)),
+      dir(std::move(_dir)),
+      store(dir, _max_bytes),
+      max_bytes(_max_bytes) {
+    std::filesystem::create_directories(dir / "entries");
+    std::filesystem::create_directories(dir / "objects");
+    store.trim();
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Starting cache server");
+}
+
+CacheServer::~CacheServer() { close_connections(); }
+
+HttpResponse CacheServer::handle(const HttpRequest& request) try {
+    std::filesystem::path path;
+    bool is_entry = false;
+    if (request.target.starts_with("/ac/") && is_hex(request.target.substr(4))) {
+        path = dir / "entries" / request.target.substr(4);
+        is_entry = true;
+    } else if (request.target.starts_with("/cas/") && is_object_name(request.target.substr(5))) {
+        path = dir / "objects" / request.target.substr(5);
+    } else {
+        return HttpResponse{404, ""};
+    }
+
+    if (request.method == "GET" || request.method == "HEAD") {
+        if (!std::filesystem::exists(path)) return HttpResponse{404, ""};
+        if (is_entry) {
+            // The write time of an entry is when it was last used, which trimming goes by
+            std::error_code err;
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(),
+                                             err);
+        }
+        return HttpResponse{200, request.method == "GET" ? FileUtils::read_all(path) : ""};
+    }
+
+    if (request.method == "PUT") {
+        const bool valid = is_entry
+                               ? ArtifactCache::parse_entries(request.body).has_value()
+                               : ArtifactCache::is_object_of(path.filename(), request.body);
+        if (!valid) return HttpResponse{400, ""};
+        FileUtils::write_atomically(path, request.body);
+        trim_if_needed(request.body.size());
+        return HttpResponse{201, ""};
+    }
+
+    return HttpResponse{405, ""};
+} catch (const std::exception&) {
+    return HttpResponse{500, ""};
+}
+
+void CacheServer::trim_if_needed(size_t stored) {
+    if ((stored_bytes += stored) < max_bytes / 8) return;
+
+    std::lock_guard lock(trim_mtx);
+    if (stored_bytes < max_bytes / 8) return;
+    stored_bytes = 0;
+    store.trim();
+}
@@ -0,0 +1,49 @@
+#ifndef CACHE_SERVER_H
+#define CACHE_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+#include "../history/artifact_cache.hpp"
+#include "http.hpp"
+
+/**
+ * A reference remote cache, serving a directory laid out like a local artifact cache over
+ * HTTP/1.1. The builds under each key are read and written at "/ac/<key>", and outputs at
+ * "/cas/<object>" where the object's name is the hash and size of it's contents. GET fetches,
+ * HEAD checks and PUT stores. Outputs whose contents don't match their name are rejected, so a
+ * client can't poison the cache for others
+ */
+class CacheServer : public HttpServer {
+   public:
+    /**
+     * Start listening, trimming the directory back to it's size limit first
+     * @param dir Where builds are stored
+     * @param endpoint Where to listen. A TCP port of 0 picks a free port
+     * @param max_bytes The size the stored outputs are trimmed back to, least recently used first
+     * @throws If the endpoint can not be bound
+     */
+    CacheServer(std::filesystem::path dir, Endpoint endpoint,
+                uint64_t max_bytes = ArtifactCache::DEFAULT_MAX_BYTES);
+
+    ~CacheServer() override;
+
+    HttpResponse handle(const HttpRequest& request) override;
+
+   private:
+    std::filesystem::path dir;
+    /** Only used to trim the directory, which it shares the layout of */
+    ArtifactCache store;
+    uint64_t max_bytes;
+
+    std::mutex trim_mtx;
+    /** Bytes stored since the directory was last trimmed */
+    std::atomic<uint64_t> stored_bytes = 0;
+
+    /** Trim the directory once an eighth of it's limit has been stored since the last trim */
+    void trim_if_needed(size_t stored);
+};
+
+#endif
@@ -0,0 +1,498 @@
+#include "http.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <utility>
+
+#include "../errors/error.hpp"
+#include "fcntl.h"
+#include "netdb.h"
+#include "netinet/in.h"
+#include "netinet/tcp.h"
+#include "poll.h"
+#include "sys/socket.h"
+#include "sys/stat.h"
+#include "sys/un.h"
+#include "unistd.h"
+
+namespace {
+const std::string HEAD_END = "\r\n\r\n";
+
+const char* reason(int status) {
+    switch (status) {
+        case 200:
+            return "OK";
+        case 201:
+            return "Created";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 503:
+            return "Service Unavailable";
+        default:
+            return "Internal Server Error";
+    }
+}
+
+/**
+ * Find the Content-Length among a message's header lines, rejecting chunked bodies
+ * @param max_body The largest length accepted
+ * @returns The length, which is 0 if none is given
+ */
+size_t content_length(std::istringstream& lines, size_t max_body) {
+    size_t len = 0;
+    std::string line;
+    while (std::getline(lines, line) && line != "\r") {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            throw ValueError("Malformed HTTP header '" + line + "'");
+        }
+        std::string name = line.substr(0, colon);
+        std::ranges::transform(name, name.begin(), [](unsigned char c) { return std::tolower(c); });
+        const std::string value = line.substr(colon + 1);
+        if (name == "content-length") {
+            size_t parsed_len = 0;
+            try {
+                len = std::stoull(value, &parsed_len);
+            } catch (const std::exception&) {
+                parsed_len = 0;
+            }
+            if (parsed_len == 0 || len > max_body) {
+                throw ValueError("Invalid Content-Length '" + value + "'");
+            }
+        } else if (name == "transfer-encoding") {
+            throw ValueError("Unsupported Transfer-Encoding '" + value + "'");
+        }
+    }
+    return len;
+}
+}  // namespace
+
+Endpoint Endpoint::parse(const std::string& str) try {
+    Endpoint endpoint;
+    if (str.starts_with("unix:")) {
+        endpoint.unix_path = str.substr(std::string("unix:").size());
+        if (endpoint.unix_path.empty()) {
+            throw ValueError("Missing socket path");
+        }
+        return endpoint;
+    }
+
+    std::string addr = str.starts_with("http://") ? str.substr(std::string("http://").size()) : str;
+    if (addr.ends_with('/')) addr.pop_back();
+    const size_t colon = addr.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        throw ValueError("Expected 'host:port' or 'unix:/path'");
+    }
+    endpoint.host = addr.substr(0, colon);
+    // IPv6 addresses are written in brackets to set them apart from the port
+    if (endpoint.host.starts_with('[') != endpoint.host.ends_with(']')) {
+        throw ValueError("Unbalanced brackets in host '" + endpoint.host + "'");
+    }
+    if (endpoint.host.starts_with('[')) {
+        endpoint.host = endpoint.host.substr(1, endpoint.host.size() - 2);
+        if (endpoint.host.empty()) {
+            throw ValueError("Missing host");
+        }
+    }
+    const std::string port = addr.substr(colon + 1);
+    size_t parsed_len = 0;
+    int port_num = -1;
+    try {
+        port_num = std::stoi(port, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len != port.size() || port_num < 0 || port_num > 65535) {
+        throw ValueError("Invalid port '" + port + "'");
+    }
+    endpoint.port = static_cast<uint16_t>(port_num);
+    return endpoint;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Parsing endpoint '" + str + "'");
+}
+
+std::string Endpoint::to_string() const {
+    if (!unix_path.empty()) return "unix:" + unix_path;
+    const bool is_ipv6 = host.find(':') != std::string::npos;
+    return (is_ipv6 ? "[" + host + "]" : host) + ":" + std::to_string(port);
+}
+
+bool Endpoint::is_local() const {
+    return !unix_path.empty() || host == "localhost" || host == "::1" || host.starts_with("127.");
+}
+
+HttpConnection::HttpConnection(int _fd, size_t _max_body) : fd(_fd), max_body(_max_body) {}
+
+HttpConnection HttpConnection::connect(const Endpoint& endpoint) try {
+    if (!endpoint.unix_path.empty()) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (endpoint.unix_path.size() >= sizeof(addr.sun_path)) {
+            throw ValueError("Socket path '" + endpoint.unix_path + "' is too long");
+        }
+        std::strcpy(addr.sun_path, endpoint.unix_path.c_str());
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw SystemError("Failed to create socket");
+        }
+        HttpConnection conn(fd);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            throw SystemError("Failed to connect to '" + endpoint.to_string() + "'");
+        }
+        return conn;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    const int err =
+        getaddrinfo(endpoint.host.c_str(), std::to_string(endpoint.port).c_str(), &hints, &found);
+    if (err != 0) {
+        throw IOError("Failed to resolve '" + endpoint.host + "': " + gai_strerror(err));
+    }
+    std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> addrs(found, freeaddrinfo);
+    for (addrinfo* addr = found; addr != nullptr; addr = addr->ai_next) {
+        const int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd < 0) continue;
+        HttpConnection conn(fd);
+        if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            // Requests are small and answered one at a time, so batching them only adds latency
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return conn;
+        }
+    }
+    throw SystemError("Failed to connect to '" + endpoint.to_string() + "'");
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Connecting to cache server");
+}
+
+HttpConnection::~HttpConnection() {
+    if (fd >= 0) close(fd);
+}
+
+HttpConnection::HttpConnection(HttpConnection&& other) noexcept
+    : fd(std::exchange(other.fd, -1)), max_body(other.max_body), buf(std::move(other.buf)) {}
+
+HttpConnection& HttpConnection::operator=(HttpConnection&& other) noexcept {
+    if (this != &other) {
+        if (fd >= 0) close(fd);
+        fd = std::exchange(other.fd, -1);
+        max_body = other.max_body;
+        buf = std::move(other.buf);
+    }
+    return *this;
+}
+
+void HttpConnection::send_request(const HttpRequest& request) {
+    write_all(request.method + " " + request.target +
+              " HTTP/1.1\r\nHost: my_make\r\nContent-Length: " +
+              std::to_string(request.body.size()) + HEAD_END + request.body);
+}
+
+HttpResponse HttpConnection::read_response(bool head) {
+    std::string msg;
+    if (!read_head(msg)) {
+        throw IOError("Connection closed before a response");
+    }
+    // e.g. "HTTP/1.1 404 Not Found"
+    std::istringstream lines(msg);
+    std::string version;
+    HttpResponse response;
+    std::string rest;
+    if (!(lines >> version >> response.status) || !version.starts_with("HTTP/1.") ||
+        !std::getline(lines, rest)) {
+        throw ValueError("Malformed HTTP status line");
+    }
+    const size_t len = content_length(lines, max_body);
+    if (!head) {
+        response.body = read_body(len);
+    }
+    return response;
+}
+
+bool HttpConnection::read_request(HttpRequest& request) {
+    std::string msg;
+    if (!read_head(msg)) return false;
+
+    // e.g. "PUT /cas/1a2b-14 HTTP/1.1"
+    std::istringstream lines(msg);
+    std::string version;
+    std::string rest;
+    if (!(lines >> request.method >> request.target >> version) ||
+        !version.starts_with("HTTP/1.") || !std::getline(lines, rest)) {
+        throw ValueError("Malformed HTTP request line");
+    }
+    request.body = read_body(content_length(lines, max_body));
+    return true;
+}
+
+void HttpConnection::send_response(const HttpResponse& response, bool head) {
+    std::string msg = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                      reason(response.status) +
+                      "\r\nContent-Length: " + std::to_string(response.body.size()) + HEAD_END;
+    if (!head) msg += response.body;
+    write_all(msg);
+}
+
+void HttpConnection::write_all(const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        // A peer that hung up must fail the write rather than kill the process with SIGPIPE
+        const ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to write to connection");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+bool HttpConnection::read_head(std::string& head) {
+    constexpr size_t MAX_HEAD = 1 << 16;
+    size_t end;
+    while ((end = buf.find(HEAD_END)) == std::string::npos) {
+        if (buf.size() > MAX_HEAD) {
+            throw ValueError("HTTP headers are too long");
+        }
+        char chunk[1 << 14];
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to read from connection");
+        }
+        if (n == 0) {
+            if (buf.empty()) return false;
+            throw IOError("Connection closed mid-message");
+        }
+        buf.append(chunk, static_cast<size_t>(n));
+    }
+    head = buf.substr(0, end + HEAD_END.size());
+    buf.erase(0, end + HEAD_END.size());
+    return true;
+}
+
+std::string HttpConnection::read_body(size_t len) {
+    std::string body = std::move(buf);
+    buf.clear();
+    if (body.size() > len) {
+        buf = body.substr(len);
+        body.resize(len);
+        return body;
+    }
+
+    const size_t have = body.size();
+    body.resize(len);
+    size_t got = have;
+    while (got < len) {
+        const ssize_t n = recv(fd, body.data() + got, len - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw SystemError("Failed to read from connection");
+        }
+        if (n == 0) {
+            throw IOError("Connection closed mid-message");
+        }
+        got += static_cast<size_t>(n);
+    }
+    return body;
+}
+
+HttpClient::HttpClient(Endpoint _endpoint) : endpoint(std::move(_endpoint)) {}
+
+HttpResponse HttpClient::request(const HttpRequest& req) {
+    std::optional<HttpConnection> conn;
+    {
+        std::lock_guard lock(mtx);
+        if (!idle.empty()) {
+            conn.emplace(std::move(idle.back()));
+            idle.pop_back();
+        }
+    }
+
+    const bool reused = conn.has_value();
+    HttpResponse response;
+    try {
+        if (!reused) conn.emplace(HttpConnection::connect(endpoint));
+        conn->send_request(req);
+        response = conn->read_response(req.method == "HEAD");
+    } catch (const std::exception&) {
+        if (!reused) throw;
+        conn.emplace(HttpConnection::connect(endpoint));
+        conn->send_request(req);
+        response = conn->read_response(req.method == "HEAD");
+    }
+
+    std::lock_guard lock(mtx);
+    idle.push_back(std::move(*conn));
+    return response;
+}
+
+const Endpoint& HttpClient::get_endpoint() const { return endpoint; }
+
+HttpServer::HttpServer(Endpoint _endpoint, size_t _max_body)
+    : endpoint(std::move(_endpoint)), max_body(_max_body) {
+    listen_fd = listen_on(endpoint);
+    struct stat st{};
+    if (!endpoint.unix_path.empty() && stat(endpoint.unix_path.c_str(), &st) == 0) {
+        socket_id = {st.st_dev, st.st_ino};
+    }
+    if (pipe2(wake_fds, O_CLOEXEC) != 0) {
+        SystemError err("Failed to create wake pipe");
+        close(listen_fd);
+        throw err;
+    }
+}
+
+HttpServer::~HttpServer() {
+    close_connections();
+    if (listen_fd >= 0) close(listen_fd);
+    if (wake_fds[0] >= 0) close(wake_fds[0]);
+    if (wake_fds[1] >= 0) close(wake_fds[1]);
+    // Only our own socket is removed, not one a server started since has bound at the same path
+    struct stat st{};
+    if (socket_id.has_value() && stat(endpoint.unix_path.c_str(), &st) == 0 &&
+        *socket_id == std::pair(st.st_dev, st.st_ino)) {
+        unlink(endpoint.unix_path.c_str());
+    }
+}
+
+const Endpoint& HttpServer::get_endpoint() const { return endpoint; }
+
+void HttpServer::serve() {
+    while (true) {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            throw SystemError("Failed to wait for connections");
+        }
+        if (fds[1].revents != 0) break;
+
+        // Threads of closed connections are joined as new ones arrive, so they never pile up
+        std::erase_if(connections, [](const Connection& conn) { return conn.done->load(); });
+
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        if (connections.size() >= MAX_CONNECTIONS) {
+            // Turned away rather than left waiting, so a client can fall back to building locally
+            HttpConnection busy(fd);
+            try {
+                busy.send_response(HttpResponse{503, ""});
+            } catch (const std::exception&) {
+            }
+            continue;
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        connections.push_back(Connection{fd, std::jthread([this, fd, done] {
+                                             serve_connection(fd);
+                                             *done = true;
+                                         }),
+                                         done});
+    }
+}
+
+void HttpServer::stop() {
+    const char byte = 0;
+    // Only fails if the pipe is full, in which case 'serve' is already being woken
+    [[maybe_unused]] const ssize_t written = write(wake_fds[1], &byte, 1);
+}
+
+void HttpServer::close_connections() {
+    // Unblocks every connection thread waiting for a request, so they can be joined
+    for (Connection& conn : connections) {
+        if (!*conn.done) ::shutdown(conn.fd, SHUT_RDWR);
+    }
+    connections.clear();
+}
+
+void HttpServer::serve_connection(int fd) {
+    HttpConnection conn(fd, max_body);
+    try {
+        HttpRequest request;
+        while (conn.read_request(request)) {
+            conn.send_response(handle(request), request.method == "HEAD");
+        }
+    } catch (const std::exception&) {
+        // A broken connection only affects the client that made it
+    }
+}
+
+int listen_on(Endpoint& endpoint) try {
+    if (!endpoint.unix_path.empty()) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (endpoint.unix_path.size() >= sizeof(addr.sun_path)) {
+            throw ValueError("Socket path '" + endpoint.unix_path + "' is too long");
+        }
+        std::strcpy(addr.sun_path, endpoint.unix_path.c_str());
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw SystemError("Failed to create socket");
+        }
+        // A socket file is only stale, and replaced, once nothing accepts connections on it
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const int connected =
+            probe < 0 ? -1 : connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        const int connect_err = errno;
+        if (probe >= 0) close(probe);
+        if (connected == 0) {
+            close(fd);
+            throw ValueError("'" + endpoint.to_string() + "' is already being served");
+        }
+        if (connect_err == ECONNREFUSED) {
+            unlink(endpoint.unix_path.c_str());
+        } else if (connect_err != ENOENT) {
+            close(fd);
+            errno = connect_err;
+            throw SystemError("Failed to check for a server on '" + endpoint.to_string() + "'");
+        }
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+            close(fd);
+            throw SystemError("Failed to listen on '" + endpoint.to_string() + "'");
+        }
+        return fd;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* found = nullptr;
+    const int err =
+        getaddrinfo(endpoint.host.c_str(), std::to_string(endpoint.port).c_str(), &hints, &found);
+    if (err != 0) {
+        throw IOError("Failed to resolve '" + endpoint.host + "': " + gai_strerror(err));
+    }
+    std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> addrs(found, freeaddrinfo);
+    for (addrinfo* addr = found; addr != nullptr; addr = addr->ai_next) {
+        const int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd < 0) continue;
+        const int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, addr->ai_addr, addr->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0) {
+            close(fd);
+            continue;
+        }
+        sockaddr_storage bound{};
+        socklen_t bound_len = sizeof(bound);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &bound_len) == 0) {
+            endpoint.port = ntohs(bound.ss_family == AF_INET6
+                                      ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                      : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+        }
+        return fd;
+    }
+    throw SystemError("Failed to listen on '" + endpoint.to_string() + "'");
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Starting server");
+}
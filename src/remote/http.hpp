@@ -0,0 +1,216 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sys/types.h"
+
+/** Where a cache server listens: a TCP host and port, or a Unix domain socket */
+struct Endpoint {
+    std::string host;
+    uint16_t port = 0;
+    /** Set for a Unix domain socket, in which case the host and port are unused */
+    std::string unix_path;
+
+    /**
+     * Parse an endpoint written as "host:port", "http://host:port" or "unix:/path/to/socket".
+     * An IPv6 host may be written in brackets (e.g. "[::1]:7879"), which are not kept
+     * @throws If the endpoint is malformed
+     */
+    static Endpoint parse(const std::string& str);
+
+    std::string to_string() const;
+
+    /** True for a Unix socket or a loopback address, which only this machine can reach */
+    bool is_local() const;
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string target;
+    std::string body;
+};
+
+struct HttpResponse {
+    int status = 0;
+    std::string body;
+};
+
+/**
+ * One end of an HTTP/1.1 connection, which may carry any number of requests one after another.
+ * Only what the cache protocol needs is understood: bodies are always sent with a Content-Length,
+ * and chunked transfer encoding is rejected
+ */
+class HttpConnection {
+   public:
+    /**
+     * Take ownership of a connected socket
+     * @param max_body The largest body accepted from the peer
+     */
+    explicit HttpConnection(int fd, size_t max_body = MAX_BODY);
+
+    /**
+     * Connect to an endpoint
+     * @throws If the connection is refused or the host can not be resolved
+     */
+    static HttpConnection connect(const Endpoint& endpoint);
+
+    /** Closes the socket */
+    ~HttpConnection();
+
+    HttpConnection(HttpConnection&& other) noexcept;
+    HttpConnection& operator=(HttpConnection&& other) noexcept;
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    /** @throws If the request can not be written */
+    void send_request(const HttpRequest& request);
+
+    /**
+     * Read the response to a request sent on this connection
+     * @param head Whether the request was a HEAD, whose response never has a body
+     * @throws If the connection closes first or the response is malformed
+     */
+    HttpResponse read_response(bool head = false);
+
+    /**
+     * Read the next request sent to this connection
+     * @returns False if the client closed the connection between requests
+     * @throws If the connection closes mid-request or the request is malformed
+     */
+    bool read_request(HttpRequest& request);
+
+    /**
+     * @param head Whether answering a HEAD request, so only the headers are sent
+     * @throws If the response can not be written
+     */
+    void send_response(const HttpResponse& response, bool head = false);
+
+    /** The largest body accepted by default, so a bad peer can't exhaust memory */
+    constexpr static size_t MAX_BODY = size_t{256} << 20;
+
+   private:
+    int fd;
+    size_t max_body;
+    /** Bytes read past the end of the last message, which belong to the next one */
+    std::string buf;
+
+    void write_all(const std::string& data);
+
+    /**
+     * Read up to and including the blank line ending a message's headers
+     * @returns False if the connection closed before any of the message arrived
+     */
+    bool read_head(std::string& head);
+
+    /** Read a body of 'len' bytes, using anything already buffered first */
+    std::string read_body(size_t len);
+};
+
+/**
+ * Sends requests to one endpoint. Connections are kept open and reused, so concurrent requests
+ * each get their own. Safe to share between threads
+ */
+class HttpClient {
+   public:
+    explicit HttpClient(Endpoint endpoint);
+
+    /**
+     * Send a request on an idle connection, or a new one if none are idle. A request failing on
+     * an idle connection is retried once on a new one, as the server may have closed it
+     * @throws If the endpoint can not be reached or the response is malformed
+     */
+    HttpResponse request(const HttpRequest& req);
+
+    const Endpoint& get_endpoint() const;
+
+   private:
+    Endpoint endpoint;
+
+    std::mutex mtx;
+    /** Connections not being used by a request right now */
+    std::vector<HttpConnection> idle;
+};
+
+/**
+ * Serves HTTP/1.1 on an endpoint, answering each request through 'handle'. Each connection is
+ * served on it's own thread, so requests on different connections are handled concurrently. At
+ * most MAX_CONNECTIONS are served at once, and further connections are answered with a 503
+ */
+class HttpServer {
+   public:
+    /**
+     * Start listening
+     * @param endpoint Where to listen. A TCP port of 0 picks a free port
+     * @param max_body The largest request body accepted. Larger requests close the connection
+     * @throws If the endpoint can not be bound, or another server is listening on it's socket
+     */
+    explicit HttpServer(Endpoint endpoint, size_t max_body = HttpConnection::MAX_BODY);
+
+    /** Closes every connection. Derived servers must call 'close_connections' first */
+    virtual ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    /** Where the server is listening, with the port it picked if asked for port 0 */
+    const Endpoint& get_endpoint() const;
+
+    /** Accept and serve connections until 'stop' is called */
+    void serve();
+
+    /** Make 'serve' return. Safe to call from any thread, including a signal handling thread */
+    void stop();
+
+    /** Answer a request. Called concurrently from every connection's thread */
+    virtual HttpResponse handle(const HttpRequest& request) = 0;
+
+    /** The most connections served at once, each of which holds a thread and a request body */
+    constexpr static size_t MAX_CONNECTIONS = 256;
+
+   protected:
+    /**
+     * Close every connection and wait for their threads, so none are still handling a request
+     * while a derived server is destroyed
+     */
+    void close_connections();
+
+   private:
+    Endpoint endpoint;
+    size_t max_body;
+    int listen_fd = -1;
+    /** Device and inode of the Unix socket file bound, so only it is removed on destruction */
+    std::optional<std::pair<dev_t, ino_t>> socket_id;
+    /** Written to by 'stop' to wake 'serve' */
+    int wake_fds[2] = {-1, -1};
+
+    struct Connection {
+        int fd;
+        std::jthread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    /** Only touched by the thread running 'serve', or once it has returned */
+    std::vector<Connection> connections;
+
+    /** Serve the requests sent on a connection until it is closed */
+    void serve_connection(int fd);
+};
+
+/**
+ * Open a socket listening on an endpoint. A TCP port of 0 picks a free port, which is written
+ * back into the endpoint. A Unix socket file is replaced if stale, but not while another server
+ * accepts connections on it
+ * @returns The listening socket
+ * @throws If the endpoint can not be bound, or another server is listening on it's socket
+ */
+int listen_on(Endpoint& endpoint);
+
+#endif
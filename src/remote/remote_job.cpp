@@ -0,0 +1,72 @@
+#include "remote_job.hpp"
+
+#include "../errors/error.hpp"
+#include "wire.hpp"
+
+namespace {
+std::filesystem::perms read_perms(WireReader& in) {
+    return static_cast<std::filesystem::perms>(in.num()) & std::filesystem::perms::mask;
+}
+}  // namespace
+
+std::string encode_job(const RemoteJob& job) {
+    WireWriter out;
+    out.strs(job.cmd);
+    out.strs(job.env);
+    out.num(static_cast<long long>(job.inputs.size()));
+    for (const RemoteInput& input : job.inputs) {
+        out.str(input.path);
+        out.str(input.object);
+        out.num(static_cast<long long>(input.perms));
+    }
+    out.strs(job.outputs);
+    return std::move(out.data);
+}
+
+RemoteJob decode_job(const std::string& data) try {
+    WireReader in(data);
+    RemoteJob job;
+    job.cmd = in.strs();
+    job.env = in.strs();
+    job.inputs.resize(in.count());
+    for (RemoteInput& input : job.inputs) {
+        input.path = in.str();
+        input.object = in.str();
+        input.perms = read_perms(in);
+    }
+    job.outputs = in.strs();
+    in.finish();
+    return job;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Decoding remote job");
+}
+
+std::string encode_result(const RemoteResult& result) {
+    WireWriter out;
+    out.num(result.status);
+    out.str(result.output);
+    out.num(static_cast<long long>(result.files.size()));
+    for (const RemoteOutput& file : result.files) {
+        out.str(file.path);
+        out.str(file.contents);
+        out.num(static_cast<long long>(file.perms));
+    }
+    return std::move(out.data);
+}
+
+RemoteResult decode_result(const std::string& data) try {
+    WireReader in(data);
+    RemoteResult result;
+    result.status = static_cast<int>(in.num());
+    result.output = in.str();
+    result.files.resize(in.count());
+    for (RemoteOutput& file : result.files) {
+        file.path = in.str();
+        file.contents = in.str();
+        file.perms = read_perms(in);
+    }
+    in.finish();
+    return result;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Decoding remote job result");
+}
@@ -0,0 +1,67 @@
+#ifndef REMOTE_JOB_H
+#define REMOTE_JOB_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/** A file a remote job reads, sent ahead to the worker's content addressed store */
+struct RemoteInput {
+    /** Relative to the directory the build runs in */
+    std::string path;
+    /** The name of the object holding it's contents */
+    std::string object;
+    std::filesystem::perms perms;
+
+    bool operator==(const RemoteInput&) const = default;
+};
+
+/** A file a remote job wrote, sent back with the job's result */
+struct RemoteOutput {
+    /** Relative to the directory the build runs in */
+    std::string path;
+    std::string contents;
+    std::filesystem::perms perms;
+
+    bool operator==(const RemoteOutput&) const = default;
+};
+
+/** A command to run on a build worker, along with everything it needs from the build */
+struct RemoteJob {
+    std::vector<std::string> cmd;
+    /** "NAME=value" entries the command runs with */
+    std::vector<std::string> env;
+    std::vector<RemoteInput> inputs;
+    /** The files to send back, if the command writes them */
+    std::vector<std::string> outputs;
+
+    bool operator==(const RemoteJob&) const = default;
+};
+
+/** The outcome of a remote job */
+struct RemoteResult {
+    /** The exit status, or -1 if the command could not be run at all */
+    int status = 0;
+    /** Everything the command wrote to stdout and stderr, or why it could not be run */
+    std::string output;
+    std::vector<RemoteOutput> files;
+
+    bool operator==(const RemoteResult&) const = default;
+};
+
+/**
+ * Encode a job to send to a worker. Every field is a netstring ("<length>:<bytes>,"), and each
+ * list is a netstring of it's size followed by it's items, so any bytes can be sent unescaped
+ */
+std::string encode_job(const RemoteJob& job);
+
+/** @throws If the job is malformed */
+RemoteJob decode_job(const std::string& data);
+
+/** Encode the result of a job, in the same way as a job */
+std::string encode_result(const RemoteResult& result);
+
+/** @throws If the result is malformed */
+RemoteResult decode_result(const std::string& data);
+
+#endif
@@ -0,0 +1,206 @@
+#include "remote_spawner.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <iterator>
+
+#include "../errors/error.hpp"
+#include "../history/artifact_cache.hpp"
+#include "../io/file_utils.hpp"
+#include "unistd.h"
+
+namespace {
+/** Join the command into a single space separated string */
+std::string cmd_str(const std::vector<std::string>& cmd) {
+    std::string str;
+    for (const std::string& tok : cmd) {
+        if (!str.empty()) {
+            str += ' ';
+        }
+        str += tok;
+    }
+    return str;
+}
+}  // namespace
+
+RemoteProcSpawner::RemoteProcSpawner(std::shared_ptr<ProcessSpawner> _local,
+                                     std::vector<Endpoint> endpoints, size_t _slots)
+    : local(std::move(_local)), slots(endpoints.empty() ? 0 : std::max<size_t>(_slots, 1)) {
+    for (Endpoint& endpoint : endpoints) {
+        workers.push_back(std::make_unique<Worker>(std::move(endpoint)));
+    }
+    pool = std::make_unique<WorkStealingPool>(slots);
+}
+
+RemoteProcSpawner::~RemoteProcSpawner() { pool.reset(); }
+
+int RemoteProcSpawner::run(std::vector<std::string>& cmd) { return local->run(cmd); }
+
+ProcessId RemoteProcSpawner::spawn(std::vector<std::string>& cmd) { return local->spawn(cmd); }
+
+std::vector<ProcessResult> RemoteProcSpawner::wait_any(
+    std::optional<std::chrono::milliseconds> timeout) {
+    {
+        std::lock_guard lock(mtx);
+        if (!completed.empty()) return std::exchange(completed, {});
+    }
+
+    // A remote command finishing from here on interrupts the wait, so none is reported late
+    std::vector<ProcessResult> results = local->wait_any(timeout);
+    std::lock_guard lock(mtx);
+    std::ranges::move(completed, std::back_inserter(results));
+    completed.clear();
+    return results;
+}
+
+void RemoteProcSpawner::interrupt() { local->interrupt(); }
+
+void RemoteProcSpawner::cancel(ProcessId id) {
+    if ((id & REMOTE_ID_BIT) == 0) {
+        local->cancel(id);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mtx);
+        if (running.erase(id) == 0) return;
+        errno = 0;
+        SystemError err("Remote command was cancelled");
+        err.set_what_str(err.format());
+        completed.push_back(ProcessResult{id, -1, std::make_exception_ptr(err), nullptr});
+    }
+    local->interrupt();
+}
+
+size_t RemoteProcSpawner::remote_capacity() const { return slots; }
+
+ProcessId RemoteProcSpawner::spawn_remote(std::vector<std::string>& cmd,
+                                          const RemoteFiles& files) {
+    if (slots == 0) {
+        return ProcessSpawner::spawn_remote(cmd, files);
+    }
+
+    Worker& worker = *workers[next_worker++ % workers.size()];
+    ProcessId id;
+    {
+        std::lock_guard lock(mtx);
+        id = next_id++ | REMOTE_ID_BIT;
+        running.insert(id);
+    }
+    pool->submit([this, id, &worker, cmd, files] {
+        ProcessResult result;
+        try {
+            result = execute(id, worker, cmd, files);
+        } catch (...) {
+            result = ProcessResult{id, -1, std::current_exception(), nullptr};
+        }
+        complete(std::move(result));
+    });
+    return id;
+}
+
+ProcessResult RemoteProcSpawner::execute(ProcessId id, Worker& worker,
+                                         std::vector<std::string> cmd,
+                                         const RemoteFiles& files) try {
+    RemoteJob job{std::move(cmd), remote_env(), send_inputs(worker, files), files.outputs};
+    const HttpResponse response =
+        worker.client.request(HttpRequest{"POST", "/run", encode_job(job)});
+    if (response.status != 200) {
+        throw IOError("Build worker answered " + std::to_string(response.status));
+    }
+    const RemoteResult result = decode_result(response.body);
+    if (result.status < 0) {
+        throw IOError("Build worker could not run command '" + cmd_str(job.cmd) +
+                      "': " + result.output);
+    }
+
+    auto output = std::make_shared<OutputBuffer>();
+    output->append(result.output);
+    if (result.status != 0) {
+        errno = 0;
+        SystemError err("Process execution failed for command '" + cmd_str(job.cmd) +
+                        "' (exit status " + std::to_string(result.status) + ")");
+        err.add_ctx("Executing command on build worker '" +
+                    worker.client.get_endpoint().to_string() + "'");
+        err.set_what_str(err.format());
+        return ProcessResult{id, result.status, std::make_exception_ptr(err), output};
+    }
+
+    {
+        // A cancelled command must not overwrite anything the build has moved on to
+        std::lock_guard lock(mtx);
+        if (!running.contains(id)) return ProcessResult{id, result.status, nullptr, output};
+    }
+    for (const RemoteOutput& file : result.files) {
+        if (std::ranges::find(files.outputs, file.path) == files.outputs.end()) {
+            throw IOError("Build worker sent back '" + file.path + "', which is not an output");
+        }
+        const std::filesystem::path path(file.path);
+        if (path.has_parent_path()) {
+            std::filesystem::create_directories(path.parent_path());
+        }
+        FileUtils::write_atomically(file.path, file.contents);
+        std::filesystem::permissions(file.path, file.perms);
+    }
+    return ProcessResult{id, 0, nullptr, output};
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Running command on build worker '" +
+                                       worker.client.get_endpoint().to_string() + "'");
+}
+
+std::vector<RemoteInput> RemoteProcSpawner::send_inputs(Worker& worker,
+                                                        const RemoteFiles& files) const {
+    std::vector<RemoteInput> inputs;
+    for (const std::string& path : files.inputs) {
+        std::error_code err;
+        if (std::filesystem::path(path).is_absolute() ||
+            !std::filesystem::is_regular_file(path, err)) {
+            continue;
+        }
+
+        const std::string contents = FileUtils::read_all(path);
+        const std::string object = ArtifactCache::object_name(contents);
+        inputs.push_back(RemoteInput{
+            path, object,
+            std::filesystem::status(path).permissions() & std::filesystem::perms::mask});
+
+        {
+            std::lock_guard lock(worker.mtx);
+            if (worker.sent.contains(object)) continue;
+        }
+        const std::string target = "/cas/" + object;
+        if (worker.client.request(HttpRequest{"HEAD", target, ""}).status != 200) {
+            const HttpResponse response =
+                worker.client.request(HttpRequest{"PUT", target, contents});
+            if (response.status != 200 && response.status != 201) {
+                throw IOError("Build worker answered " + std::to_string(response.status) +
+                              " to '" + path + "'");
+            }
+        }
+        std::lock_guard lock(worker.mtx);
+        worker.sent.insert(object);
+    }
+    return inputs;
+}
+
+std::vector<std::string> RemoteProcSpawner::remote_env() {
+    std::vector<std::string> env;
+    for (char** entry = environ; *entry != nullptr; entry++) {
+        const std::string_view var(*entry);
+        const bool local_only = std::ranges::any_of(LOCAL_ENV, [&](std::string_view name) {
+            return var.starts_with(name) && var.substr(name.size()).starts_with('=');
+        });
+        if (!local_only) env.emplace_back(var);
+    }
+    return env;
+}
+
+void RemoteProcSpawner::complete(ProcessResult result) {
+    {
+        std::lock_guard lock(mtx);
+        if (running.erase(result.id) == 0) return;
+        completed.push_back(std::move(result));
+    }
+    local->interrupt();
+}
@@ -0,0 +1,105 @@
+#ifndef REMOTE_SPAWNER_H
+#define REMOTE_SPAWNER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../concurrency/work_stealing_pool.hpp"
+#include "../io/proc_spawner.hpp"
+#include "http.hpp"
+#include "remote_job.hpp"
+
+/**
+ * Runs commands on build workers (see BuildWorker) as well as on this machine. Local commands are
+ * left to another spawner, while each remote command is sent from a thread of it's own, as it
+ * spends it's time waiting on the worker. Workers are picked round robin. Completions from both
+ * are reported through the local spawner's 'wait_any', which remote commands wake once done
+ */
+class RemoteProcSpawner : public ProcessSpawner {
+   public:
+    /**
+     * @param local Runs every command not sent to a worker
+     * @param workers Where to send remote commands
+     * @param slots The most commands sent to the workers at once, across all of them
+     */
+    RemoteProcSpawner(std::shared_ptr<ProcessSpawner> local, std::vector<Endpoint> workers,
+                      size_t slots);
+
+    /** Waits for every remote command still running */
+    ~RemoteProcSpawner() override;
+
+    int run(std::vector<std::string>& cmd) override;
+
+    ProcessId spawn(std::vector<std::string>& cmd) override;
+
+    std::vector<ProcessResult> wait_any(
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+
+    void interrupt() override;
+
+    /**
+     * Stop a command. A remote command is reported as failed straight away and anything it sends
+     * back is dropped, as it can not be stopped on the worker
+     */
+    void cancel(ProcessId id) override;
+
+    size_t remote_capacity() const override;
+
+    ProcessId spawn_remote(std::vector<std::string>& cmd, const RemoteFiles& files) override;
+
+   private:
+    /** Set in the ids of remote commands, which would never be reached by a local spawner */
+    constexpr static ProcessId REMOTE_ID_BIT = ProcessId{1} << 62;
+    /** Environment variables that only make sense on this machine (e.g. jobserver descriptors) */
+    constexpr static const char* LOCAL_ENV[] = {"MAKEFLAGS", "MFLAGS"};
+
+    struct Worker {
+        explicit Worker(Endpoint endpoint) : client(std::move(endpoint)) {}
+
+        HttpClient client;
+        std::mutex mtx;
+        /** Objects the worker is known to hold, so they are not checked for again */
+        std::unordered_set<std::string> sent;
+    };
+
+    std::shared_ptr<ProcessSpawner> local;
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t slots;
+    std::atomic<size_t> next_worker = 0;
+
+    std::mutex mtx;
+    ProcessId next_id = 0;
+    /** Remote commands that have finished but not been reported yet */
+    std::vector<ProcessResult> completed;
+    /** Remote commands that are running */
+    std::unordered_set<ProcessId> running;
+
+    /** Sends remote commands, with a thread per slot */
+    std::unique_ptr<WorkStealingPool> pool;
+
+    /**
+     * Send a command to a worker and write back the outputs it returns
+     * @throws If the worker can not be reached or answers with an error
+     */
+    ProcessResult execute(ProcessId id, Worker& worker, std::vector<std::string> cmd,
+                          const RemoteFiles& files);
+
+    /**
+     * Make sure the worker holds the contents of every input it can be sent. Absolute paths are
+     * left to the worker's own files, as are inputs that are not regular files
+     */
+    std::vector<RemoteInput> send_inputs(Worker& worker, const RemoteFiles& files) const;
+
+    /** The environment of this process, without anything that only makes sense on this machine */
+    static std::vector<std::string> remote_env();
+
+    /** Report a remote command's result unless it has already been reported as cancelled */
+    void complete(ProcessResult result);
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "remote_store.hpp"
+
+#include "../errors/error.hpp"
+
+HttpRemoteStore::HttpRemoteStore(Endpoint endpoint) : client(std::move(endpoint)) {}
+
+std::optional<std::string> HttpRemoteStore::get(const std::string& path) try {
+    HttpResponse response = client.request(HttpRequest{"GET", "/" + path, ""});
+    if (response.status == 404) return std::nullopt;
+    if (response.status != 200) {
+        throw IOError("Cache server answered " + std::to_string(response.status));
+    }
+    return std::move(response.body);
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Fetching '" + path + "' from remote cache");
+}
+
+bool HttpRemoteStore::contains(const std::string& path) try {
+    const HttpResponse response = client.request(HttpRequest{"HEAD", "/" + path, ""});
+    if (response.status != 200 && response.status != 404) {
+        throw IOError("Cache server answered " + std::to_string(response.status));
+    }
+    return response.status == 200;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Checking '" + path + "' in remote cache");
+}
+
+void HttpRemoteStore::put(const std::string& path, const std::string& value) try {
+    const HttpResponse response = client.request(HttpRequest{"PUT", "/" + path, value});
+    if (response.status != 200 && response.status != 201) {
+        throw IOError("Cache server answered " + std::to_string(response.status));
+    }
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Storing '" + path + "' in remote cache");
+}
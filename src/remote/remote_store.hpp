@@ -0,0 +1,53 @@
+#ifndef REMOTE_STORE_H
+#define REMOTE_STORE_H
+
+#include <optional>
+#include <string>
+
+#include "http.hpp"
+
+/**
+ * A store of cached builds shared between machines. Keys are paths like "ac/<key>" for the builds
+ * stored under an action key and "cas/<object>" for the contents of an output. Primarily useful
+ * for enabling dependency injection
+ */
+class RemoteStore {
+   public:
+    virtual ~RemoteStore() = default;
+
+    /**
+     * @returns The value stored at a path, or nothing if there is none
+     * @throws If the store can not be reached
+     */
+    virtual std::optional<std::string> get(const std::string& path) = 0;
+
+    /**
+     * Check whether anything is stored at a path, without fetching it
+     * @throws If the store can not be reached
+     */
+    virtual bool contains(const std::string& path) = 0;
+
+    /**
+     * Store a value at a path, replacing anything already there
+     * @throws If the store can not be reached or rejects the value
+     */
+    virtual void put(const std::string& path, const std::string& value) = 0;
+};
+
+/**
+ * A remote store reached over HTTP/1.1, as served by my_make_cache_server. Each path is a
+ * resource under the server's root, read with GET, checked with HEAD and written with PUT
+ */
+class HttpRemoteStore : public RemoteStore {
+   public:
+    explicit HttpRemoteStore(Endpoint endpoint);
+
+    std::optional<std::string> get(const std::string& path) override;
+    bool contains(const std::string& path) override;
+    void put(const std::string& path, const std::string& value) override;
+
+   private:
+    HttpClient client;
+};
+
+#endif
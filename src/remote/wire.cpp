@@ -0,0 +1,77 @@
+#include "wire.hpp"
+
+#include "../errors/error.hpp"
+
+void WireWriter::str(const std::string& val) {
+    data += std::to_string(val.size());
+    data += ':';
+    data += val;
+    data += ',';
+}
+
+void WireWriter::num(long long val) { str(std::to_string(val)); }
+
+void WireWriter::strs(const std::vector<std::string>& vals) {
+    num(static_cast<long long>(vals.size()));
+    for (const std::string& val : vals) {
+        str(val);
+    }
+}
+
+WireReader::WireReader(const std::string& _data) : data(_data) {}
+
+std::string WireReader::str() {
+    const size_t colon = data.find(':', pos);
+    if (colon == std::string::npos || colon == pos || colon - pos > 20) {
+        throw ValueError("Expected a netstring length at byte " + std::to_string(pos));
+    }
+    size_t len = 0;
+    for (size_t i = pos; i < colon; i++) {
+        if (data[i] < '0' || data[i] > '9') {
+            throw ValueError("Invalid netstring length at byte " + std::to_string(pos));
+        }
+        len = len * 10 + static_cast<size_t>(data[i] - '0');
+    }
+    if (len > data.size() - colon - 1 || data[colon + 1 + len] != ',') {
+        throw ValueError("Truncated netstring at byte " + std::to_string(pos));
+    }
+    pos = colon + len + 2;
+    return data.substr(colon + 1, len);
+}
+
+long long WireReader::num() {
+    const std::string val = str();
+    size_t parsed_len = 0;
+    long long parsed = 0;
+    try {
+        parsed = std::stoll(val, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len == 0 || parsed_len != val.size()) {
+        throw ValueError("Expected a number but found '" + val + "'");
+    }
+    return parsed;
+}
+
+size_t WireReader::count() {
+    const long long val = num();
+    if (val < 0 || static_cast<size_t>(val) > data.size() - pos) {
+        throw ValueError("Invalid list size " + std::to_string(val));
+    }
+    return static_cast<size_t>(val);
+}
+
+std::vector<std::string> WireReader::strs() {
+    std::vector<std::string> vals(count());
+    for (std::string& val : vals) {
+        val = str();
+    }
+    return vals;
+}
+
+void WireReader::finish() const {
+    if (pos != data.size()) {
+        throw ValueError("Unexpected data after byte " + std::to_string(pos));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Writes a message as a sequence of netstrings ("<len>:<bytes>,"), so any bytes can be sent
+ * without escaping. Numbers are written as their decimal strings
+ */
+class WireWriter {
+   public:
+    void str(const std::string& val);
+
+    void num(long long val);
+
+    /** The size of the list followed by each of it's items */
+    void strs(const std::vector<std::string>& vals);
+
+    std::string data;
+};
+
+/** Reads a message written by a WireWriter, field by field in the order they were written */
+class WireReader {
+   public:
+    /** @param data Must outlive the reader */
+    explicit WireReader(const std::string& data);
+
+    /** @throws If the next field is not a complete netstring */
+    std::string str();
+
+    /** @throws If the next field is not a number */
+    long long num();
+
+    /** The size of a list, which can't be more than the bytes left as every item takes some */
+    size_t count();
+
+    std::vector<std::string> strs();
+
+    /** @throws If anything is left after the last field */
+    void finish() const;
+
+   private:
+    const std::string& data;
+    size_t pos = 0;
+};
+
+#endif
@@ -12,8 +12,10 @@
 RuleGraph::RuleGraph(std::vector<std::unique_ptr<Rule>> rules) try {
     for (std::unique_ptr<Rule>& rule : rules) {
         const std::string name = rule->get_name();
+        // Rules without dependencies still need an entry so they can be traversed
+        std::vector<std::string>& rule_deps = dep_map[name];
         for (const std::string& dep : rule->get_deps()) {
-            dep_map[name].push_back(dep);
+            rule_deps.push_back(dep);
         }
         name_to_rule[name] = std::move(rule);
     }
@@ -1,43 +1,944 @@
 #include "rule_runner.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "errors/error.hpp"
+#include "io/content_hash.hpp"
+#include "io/depfile.hpp"
+#include "io/file_utils.hpp"
+
+/**
+ * An event reported back to the scheduling thread by the planners. Stale rules stay in this form
+ * while they wait for, and then occupy, a job slot
+ */
+struct RunEvent {
+    enum class Kind { STALE, FAILED };
+
+    Kind kind;
+    size_t rule_idx;
+    std::vector<Command> cmds;
+    /** Set if and only if planning or a command failed */
+    std::exception_ptr err;
+    /** The index of the next command to spawn */
+    size_t next_cmd = 0;
+    std::chrono::steady_clock::time_point start = {};
+    /** The outputs the job is about to rewrite, if cutting off early */
+    std::vector<PreviousOutput> previous = {};
+    /** The key the job's outputs are cached under, if they are */
+    std::optional<uint64_t> cache_key = std::nullopt;
+    /** The files the job reads and writes, if it's commands may run remotely */
+    std::optional<RemoteFiles> remote_files = std::nullopt;
+    /** Whether the job holds a remote slot rather than a local one */
+    bool remote = false;
+};
+
+struct RunState {
+    RunState(const BuildPlan& _plan, const DirtySet& _marks, std::function<void()> _wake)
+        : plan(_plan),
+          marks(_marks),
+          remaining(std::make_unique<std::atomic<size_t>[]>(_plan.rules.size())),
+          cache_keys(_plan.rules.size()),
+          wake(std::move(_wake)) {
+        for (size_t i = 0; i < plan.rules.size(); i++) {
+            remaining[i] = plan.indegree[i];
+        }
+    }
+
+    const BuildPlan& plan;
+    const DirtySet& marks;
+    /** Number of unfinished rule dependencies for each rule */
+    std::unique_ptr<std::atomic<size_t>[]> remaining;
+    /** Number of rules that have finished, or that never will because a dependency failed */
+    std::atomic<size_t> finished = 0;
+    /** Set once anything fails so planners stop releasing more work, unless keeping going */
+    std::atomic<bool> failed = false;
+    /** The key each rule's outputs are cached under, if it was worked out to prefetch them */
+    std::vector<std::optional<uint64_t>> cache_keys;
+    /** Wakes the scheduling thread while it waits on the process spawner */
+    std::function<void()> wake;
+
+    std::mutex mtx;
+    std::deque<RunEvent> events;
+
+    void post(RunEvent ev) {
+        {
+            std::lock_guard lock(mtx);
+            events.push_back(std::move(ev));
+        }
+        wake();
+    }
+};
 
 RuleRunner::RuleRunner(std::shared_ptr<const RuleGraph> rule_graph,
                        std::shared_ptr<const Config> cfg,
                        std::shared_ptr<ProcessSpawner> proc_spawner,
-                       std::shared_ptr<FSGateway> fs_gw)
-    : graph(rule_graph), config(cfg), process_runner(proc_spawner), fs_gateway(fs_gw) {};
+                       std::shared_ptr<FSGateway> fs_gw, RunnerOptions opts)
+    : graph(rule_graph),
+      config(cfg),
+      process_runner(proc_spawner),
+      fs_gateway(fs_gw),
+      options(opts),
+      planner(std::make_unique<WorkStealingPool>(opts.planning_workers)) {
+    options.max_jobs = std::max<size_t>(options.max_jobs, 1);
+    if (options.history == nullptr) {
+        options.history = std::make_shared<DurationHistory>();
+    }
+    if (options.job_output == nullptr) {
+        options.job_output = &std::cout;
+    }
+    options.restat = options.restat && options.build_log != nullptr && options.hashes == nullptr;
+};
+
+void RuleRunner::run_rule(const std::string& rule_name) const { run_rules({rule_name}); }
 
-void RuleRunner::run_rule(const std::string& rule_name) const {
-    if (!graph->is_rule(rule_name)) {
-        throw LogicError("Cannot find rule '" + rule_name + "'");
+void RuleRunner::run_rules(const std::vector<std::string>& rule_names) const {
+    for (const std::string& rule_name : rule_names) {
+        if (!graph->is_rule(rule_name)) {
+            throw LogicError("Cannot find rule '" + rule_name + "'");
+        }
     }
 
-    Visited visited;
-    run_rule_recurse(rule_name, visited);
+    const BuildPlan plan = plan_build(rule_names);
+    execute_plan(plan);
 }
 
-void RuleRunner::run_rule_recurse(const std::string& rule_name, Visited& visited) const try {
-    // We can only build recipes with commands so we ignore others. Also skip visited
-    if (!graph->is_rule(rule_name) || visited.contains(rule_name)) return;
+BuildPlan RuleRunner::plan_build(const std::string& rule_name) const {
+    return plan_build(std::vector<std::string>{rule_name});
+}
+
+BuildPlan RuleRunner::plan_build(const std::vector<std::string>& rule_names) const try {
+    BuildPlan plan;
+    std::unordered_map<std::string, size_t> index;
+    auto index_of = [&](const std::string& name) {
+        auto [itm, inserted] = index.try_emplace(name, plan.rules.size());
+        if (inserted) {
+            plan.rules.push_back(name);
+            plan.indegree.push_back(0);
+            plan.dependants.emplace_back();
+        }
+        return std::pair{itm->second, inserted};
+    };
+
+    // Targets sharing dependencies reach the same indices, so shared rules are only visited once
+    std::vector<size_t> stack;
+    for (const std::string& rule_name : rule_names) {
+        const auto [idx, inserted] = index_of(rule_name);
+        if (inserted) {
+            stack.push_back(idx);
+        }
+    }
+    while (!stack.empty()) {
+        const size_t v = stack.back();
+        stack.pop_back();
+
+        // A rule may list the same dependency more than once but it only needs releasing once
+        std::unordered_set<std::string> seen;
+        for (const std::string& dep : graph->dependencies(plan.rules[v])) {
+            // We can only build recipes with commands so we ignore others
+            if (!graph->is_rule(dep) || !seen.insert(dep).second) continue;
+
+            const auto [d, inserted] = index_of(dep);
+            plan.indegree[v]++;
+            plan.dependants[d].push_back(v);
+            if (inserted) {
+                stack.push_back(d);
+            }
+        }
+    }
+
+    // Any rule that can't be reached by peeling off rules with no dependencies is part of a cycle
+    std::vector<size_t> remaining = plan.indegree;
+    std::vector<size_t> q;
+    for (size_t i = 0; i < remaining.size(); i++) {
+        if (remaining[i] == 0) q.push_back(i);
+    }
+    std::vector<size_t> order;
+    while (!q.empty()) {
+        const size_t v = q.back();
+        q.pop_back();
+        order.push_back(v);
+        for (size_t d : plan.dependants[v]) {
+            if (--remaining[d] == 0) q.push_back(d);
+        }
+    }
+    if (order.size() != plan.rules.size()) {
+        throw LogicError("Cyclical dependency between rules detected. " +
+                         std::to_string(plan.rules.size() - order.size()) +
+                         " rule(s) could never become ready");
+    }
 
-    for (const std::string& dep : graph->dependencies(rule_name)) {
-        run_rule_recurse(dep, visited);
+    // Dependants come later in the topological order, so walking it backwards means every
+    // dependant's remaining path is known before the rules it depends on
+    plan.priority.assign(plan.rules.size(), 0);
+    for (size_t v : std::views::reverse(order)) {
+        double longest_after = 0;
+        for (size_t d : plan.dependants[v]) {
+            longest_after = std::max(longest_after, plan.priority[d]);
+        }
+        plan.priority[v] = options.history->estimate(plan.rules[v]) + longest_after;
     }
 
-    visited.insert(rule_name);
+    std::unordered_map<std::string, size_t> pool_index;
+    plan.pool.assign(plan.rules.size(), BuildPlan::NO_POOL);
+    for (size_t i = 0; i < plan.rules.size(); i++) {
+        const Rule& rule = graph->get_rule(plan.rules[i]);
+        const std::string& pool = rule.get_pool();
+        if (pool.empty()) continue;
 
-    const Rule& rule = graph->get_rule(rule_name);
-    if (rule.should_run(*fs_gateway)) {
-        for (Command& cmd : rule.get_commands(*config)) {
-            process_runner->run(cmd);
+        auto size = config->pools.find(pool);
+        if (size == config->pools.end()) {
+            throw LogicError("Rule '" + plan.rules[i] + "' uses pool '" + pool +
+                                 "' which is not defined in the config",
+                             rule.get_loc());
+        }
+        auto [itm, inserted] = pool_index.try_emplace(pool, plan.pool_sizes.size());
+        if (inserted) {
+            plan.pool_sizes.push_back(size->second);
         }
+        plan.pool[i] = itm->second;
     }
+
+    plan.order = std::move(order);
+    return plan;
 } catch (std::exception& excep) {
-    if (graph->is_rule(rule_name)) {
-        Error::update_and_throw(excep, "Running rule '" + rule_name + "'",
-                                graph->get_rule(rule_name).get_loc());
-    } else {
-        Error::update_and_throw(excep, "Running rule '" + rule_name + "'");
+    std::string names;
+    for (const std::string& rule_name : rule_names) {
+        names += (names.empty() ? "'" : ", '") + rule_name + "'";
+    }
+    Error::update_and_throw(excep, "Planning build of " + names);
+}
+
+std::vector<std::string> RuleRunner::plan_files(const BuildPlan& plan) const {
+    std::vector<std::string> files;
+    std::unordered_set<std::string> seen;
+    auto add_file = [&](const std::string& file) {
+        if (seen.insert(file).second) {
+            files.push_back(file);
+        }
+    };
+    for (const std::string& rule_name : plan.rules) {
+        const Rule& rule = graph->get_rule(rule_name);
+        add_file(rule_name);
+        for (const std::string& dep : rule.get_deps()) {
+            add_file(dep);
+        }
+        if (options.deps_log == nullptr) continue;
+        for (const std::string& output : rule.get_depfile_outputs(*config)) {
+            add_file(output);
+            for (const std::string& header :
+                 options.deps_log->get(output).value_or(std::vector<std::string>{})) {
+                add_file(header);
+            }
+        }
+    }
+    return files;
+}
+
+void RuleRunner::execute_plan(const BuildPlan& plan) const {
+    // Every file checked for staleness is looked up in one batch first, so the latency of each
+    // query overlaps with the rest instead of being paid rule by rule
+    fs_gateway->prefetch(plan_files(plan));
+
+    const DirtySet marks = mark_dirty(plan);
+    RunState state(plan, marks, [this] { process_runner->interrupt(); });
+    // Clean rules are settled up front, so the scheduler only ever sees the dirty part of the plan
+    for (size_t i = 0; i < plan.rules.size(); i++) {
+        if (marks.dirty[i]) continue;
+        state.finished++;
+        for (size_t d : plan.dependants[i]) {
+            state.remaining[d]--;
+        }
+    }
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < plan.rules.size(); i++) {
+        if (marks.dirty[i] && state.remaining[i] == 0) {
+            ready.push_back(i);
+        }
     }
-}
\ No newline at end of file
+    if (options.cache != nullptr && options.cache->has_remote()) {
+        prefetch_cached(state, ready);
+    }
+    for (size_t i : ready) {
+        planner->submit([this, &state, i] { plan_rule(state, i); });
+    }
+
+    // Heap of stale rules waiting for a job slot, ordered by their critical path priority
+    std::vector<RunEvent> runnable;
+    auto lower_priority = [&](const RunEvent& a, const RunEvent& b) {
+        return plan.priority[a.rule_idx] < plan.priority[b.rule_idx];
+    };
+    std::unordered_map<ProcessId, RunEvent> running;
+    // Jobs on remote slots are limited separately, so they come on top of 'max_jobs'
+    const size_t remote_slots = process_runner->remote_capacity();
+    size_t remote_running = 0;
+    auto local_running = [&] { return running.size() - remote_running; };
+    // Jobs held back by each pool, and the number of running jobs in each pool
+    std::vector<std::vector<RunEvent>> pool_blocked(plan.pool_sizes.size());
+    std::vector<size_t> pool_used(plan.pool_sizes.size(), 0);
+    std::vector<RunEvent> failures;
+    // Rules that failed or transitively depend on a failed rule when keeping going
+    std::vector<bool> abandoned(plan.rules.size(), false);
+    auto stopping = [&] { return !options.keep_going && state.failed; };
+
+    auto record_failure = [&](RunEvent ev) {
+        if (options.keep_going) {
+            // Dependants of a failed rule are never released, so they are settled straight away
+            size_t settled = 0;
+            std::vector<size_t> stack = {ev.rule_idx};
+            while (!stack.empty()) {
+                const size_t v = stack.back();
+                stack.pop_back();
+                if (abandoned[v]) continue;
+                abandoned[v] = true;
+                settled++;
+                for (size_t d : plan.dependants[v]) {
+                    stack.push_back(d);
+                }
+            }
+            state.finished += settled;
+        } else if (state.failed.exchange(true)) {
+            // Only the first failure matters. Later ones are usually the jobs cancelled below
+            return;
+        } else {
+            for (const auto& [id, job] : running) {
+                process_runner->cancel(id);
+            }
+        }
+        failures.push_back(std::move(ev));
+    };
+
+    // Free a job's pool slot, letting the highest priority job waiting on the pool run
+    auto release_pool = [&](size_t rule_idx) {
+        const size_t pool = plan.pool[rule_idx];
+        if (pool == BuildPlan::NO_POOL) return;
+
+        pool_used[pool]--;
+        std::vector<RunEvent>& blocked = pool_blocked[pool];
+        if (!blocked.empty()) {
+            std::ranges::pop_heap(blocked, lower_priority);
+            runnable.push_back(std::move(blocked.back()));
+            std::ranges::push_heap(runnable, lower_priority);
+            blocked.pop_back();
+        }
+    };
+
+    // Spawn the next command of a job, finishing the rule once every command has succeeded
+    auto advance = [&](RunEvent job) {
+        if (job.next_cmd == job.cmds.size()) {
+            // Dependants are planned next, and must see the files this job wrote
+            const Rule& rule = graph->get_rule(plan.rules[job.rule_idx]);
+            for (const std::string& output : rule.get_outputs()) {
+                fs_gateway->invalidate(output);
+            }
+            if (options.hashes != nullptr) {
+                // Hashed on the planning pool so a large output never holds up starting jobs
+                planner->submit([this, &rule] {
+                    try {
+                        options.hashes->record_build(rule.get_name(), rule.get_deps());
+                    } catch (const std::exception&) {
+                        // Without a record the next build compares write times instead
+                    }
+                });
+            }
+            if (options.deps_log != nullptr || job.cache_key.has_value()) {
+                // Outputs are stored once the headers they were built from are in the deps log
+                planner->submit([this, &rule, key = job.cache_key] {
+                    if (options.deps_log != nullptr) record_headers(rule);
+                    if (key.has_value()) store_cached(rule, *key);
+                });
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - job.start;
+            options.history->record(plan.rules[job.rule_idx],
+                                    std::chrono::duration<double>(elapsed).count());
+            if (options.build_log != nullptr) {
+                using std::chrono::nanoseconds;
+                const auto end = std::chrono::system_clock::now().time_since_epoch();
+                const nanoseconds end_ns = std::chrono::duration_cast<nanoseconds>(end);
+                const nanoseconds start_ns =
+                    end_ns - std::chrono::duration_cast<nanoseconds>(elapsed);
+                try {
+                    options.build_log->record(
+                        rule.get_name(), BuildLogEntry{BuildLog::hash_commands(job.cmds),
+                                                       start_ns.count(), end_ns.count()});
+                } catch (const std::exception&) {
+                    // Without a record the next build takes the rule's commands as they are then
+                }
+            }
+            release_pool(job.rule_idx);
+            if (!job.previous.empty()) {
+                // Dependants must not be planned until the write times are back, so finishing
+                // waits on the hashing, which happens on the planning pool
+                planner->submit([this, &state, idx = job.rule_idx,
+                                 previous = std::move(job.previous)] {
+                    restore_unchanged(previous);
+                    finish_rule(state, idx);
+                });
+                return;
+            }
+            finish_rule(state, job.rule_idx);
+            return;
+        }
+
+        try {
+            Command& cmd = job.cmds[job.next_cmd++];
+            const ProcessId id = job.remote ? process_runner->spawn_remote(cmd, *job.remote_files)
+                                            : process_runner->spawn(cmd);
+            remote_running += job.remote ? 1 : 0;
+            running.emplace(id, std::move(job));
+        } catch (...) {
+            release_pool(job.rule_idx);
+            job.err = std::current_exception();
+            record_failure(std::move(job));
+        }
+    };
+
+    // This thread is the only one that spawns and reaps processes. It sleeps in the spawner's
+    // event loop, and planners wake it through 'interrupt' when they post an event
+    // Every running job after the first holds a jobserver token. Once jobs finish their tokens
+    // go back, so the rest of a nested build can use them
+    JobServerClient* jobserver = options.jobserver.get();
+    auto return_tokens = [&](size_t keep) {
+        while (jobserver != nullptr && jobserver->held() > keep) {
+            try {
+                jobserver->release();
+            } catch (const std::exception&) {
+                // A lost token only shrinks the shared limit, which is no reason to fail the build
+                break;
+            }
+        }
+    };
+
+    while (state.finished < plan.rules.size()) {
+        // Remote jobs run elsewhere, so they hold no jobserver token
+        return_tokens(local_running() == 0 ? 0 : local_running() - 1);
+
+        std::optional<std::chrono::milliseconds> recheck;
+        // Once local jobs are held back, the rest of the ready jobs can still run remotely
+        bool local_held = false;
+        // Jobs that can only run locally, waiting for a local slot
+        std::vector<RunEvent> local_only;
+        auto has_slot = [&] {
+            return (!local_held && local_running() < options.max_jobs) ||
+                   remote_running < remote_slots;
+        };
+        while (!stopping() && has_slot() && !runnable.empty()) {
+            std::ranges::pop_heap(runnable, lower_priority);
+            RunEvent job = std::move(runnable.back());
+            runnable.pop_back();
+
+            // A full pool holds the job back without stopping other ready jobs from starting
+            const size_t pool = plan.pool[job.rule_idx];
+            if (pool != BuildPlan::NO_POOL && pool_used[pool] == plan.pool_sizes[pool]) {
+                pool_blocked[pool].push_back(std::move(job));
+                std::ranges::push_heap(pool_blocked[pool], lower_priority);
+                continue;
+            }
+
+            // The first job always starts so a loaded machine slows the build rather than stalls
+            // it, and runs on the implicit token every process has
+            if (!local_held && local_running() < options.max_jobs && local_running() > 0 &&
+                options.load_monitor != nullptr &&
+                !options.load_monitor->can_start(local_running())) {
+                local_held = true;
+                recheck = THROTTLE_RECHECK;
+            }
+            if (!local_held && local_running() < options.max_jobs && jobserver != nullptr &&
+                local_running() > jobserver->held() && !jobserver->try_acquire()) {
+                local_held = true;
+                recheck = JOBSERVER_RECHECK;
+            }
+            job.remote = local_held || local_running() >= options.max_jobs;
+            if (job.remote && (!job.remote_files.has_value() || remote_running == remote_slots)) {
+                local_only.push_back(std::move(job));
+                continue;
+            }
+
+            if (pool != BuildPlan::NO_POOL) {
+                pool_used[pool]++;
+            }
+            job.start = std::chrono::steady_clock::now();
+            advance(std::move(job));
+        }
+        for (RunEvent& job : local_only) {
+            runnable.push_back(std::move(job));
+            std::ranges::push_heap(runnable, lower_priority);
+        }
+
+        if (stopping() && running.empty()) break;
+
+        std::deque<RunEvent> events;
+        {
+            std::lock_guard lock(state.mtx);
+            std::swap(events, state.events);
+        }
+        for (RunEvent& ev : events) {
+            if (ev.kind == RunEvent::Kind::FAILED) {
+                record_failure(std::move(ev));
+            } else if (!stopping()) {
+                runnable.push_back(std::move(ev));
+                std::ranges::push_heap(runnable, lower_priority);
+            }
+        }
+        if (!events.empty() || state.finished == plan.rules.size()) continue;
+
+        // Pressure can ease and tokens can be returned by other processes without any of our jobs
+        // finishing, so a held back build checks again later
+        for (ProcessResult& res : process_runner->wait_any(recheck)) {
+            auto itm = running.find(res.id);
+            if (itm == running.end()) continue;
+            RunEvent job = std::move(itm->second);
+            running.erase(itm);
+            remote_running -= job.remote ? 1 : 0;
+
+            // A remote command can fail for reasons of it's own (e.g. a header the deps log did
+            // not know about yet), so it is run again locally, where a real error is reported
+            if (res.err && job.remote && !stopping()) {
+                job.next_cmd--;
+                job.remote = false;
+                job.remote_files.reset();
+                release_pool(job.rule_idx);
+                runnable.push_back(std::move(job));
+                std::ranges::push_heap(runnable, lower_priority);
+                continue;
+            }
+
+            // Only this thread prints, so blocks from concurrent jobs never interleave. The
+            // output of jobs cancelled after a failure is not worth showing
+            if (res.output && !res.output->empty() && !stopping()) {
+                try {
+                    print_output(job.cmds[job.next_cmd - 1], *res.output);
+                } catch (...) {
+                    if (!res.err) res.err = std::current_exception();
+                }
+            }
+
+            if (res.err) {
+                release_pool(job.rule_idx);
+                job.err = res.err;
+                record_failure(std::move(job));
+            } else if (!stopping()) {
+                advance(std::move(job));
+            }
+        }
+    }
+
+    // Planners hold a reference to the run state so they must drain before it goes out of scope
+    planner->wait_idle();
+    return_tokens(0);
+
+    if (!failures.empty()) {
+        const std::string& rule_name = plan.rules[failures.front().rule_idx];
+        std::string ctx = "Running rule '" + rule_name + "'";
+        if (failures.size() > 1) {
+            ctx += ". " + std::to_string(failures.size() - 1) + " other rule(s) also failed:";
+            for (size_t i = 1; i < failures.size(); i++) {
+                ctx += " '" + plan.rules[failures[i].rule_idx] + "'";
+            }
+        }
+        try {
+            std::rethrow_exception(failures.front().err);
+        } catch (std::exception& excep) {
+            Error::update_and_throw(excep, ctx, graph->get_rule(rule_name).get_loc());
+        }
+    }
+}
+
+void RuleRunner::plan_rule(RunState& state, size_t idx) const {
+    if (state.failed) return;
+
+    // Staleness is only checked once all dependencies have finished, which is guaranteed by only
+    // ever planning rules that have been released
+    const Rule& rule = graph->get_rule(state.plan.rules[idx]);
+    bool stale = state.marks.stale[idx];
+    std::vector<Command> cmds;
+    try {
+        if (stale) {
+            cmds = rule.get_commands(*config);
+        } else {
+            stale = needs_run(rule, cmds);
+            if (stale && cmds.empty()) {
+                cmds = rule.get_commands(*config);
+            }
+        }
+    } catch (...) {
+        state.post(RunEvent{RunEvent::Kind::FAILED, idx, {}, std::current_exception()});
+        return;
+    }
+
+    if (!stale) {
+        finish_rule(state, idx);
+        return;
+    }
+
+    std::optional<uint64_t> key = state.cache_keys[idx];
+    if (options.cache != nullptr && rule.builds_outputs()) {
+        if (!key.has_value()) key = cache_key(rule, cmds);
+        if (key.has_value() && restore_cached(rule, cmds, *key)) {
+            finish_rule(state, idx);
+            return;
+        }
+    }
+
+    RunEvent ev{RunEvent::Kind::STALE, idx, std::move(cmds), nullptr};
+    ev.cache_key = key;
+    if (process_runner->remote_capacity() > 0) {
+        ev.remote_files = remote_files(rule);
+    }
+    if (options.restat && rule.builds_outputs()) {
+        const bool interface = rule.exports_interface();
+        for (const std::string& output : rule.get_outputs()) {
+            try {
+                const auto write_time = fs_gateway->modified_time(output);
+                const std::optional<uint64_t> hash = interface
+                                                         ? fs_gateway->hash_interface(output)
+                                                         : fs_gateway->hash_contents(output);
+                if (write_time.has_value() && hash.has_value()) {
+                    ev.previous.push_back(PreviousOutput{output, *write_time, *hash, interface});
+                }
+            } catch (const std::exception&) {
+                // The output is simply treated as changed by the job
+            }
+        }
+    }
+    state.post(std::move(ev));
+}
+
+bool RuleRunner::needs_run(const Rule& rule, std::vector<Command>& cmds) const {
+    bool stale = options.hashes != nullptr
+                     ? rule.should_run_by_content(*fs_gateway, *options.hashes)
+                     : rule.should_run(*fs_gateway);
+    if (stale && options.restat) {
+        stale = !ran_since_inputs_changed(rule);
+    }
+    if (!stale && options.deps_log != nullptr) {
+        stale = headers_changed(rule);
+    }
+    if (!stale && options.build_log != nullptr && rule.builds_outputs()) {
+        cmds = rule.get_commands(*config);
+        stale = command_changed(rule, cmds);
+    }
+    return stale;
+}
+
+DirtySet RuleRunner::mark_dirty(const BuildPlan& plan) const try {
+    const size_t n = plan.rules.size();
+    DirtySet marks{std::vector<bool>(n, false), std::vector<bool>(n, false)};
+
+    // A rule's level is one more than that of it's deepest dependency, so once every earlier
+    // level is settled the rules of a level can be checked independently
+    std::vector<size_t> level(n, 0);
+    size_t level_count = 0;
+    for (size_t v : plan.order) {
+        for (size_t d : plan.dependants[v]) {
+            level[d] = std::max(level[d], level[v] + 1);
+        }
+        level_count = std::max(level_count, level[v] + 1);
+    }
+    std::vector<size_t> level_start(level_count + 1, 0);
+    for (size_t v = 0; v < n; v++) {
+        level_start[level[v] + 1]++;
+    }
+    for (size_t l = 0; l < level_count; l++) {
+        level_start[l + 1] += level_start[l];
+    }
+    std::vector<size_t> by_level(n);
+    std::vector<size_t> next = level_start;
+    for (size_t v = 0; v < n; v++) {
+        by_level[next[level[v]]++] = v;
+    }
+
+    // One byte per rule, so workers recording results never share a word of the bitsets
+    enum Check : uint8_t { CLEAN, STALE, UNKNOWN };
+    std::vector<uint8_t> checks(n, CLEAN);
+    auto check = [&](size_t v) {
+        std::vector<Command> cmds;
+        try {
+            checks[v] = needs_run(graph->get_rule(plan.rules[v]), cmds) ? STALE : CLEAN;
+        } catch (const std::exception&) {
+            // Planned as dirty, where the check runs again and the error is reported
+            checks[v] = UNKNOWN;
+        }
+    };
+
+    std::vector<size_t> unchecked;
+    for (size_t l = 0; l < level_count; l++) {
+        const std::span<const size_t> rules(by_level.begin() + level_start[l],
+                                            by_level.begin() + level_start[l + 1]);
+        unchecked.clear();
+        for (size_t v : rules) {
+            if (!marks.dirty[v]) unchecked.push_back(v);
+        }
+
+        // Small levels, e.g. every level of a long chain, aren't worth a round trip to the pool
+        if (unchecked.size() <= DIRTY_CHECK_BATCH) {
+            std::ranges::for_each(unchecked, check);
+        } else {
+            for (size_t begin = 0; begin < unchecked.size(); begin += DIRTY_CHECK_BATCH) {
+                planner->submit([&, begin] {
+                    const size_t end = std::min(begin + DIRTY_CHECK_BATCH, unchecked.size());
+                    for (size_t i = begin; i < end; i++) {
+                        check(unchecked[i]);
+                    }
+                });
+            }
+            planner->wait_idle();
+        }
+
+        for (size_t v : unchecked) {
+            marks.stale[v] = checks[v] == STALE;
+            marks.dirty[v] = checks[v] != CLEAN;
+        }
+        for (size_t v : rules) {
+            if (!marks.dirty[v]) continue;
+            for (size_t d : plan.dependants[v]) {
+                marks.dirty[d] = true;
+            }
+        }
+    }
+
+    return marks;
+} catch (std::exception& excep) {
+    Error::update_and_throw(excep, "Marking dirty rules");
+}
+
+bool RuleRunner::command_changed(const Rule& rule, const std::vector<Command>& cmds) const {
+    const uint64_t command_hash = BuildLog::hash_commands(cmds);
+    const std::optional<BuildLogEntry> entry = options.build_log->get(rule.get_name());
+    if (entry.has_value()) {
+        return entry->command_hash != command_hash;
+    }
+
+    // Up to date before the log knew about it, e.g. the first build with a log
+    options.build_log->record(rule.get_name(), BuildLogEntry{command_hash, 0, 0});
+    return false;
+}
+
+bool RuleRunner::headers_changed(const Rule& rule) const {
+    for (const std::string& output : rule.get_depfile_outputs(*config)) {
+        const std::optional<std::vector<std::string>> headers = options.deps_log->get(output);
+        if (!headers.has_value()) return true;
+
+        const auto output_write_t = last_built(rule, output);
+        if (!output_write_t.has_value()) return true;
+        for (const std::string& header : *headers) {
+            const auto header_write_t = fs_gateway->modified_time(header);
+            if (!header_write_t.has_value() || *header_write_t > *output_write_t) return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::filesystem::file_time_type> RuleRunner::last_built(
+    const Rule& rule, const std::string& output) const {
+    const auto write_time = fs_gateway->modified_time(output);
+    if (!write_time.has_value() || !options.restat) return write_time;
+
+    const std::optional<BuildLogEntry> entry = options.build_log->get(rule.get_name());
+    if (!entry.has_value() || entry->start_ns == 0) return write_time;
+    const std::chrono::sys_time<std::chrono::nanoseconds> start(
+        std::chrono::nanoseconds(entry->start_ns));
+    const auto start_time = std::chrono::time_point_cast<std::filesystem::file_time_type::duration>(
+        std::chrono::file_clock::from_sys(start));
+    return std::max(*write_time, start_time);
+}
+
+bool RuleRunner::ran_since_inputs_changed(const Rule& rule) const {
+    const auto built = last_built(rule, rule.get_name());
+    if (!built.has_value()) return false;
+
+    return std::ranges::all_of(rule.get_deps(), [&](const std::string& dep) {
+        const auto dep_write_t = fs_gateway->modified_time(dep);
+        return dep_write_t.has_value() && *dep_write_t <= *built;
+    });
+}
+
+void RuleRunner::restore_unchanged(const std::vector<PreviousOutput>& previous) const {
+    for (const PreviousOutput& output : previous) {
+        try {
+            const std::optional<uint64_t> hash = output.interface
+                                                     ? fs_gateway->hash_interface(output.filename)
+                                                     : fs_gateway->hash_contents(output.filename);
+            if (hash == output.hash) {
+                fs_gateway->set_write_time(output.filename, output.write_time);
+            }
+        } catch (const std::exception&) {
+            // Leaving the new write time only costs rebuilding the dependants
+        }
+    }
+}
+
+void RuleRunner::record_headers(const Rule& rule) const {
+    const std::vector<std::string>& deps = rule.get_deps();
+    for (const std::string& output : rule.get_depfile_outputs(*config)) {
+        const std::string depfile = Rule::get_depfile(output);
+        try {
+            std::vector<std::string> headers = parse_depfile(FileUtils::read_all(depfile));
+            std::erase_if(headers, [&](const std::string& header) {
+                return std::ranges::find(deps, header) != deps.end();
+            });
+            options.deps_log->record(output, headers);
+            std::filesystem::remove(depfile);
+        } catch (const std::exception&) {
+            // Without a record the output is rebuilt next time, which writes the depfile again
+        }
+    }
+}
+
+std::optional<RemoteFiles> RuleRunner::remote_files(const Rule& rule) const {
+    if (!rule.builds_outputs()) return std::nullopt;
+
+    RemoteFiles files{rule.get_deps(), rule.get_outputs()};
+    for (const std::string& output : rule.get_depfile_outputs(*config)) {
+        const std::optional<std::vector<std::string>> headers =
+            options.deps_log == nullptr ? std::nullopt : options.deps_log->get(output);
+        if (!headers.has_value()) return std::nullopt;
+        files.inputs.insert(files.inputs.end(), headers->begin(), headers->end());
+        files.outputs.push_back(Rule::get_depfile(output));
+    }
+    return files;
+}
+
+void RuleRunner::prefetch_cached(RunState& state, const std::vector<size_t>& ready) const {
+    // Keys take hashing every dependency, which is spread over the planning pool. Downloads then
+    // all run at once in the background, rather than one per planner as each rule is planned
+    for (size_t start = 0; start < ready.size(); start += DIRTY_CHECK_BATCH) {
+        planner->submit([this, &state, &ready, start] {
+            const size_t end = std::min(ready.size(), start + DIRTY_CHECK_BATCH);
+            for (size_t i = start; i < end; i++) {
+                const Rule& rule = graph->get_rule(state.plan.rules[ready[i]]);
+                if (!rule.builds_outputs()) continue;
+                try {
+                    state.cache_keys[ready[i]] = cache_key(rule, rule.get_commands(*config));
+                } catch (const std::exception&) {
+                    // The rule fails again once it is planned, where the error is reported
+                    continue;
+                }
+                if (state.cache_keys[ready[i]].has_value()) {
+                    options.cache->prefetch(*state.cache_keys[ready[i]]);
+                }
+            }
+        });
+    }
+    planner->wait_idle();
+}
+
+std::optional<uint64_t> RuleRunner::cache_key(const Rule& rule,
+                                              const std::vector<Command>& cmds) const {
+    std::string summary = std::to_string(BuildLog::hash_commands(cmds));
+    try {
+        for (const Command& cmd : cmds) {
+            if (cmd.empty()) continue;
+            summary += ' ' + std::to_string(options.cache->program_identity(cmd[0]));
+        }
+        for (const std::string& dep : rule.get_deps()) {
+            const std::optional<uint64_t> hash = fs_gateway->hash_contents(dep);
+            if (!hash.has_value()) return std::nullopt;
+            summary += ' ' + std::to_string(*hash);
+        }
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    return content_hash(summary);
+}
+
+bool RuleRunner::restore_cached(const Rule& rule, const std::vector<Command>& cmds,
+                                uint64_t key) const {
+    std::optional<CacheEntry> entry;
+    try {
+        entry = options.cache->fetch(key, [&](const CacheEntry& build) {
+            return std::ranges::all_of(build.headers, [&](const auto& header) {
+                return fs_gateway->hash_contents(header.first) == header.second;
+            });
+        });
+    } catch (const std::exception&) {
+        // Running the job rewrites anything that was partly restored
+        return false;
+    }
+    if (!entry.has_value()) return false;
+
+    for (const std::string& output : rule.get_outputs()) {
+        fs_gateway->invalidate(output);
+    }
+    try {
+        if (options.deps_log != nullptr) {
+            std::vector<std::string> headers;
+            for (const auto& header : entry->headers) {
+                headers.push_back(header.first);
+            }
+            for (const std::string& output : rule.get_depfile_outputs(*config)) {
+                options.deps_log->record(output, headers);
+            }
+        }
+        if (options.hashes != nullptr) {
+            options.hashes->record_build(rule.get_name(), rule.get_deps());
+        }
+        if (options.build_log != nullptr) {
+            const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+            options.build_log->record(rule.get_name(),
+                                      BuildLogEntry{BuildLog::hash_commands(cmds), now, now});
+        }
+    } catch (const std::exception&) {
+        // As with a job, a missing record only costs checking or rebuilding the rule next time
+    }
+    return true;
+}
+
+void RuleRunner::store_cached(const Rule& rule, uint64_t key) const {
+    // Runs on the planner, where nothing would catch an error, so a header that can't be read
+    // just leaves the build uncached
+    try {
+        std::vector<std::pair<std::string, uint64_t>> headers;
+        for (const std::string& output : rule.get_depfile_outputs(*config)) {
+            if (options.deps_log == nullptr) return;
+            const std::optional<std::vector<std::string>> names = options.deps_log->get(output);
+            if (!names.has_value()) return;
+            for (const std::string& name : *names) {
+                const std::optional<uint64_t> hash = fs_gateway->hash_contents(name);
+                if (!hash.has_value()) return;
+                headers.emplace_back(name, *hash);
+            }
+        }
+
+        options.cache->store(key, headers, rule.get_outputs());
+    } catch (const std::exception&) {
+        // The outputs are simply built again if they are needed later
+    }
+}
+
+void RuleRunner::finish_rule(RunState& state, size_t idx) const {
+    if (++state.finished == state.plan.rules.size()) {
+        state.wake();
+    }
+
+    if (state.failed) return;
+
+    for (size_t dependant : state.plan.dependants[idx]) {
+        if (--state.remaining[dependant] == 0) {
+            planner->submit([this, &state, dependant] { plan_rule(state, dependant); });
+        }
+    }
+}
+
+void RuleRunner::print_output(const Command& cmd, const OutputBuffer& output) const {
+    std::ostream& os = *options.job_output;
+    for (size_t i = 0; i < cmd.size(); i++) {
+        os << (i == 0 ? "" : " ") << cmd[i];
+    }
+    os << '\n';
+    output.write_to(os);
+    os.flush();
+}
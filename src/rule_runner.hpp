@@ -1,36 +1,311 @@
 #ifndef RULE_RUNNER_H
 #define RULE_RUNNER_H
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
 #include <memory>
-#include <unordered_set>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
 
+#include "concurrency/jobserver.hpp"
+#include "concurrency/load_monitor.hpp"
+#include "concurrency/work_stealing_pool.hpp"
 #include "dictionaries/config.hpp"
+#include "history/artifact_cache.hpp"
+#include "history/build_log.hpp"
+#include "history/deps_log.hpp"
+#include "history/duration_history.hpp"
+#include "history/hash_database.hpp"
 #include "io/fs_gateway.hpp"
 #include "io/proc_spawner.hpp"
 #include "rule_graph.hpp"
 
-using Visited = std::unordered_set<std::string>;
+/** Options controlling how the runner schedules rules */
+struct RunnerOptions {
+    /** The maximum number of rules that may be executing at the same time */
+    size_t max_jobs = 1;
+    /**
+     * Keep building every rule that does not depend on a failed rule. Otherwise the first failure
+     * cancels every running job
+     */
+    bool keep_going = false;
+    /** The number of threads used to check staleness and build commands for ready rules */
+    size_t planning_workers = 1;
+    /**
+     * Durations of past runs used to start the rules on the longest remaining path first. Runs
+     * are recorded into it. An empty in memory history is used if not set
+     */
+    std::shared_ptr<DurationHistory> history;
+    /**
+     * Where the captured output of each command is printed once it finishes, as a single block
+     * prefixed by the command. Standard output is used if not set
+     */
+    std::ostream* job_output = nullptr;
+    /**
+     * Asked before starting each job while others are running, so jobs are held back when the
+     * machine is under pressure. Only 'max_jobs' limits jobs if not set
+     */
+    std::shared_ptr<LoadMonitor> load_monitor;
+    /**
+     * A GNU make jobserver shared with the rest of a nested build. A token is taken from it
+     * before starting each job after the first. Only 'max_jobs' limits jobs if not set
+     */
+    std::shared_ptr<JobServerClient> jobserver;
+    /**
+     * Decide staleness by comparing file contents with those each rule was last built from, and
+     * record the contents of every rule built. Write times are compared if not set
+     */
+    std::shared_ptr<HashDatabase> hashes;
+    /**
+     * The commands each rule was last built with. Rules whose commands have changed since are
+     * rerun, and every rule that runs is recorded. Commands are not compared if not set
+     */
+    std::shared_ptr<BuildLog> build_log;
+    /**
+     * The headers each compile last read, taken from the depfiles written by rules with header
+     * tracking enabled. Compiles are rerun when any of them is newer than the output, and every
+     * depfile is folded into the log once it's job finishes. Headers are not tracked if not set
+     */
+    std::shared_ptr<DepsLog> deps_log;
+    /**
+     * Cut the build off early when a job rewrites an output with the same contents. The write
+     * time of each such output is put back, so it's dependants stay up to date. A rule whose
+     * inputs are all older than it's last recorded run in 'build_log' is then up to date, even
+     * though it's output was put back to an older time. Rules exporting an interface (shared
+     * libraries) are cut off when the interface is unchanged, even if their contents are not.
+     * Has no effect without 'build_log', or
+     * with 'hashes' as dependants then compare contents and are cut off already
+     */
+    bool restat = false;
+    /**
+     * Outputs of earlier builds, keyed by each rule's commands, compiler and input contents. A
+     * stale rule whose key (and headers) match a stored build has it's outputs restored instead
+     * of running, and the outputs of every job that runs are stored. Nothing is cached if not set
+     */
+    std::shared_ptr<ArtifactCache> cache;
+};
+
+/**
+ * The subgraph of rules that must be visited to build a target. Rules are densely indexed and
+ * edges point from a rule to the rules that depend upon it, so that finishing a rule can release
+ * its dependants.
+ */
+struct BuildPlan {
+    /** The name of the rule at each index */
+    std::vector<std::string> rules;
+    /** Number of rule dependencies for each rule in the plan */
+    std::vector<size_t> indegree;
+    /** The indices of the rules in the plan that directly depend on each rule */
+    std::vector<std::vector<size_t>> dependants;
+    /**
+     * The estimated seconds of work on the longest path from each rule up to the target,
+     * including the rule itself. Ready rules with the highest priority are started first
+     */
+    std::vector<double> priority;
+
+    constexpr static size_t NO_POOL = std::numeric_limits<size_t>::max();
+    /** The index into 'pool_sizes' of each rule's pool, or NO_POOL if it is not in one */
+    std::vector<size_t> pool;
+    /** The maximum number of jobs that may run at once in each pool used by the plan */
+    std::vector<size_t> pool_sizes;
+
+    /** The index of every rule, with each rule after all of it's dependencies */
+    std::vector<size_t> order;
+};
+
+/** Which rules of a plan need visiting, decided once before anything runs */
+struct DirtySet {
+    /**
+     * Rules that are stale or depend (directly or transitively) on a stale rule. Every other rule
+     * is clean, and is finished without being planned
+     */
+    std::vector<bool> dirty;
+    /**
+     * Rules that were stale before the build started, which are run without checking again. Dirty
+     * rules that are not stale are checked once their dependencies finish, as they only need to
+     * run if a dependency's output actually changed
+     */
+    std::vector<bool> stale;
+};
+
+/** Mutable state shared between the scheduler and it's workers during a single run */
+struct RunState;
+
+/** An output as it was before a job rewrote it, kept to undo the write if nothing changed */
+struct PreviousOutput {
+    std::string filename;
+    std::filesystem::file_time_type write_time;
+    /** The hash of the output's contents, or of it's exported interface if 'interface' is set */
+    uint64_t hash;
+    bool interface;
+};
 
 class RuleRunner {
    public:
     RuleRunner(std::shared_ptr<const RuleGraph> rule_graph, std::shared_ptr<const Config> cfg,
-               std::shared_ptr<ProcessSpawner> proc_spawner, std::shared_ptr<FSGateway> fs_gw);
+               std::shared_ptr<ProcessSpawner> proc_spawner, std::shared_ptr<FSGateway> fs_gw,
+               RunnerOptions opts = {});
 
     /**
-     * @brief Run a rule and all of it's dependencies
+     * @brief Run a rule and all of it's dependencies. Any rule whose rule dependencies have
+     * finished is ready. Ready rules are planned (staleness check + command building) on a work
+     * stealing pool, and up to 'max_jobs' stale rules are executed concurrently. All processes
+     * are spawned and reaped from the calling thread through the spawner's event loop
      *
      * @param rule_name The rule's identifier
+     * @throws If the rule does not exist, the rules form a cycle or any command fails. Jobs
+     * still in flight are cancelled before the error is propagated, unless keeping going in which
+     * case it is propagated once every rule not depending on a failure has been built
      */
     void run_rule(const std::string& rule_name) const;
 
+    /**
+     * @brief Run several rules and all of their dependencies as a single schedule. Rules shared
+     * between targets are only checked and run once, and work for every target overlaps
+     *
+     * @param rule_names The rules' identifiers
+     * @throws Under the same conditions as 'run_rule' for any of the rules
+     */
+    void run_rules(const std::vector<std::string>& rule_names) const;
+
+    /**
+     * Collect every rule reachable from the targets along with it's in-degree, critical path
+     * priority and pool, without running anything
+     * @throws If the rules in the plan form a cycle or a rule uses a pool that is not configured
+     */
+    BuildPlan plan_build(const std::vector<std::string>& rule_names) const;
+
+    /** Plan the build of a single target */
+    BuildPlan plan_build(const std::string& rule_name) const;
+
+    /**
+     * Decide which rules of a plan are dirty. Rules are checked a level at a time in dependency
+     * order, and a rule depending on a dirty rule is marked dirty without being checked. Each
+     * rule is checked at most once and each edge followed once, so the pass is linear in the
+     * size of the plan. Rules within a level are checked in parallel on the planning pool
+     */
+    DirtySet mark_dirty(const BuildPlan& plan) const;
+
    private:
+    /** How often a load monitor is asked again while it is holding jobs back */
+    constexpr static std::chrono::milliseconds THROTTLE_RECHECK{250};
+    /** How often the jobserver is checked for a free token while jobs are waiting for one */
+    constexpr static std::chrono::milliseconds JOBSERVER_RECHECK{10};
+    /** The number of rules checked by each task while marking dirty rules */
+    constexpr static size_t DIRTY_CHECK_BATCH = 64;
+
     std::shared_ptr<const RuleGraph> graph;
     std::shared_ptr<const Config> config;
     std::shared_ptr<ProcessSpawner> process_runner;
     std::shared_ptr<FSGateway> fs_gateway;
+    RunnerOptions options;
+    std::unique_ptr<WorkStealingPool> planner;
+
+    /**
+     * Every file checked for staleness while executing a plan: each rule's output and
+     * dependencies, along with the headers of it's compiles
+     */
+    std::vector<std::string> plan_files(const BuildPlan& plan) const;
+
+    /** Execute the rules of a plan in dependency order */
+    void execute_plan(const BuildPlan& plan) const;
+
+    /**
+     * Decide whether a ready rule needs to run and build it's commands. Runs on the planning pool.
+     * Clean rules are finished immediately while stale rules are handed back to the scheduler
+     */
+    void plan_rule(RunState& state, size_t idx) const;
+
+    /**
+     * Check whether a rule needs to run as the files stand now
+     * @param cmds Set to the rule's commands if they were needed to decide
+     */
+    bool needs_run(const Rule& rule, std::vector<Command>& cmds) const;
+
+    /**
+     * Check whether a rule's commands differ from those it was last built with. Rules missing from
+     * the log are recorded with their current commands rather than rebuilt
+     */
+    bool command_changed(const Rule& rule, const std::vector<Command>& cmds) const;
+
+    /**
+     * Check whether any header a rule's outputs were last compiled from is missing or newer than
+     * the output. Outputs with no headers in the deps log are treated as changed, as their
+     * depfiles have never been read
+     */
+    bool headers_changed(const Rule& rule) const;
+
+    /**
+     * When a rule's output was last brought up to date. This is it's write time, unless restat
+     * put that back to before the rule's last run, in which case the run's start time is used
+     * @returns The time, or nothing if the output does not exist
+     */
+    std::optional<std::filesystem::file_time_type> last_built(const Rule& rule,
+                                                             const std::string& output) const;
+
+    /**
+     * Check whether every input of a rule is older than it's last recorded run, in which case a
+     * rule that looks stale by write times only does because restat put it's output back
+     */
+    bool ran_since_inputs_changed(const Rule& rule) const;
+
+    /**
+     * Put back the write time of every output a job left with the same contents, or for a
+     * shared library the same exported interface
+     * @param previous The outputs as they were before the job ran
+     */
+    void restore_unchanged(const std::vector<PreviousOutput>& previous) const;
+
+    /**
+     * Fold the depfiles written by a rule's job into the deps log, removing them once read. The
+     * rule's listed dependencies are left out as they are already checked
+     */
+    void record_headers(const Rule& rule) const;
+
+    /**
+     * The files a rule's job reads and writes, so it's commands can run remotely. Compiles are
+     * only sent once the deps log knows the headers they read
+     * @returns The files, or nothing if the job must run locally
+     */
+    std::optional<RemoteFiles> remote_files(const Rule& rule) const;
+
+    /**
+     * Work out the cache key of every rule ready to plan at the start of a build, and start
+     * downloading their builds from the remote cache in the background
+     * @param ready The indices of the rules, whose keys are kept in the run state
+     */
+    void prefetch_cached(RunState& state, const std::vector<size_t>& ready) const;
+
+    /**
+     * The key a rule's outputs are cached under, which covers it's commands, the compilers they
+     * run and the contents of it's listed dependencies. Headers are checked separately, as they
+     * are only known once the rule has been built
+     * @returns The key, or nothing if a dependency can not be read
+     */
+    std::optional<uint64_t> cache_key(const Rule& rule, const std::vector<Command>& cmds) const;
+
+    /**
+     * Restore a rule's outputs from the cache, recording them as if the rule's job had run
+     * @returns True if and only if a stored build matched, so the job need not run
+     */
+    bool restore_cached(const Rule& rule, const std::vector<Command>& cmds, uint64_t key) const;
+
+    /**
+     * Store the outputs a rule's job wrote in the cache, along with the headers it read. Nothing is
+     * stored if the headers are not known, as the outputs could not safely be restored
+     */
+    void store_cached(const Rule& rule, uint64_t key) const;
+
+    /** Mark a rule as finished and plan every dependant that has no unfinished dependencies */
+    void finish_rule(RunState& state, size_t idx) const;
 
-    /** Recursive helper for run_rule */
-    void run_rule_recurse(const std::string& rule_name, Visited& visited) const;
+    /** Print the command that produced some output followed by the output as one block */
+    void print_output(const Command& cmd, const OutputBuffer& output) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -29,6 +29,14 @@ ValueList& ValueList::operator+=(const ValueList& other) {
     return *this;
 }
 
+bool ValueList::operator==(const ValueList& other) const {
+    if (elements.size() != other.elements.size()) return false;
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (!(*elements[i] == *other.elements[i])) return false;
+    }
+    return true;
+}
+
 ValueList::iterator ValueList::begin() { return ValueList::iterator(elements.begin()); };
 ValueList::iterator ValueList::end() { return ValueList::iterator(elements.end()); };
 
@@ -43,6 +51,15 @@ const Value& Dictionary::get(const std::string& key) const { return fields.at(ke
 
 bool Dictionary::contains(const std::string& key) const { return fields.contains(key); }
 
+std::vector<std::string> Dictionary::keys() const {
+    std::vector<std::string> out;
+    out.reserve(fields.size());
+    for (const auto& [key, val] : fields) {
+        out.push_back(key);
+    }
+    return out;
+}
+
 Value& Dictionary::insert(const std::string key, Value val) { return fields[key] = val; }
 
 void Dictionary::assert_contains(const std::vector<std::pair<std::string, ValueType>> shape) const {
@@ -72,8 +89,14 @@ Value::Value(ScopedEnumValue x) : raw_val(std::move(x)) { type = ValueType::ENUM
 
 Value::Value(Dictionary x) : raw_val(std::move(x)) { type = ValueType::Dictionary; }
 
+bool Dictionary::operator==(const Dictionary& other) const { return fields == other.fields; }
+
 ValueType Value::get_type() const { return type; }
 
+bool Value::operator==(const Value& other) const {
+    return type == other.type && raw_val == other.raw_val;
+}
+
 Value& Value::operator+=(const Value& other) {
     if (other.type != type) {
         const std::string type_a = type_string_map.at(type);
@@ -29,6 +29,9 @@ class ValueList {
 
     ValueList& operator+=(const ValueList& other);
 
+    /** True if both hold equal elements in the same order */
+    bool operator==(const ValueList& other) const;
+
     template <typename T>
     class ValueIterator {
         using ConstIter = std::vector<std::unique_ptr<Value>>::const_iterator;
@@ -69,6 +72,8 @@ class ValueList {
 struct ScopedEnumValue {
     std::string scope;
     std::string name;
+
+    bool operator==(const ScopedEnumValue&) const = default;
 };
 
 class Dictionary {
@@ -82,6 +87,9 @@ class Dictionary {
     /** Return true if the dictionary contains a type */
     bool contains(const std::string& key) const;
 
+    /** Get every key in the dictionary, in no particular order */
+    std::vector<std::string> keys() const;
+
     /** Add a key-value pair to the dictionary. Returns val */
     Value& insert(const std::string key, Value val);
 
@@ -93,6 +101,9 @@ class Dictionary {
      */
     void assert_contains(const std::vector<std::pair<std::string, ValueType>> shape) const;
 
+    /** True if both hold the same keys with equal values */
+    bool operator==(const Dictionary& other) const;
+
    private:
     std::unordered_map<std::string, Value> fields;
 };
@@ -134,6 +145,9 @@ class Value {
 
     Value& operator+=(const Value& other);
 
+    /** True if both are of the same type and hold equal data */
+    bool operator==(const Value& other) const;
+
     /**
      * @brief Throw an exception if a type does not match it's expected type
 
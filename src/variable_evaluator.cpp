@@ -1,10 +1,12 @@
 #include "variable_evaluator.hpp"
 
+#include <algorithm>
 #include <deque>
 #include <memory>
 #include <ranges>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "built_in/func_registry.hpp"
@@ -16,10 +18,11 @@
 #include "parsing/parser.hpp"
 #include "value.hpp"
 
-VariableEvaluator::VariableEvaluator(std::vector<ParsedVariable> vars, FuncRegistry _fn_reg)
-    : raw_vars(std::move(vars)), fn_reg(_fn_reg) {};
+VariableEvaluator::VariableEvaluator(std::vector<ParsedVariable> vars, FuncRegistry _fn_reg,
+                                     std::vector<ListedDir>* _listed)
+    : raw_vars(std::move(vars)), fn_reg(_fn_reg), listed(_listed) {};
 
-QualifiedDicts VariableEvaluator::evaluate() try {
+QualifiedDicts VariableEvaluator::evaluate(RetainedVars* retained) try {
     std::unordered_map<std::string, std::vector<std::string>> dep_graph;
     for (const ParsedVariable& v : raw_vars) {
         dep_graph[v.identifier] = aggregate_deps(v);
@@ -30,8 +33,44 @@ QualifiedDicts VariableEvaluator::evaluate() try {
     std::vector<std::unique_ptr<Rule>> rules;
     std::unique_ptr<Config> cfg;
 
+    RetainedVars prev;
+    if (retained != nullptr) {
+        prev = std::move(*retained);
+        retained->clear();
+    }
+    RetainedVars next;
+    // Variables whose value differs from the one retained, or that had none
+    std::unordered_set<std::string> changed;
+
     for (const ParsedVariable& var : raw_vars) {
-        var_map[var.identifier] = var.expr->evaluate(var_map, fn_reg);
+        auto kept = prev.find(var.identifier);
+        const auto is_changed = [&](const std::string& dep) { return changed.contains(dep); };
+        const bool reuse = kept != prev.end() && kept->second.fingerprint == var.fingerprint &&
+                           std::ranges::none_of(dep_graph.at(var.identifier), is_changed) &&
+                           ListedDir::unchanged(kept->second.listed);
+
+        if (reuse) {
+            var_map[var.identifier] = std::move(kept->second.val);
+            if (listed != nullptr) {
+                listed->insert(listed->end(), kept->second.listed.begin(),
+                               kept->second.listed.end());
+            }
+            next[var.identifier] = {var.fingerprint, Value(), std::move(kept->second.listed)};
+        } else {
+            const size_t first_listed = listed != nullptr ? listed->size() : 0;
+            Value val = var.expr->evaluate(var_map, fn_reg);
+            // A variable evaluating the same as before leaves it's dependants as they were
+            if (kept == prev.end() || !(kept->second.val == val)) {
+                changed.insert(var.identifier);
+            }
+            var_map[var.identifier] = std::move(val);
+            std::vector<ListedDir> var_listed;
+            if (listed != nullptr) {
+                var_listed.assign(listed->begin() + static_cast<ptrdiff_t>(first_listed),
+                                  listed->end());
+            }
+            next[var.identifier] = {var.fingerprint, Value(), std::move(var_listed)};
+        }
         process_val(var, var_map.at(var.identifier), rules, cfg);
     }
 
@@ -39,6 +78,12 @@ QualifiedDicts VariableEvaluator::evaluate() try {
         throw LogicError("Could not find <Config> qualified dictionary. Config must be added");
     }
 
+    if (retained != nullptr) {
+        for (auto& [id, var] : next) {
+            var.val = std::move(var_map.at(id));
+        }
+        *retained = std::move(next);
+    }
     return QualifiedDicts{std::move(rules), *cfg};
 } catch (std::exception& excep) {
     Error::update_and_throw(excep, "Variable evaluation (includes all dictionaries)");
@@ -1,6 +1,7 @@
 #ifndef VAR_EVALUATOR_H
 #define VAR_EVALUATOR_H
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -15,6 +16,18 @@
 using DepGraph = std::unordered_map<std::string, std::vector<std::string>>;
 using VarMap = std::unordered_map<std::string, Value>;
 
+/** What a variable evaluated to, kept so it is only evaluated again once that could differ */
+struct RetainedVariable {
+    /** The fingerprint of the variable's expression when it was evaluated */
+    uint64_t fingerprint;
+    Value val;
+    /** Every directory listed by 'files' while evaluating the variable's own expression */
+    std::vector<ListedDir> listed;
+};
+
+/** The variables of the last evaluation that succeeded, by identifier */
+using RetainedVars = std::unordered_map<std::string, RetainedVariable>;
+
 class VariableEvaluator {
    public:
     /**
@@ -22,22 +35,31 @@ class VariableEvaluator {
      *
      * @param vars The parsed, but not evaluated variables
      * @param _fn_reg The registry of functions used in evaluating variables
+     * @param _listed Where the registry's 'files' adds each directory it lists, if it records
+     * them. The directories of variables that aren't evaluated again are added too, so it ends up
+     * holding every directory the evaluation depends on
      */
-    VariableEvaluator(std::vector<ParsedVariable> vars, FuncRegistry _fn_reg);
+    VariableEvaluator(std::vector<ParsedVariable> vars, FuncRegistry _fn_reg,
+                      std::vector<ListedDir>* _listed = nullptr);
 
     /**
      * @brief Evaluating variables in the topological order
      *
+     * @param retained The variables of an earlier evaluation, replaced by those of this one. A
+     * variable whose expression is unchanged, whose dependencies evaluate the same as before and
+     * whose listed directories are unchanged keeps it's earlier value rather than being evaluated
+     * again. Cleared if the evaluation fails
      * @return QualifiedDicts the qualified dictionaries extracted from the evaluated variables
      * @throws If no config could be found
      */
-    QualifiedDicts evaluate();
+    QualifiedDicts evaluate(RetainedVars* retained = nullptr);
 
    private:
     std::vector<ParsedVariable> raw_vars;
 
     VarMap var_map;
     FuncRegistry fn_reg;
+    std::vector<ListedDir>* listed;
 
     /** Given an expression, return its dependencies */
     std::vector<std::string> aggregate_deps(const ParsedVariable& var) const;
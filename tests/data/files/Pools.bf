@@ -0,0 +1,24 @@
+<Config> cfg {
+    compiler = "g++"
+    compilation_flags = ["-c"]
+    link_flags = []
+    default_rule = "app"
+    pools = {
+        heavy = "1"
+    }
+}
+
+src_files = ["main.cpp", "utils.cpp", "parser.cpp"]
+obj_files = ["main.o", "utils.o", "parser.o"]
+
+<MultiRule> compilation {
+    deps = src_files
+    output = obj_files
+    step = Step::COMPILE
+    pool = "heavy"
+}
+
+<Rule> app {
+    deps = obj_files
+    step = Step::LINK
+}
@@ -0,0 +1,14 @@
+#include "fake_load_monitor.hpp"
+
+FakeLoadMonitor::FakeLoadMonitor(size_t _capacity) : capacity(_capacity) {}
+
+bool FakeLoadMonitor::can_start(size_t running) {
+    if (running < capacity) return true;
+
+    throttle_count++;
+    return false;
+}
+
+void FakeLoadMonitor::set_capacity(size_t _capacity) { capacity = _capacity; }
+
+size_t FakeLoadMonitor::get_throttle_count() const { return throttle_count; }
@@ -0,0 +1,27 @@
+#ifndef FAKE_LOAD_MONITOR_H
+#define FAKE_LOAD_MONITOR_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "src/concurrency/load_monitor.hpp"
+
+/** Load monitor reporting a fixed capacity for jobs, as if the machine could only fit that many */
+class FakeLoadMonitor : public LoadMonitor {
+   public:
+    explicit FakeLoadMonitor(size_t capacity);
+
+    bool can_start(size_t running) override;
+
+    /** Change the number of jobs the machine can fit */
+    void set_capacity(size_t capacity);
+
+    /** Get the number of times a job was held back */
+    size_t get_throttle_count() const;
+
+   private:
+    std::atomic<size_t> capacity;
+    std::atomic<size_t> throttle_count = 0;
+};
+
+#endif
@@ -1,12 +1,20 @@
 #include "mock_fs_gateway.hpp"
 
 #include <chrono>
+#include <functional>
 #include <filesystem>
+#include <mutex>
 #include <stdexcept>
 
-bool MockFsGateway::exists(std::string filename) const { return name_to_file.contains(filename); }
+bool MockFsGateway::exists(std::string filename) const {
+    std::lock_guard lock(mtx);
+    query_counts[filename]++;
+    return name_to_file.contains(filename);
+}
 
 std::filesystem::file_time_type MockFsGateway::last_write_time(std::string filename) const {
+    std::lock_guard lock(mtx);
+    query_counts[filename]++;
     auto entry = name_to_file.find(filename);
     if (entry == name_to_file.end()) {
         throw std::invalid_argument("Cannot get last write time of '" + filename + "'");
@@ -20,6 +28,7 @@ void MockFsGateway::touch(std::string filename) {
 }
 
 void MockFsGateway::touch_at(std::string filename, std::filesystem::file_time_type time) {
+    std::lock_guard lock(mtx);
     auto entry = name_to_file.find(filename);
     if (entry == name_to_file.end()) {
         name_to_file[filename] = MockFileEntry{filename, time, 1};
@@ -30,6 +39,7 @@ void MockFsGateway::touch_at(std::string filename, std::filesystem::file_time_ty
 }
 
 size_t MockFsGateway::get_write_count(std::string filename) {
+    std::lock_guard lock(mtx);
     auto entry = name_to_file.find(filename);
     if (entry == name_to_file.end()) {
         throw std::invalid_argument("Cannot get write count of '" + filename + "'");
@@ -37,3 +47,58 @@ size_t MockFsGateway::get_write_count(std::string filename) {
 
     return entry->second.write_count;
 }
+
+size_t MockFsGateway::get_query_count(std::string filename) const {
+    std::lock_guard lock(mtx);
+    auto entry = query_counts.find(filename);
+    return entry == query_counts.end() ? 0 : entry->second;
+}
+
+std::optional<uint64_t> MockFsGateway::hash_contents(const std::string& filename) const {
+    std::lock_guard lock(mtx);
+    auto entry = name_to_file.find(filename);
+    if (entry == name_to_file.end()) return std::nullopt;
+
+    const MockFileEntry& file = entry->second;
+    return std::hash<std::string>{}(file.contents.value_or(filename + "#" +
+                                                            std::to_string(file.write_count)));
+}
+
+std::optional<uint64_t> MockFsGateway::hash_interface(const std::string& filename) const {
+    {
+        std::lock_guard lock(mtx);
+        auto entry = name_to_file.find(filename);
+        if (entry != name_to_file.end() && entry->second.interface.has_value()) {
+            return std::hash<std::string>{}(*entry->second.interface);
+        }
+    }
+    return hash_contents(filename);
+}
+
+void MockFsGateway::set_write_time(const std::string& filename,
+                                   std::filesystem::file_time_type time) {
+    std::lock_guard lock(mtx);
+    auto entry = name_to_file.find(filename);
+    if (entry == name_to_file.end()) {
+        throw std::invalid_argument("Cannot set write time of '" + filename + "'");
+    }
+    entry->second.last_write_time = time;
+}
+
+void MockFsGateway::set_contents(const std::string& filename, std::string contents) {
+    std::lock_guard lock(mtx);
+    auto entry = name_to_file.find(filename);
+    if (entry == name_to_file.end()) {
+        throw std::invalid_argument("Cannot set contents of '" + filename + "'");
+    }
+    entry->second.contents = std::move(contents);
+}
+
+void MockFsGateway::set_interface(const std::string& filename, std::string interface) {
+    std::lock_guard lock(mtx);
+    auto entry = name_to_file.find(filename);
+    if (entry == name_to_file.end()) {
+        throw std::invalid_argument("Cannot set interface of '" + filename + "'");
+    }
+    entry->second.interface = std::move(interface);
+}
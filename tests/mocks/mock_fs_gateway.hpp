@@ -2,6 +2,8 @@
 #define MOCK_FS_GATEWAY_H
 
 #include <filesystem>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
@@ -11,9 +13,13 @@ struct MockFileEntry {
     std::string name;
     std::filesystem::file_time_type last_write_time;
     size_t write_count;
+    /** Fixed contents that survive every write, if set */
+    std::optional<std::string> contents = std::nullopt;
+    /** A fixed exported interface that survives every write, if set */
+    std::optional<std::string> interface = std::nullopt;
 };
 
-/** Mock FSGateway that works in memory with file modification logs */
+/** Mock FSGateway that works in memory with file modification logs. Safe to share between jobs */
 class MockFsGateway : public FSGateway {
    public:
     bool exists(std::string filename) const override;
@@ -22,14 +28,37 @@ class MockFsGateway : public FSGateway {
 
     void touch(std::string filename) override;
 
+    /**
+     * Files given contents through 'set_contents' hash the same however often they are written.
+     * Every other file hashes differently after each write
+     */
+    std::optional<uint64_t> hash_contents(const std::string& filename) const override;
+
+    /** Files given an interface through 'set_interface' otherwise hash as 'hash_contents' */
+    std::optional<uint64_t> hash_interface(const std::string& filename) const override;
+
+    void set_write_time(const std::string& filename,
+                        std::filesystem::file_time_type time) override;
+
+    /** Give an existing file contents that are kept when it is written */
+    void set_contents(const std::string& filename, std::string contents);
+
+    /** Give an existing file an exported interface that is kept when it is written */
+    void set_interface(const std::string& filename, std::string interface);
+
     /** Mock the creation of a file at a specified time */
     void touch_at(std::string filename, std::filesystem::file_time_type time);
 
     /** Get the number of times a file has been written to */
     size_t get_write_count(std::string filename);
 
+    /** Get the number of times a file's existence or write time has been queried */
+    size_t get_query_count(std::string filename) const;
+
    private:
+    mutable std::mutex mtx;
     std::unordered_map<std::string, MockFileEntry> name_to_file;
+    mutable std::unordered_map<std::string, size_t> query_counts;
 };
 
 #endif
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "mock_proc_spawner.hpp"
 
+#include <algorithm>
+#include <utility>
+
+#include "src/errors/error.hpp"
+
 MockProcSpawner::MockProcSpawner(std::shared_ptr<MockFsGateway> mock_fs)
     : fs(std::move(mock_fs)), run_count(0) {};
 
@@ -13,11 +18,109 @@ int MockProcSpawner::run(std::vector<std::string>& cmd) {
         throw std::invalid_argument("Cannot run mock spawner as cmd \"-o\" isn't followed by name");
     }
 
-    fs->touch(*out_prefix);
-
     run_count++;
+    {
+        std::lock_guard lock(order_mtx);
+        run_order.push_back(*out_prefix);
+        if (failing.contains(*out_prefix)) {
+            return 1;
+        }
+    }
+
+    fs->touch(*out_prefix);
 
     return 0;
 }
 
+ProcessId MockProcSpawner::spawn(std::vector<std::string>& cmd) {
+    const int status = run(cmd);
+
+    std::shared_ptr<OutputBuffer> output;
+    {
+        std::lock_guard lock(order_mtx);
+        auto itm = outputs.find(run_order.back());
+        if (itm != outputs.end()) {
+            output = std::make_shared<OutputBuffer>();
+            output->append(itm->second);
+        }
+    }
+
+    std::lock_guard lock(wait_mtx);
+    const ProcessId id = next_id++;
+    max_in_flight = std::max(max_in_flight, ++in_flight);
+    std::exception_ptr err;
+    if (status != 0) {
+        err = std::make_exception_ptr(SystemError("Mock command failed"));
+    }
+    completed.push_back(ProcessResult{id, status, err, output});
+    wait_cv.notify_all();
+    return id;
+}
+
+std::vector<ProcessResult> MockProcSpawner::wait_any(
+    std::optional<std::chrono::milliseconds> timeout) {
+    std::unique_lock lock(wait_mtx);
+    auto ready = [&] { return !completed.empty() || interrupted; };
+    if (timeout.has_value()) {
+        wait_cv.wait_for(lock, *timeout, ready);
+    } else {
+        wait_cv.wait(lock, ready);
+    }
+
+    interrupted = false;
+    in_flight -= completed.size();
+    return std::exchange(completed, {});
+}
+
+void MockProcSpawner::interrupt() {
+    std::lock_guard lock(wait_mtx);
+    interrupted = true;
+    wait_cv.notify_all();
+}
+
+void MockProcSpawner::cancel(ProcessId) {}
+
+size_t MockProcSpawner::remote_capacity() const { return remote_slots; }
+
+ProcessId MockProcSpawner::spawn_remote(std::vector<std::string>& cmd, const RemoteFiles&) {
+    remote_count++;
+    if (!remote_fails) {
+        return spawn(cmd);
+    }
+
+    std::lock_guard lock(wait_mtx);
+    const ProcessId id = next_id++;
+    max_in_flight = std::max(max_in_flight, ++in_flight);
+    completed.push_back(ProcessResult{
+        id, 1, std::make_exception_ptr(SystemError("Mock remote command failed")), nullptr});
+    wait_cv.notify_all();
+    return id;
+}
+
+size_t MockProcSpawner::get_max_in_flight() const {
+    std::lock_guard lock(wait_mtx);
+    return max_in_flight;
+}
+
 size_t MockProcSpawner::get_run_count() const { return run_count; }
+
+std::vector<std::string> MockProcSpawner::get_run_order() const {
+    std::lock_guard lock(order_mtx);
+    return run_order;
+}
+
+void MockProcSpawner::set_output(const std::string& file, std::string output) {
+    std::lock_guard lock(order_mtx);
+    outputs[file] = std::move(output);
+}
+
+void MockProcSpawner::fail_on(const std::string& file) {
+    std::lock_guard lock(order_mtx);
+    failing.insert(file);
+}
+
+void MockProcSpawner::set_remote_capacity(size_t slots) { remote_slots = slots; }
+
+void MockProcSpawner::fail_remote() { remote_fails = true; }
+
+size_t MockProcSpawner::get_remote_count() const { return remote_count; }
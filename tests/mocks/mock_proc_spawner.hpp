@@ -1,28 +1,90 @@
-
-
 #ifndef MOCK_PROC_SPAWNER_H
 #define MOCK_PROC_SPAWNER_H
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "mock_fs_gateway.hpp"
 #include "src/io/proc_spawner.hpp"
 
-/** @note Only supports compilation as of now */
+/**
+ * Mock spawner that "runs" commands by touching their output. Spawned processes complete
+ * immediately and are reported by the next call to wait_any
+ * @note Only supports compilation as of now
+ */
 class MockProcSpawner : public ProcessSpawner {
    public:
     MockProcSpawner(std::shared_ptr<MockFsGateway> mock_fs);
 
     int run(std::vector<std::string>& cmd) override;
 
+    ProcessId spawn(std::vector<std::string>& cmd) override;
+
+    std::vector<ProcessResult> wait_any(
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+
+    void interrupt() override;
+
+    /** Processes complete as soon as they are spawned so there is never anything to cancel */
+    void cancel(ProcessId id) override;
+
+    size_t remote_capacity() const override;
+
+    /** "Runs" the command like 'spawn', failing instead if remote commands are set to fail */
+    ProcessId spawn_remote(std::vector<std::string>& cmd, const RemoteFiles& files) override;
+
     size_t get_run_count() const;
 
+    /** Get the outputs of each run command in the order they were run */
+    std::vector<std::string> get_run_order() const;
+
+    /** Make spawned commands that build a file report some captured output */
+    void set_output(const std::string& file, std::string output);
+
+    /**
+     * Get the most processes that were ever spawned but not yet reported by wait_any, i.e. the
+     * peak number of jobs the caller had running at once
+     */
+    size_t get_max_in_flight() const;
+
+    /** Make spawned commands that build a file fail without touching it */
+    void fail_on(const std::string& file);
+
+    /** Allow commands to be spawned remotely, with up to 'slots' running at once */
+    void set_remote_capacity(size_t slots);
+
+    /** Make every command spawned remotely fail without touching it's output */
+    void fail_remote();
+
+    /** Get the number of commands that were spawned remotely */
+    size_t get_remote_count() const;
+
    private:
     std::shared_ptr<MockFsGateway> fs;
     /** Number of times the run method has been used */
-    size_t run_count;
+    std::atomic<size_t> run_count;
+
+    mutable std::mutex order_mtx;
+    std::vector<std::string> run_order;
+    std::unordered_map<std::string, std::string> outputs;
+    std::unordered_set<std::string> failing;
+    size_t remote_slots = 0;
+    std::atomic<bool> remote_fails = false;
+    std::atomic<size_t> remote_count = 0;
+
+    mutable std::mutex wait_mtx;
+    std::condition_variable wait_cv;
+    std::vector<ProcessResult> completed;
+    size_t in_flight = 0;
+    size_t max_in_flight = 0;
+    ProcessId next_id = 1;
+    bool interrupted = false;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,127 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/history/artifact_cache.hpp"
+#include "src/io/file_utils.hpp"
+#include "utils.hpp"
+
+namespace {
+const auto ALWAYS = [](const CacheEntry&) { return true; };
+}  // namespace
+
+TEST_CASE("Cached outputs are restored by key", "[artifact_cache]") {
+    const auto dir = IO::fresh_test_dir("artifact_cache");
+    const std::string output = dir / "a.o";
+    ArtifactCache cache(dir / "cache");
+
+    REQUIRE_FALSE(cache.fetch(1, ALWAYS).has_value());
+
+    IO::write_file(output, "first build");
+    cache.store(1, {}, {output});
+    IO::write_file(output, "second build");
+    cache.store(2, {}, {output});
+
+    std::filesystem::remove(output);
+    const auto entry = cache.fetch(1, ALWAYS);
+    REQUIRE(entry.has_value());
+    REQUIRE(entry->outputs.size() == 1);
+    REQUIRE(FileUtils::read_all(output) == "first build");
+
+    REQUIRE(cache.fetch(2, ALWAYS).has_value());
+    REQUIRE(FileUtils::read_all(output) == "second build");
+
+    const CacheStats stats = cache.stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.stores == 2);
+}
+
+TEST_CASE("Restored outputs keep their permissions", "[artifact_cache]") {
+    const auto dir = IO::fresh_test_dir("artifact_cache");
+    const std::string output = dir / "app";
+    ArtifactCache cache(dir / "cache");
+
+    IO::write_file(output, "#!/bin/sh\n");
+    std::filesystem::permissions(output, std::filesystem::perms::owner_all);
+    cache.store(1, {}, {output});
+    std::filesystem::remove(output);
+
+    REQUIRE(cache.fetch(1, ALWAYS).has_value());
+    const auto perms = std::filesystem::status(output).permissions();
+    REQUIRE((perms & std::filesystem::perms::owner_exec) != std::filesystem::perms::none);
+}
+
+TEST_CASE("Builds reading different headers are kept side by side", "[artifact_cache]") {
+    const auto dir = IO::fresh_test_dir("artifact_cache");
+    const std::string output = dir / "a.o";
+    ArtifactCache cache(dir / "cache");
+
+    IO::write_file(output, "with old header");
+    cache.store(1, {{"a.h", 10}}, {output});
+    IO::write_file(output, "with new header");
+    cache.store(1, {{"a.h", 20}}, {output});
+
+    auto header_is = [](uint64_t hash) {
+        return [hash](const CacheEntry& entry) { return entry.headers.front().second == hash; };
+    };
+    REQUIRE(cache.fetch(1, header_is(10)).has_value());
+    REQUIRE(FileUtils::read_all(output) == "with old header");
+    REQUIRE(cache.fetch(1, header_is(20)).has_value());
+    REQUIRE(FileUtils::read_all(output) == "with new header");
+    REQUIRE_FALSE(cache.fetch(1, header_is(30)).has_value());
+
+    // Storing the same headers again replaces the build rather than adding another
+    IO::write_file(output, "rebuilt");
+    cache.store(1, {{"a.h", 10}}, {output});
+    std::vector<uint64_t> stored;
+    cache.fetch(1, [&](const CacheEntry& entry) {
+        stored.push_back(entry.headers.front().second);
+        return false;
+    });
+    REQUIRE(stored == std::vector<uint64_t>{10, 20});
+}
+
+TEST_CASE("Trimming removes the least recently used builds", "[artifact_cache]") {
+    const auto dir = IO::fresh_test_dir("artifact_cache");
+    const std::string output = dir / "a.o";
+    ArtifactCache cache(dir / "cache", 250);
+
+    for (uint64_t key = 1; key <= 3; key++) {
+        IO::write_file(output, std::string(100, static_cast<char>('a' + key)));
+        cache.store(key, {}, {output});
+    }
+    // Using the oldest build makes it the most recent, so the second is evicted instead
+    const auto old = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    for (const auto& file : std::filesystem::directory_iterator(dir / "cache" / "entries")) {
+        std::filesystem::last_write_time(file.path(), old);
+    }
+    REQUIRE(cache.fetch(1, ALWAYS).has_value());
+    std::filesystem::last_write_time(dir / "cache" / "entries" / "3",
+                                     old + std::chrono::minutes(1));
+
+    cache.trim();
+    REQUIRE(cache.fetch(1, ALWAYS).has_value());
+    REQUIRE_FALSE(cache.fetch(2, ALWAYS).has_value());
+    REQUIRE(cache.fetch(3, ALWAYS).has_value());
+    const auto objects = std::distance(
+        std::filesystem::directory_iterator(dir / "cache" / "objects"), {});
+    REQUIRE(objects == 2);
+}
+
+TEST_CASE("Programs are identified by their build", "[artifact_cache]") {
+    const auto dir = IO::fresh_test_dir("artifact_cache");
+    const std::string program = dir / "cc";
+    IO::write_file(program, "v1");
+    std::filesystem::permissions(program, std::filesystem::perms::owner_all);
+
+    ArtifactCache cache(dir / "cache");
+    ArtifactCache other(dir / "cache");
+    const uint64_t first = cache.program_identity(program);
+    REQUIRE(cache.program_identity(program) == first);
+    REQUIRE(cache.program_identity("sh") != first);
+
+    IO::write_file(program, "version 2");
+    REQUIRE(other.program_identity(program) != first);
+}
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/daemon/build_daemon.hpp"
+#include "src/errors/error.hpp"
+#include "utils.hpp"
+
+namespace {
+/** A build daemon serving and running builds on background threads for the lifetime of the test */
+struct RunningDaemon {
+    Net::RunningServer<BuildDaemon> running;
+    BuildDaemon& daemon = running.server;
+    std::atomic<bool> stopping = false;
+    /** Joined before the daemon is stopped, as members are destroyed in reverse order */
+    std::jthread building;
+
+    RunningDaemon(const Endpoint& endpoint, BuildDaemon::BuildFn build)
+        : running(endpoint, std::vector<std::string>{"-k", "Buildfile"}, std::move(build)),
+          building([this] {
+              while (!stopping) {
+                  daemon.run_next(std::chrono::milliseconds(10));
+              }
+          }) {}
+
+    ~RunningDaemon() {
+        stopping = true;
+        building.join();
+    }
+};
+}  // namespace
+
+TEST_CASE("Build requests and progress survive encoding", "[build_daemon]") {
+    const DaemonRequest request{{"-j", "4", "a b.bf"}, {"app", ""}};
+    REQUIRE(decode_request(encode_request(request)) == request);
+
+    const DaemonProgress progress{true, false, std::string("a.c:1: error\0\n", 14)};
+    REQUIRE(decode_progress(encode_progress(progress)) == progress);
+
+    REQUIRE_THROWS(decode_request("3:abc,"));
+    REQUIRE_THROWS(decode_progress(encode_progress(progress).substr(1)));
+}
+
+TEST_CASE("Build daemons run builds for clients and send back their output", "[build_daemon]") {
+    const Endpoint endpoint =
+        Endpoint::parse("unix:" + (IO::fresh_test_dir("build_daemon") / "server.sock").string());
+    std::ostream* output = nullptr;
+    RunningDaemon running(endpoint, [&](const std::vector<std::string>& targets) {
+        for (const std::string& target : targets) {
+            *output << "Built " << target << std::endl;
+        }
+        return targets.size() != 1 || targets[0] != "broken";
+    });
+    output = &running.daemon.get_output();
+
+    std::ostringstream out;
+    REQUIRE(build_on_daemon(endpoint, DaemonRequest{{"-k", "Buildfile"}, {"a", "b"}}, out) == true);
+    REQUIRE(out.str() == "Built a\nBuilt b\n");
+
+    out.str("");
+    REQUIRE(build_on_daemon(endpoint, DaemonRequest{{"-k", "Buildfile"}, {"broken"}}, out) ==
+            false);
+    REQUIRE(out.str() == "Built broken\n");
+
+    // Builds are only run with the options the daemon was started with
+    REQUIRE_THROWS_AS(build_on_daemon(endpoint, DaemonRequest{{"Buildfile"}, {"a"}}, out),
+                      LogicError);
+
+    REQUIRE(running.daemon.handle({"GET", "/builds/123?from=0", ""}).status == 404);
+    REQUIRE(running.daemon.handle({"GET", "/builds/x", ""}).status == 400);
+    REQUIRE(running.daemon.handle({"POST", "/builds", "garbage"}).status == 400);
+}
+
+TEST_CASE("Builds asked for at once are run one at a time", "[build_daemon]") {
+    const Endpoint endpoint =
+        Endpoint::parse("unix:" + (IO::fresh_test_dir("build_daemon") / "server.sock").string());
+    std::atomic<int> active = 0;
+    std::atomic<bool> overlapped = false;
+    RunningDaemon running(endpoint, [&](const std::vector<std::string>&) {
+        overlapped = overlapped || active++ > 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        active--;
+        return true;
+    });
+
+    std::atomic<int> succeeded = 0;
+    {
+        std::vector<std::jthread> clients;
+        for (int i = 0; i < 4; i++) {
+            clients.emplace_back([&] {
+                std::ostringstream out;
+                const DaemonRequest request{{"-k", "Buildfile"}, {"app"}};
+                if (build_on_daemon(endpoint, request, out) == true) succeeded++;
+            });
+        }
+    }
+    REQUIRE(succeeded == 4);
+    REQUIRE_FALSE(overlapped);
+}
+
+TEST_CASE("Clients find no daemon where none is listening", "[build_daemon]") {
+    const Endpoint endpoint =
+        Endpoint::parse("unix:" + (IO::fresh_test_dir("build_daemon") / "server.sock").string());
+    std::ostringstream out;
+    REQUIRE_FALSE(build_on_daemon(endpoint, DaemonRequest{{}, {"app"}}, out).has_value());
+}
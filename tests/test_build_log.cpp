@@ -0,0 +1,101 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/history/build_log.hpp"
+#include "utils.hpp"
+
+TEST_CASE("Build log records the latest run of each rule", "[build_log]") {
+    BuildLog log;
+    REQUIRE_FALSE(log.get("a.o").has_value());
+
+    log.record("a.o", BuildLogEntry{1, 10, 20});
+    log.record("a.o", BuildLogEntry{2, 30, 40});
+    REQUIRE(log.get("a.o")->command_hash == 2);
+    REQUIRE(log.get("a.o")->start_ns == 30);
+    REQUIRE(log.get("a.o")->end_ns == 40);
+}
+
+TEST_CASE("Build log persists between builds", "[build_log]") {
+    const auto path = IO::fresh_test_dir("build_log") / "state" / "build_log";
+    {
+        BuildLog log(path);
+        log.record("a.o", BuildLogEntry{1, 10, 20});
+        log.record("dir/with space.o", BuildLogEntry{2, 0, 0});
+    }
+
+    BuildLog loaded(path);
+    REQUIRE(loaded.get("a.o")->command_hash == 1);
+    REQUIRE(loaded.get("dir/with space.o")->command_hash == 2);
+    REQUIRE_FALSE(loaded.get("b.o").has_value());
+}
+
+TEST_CASE("Records cut short are dropped", "[build_log]") {
+    const auto path = IO::fresh_test_dir("build_log") / "state" / "build_log";
+    {
+        BuildLog log(path);
+        log.record("a.o", BuildLogEntry{1, 0, 0});
+        log.record("b.o", BuildLogEntry{2, 0, 0});
+    }
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+    {
+        BuildLog log(path);
+        REQUIRE(log.get("a.o")->command_hash == 1);
+        REQUIRE_FALSE(log.get("b.o").has_value());
+        log.record("c.o", BuildLogEntry{3, 0, 0});
+    }
+
+    BuildLog loaded(path);
+    REQUIRE(loaded.get("a.o")->command_hash == 1);
+    REQUIRE(loaded.get("c.o")->command_hash == 3);
+}
+
+TEST_CASE("Files that are not build logs are discarded", "[build_log]") {
+    const auto path = IO::fresh_test_dir("build_log") / "state" / "build_log";
+    IO::write_file(path, "not a build log, just some text long enough to hold a header");
+
+    {
+        BuildLog log(path);
+        REQUIRE_FALSE(log.get("a.o").has_value());
+        log.record("a.o", BuildLogEntry{1, 0, 0});
+    }
+    REQUIRE(BuildLog(path).get("a.o")->command_hash == 1);
+}
+
+TEST_CASE("Build log is compacted once enough records are appended", "[build_log]") {
+    const auto path = IO::fresh_test_dir("build_log") / "state" / "build_log";
+    const size_t rule_count = 100;
+    {
+        BuildLog log(path);
+        for (size_t i = 0; i <= BuildLog::COMPACTION_THRESHOLD; i++) {
+            log.record("obj_" + std::to_string(i % rule_count), BuildLogEntry{i, 0, 0});
+        }
+        const auto appended_size = std::filesystem::file_size(path);
+        log.compact_if_needed();
+        REQUIRE(std::filesystem::file_size(path) < appended_size);
+
+        // Records appended after compaction take precedence over the table
+        log.record("obj_0", BuildLogEntry{12345, 0, 0});
+        REQUIRE(log.get("obj_0")->command_hash == 12345);
+    }
+
+    BuildLog loaded(path);
+    REQUIRE(loaded.get("obj_0")->command_hash == 12345);
+    for (size_t i = 1; i < rule_count; i++) {
+        // The latest record of each rule
+        const size_t last = BuildLog::COMPACTION_THRESHOLD;
+        const size_t latest = last - (last - i) % rule_count;
+        REQUIRE(loaded.get("obj_" + std::to_string(i))->command_hash == latest);
+    }
+    REQUIRE_FALSE(loaded.get("obj_" + std::to_string(rule_count)).has_value());
+}
+
+TEST_CASE("Command hashes separate tokens and commands", "[build_log]") {
+    const auto hash = BuildLog::hash_commands;
+    REQUIRE(hash({{"g++", "a.c"}}) == hash({{"g++", "a.c"}}));
+    REQUIRE(hash({{"ab", "c"}}) != hash({{"a", "bc"}}));
+    REQUIRE(hash({{"a", "b"}}) != hash({{"a"}, {"b"}}));
+    REQUIRE(hash({{"g++", "-O2", "a.c"}}) != hash({{"g++", "-O3", "a.c"}}));
+}
@@ -0,0 +1,162 @@
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catch.hpp"
+#include "mocks/mock_fs_gateway.hpp"
+#include "src/io/caching_fs_gateway.hpp"
+#include "src/io/fs_gateway.hpp"
+#include "utils.hpp"
+
+TEST_CASE("Each file is only queried once", "[fs_gateway]") {
+    auto mock = std::make_shared<MockFsGateway>();
+    const auto written = Time::past();
+    mock->touch_at("a.h", written);
+    CachingFSGateway fs(mock);
+
+    for (int i = 0; i < 3; i++) {
+        REQUIRE(fs.exists("a.h"));
+        REQUIRE(fs.last_write_time("a.h") == written);
+        REQUIRE_FALSE(fs.exists("missing.h"));
+    }
+
+    // The uncached gateway checks existence and write time separately
+    REQUIRE(mock->get_query_count("a.h") == 2);
+    REQUIRE(mock->get_query_count("missing.h") == 1);
+}
+
+TEST_CASE("Invalidated files are queried again", "[fs_gateway]") {
+    auto mock = std::make_shared<MockFsGateway>();
+    CachingFSGateway fs(mock);
+    REQUIRE_FALSE(fs.exists("a.o"));
+    REQUIRE(fs.cached_files() == std::vector<std::string>{"a.o"});
+
+    SECTION("Written by a job") {
+        const auto written = Time::future();
+        mock->touch_at("a.o", written);
+        REQUIRE_FALSE(fs.exists("a.o"));
+        fs.invalidate("a.o");
+        REQUIRE(fs.cached_files().empty());
+        REQUIRE(fs.last_write_time("a.o") == written);
+    }
+
+    SECTION("Written through the gateway") {
+        fs.touch("a.o");
+        REQUIRE(fs.exists("a.o"));
+    }
+}
+
+TEST_CASE("Refreshed files report whether they changed", "[fs_gateway]") {
+    auto mock = std::make_shared<MockFsGateway>();
+    mock->touch_at("a.c", Time::past());
+    CachingFSGateway fs(mock);
+
+    // Nothing was remembered to compare with
+    REQUIRE(fs.refresh("a.c"));
+    REQUIRE_FALSE(fs.refresh("a.c"));
+    REQUIRE(fs.cached_files() == std::vector<std::string>{"a.c"});
+
+    const auto written = Time::future();
+    mock->set_write_time("a.c", written);
+    REQUIRE(fs.refresh("a.c"));
+    REQUIRE(fs.last_write_time("a.c") == written);
+
+    REQUIRE_FALSE(fs.exists("a.o"));
+    mock->touch_at("a.o", Time::past());
+    REQUIRE(fs.refresh("a.o"));
+    REQUIRE(fs.exists("a.o"));
+}
+
+TEST_CASE("Files invalidated while being queried are queried again", "[fs_gateway]") {
+    /** Runs a callback in the middle of the next query, as a job finishing at that moment would */
+    struct RacingFsGateway : MockFsGateway {
+        mutable std::function<void()> during_query;
+
+        std::optional<std::filesystem::file_time_type> modified_time(
+            const std::string& filename) const override {
+            const auto write_t = MockFsGateway::modified_time(filename);
+            if (during_query) std::exchange(during_query, nullptr)();
+            return write_t;
+        }
+    };
+    auto mock = std::make_shared<RacingFsGateway>();
+    mock->touch_at("a.o", Time::past());
+    CachingFSGateway fs(mock);
+    const auto written = Time::future();
+    mock->during_query = [&] {
+        mock->set_write_time("a.o", written);
+        fs.invalidate("a.o");
+    };
+
+    SECTION("Queried alone") { fs.modified_time("a.o"); }
+
+    SECTION("Queried in a batch") {
+        const std::vector<std::string> files = {"a.o"};
+        fs.stat_many(files);
+    }
+
+    REQUIRE(fs.modified_time("a.o") == written);
+}
+
+TEST_CASE("Prefetched files are not queried again", "[fs_gateway]") {
+    auto mock = std::make_shared<MockFsGateway>();
+    const auto written = Time::past();
+    mock->touch_at("a.h", written);
+    CachingFSGateway fs(mock);
+
+    const std::vector<std::string> files = {"a.h", "missing.h", "a.h"};
+    fs.prefetch(files);
+    const size_t after_prefetch = mock->get_query_count("a.h");
+
+    const auto times = fs.stat_many(files);
+    REQUIRE(times.size() == 3);
+    REQUIRE(times[0] == written);
+    REQUIRE_FALSE(times[1].has_value());
+    REQUIRE(times[2] == written);
+    REQUIRE(fs.exists("a.h"));
+    REQUIRE(mock->get_query_count("a.h") == after_prefetch);
+    REQUIRE(mock->get_query_count("missing.h") == 1);
+}
+
+TEST_CASE("Missing files fail like the underlying gateway", "[fs_gateway]") {
+    CachingFSGateway fs(std::make_shared<MockFsGateway>());
+    REQUIRE_THROWS_AS(fs.last_write_time("missing.h"), std::invalid_argument);
+}
+
+TEST_CASE("Write times from statx match std::filesystem", "[fs_gateway]") {
+    const auto path = IO::fresh_test_dir("statx") / "file";
+    IO::write_file(path, "data");
+    ProdFSGateway prod;
+    FSGateway& fs = prod;
+
+    REQUIRE(fs.modified_time(path.string()) == std::filesystem::last_write_time(path));
+    std::filesystem::remove(path);
+    REQUIRE_FALSE(fs.modified_time(path.string()).has_value());
+    REQUIRE_FALSE(fs.modified_time((path / "child").string()).has_value());
+}
+
+TEST_CASE("Batched queries match individual queries", "[fs_gateway]") {
+    // More files than a single io_uring submission holds
+    const auto dir = IO::fresh_test_dir("stat_many");
+    std::vector<std::string> files;
+    for (int i = 0; i < 600; i++) {
+        const auto path = dir / std::to_string(i);
+        if (i % 3 != 0) {
+            IO::write_file(path, std::to_string(i));
+        }
+        files.push_back(path.string());
+    }
+
+    ProdFSGateway prod;
+    FSGateway& fs = prod;
+    const auto times = fs.stat_many(files);
+    REQUIRE(times.size() == files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        REQUIRE(times[i] == fs.modified_time(files[i]));
+        REQUIRE(times[i].has_value() == (i % 3 != 0));
+    }
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,126 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "mocks/mock_fs_gateway.hpp"
+#include "mocks/mock_proc_spawner.hpp"
+#include "src/build_orchestrator.hpp"
+#include "src/built_in/funcs.hpp"
+#include "src/history/compiled_buildfile.hpp"
+#include "src/io/content_hash.hpp"
+#include "src/io/file_utils.hpp"
+#include "utils.hpp"
+
+namespace {
+QualifiedDicts make_dicts() {
+    QualifiedDicts dicts;
+    dicts.cfg.compiler = "g++";
+    dicts.cfg.compilation_flags = {"-c", "-O2"};
+    dicts.cfg.default_rule = "app";
+    dicts.cfg.pools = {{"link", 1}};
+    dicts.cfg.header_deps = HeaderDeps::GCC;
+    dicts.rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                       Step::COMPILE, Location{3, 5, 40}));
+    dicts.rules.push_back(std::make_unique<SingleRule>(
+        "app", std::vector<std::string>{"a.o", "b.o"}, Step::LINK, Location{9, 1, 80}, "link"));
+    dicts.rules.push_back(
+        std::make_unique<CleanRule>("clean", std::vector<std::string>{"app"}, Location{}));
+    return dicts;
+}
+}  // namespace
+
+TEST_CASE("Saved evaluations load back while they still hold", "[compiled_buildfile]") {
+    const auto dir = IO::fresh_test_dir("compiled_buildfile");
+    std::filesystem::create_directories(dir / "src" / "nested");
+    const auto path = dir / "compiled" / "bf";
+    std::vector<ListedDir> listed;
+    std::vector<std::unique_ptr<Value>> exts;
+    exts.push_back(std::make_unique<Value>(std::string(".h")));
+    exts.push_back(std::make_unique<Value>(std::string(".c")));
+    const Value ext_list((ValueList(std::move(exts))));
+    BuiltIn::list_files({Value((dir / "src").string()), ext_list}, listed);
+    REQUIRE(listed.size() == 2);
+    REQUIRE(listed[0].extensions == std::vector<std::string>{".c", ".h"});
+    CompiledBuildfile::save(path, 42, listed, make_dicts());
+    std::vector<ListedDir> found;
+
+    SECTION("Rules and config are as they were saved") {
+        const std::optional<QualifiedDicts> loaded = CompiledBuildfile::load(path, 42, found);
+        REQUIRE(loaded.has_value());
+        REQUIRE(found == listed);
+        REQUIRE(loaded->cfg.compiler == "g++");
+        REQUIRE(loaded->cfg.compilation_flags == std::vector<std::string>{"-c", "-O2"});
+        REQUIRE(loaded->cfg.pools.at("link") == 1);
+        REQUIRE(loaded->cfg.header_deps == HeaderDeps::GCC);
+        REQUIRE(loaded->rules.size() == 3);
+
+        const auto* link = dynamic_cast<const SingleRule*>(loaded->rules[1].get());
+        REQUIRE(link != nullptr);
+        REQUIRE(link->get_name() == "app");
+        REQUIRE(link->get_deps() == std::vector<std::string>{"a.o", "b.o"});
+        REQUIRE(link->get_step() == Step::LINK);
+        REQUIRE(link->get_pool() == "link");
+        REQUIRE(link->get_loc() == Location{9, 1, 80});
+        REQUIRE(dynamic_cast<const CleanRule*>(loaded->rules[2].get()) != nullptr);
+    }
+
+    SECTION("Other build file contents don't match") {
+        REQUIRE_FALSE(CompiledBuildfile::load(path, 43, found).has_value());
+    }
+
+    SECTION("A file added anywhere under a listed directory makes it stale") {
+        IO::write_file(dir / "src" / "nested" / "b.c", "");
+        REQUIRE_FALSE(CompiledBuildfile::load(path, 42, found).has_value());
+    }
+
+    SECTION("A removed listed directory makes it stale") {
+        std::filesystem::remove_all(dir / "src" / "nested");
+        REQUIRE_FALSE(CompiledBuildfile::load(path, 42, found).has_value());
+    }
+
+    SECTION("Corrupt files are ignored") {
+        std::string data = FileUtils::read_all(path);
+        data[data.size() - 3] ^= 1;
+        FileUtils::write_atomically(path.string(), data);
+        REQUIRE_FALSE(CompiledBuildfile::load(path, 42, found).has_value());
+
+        FileUtils::write_atomically(path.string(), data.substr(0, data.size() / 2));
+        REQUIRE_FALSE(CompiledBuildfile::load(path, 42, found).has_value());
+    }
+
+    REQUIRE_FALSE(CompiledBuildfile::load(dir / "missing", 42, found).has_value());
+}
+
+TEST_CASE("Build files are evaluated once and loaded after", "[compiled_buildfile][integration]") {
+    const auto dir = IO::fresh_test_dir("compiled_buildfile");
+    const std::string src = (dir / "Buildfile").string();
+    IO::write_file(src,
+                   "<Config> cfg {\n"
+                   "    compiler = \"g++\"\n"
+                   "    compilation_flags = []\n"
+                   "    link_flags = []\n"
+                   "    default_rule = \"app\"\n"
+                   "}\n"
+                   "<Rule> app {\n"
+                   "    deps = [\"main.cpp\"]\n"
+                   "    step = Step::LINK\n"
+                   "}\n");
+
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("main.cpp", Time::past());
+    auto proc = std::make_shared<MockProcSpawner>(fs);
+    BuildOrchestrator first(fs, proc, src, {}, dir / "compiled");
+    const auto path = CompiledBuildfile::path_for(dir / "compiled", src);
+    std::vector<ListedDir> listed;
+    const std::optional<QualifiedDicts> saved =
+        CompiledBuildfile::load(path, content_hash(FileUtils::read_all(src)), listed);
+    REQUIRE(saved.has_value());
+    REQUIRE(saved->rules.size() == 1);
+    REQUIRE(saved->rules[0]->get_deps() == std::vector<std::string>{"main.cpp"});
+
+    BuildOrchestrator second(fs, proc, src, {}, dir / "compiled");
+    REQUIRE(second.run_rules({"app"}));
+    REQUIRE(proc->get_run_count() == 1);
+}
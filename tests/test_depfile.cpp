@@ -0,0 +1,37 @@
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/errors/error.hpp"
+#include "src/io/depfile.hpp"
+
+using Prereqs = std::vector<std::string>;
+
+TEST_CASE("Depfiles list the prerequisites of their targets", "[depfile]") {
+    REQUIRE(parse_depfile("a.o: a.c a.h\n") == Prereqs{"a.c", "a.h"});
+    REQUIRE(parse_depfile("a.o : a.c") == Prereqs{"a.c"});
+    REQUIRE(parse_depfile("a.o:\n").empty());
+    REQUIRE(parse_depfile("").empty());
+}
+
+TEST_CASE("Depfile lines continue after a backslash", "[depfile]") {
+    REQUIRE(parse_depfile("a.o: a.c \\\n  include/a.h \\\n  include/b.h\n") ==
+            Prereqs{"a.c", "include/a.h", "include/b.h"});
+    REQUIRE(parse_depfile("a.o: a.c \\\r\n  a.h\r\n") == Prereqs{"a.c", "a.h"});
+}
+
+TEST_CASE("Depfile escapes are undone", "[depfile]") {
+    REQUIRE(parse_depfile("a.o: my\\ dir/a.h a\\#1.h cost$$.h\n") ==
+            Prereqs{"my dir/a.h", "a#1.h", "cost$.h"});
+}
+
+TEST_CASE("Prerequisites of every target are listed once", "[depfile]") {
+    // '-MP' adds an empty rule for each header, and some tools list several targets
+    REQUIRE(parse_depfile("a.o a.d: a.c a.h\n\na.h:\n") == Prereqs{"a.c", "a.h"});
+    REQUIRE(parse_depfile("a.o: a.c a.h\nb.o: b.c a.h\n") == Prereqs{"a.c", "a.h", "b.c"});
+}
+
+TEST_CASE("Depfiles without a ':' are rejected", "[depfile]") {
+    REQUIRE_THROWS_AS(parse_depfile("a.o a.c\n"), ValueError);
+    REQUIRE_THROWS_AS(parse_depfile("a.o"), ValueError);
+}
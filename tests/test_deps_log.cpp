@@ -0,0 +1,111 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/history/deps_log.hpp"
+#include "utils.hpp"
+
+using Paths = std::vector<std::string>;
+
+TEST_CASE("Deps log records the latest inputs of each output", "[deps_log]") {
+    DepsLog log;
+    REQUIRE_FALSE(log.get("a.o").has_value());
+
+    log.record("a.o", {"a.h", "b.h"});
+    log.record("b.o", {});
+    log.record("a.o", {"b.h"});
+    REQUIRE(log.get("a.o") == Paths{"b.h"});
+    REQUIRE(log.get("b.o") == Paths{});
+}
+
+TEST_CASE("Deps log persists between builds", "[deps_log]") {
+    const auto path = IO::fresh_test_dir("deps_log") / "state" / "deps";
+    {
+        DepsLog log(path);
+        log.record("a.o", {"include/a.h", "dir/with space.h"});
+        log.record("b.o", {"include/a.h", "abcd.h"});
+    }
+
+    DepsLog loaded(path);
+    REQUIRE(loaded.get("a.o") == Paths{"include/a.h", "dir/with space.h"});
+    REQUIRE(loaded.get("b.o") == Paths{"include/a.h", "abcd.h"});
+    REQUIRE_FALSE(loaded.get("include/a.h").has_value());
+}
+
+TEST_CASE("Paths are only written once", "[deps_log]") {
+    const auto path = IO::fresh_test_dir("deps_log") / "state" / "deps";
+    DepsLog log(path);
+    log.record("a.o", {"a_long_header_name.h"});
+    const auto first_size = std::filesystem::file_size(path);
+
+    // An unchanged record is not written again
+    log.record("a.o", {"a_long_header_name.h"});
+    REQUIRE(std::filesystem::file_size(path) == first_size);
+
+    // A new output costs it's name, but the header is referred to by id
+    log.record("b.o", {"a_long_header_name.h"});
+    const auto second_size = std::filesystem::file_size(path);
+    log.record("a.o", {"a_long_header_name.h", "a_long_header_name.h"});
+    REQUIRE(std::filesystem::file_size(path) - second_size == 16);
+}
+
+TEST_CASE("Deps records cut short are dropped", "[deps_log]") {
+    const auto path = IO::fresh_test_dir("deps_log") / "state" / "deps";
+    {
+        DepsLog log(path);
+        log.record("a.o", {"a.h"});
+        log.record("b.o", {"b.h"});
+    }
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+    {
+        DepsLog log(path);
+        REQUIRE(log.get("a.o") == Paths{"a.h"});
+        REQUIRE_FALSE(log.get("b.o").has_value());
+        log.record("c.o", {"a.h", "c.h"});
+    }
+
+    DepsLog loaded(path);
+    REQUIRE(loaded.get("a.o") == Paths{"a.h"});
+    REQUIRE(loaded.get("c.o") == Paths{"a.h", "c.h"});
+}
+
+TEST_CASE("Files that are not deps logs are discarded", "[deps_log]") {
+    const auto path = IO::fresh_test_dir("deps_log") / "state" / "deps";
+    IO::write_file(path, "not a deps log");
+
+    {
+        DepsLog log(path);
+        REQUIRE_FALSE(log.get("a.o").has_value());
+        log.record("a.o", {"a.h"});
+    }
+    REQUIRE(DepsLog(path).get("a.o") == Paths{"a.h"});
+}
+
+TEST_CASE("Deps log is compacted once most records are replaced", "[deps_log]") {
+    const auto path = IO::fresh_test_dir("deps_log") / "state" / "deps";
+    const size_t output_count = 10;
+    {
+        DepsLog log(path);
+        for (size_t i = 0; i <= DepsLog::COMPACTION_THRESHOLD + output_count; i++) {
+            const std::string header = "h" + std::to_string(i) + ".h";
+            log.record("obj_" + std::to_string(i % output_count), {"common.h", header});
+        }
+        const auto appended_size = std::filesystem::file_size(path);
+        log.compact_if_needed();
+        REQUIRE(std::filesystem::file_size(path) < appended_size / 10);
+
+        log.record("obj_0", {"new.h"});
+        REQUIRE(log.get("obj_0") == Paths{"new.h"});
+    }
+
+    DepsLog loaded(path);
+    REQUIRE(loaded.get("obj_0") == Paths{"new.h"});
+    const size_t last = DepsLog::COMPACTION_THRESHOLD + output_count;
+    for (size_t i = 1; i < output_count; i++) {
+        const size_t latest = last - (last - i) % output_count;
+        REQUIRE(loaded.get("obj_" + std::to_string(i)) ==
+                Paths{"common.h", "h" + std::to_string(latest) + ".h"});
+    }
+}
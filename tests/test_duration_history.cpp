@@ -0,0 +1,61 @@
+#include <filesystem>
+
+#include "catch.hpp"
+#include "src/history/duration_history.hpp"
+#include "utils.hpp"
+
+TEST_CASE("Unknown rules are estimated from known durations", "[history]") {
+    DurationHistory history;
+    REQUIRE_FALSE(history.get("a.o").has_value());
+    REQUIRE(history.estimate("a.o") == 1.0);
+
+    history.record("a.o", 2.0);
+    history.record("b.o", 4.0);
+
+    REQUIRE(history.get("a.o") == 2.0);
+    // Average of the known rules
+    REQUIRE(history.estimate("c.o") == 3.0);
+}
+
+TEST_CASE("Repeated runs are smoothed", "[history]") {
+    DurationHistory history;
+    history.record("app", 10.0);
+    history.record("app", 20.0);
+
+    REQUIRE(history.get("app") == 15.0);
+}
+
+TEST_CASE("Durations survive a save and load", "[history]") {
+    const auto path = IO::fresh_test_dir("durations_roundtrip") / "durations";
+    {
+        DurationHistory history(path);
+        history.record("main.o", 1.5);
+        history.record("my app", 8.25);
+        history.save();
+    }
+
+    DurationHistory loaded(path);
+    REQUIRE(loaded.get("main.o") == 1.5);
+    REQUIRE(loaded.get("my app") == 8.25);
+}
+
+TEST_CASE("Malformed duration records are skipped", "[history]") {
+    const auto path = IO::fresh_test_dir("durations_malformed") / "durations";
+    IO::write_file(path,
+                   "not_a_number app\n"
+                   "2.5 main.o\n"
+                   "-1 negative.o\n"
+                   "3\n"
+                   "\n"
+                   "nan lib.o\n"
+                   "4.5 my app\n"
+                   "1.");
+
+    DurationHistory history(path);
+    REQUIRE_FALSE(history.get("app").has_value());
+    REQUIRE_FALSE(history.get("negative.o").has_value());
+    REQUIRE_FALSE(history.get("lib.o").has_value());
+    REQUIRE(history.get("main.o") == 2.5);
+    REQUIRE(history.get("my app") == 4.5);
+    REQUIRE(history.estimate("other.o") == 3.5);
+}
@@ -0,0 +1,136 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "elf.h"
+#include "src/io/elf_interface.hpp"
+
+namespace {
+struct TestSymbol {
+    std::string name;
+    unsigned char type = STT_FUNC;
+    unsigned char bind = STB_GLOBAL;
+    unsigned char visibility = STV_DEFAULT;
+    uint64_t size = 16;
+    bool defined = true;
+};
+
+template <typename T>
+void append(std::string& image, const T& val) {
+    image.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+/** Lay out a minimal 64 bit shared object holding a dynamic symbol table and some code */
+std::string make_library(const std::string& soname, const std::vector<TestSymbol>& symbols,
+                         const std::string& code = "code") {
+    std::string strings(1, '\0');
+    auto add_string = [&](const std::string& str) {
+        const size_t offset = strings.size();
+        strings += str + '\0';
+        return offset;
+    };
+
+    std::string syms;
+    append(syms, Elf64_Sym{});
+    for (const TestSymbol& sym : symbols) {
+        Elf64_Sym entry{};
+        entry.st_name = static_cast<uint32_t>(add_string(sym.name));
+        entry.st_info = static_cast<unsigned char>((sym.bind << 4) | sym.type);
+        entry.st_other = sym.visibility;
+        entry.st_shndx = sym.defined ? 4 : SHN_UNDEF;
+        entry.st_size = sym.size;
+        append(syms, entry);
+    }
+    std::string dynamic;
+    Elf64_Dyn dyn{};
+    if (!soname.empty()) {
+        dyn.d_tag = DT_SONAME;
+        dyn.d_un.d_val = add_string(soname);
+        append(dynamic, dyn);
+    }
+    append(dynamic, Elf64_Dyn{});
+
+    // Sections follow the header in order, and the section headers come last
+    const std::vector<std::pair<uint32_t, std::string>> contents = {
+        {SHT_STRTAB, strings}, {SHT_DYNSYM, syms}, {SHT_DYNAMIC, dynamic}, {SHT_PROGBITS, code}};
+    std::string image(sizeof(Elf64_Ehdr), '\0');
+    std::vector<Elf64_Shdr> headers(1, Elf64_Shdr{});
+    for (const auto& [type, data] : contents) {
+        Elf64_Shdr header{};
+        header.sh_type = type;
+        header.sh_offset = image.size();
+        header.sh_size = data.size();
+        header.sh_link = (type == SHT_DYNSYM || type == SHT_DYNAMIC) ? 1 : 0;
+        headers.push_back(header);
+        image += data;
+    }
+
+    Elf64_Ehdr ehdr{};
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_DYN;
+    ehdr.e_shoff = image.size();
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = static_cast<uint16_t>(headers.size());
+    std::memcpy(image.data(), &ehdr, sizeof(ehdr));
+    for (const Elf64_Shdr& header : headers) {
+        append(image, header);
+    }
+    return image;
+}
+}  // namespace
+
+TEST_CASE("Library interfaces ignore code and symbol order", "[elf_interface]") {
+    const auto hash = elf_interface_hash(make_library("libcore.so.1", {{"f"}, {"g"}}, "old"));
+    REQUIRE(hash.has_value());
+    REQUIRE(elf_interface_hash(make_library("libcore.so.1", {{"g"}, {"f"}}, "new code")) == hash);
+}
+
+TEST_CASE("Library interfaces ignore symbols programs can't use", "[elf_interface]") {
+    const auto hash = elf_interface_hash(make_library("libcore.so", {{"f"}}));
+    TestSymbol local{"helper"};
+    local.bind = STB_LOCAL;
+    TestSymbol hidden{"internal"};
+    hidden.visibility = STV_HIDDEN;
+    TestSymbol imported{"malloc"};
+    imported.defined = false;
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {{"f"}, local, hidden, imported})) ==
+            hash);
+}
+
+TEST_CASE("Library interfaces change with the exported symbols", "[elf_interface]") {
+    TestSymbol data{"table", STT_OBJECT, STB_GLOBAL, STV_DEFAULT, 64};
+    const auto hash = elf_interface_hash(make_library("libcore.so", {{"f"}, data}));
+
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {{"f"}, {"g"}, data})) != hash);
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {data})) != hash);
+    REQUIRE(elf_interface_hash(make_library("libcore.so.2", {{"f"}, data})) != hash);
+
+    TestSymbol weak{"f"};
+    weak.bind = STB_WEAK;
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {weak, data})) != hash);
+
+    // Programs copy data into themselves, so it's size matters while a function's does not
+    data.size = 128;
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {{"f"}, data})) != hash);
+    TestSymbol longer{"f"};
+    longer.size = 1024;
+    data.size = 64;
+    REQUIRE(elf_interface_hash(make_library("libcore.so", {longer, data})) == hash);
+}
+
+TEST_CASE("Files that are not shared objects have no interface", "[elf_interface]") {
+    REQUIRE_FALSE(elf_interface_hash("").has_value());
+    REQUIRE_FALSE(elf_interface_hash("#!/bin/sh\necho hello\n").has_value());
+
+    const std::string library = make_library("libcore.so", {{"f"}});
+    REQUIRE_FALSE(elf_interface_hash(library.substr(0, library.size() - 8)).has_value());
+
+    std::string executable = library;
+    const uint16_t exec_type = ET_EXEC;
+    std::memcpy(executable.data() + offsetof(Elf64_Ehdr, e_type), &exec_type, sizeof(exec_type));
+    REQUIRE_FALSE(elf_interface_hash(executable).has_value());
+}
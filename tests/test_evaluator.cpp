@@ -1,8 +1,10 @@
+#include <filesystem>
 #include <memory>
 #include <vector>
 
 #include "../catch.hpp"
 #include "src/built_in/func_registry.hpp"
+#include "src/built_in/funcs.hpp"
 #include "src/dictionaries/rules.hpp"
 #include "src/errors/error.hpp"
 #include "src/parsing/expr.hpp"
@@ -215,3 +217,108 @@ TEST_CASE("Cyclical variable dependency leads to error", "[variable_evaluator]")
     VariableEvaluator evaluator(std::move(vars), FuncRegistry{});
     REQUIRE_THROWS(evaluator.evaluate());
 }
+
+namespace {
+/**
+ * Builds the following variables, with the fingerprints given for 'x':
+ * x = <x_fn>()
+ * <Config> cfg { compiler = x + tick() ... }
+ */
+std::vector<ParsedVariable> make_ticking_vars(const std::string& x_fn, uint64_t x_fingerprint) {
+    auto compiler = std::make_unique<BinaryOpExpr>(
+        BinaryOpType::ADD, std::make_unique<VarRefExpr>("x"), std::make_unique<FnExpr>("tick"));
+    std::vector<ParsedVariable> vars;
+    vars.push_back({"x", std::make_unique<FnExpr>(x_fn), VarCategory::REGULAR, {0, 0, 0},
+                    x_fingerprint});
+    vars.push_back({"cfg", Factories::create_cfg_dict(std::move(compiler), {}, {}, ""),
+                    VarCategory::CONFIG, {0, 0, 0}, 100});
+    return vars;
+}
+}  // namespace
+
+TEST_CASE("Only variables that could have changed are evaluated again", "[variable_evaluator]") {
+    int ticks = 0;
+    const FuncRegistry fns(FnMap{{"tick",
+                                  [&](const std::vector<Value>&) {
+                                      ticks++;
+                                      return Value(std::string(""));
+                                  }},
+                                 {"gcc", [](const std::vector<Value>&) {
+                                      return Value(std::string("gcc"));
+                                  }}});
+    RetainedVars retained;
+    VariableEvaluator(make_ticking_vars("tick", 1), fns).evaluate(&retained);
+    REQUIRE(ticks == 2);
+    REQUIRE(retained.size() == 2);
+
+    SECTION("Unchanged variables keep their values") {
+        VariableEvaluator evaluator(make_ticking_vars("tick", 1), fns);
+        QualifiedDicts dicts = evaluator.evaluate(&retained);
+        REQUIRE(ticks == 2);
+        REQUIRE(dicts.cfg.compiler.empty());
+    }
+
+    SECTION("Dependants of a variable that evaluates the same aren't evaluated again") {
+        VariableEvaluator(make_ticking_vars("tick", 2), fns).evaluate(&retained);
+        REQUIRE(ticks == 3);
+    }
+
+    SECTION("Dependants of a variable that evaluates differently are evaluated again") {
+        VariableEvaluator evaluator(make_ticking_vars("gcc", 2), fns);
+        QualifiedDicts dicts = evaluator.evaluate(&retained);
+        REQUIRE(ticks == 3);
+        REQUIRE(dicts.cfg.compiler == "gcc");
+    }
+
+    SECTION("Nothing is kept from an evaluation that fails") {
+        std::vector<ParsedVariable> vars = make_ticking_vars("tick", 1);
+        vars.pop_back();
+        REQUIRE_THROWS(VariableEvaluator(std::move(vars), fns).evaluate(&retained));
+        REQUIRE(retained.empty());
+    }
+}
+
+TEST_CASE("Variables listing a changed directory are evaluated again", "[variable_evaluator]") {
+    const auto dir = IO::fresh_test_dir("evaluator_listing");
+    std::filesystem::create_directories(dir / "nested");
+    IO::write_file(dir / "a.cpp", "");
+
+    std::vector<ListedDir> listed;
+    int listings = 0;
+    const FuncRegistry fns(FnMap{{"files", [&](const std::vector<Value>& args) {
+                                      listings++;
+                                      return BuiltIn::list_files(args, listed);
+                                  }}});
+    auto make_vars = [&] {
+        auto files = std::make_unique<FnExpr>("files");
+        files->add_arg(std::make_unique<StringExpr>(dir.string()));
+        std::vector<std::unique_ptr<Expr>> exts;
+        exts.push_back(std::make_unique<StringExpr>(".cpp"));
+        files->add_arg(std::make_unique<ListExpr>(std::move(exts)));
+        auto rule = std::make_unique<DictionaryExpr>();
+        rule->insert_entry(RuleFields::DEPS, std::move(files));
+        rule->insert_entry(RuleFields::STEP, std::make_unique<EnumExpr>("Step", "LINK"));
+
+        std::vector<ParsedVariable> vars;
+        vars.push_back({"cfg", Factories::create_cfg_dict(), VarCategory::CONFIG, {0, 0, 0}, 1});
+        vars.push_back({"app", std::move(rule), VarCategory::SINGLE_RULE, {0, 0, 0}, 2});
+        return vars;
+    };
+
+    RetainedVars retained;
+    VariableEvaluator(make_vars(), fns, &listed).evaluate(&retained);
+    REQUIRE(listings == 1);
+    REQUIRE(listed.size() == 2);
+
+    // The directories of variables that aren't evaluated again are still reported
+    listed.clear();
+    VariableEvaluator(make_vars(), fns, &listed).evaluate(&retained);
+    REQUIRE(listings == 1);
+    REQUIRE(listed.size() == 2);
+
+    IO::write_file(dir / "nested" / "b.cpp", "");
+    listed.clear();
+    QualifiedDicts dicts = VariableEvaluator(make_vars(), fns, &listed).evaluate(&retained);
+    REQUIRE(listings == 2);
+    REQUIRE(dicts.rules.at(0)->get_deps().size() == 2);
+}
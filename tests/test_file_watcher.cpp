@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/io/file_watcher.hpp"
+#include "utils.hpp"
+
+namespace {
+constexpr std::chrono::milliseconds TIMEOUT{2000};
+constexpr std::chrono::milliseconds QUIET{50};
+}  // namespace
+
+TEST_CASE("Watched files are reported once they change", "[file_watcher]") {
+    const auto dir = IO::fresh_test_dir("file_watcher");
+    const std::string source = dir / "src" / "a.c";
+    const std::string header = dir / "src" / "a.h";
+    const std::string created = dir / "b.c";
+    IO::write_file(source, "int a;");
+    IO::write_file(header, "");
+
+    const std::string missing = dir / "missing" / "c.c";
+
+    FileWatcher watcher;
+    watcher.watch({source, header, created, missing});
+    REQUIRE(watcher.wait(QUIET).empty());
+    REQUIRE(watcher.get_unwatched() == std::vector<std::string>{missing});
+
+    SECTION("Writes, including several to one file, are reported once") {
+        IO::write_file(source, "int a = 1;");
+        std::ofstream(source, std::ios::app) << "int b;";
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{source});
+    }
+
+    SECTION("Files replaced by a rename are still followed") {
+        IO::write_file(dir / "src" / ".a.h.swp", "#pragma once");
+        std::filesystem::rename(dir / "src" / ".a.h.swp", header);
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{header});
+
+        IO::write_file(header, "#pragma once\n");
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{header});
+    }
+
+    SECTION("Created and removed files are reported, unwatched ones are not") {
+        IO::write_file(dir / "unrelated.txt", "x");
+        REQUIRE(watcher.wait(QUIET).empty());
+
+        IO::write_file(created, "int b;");
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{created});
+
+        std::filesystem::remove(source);
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{source});
+    }
+
+    SECTION("Files in a removed directory are reported, and unwatched until watched again") {
+        std::filesystem::remove_all(dir / "src");
+        auto changed = watcher.wait(TIMEOUT);
+        std::ranges::sort(changed);
+        REQUIRE(changed == std::vector<std::string>{source, header});
+        REQUIRE(watcher.get_unwatched().size() == 3);
+
+        std::filesystem::create_directories(dir / "src");
+        watcher.watch({source});
+        REQUIRE(watcher.get_unwatched().empty());
+        IO::write_file(source, "int a;");
+        REQUIRE(watcher.wait(TIMEOUT) == std::vector<std::string>{source});
+    }
+
+    SECTION("Files no longer watched are not reported") {
+        watcher.watch({header});
+        IO::write_file(source, "int a = 2;");
+        REQUIRE(watcher.wait(QUIET).empty());
+    }
+}
+
+TEST_CASE("Watched directories are reported once their listing changes", "[file_watcher]") {
+    const auto dir = IO::fresh_test_dir("file_watcher");
+    const std::string src = dir / "src";
+    const std::string source = dir / "src" / "a.c";
+    IO::write_file(source, "int a;");
+
+    FileWatcher watcher;
+    watcher.watch({}, {{src + "/", {".c"}}});
+    REQUIRE(watcher.get_unwatched().empty());
+    const std::vector<std::string> reported = {src + "/"};
+
+    SECTION("Writes to an entry leave the listing as it was") {
+        IO::write_file(source, "int a = 1;");
+        REQUIRE(watcher.wait(QUIET).empty());
+    }
+
+    SECTION("Entries created, renamed and removed are reported") {
+        IO::write_file(dir / "src" / "b.c", "int b;");
+        REQUIRE(watcher.wait(TIMEOUT) == reported);
+
+        std::filesystem::rename(dir / "src" / "b.c", dir / "src" / "c.c");
+        REQUIRE(watcher.wait(TIMEOUT) == reported);
+
+        std::filesystem::remove(source);
+        REQUIRE(watcher.wait(TIMEOUT) == reported);
+    }
+
+    SECTION("Only entries with a listed extension, and directories, are reported") {
+        IO::write_file(dir / "src" / "a.o", "");
+        IO::write_file(dir / "src" / "a", "");
+        REQUIRE(watcher.wait(QUIET).empty());
+
+        std::filesystem::create_directories(dir / "src" / "sub");
+        REQUIRE(watcher.wait(TIMEOUT) == reported);
+    }
+
+    SECTION("A removed directory is reported, and unwatched until watched again") {
+        std::filesystem::remove_all(dir / "src");
+        REQUIRE(watcher.wait(TIMEOUT) == reported);
+        REQUIRE(watcher.get_unwatched() == reported);
+    }
+}
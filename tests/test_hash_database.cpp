@@ -0,0 +1,107 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/dictionaries/rules.hpp"
+#include "src/errors/error.hpp"
+#include "src/history/hash_database.hpp"
+#include "src/io/content_hash.hpp"
+#include "src/io/fs_gateway.hpp"
+#include "utils.hpp"
+
+namespace {
+/** Move a file's write time, as a 'touch' or 'git checkout' would, without changing it */
+void shift_write_time(const std::filesystem::path& path, std::chrono::seconds by) {
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + by);
+}
+}  // namespace
+
+TEST_CASE("Content hashes match the XXH64 reference", "[hashes]") {
+    REQUIRE(content_hash("") == 0xEF46DB3751D8E999ULL);
+    REQUIRE(content_hash("abc") == 0x44BC2CF5AD770999ULL);
+    REQUIRE(content_hash("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ULL);
+}
+
+TEST_CASE("Files are hashed by contents", "[hashes]") {
+    const auto dir = IO::fresh_test_dir("hashes");
+    HashDatabase hashes;
+    IO::write_file(dir / "a.c", "int a;");
+    IO::write_file(dir / "b.c", "int a;");
+
+    const auto a_hash = hashes.hash((dir / "a.c").string());
+    REQUIRE(a_hash.has_value());
+    REQUIRE(a_hash == hashes.hash((dir / "b.c").string()));
+    REQUIRE_FALSE(hashes.hash((dir / "missing.c").string()).has_value());
+
+    IO::write_file(dir / "a.c", "int b;");
+    REQUIRE(hashes.hash((dir / "a.c").string()) != a_hash);
+}
+
+TEST_CASE("Only changed contents make a rule stale", "[hashes]") {
+    const auto dir = IO::fresh_test_dir("hashes");
+    const std::string src = (dir / "a.c").string();
+    const std::string obj = (dir / "a.o").string();
+    IO::write_file(src, "int a;");
+    IO::write_file(obj, "object");
+    shift_write_time(src, std::chrono::seconds(-10));
+
+    ProdFSGateway fs;
+    HashDatabase hashes;
+    SingleRule rule(obj, {src}, Step::COMPILE, Location{0, 0, 0});
+
+    // Up to date by write time, so it becomes the baseline
+    REQUIRE_FALSE(rule.should_run_by_content(fs, hashes));
+    REQUIRE(hashes.changed_since_build(obj, {src}) == false);
+
+    SECTION("Touching an input") {
+        shift_write_time(src, std::chrono::seconds(20));
+        REQUIRE(rule.should_run(fs));
+        REQUIRE_FALSE(rule.should_run_by_content(fs, hashes));
+    }
+
+    SECTION("Editing an input") {
+        IO::write_file(src, "int b;");
+        REQUIRE(rule.should_run_by_content(fs, hashes));
+    }
+
+    SECTION("Editing the output") {
+        IO::write_file(obj, "edited");
+        REQUIRE(rule.should_run_by_content(fs, hashes));
+    }
+
+    SECTION("Changing the inputs") {
+        REQUIRE(hashes.changed_since_build(obj, {src, src}) == true);
+    }
+}
+
+TEST_CASE("Hash database persists between builds", "[hashes]") {
+    const auto dir = IO::fresh_test_dir("hashes");
+    const std::string src = (dir / "a c.c").string();
+    const std::string obj = (dir / "a.o").string();
+    const std::string missing = (dir / "missing.h").string();
+    IO::write_file(src, "int a;");
+    IO::write_file(obj, "object");
+
+    const auto db_path = dir / "state" / "hashes";
+    {
+        HashDatabase hashes(db_path);
+        hashes.record_build(obj, {src, missing});
+        hashes.save();
+    }
+
+    HashDatabase loaded(db_path);
+    // The missing input is recorded as missing, which always makes the rule stale
+    REQUIRE(loaded.changed_since_build(obj, {src, missing}) == true);
+    REQUIRE_FALSE(loaded.changed_since_build(src, {}).has_value());
+
+    IO::write_file(missing, "");
+    loaded.record_build(obj, {src, missing});
+    REQUIRE(loaded.changed_since_build(obj, {src, missing}) == false);
+}
+
+TEST_CASE("Malformed hash databases are rejected", "[hashes]") {
+    const auto dir = IO::fresh_test_dir("hashes");
+    IO::write_file(dir / "hashes", "B 1a 2 a.o\nI 2b a.c\n");
+    REQUIRE_THROWS_AS(HashDatabase(dir / "hashes"), IOError);
+}
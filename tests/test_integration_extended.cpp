@@ -164,3 +164,23 @@ TEST_CASE("List concatenation works correctly", "[integration][list_concat]") {
 
     REQUIRE_NOTHROW(orchestrator.run_rule("app"));
 }
+
+// Pool Tests
+
+TEST_CASE("Pools are read from the config and limit their rules", "[integration][pools]") {
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("main.cpp", Time::past());
+    fs->touch_at("utils.cpp", Time::past());
+    fs->touch_at("parser.cpp", Time::past());
+
+    auto proc = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.max_jobs = 4;
+    BuildOrchestrator orchestrator(fs, proc, IO::get_test_file_path("Pools.bf"), opts);
+
+    REQUIRE(orchestrator.run_rule("app"));
+    REQUIRE(proc->get_run_count() == 4);
+    // Every compile is in the pool of size 1
+    REQUIRE(proc->get_max_in_flight() == 1);
+}
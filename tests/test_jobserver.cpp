@@ -0,0 +1,53 @@
+#include <memory>
+
+#include "catch.hpp"
+#include "src/concurrency/jobserver.hpp"
+#include "src/errors/error.hpp"
+
+TEST_CASE("No jobserver is used unless one is advertised", "[jobserver]") {
+    REQUIRE(JobServerClient::from_makeflags("") == nullptr);
+    REQUIRE(JobServerClient::from_makeflags("kw -j4") == nullptr);
+}
+
+TEST_CASE("A jobserver hands out a token for every job after the first", "[jobserver]") {
+    const JobServer::Style style =
+        GENERATE(JobServer::Style::FIFO, JobServer::Style::PIPE);
+    JobServer server(3, style);
+    auto client = JobServerClient::from_makeflags("kw -- " + server.makeflags());
+    REQUIRE(client != nullptr);
+
+    REQUIRE(client->try_acquire());
+    REQUIRE(client->try_acquire());
+    REQUIRE_FALSE(client->try_acquire());
+    REQUIRE(client->held() == 2);
+
+    client->release();
+    REQUIRE(client->held() == 1);
+    REQUIRE(client->try_acquire());
+}
+
+TEST_CASE("Tokens are shared between clients and returned on destruction", "[jobserver]") {
+    JobServer server(2);
+    auto first = JobServerClient::from_makeflags(server.makeflags());
+    auto second = JobServerClient::from_makeflags(server.makeflags());
+
+    REQUIRE(first->try_acquire());
+    REQUIRE_FALSE(second->try_acquire());
+
+    first.reset();
+    REQUIRE(second->try_acquire());
+}
+
+TEST_CASE("The last jobserver advertised is used", "[jobserver]") {
+    JobServer server(2);
+    auto client = JobServerClient::from_makeflags("--jobserver-auth=fifo:/not/a/fifo " +
+                                                  server.makeflags());
+    REQUIRE(client->try_acquire());
+}
+
+TEST_CASE("An unusable jobserver throws", "[jobserver]") {
+    REQUIRE_THROWS_AS(JobServerClient::from_makeflags("--jobserver-auth=fifo:/not/a/fifo"),
+                      SystemError);
+    REQUIRE_THROWS_AS(JobServerClient::from_makeflags("--jobserver-auth=998,999"), SystemError);
+    REQUIRE_THROWS_AS(JobServerClient::from_makeflags("--jobserver-fds=3"), ValueError);
+}
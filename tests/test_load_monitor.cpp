@@ -0,0 +1,52 @@
+#include <filesystem>
+#include <string>
+
+#include "catch.hpp"
+#include "src/concurrency/load_monitor.hpp"
+#include "utils.hpp"
+
+namespace {
+/** A fake procfs root holding the files the monitor reads */
+std::filesystem::path make_proc_root(double memory_pressure, double cpu_pressure,
+                                     uint64_t available_kib) {
+    const auto root = IO::fresh_test_dir("proc");
+    IO::write_file(root / "pressure" / "memory",
+                   "some avg10=" + std::to_string(memory_pressure) +
+                       " avg60=0.00 avg300=0.00 total=100\n"
+                       "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    IO::write_file(root / "pressure" / "cpu", "some avg10=" + std::to_string(cpu_pressure) +
+                                                  " avg60=0.00 avg300=0.00 total=100\n");
+    IO::write_file(root / "meminfo", "MemTotal:       16000000 kB\n"
+                                     "MemFree:          100000 kB\n"
+                                     "MemAvailable:   " +
+                                         std::to_string(available_kib) + " kB\n");
+    return root;
+}
+}  // namespace
+
+TEST_CASE("Jobs start on an idle machine", "[load_monitor]") {
+    PressureLoadMonitor monitor({}, make_proc_root(0.0, 5.0, 8000000));
+    REQUIRE(monitor.can_start(4));
+}
+
+TEST_CASE("Jobs are held back under pressure", "[load_monitor]") {
+    SECTION("Memory pressure") {
+        PressureLoadMonitor monitor({}, make_proc_root(25.0, 5.0, 8000000));
+        REQUIRE_FALSE(monitor.can_start(4));
+    }
+
+    SECTION("CPU pressure") {
+        PressureLoadMonitor monitor({}, make_proc_root(0.0, 95.0, 8000000));
+        REQUIRE_FALSE(monitor.can_start(4));
+    }
+
+    SECTION("Low available memory") {
+        PressureLoadMonitor monitor({}, make_proc_root(0.0, 5.0, 1000));
+        REQUIRE_FALSE(monitor.can_start(4));
+    }
+}
+
+TEST_CASE("Missing pressure information is ignored", "[load_monitor]") {
+    PressureLoadMonitor monitor({}, IO::fresh_test_dir("empty_proc"));
+    REQUIRE(monitor.can_start(4));
+}
@@ -0,0 +1,37 @@
+#include <sstream>
+#include <string>
+
+#include "catch.hpp"
+#include "src/io/output_buffer.hpp"
+
+TEST_CASE("Small output is kept in memory", "[output_buffer]") {
+    OutputBuffer buf(16);
+    REQUIRE(buf.empty());
+
+    buf.append("hello ");
+    buf.append("world");
+
+    REQUIRE(buf.size() == 11);
+    REQUIRE_FALSE(buf.spilled());
+    std::ostringstream os;
+    buf.write_to(os);
+    REQUIRE(os.str() == "hello world");
+}
+
+TEST_CASE("Output past the cap spills to disk without losing anything", "[output_buffer]") {
+    OutputBuffer buf(8);
+    buf.append("0123");
+    buf.append("456789");
+    REQUIRE(buf.spilled());
+
+    std::ostringstream first;
+    buf.write_to(first);
+    REQUIRE(first.str() == "0123456789");
+
+    // Appending after reading back continues at the end
+    buf.append("abc");
+    std::ostringstream second;
+    buf.write_to(second);
+    REQUIRE(second.str() == "0123456789abc");
+    REQUIRE(buf.size() == 13);
+}
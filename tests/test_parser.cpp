@@ -241,4 +241,16 @@ TEST_CASE("Test parser with Clean dictionary", "[parser]") {
     REQUIRE(target2->val == "*.o");
 
     REQUIRE(clean_var.loc == Location{0, 1, 0});
-}
\ No newline at end of file
+}
+
+TEST_CASE("Variables written the same way have the same fingerprint", "[parser]") {
+    std::vector<ParsedVariable> parsed =
+        Parser(Lexer::from_contents("a = \"x\" + b\n\n\nc = \"x\" + b\nd = \"x\" + e\n"
+                                    "<Rule> f {\n    deps = [\"x\"]\n}\n")
+                   .lex())
+            .parse();
+    REQUIRE(parsed.size() == 4);
+    REQUIRE(parsed[0].fingerprint == parsed[1].fingerprint);
+    REQUIRE(parsed[0].fingerprint != parsed[2].fingerprint);
+    REQUIRE(parsed[0].fingerprint != parsed[3].fingerprint);
+}
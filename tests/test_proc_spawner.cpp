@@ -0,0 +1,120 @@
+#include <chrono>
+#include <csignal>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#include "catch.hpp"
+#include "src/errors/error.hpp"
+#include "src/io/proc_spawner.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+/** Wait for processes until every id has been reported, returning their results */
+std::vector<ProcessResult> wait_for_all(PosixProcSpawner& spawner, size_t count) {
+    std::vector<ProcessResult> results;
+    while (results.size() < count) {
+        for (ProcessResult& res : spawner.wait_any(5s)) {
+            results.push_back(std::move(res));
+        }
+    }
+    return results;
+}
+}  // namespace
+
+TEST_CASE("One thread reaps many concurrent processes", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    std::unordered_set<ProcessId> ids;
+    for (size_t i = 0; i < 100; i++) {
+        std::vector<std::string> cmd = {"true"};
+        ids.insert(spawner.spawn(cmd));
+    }
+    REQUIRE(ids.size() == 100);
+
+    for (const ProcessResult& res : wait_for_all(spawner, 100)) {
+        REQUIRE(ids.erase(res.id) == 1);
+        REQUIRE(res.status == 0);
+        REQUIRE_FALSE(res.err);
+    }
+    REQUIRE(ids.empty());
+}
+
+TEST_CASE("Failing processes report their exit status", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    std::vector<std::string> cmd = {"sh", "-c", "exit 3"};
+    const ProcessId id = spawner.spawn(cmd);
+
+    const std::vector<ProcessResult> results = wait_for_all(spawner, 1);
+    REQUIRE(results.at(0).id == id);
+    REQUIRE(results.at(0).status == 3);
+    REQUIRE_THROWS_AS(std::rethrow_exception(results.at(0).err), SystemError);
+}
+
+TEST_CASE("Environment variables are passed to children", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    spawner.set_env("MY_MAKE_TEST_VAR", "first");
+    spawner.set_env("MY_MAKE_TEST_VAR", "second");
+    std::vector<std::string> cmd = {"sh", "-c", "test \"$MY_MAKE_TEST_VAR\" = second"};
+    spawner.spawn(cmd);
+
+    REQUIRE(wait_for_all(spawner, 1).at(0).status == 0);
+}
+
+TEST_CASE("Spawning a missing program throws", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    std::vector<std::string> cmd = {"/definitely/not/a/program"};
+    REQUIRE_THROWS_AS(spawner.spawn(cmd), SystemError);
+}
+
+TEST_CASE("Interrupt wakes a waiting thread", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    std::jthread waker([&] {
+        std::this_thread::sleep_for(20ms);
+        spawner.interrupt();
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    REQUIRE(spawner.wait_any(10s).empty());
+    REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+}
+
+TEST_CASE("Stdout and stderr are captured per process", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    std::vector<std::string> cmd = {"sh", "-c", "echo out; echo err >&2; exit 1"};
+    spawner.spawn(cmd);
+
+    const std::vector<ProcessResult> results = wait_for_all(spawner, 1);
+    REQUIRE(results.at(0).output != nullptr);
+    std::ostringstream os;
+    results.at(0).output->write_to(os);
+    REQUIRE(os.str() == "out\nerr\n");
+}
+
+TEST_CASE("Noisy processes spill their output to disk", "[proc_spawner]") {
+    PosixProcSpawner spawner(1024);
+    // Larger than a pipe buffer, so it must be read while the process is still running
+    std::vector<std::string> cmd = {"sh", "-c", "head -c 200000 /dev/zero"};
+    spawner.spawn(cmd);
+
+    const std::vector<ProcessResult> results = wait_for_all(spawner, 1);
+    REQUIRE_FALSE(results.at(0).err);
+    REQUIRE(results.at(0).output->spilled());
+    REQUIRE(results.at(0).output->size() == 200000);
+}
+
+TEST_CASE("Cancelling a process stops it's whole process group", "[proc_spawner]") {
+    PosixProcSpawner spawner;
+    // The shell waits on a child of it's own which must be stopped too
+    std::vector<std::string> cmd = {"sh", "-c", "sleep 30 & wait"};
+    const ProcessId id = spawner.spawn(cmd);
+    std::this_thread::sleep_for(50ms);
+
+    const auto start = std::chrono::steady_clock::now();
+    spawner.cancel(id);
+    const std::vector<ProcessResult> results = wait_for_all(spawner, 1);
+    REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+    REQUIRE(results.at(0).err);
+    // Killed by SIGTERM, reported like a shell would
+    REQUIRE(results.at(0).status == 128 + SIGTERM);
+}
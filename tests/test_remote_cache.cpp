@@ -0,0 +1,194 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "src/history/artifact_cache.hpp"
+#include "src/io/file_utils.hpp"
+#include "src/remote/cache_server.hpp"
+#include "src/remote/http.hpp"
+#include "src/remote/remote_store.hpp"
+#include "sys/socket.h"
+#include "sys/un.h"
+#include "unistd.h"
+#include "utils.hpp"
+
+namespace {
+using RunningServer = Net::RunningServer<CacheServer>;
+
+const auto ALWAYS = [](const CacheEntry&) { return true; };
+}  // namespace
+
+TEST_CASE("Endpoints are parsed", "[remote_cache]") {
+    const Endpoint tcp = Endpoint::parse("http://cache.local:8080/");
+    REQUIRE(tcp.host == "cache.local");
+    REQUIRE(tcp.port == 8080);
+    REQUIRE(Endpoint::parse("[::1]:80").host == "::1");
+    REQUIRE(Endpoint::parse("::1:80").host == "::1");
+    REQUIRE(Endpoint::parse("[::1]:80").to_string() == "[::1]:80");
+    REQUIRE(Endpoint::parse("unix:/tmp/cache.sock").unix_path == "/tmp/cache.sock");
+
+    REQUIRE_THROWS(Endpoint::parse("localhost"));
+    REQUIRE_THROWS(Endpoint::parse("localhost:http"));
+    REQUIRE_THROWS(Endpoint::parse("localhost:70000"));
+    REQUIRE_THROWS(Endpoint::parse("unix:"));
+    REQUIRE_THROWS(Endpoint::parse("[::1:80"));
+    REQUIRE_THROWS(Endpoint::parse("[]:80"));
+}
+
+TEST_CASE("Only loopback addresses and Unix sockets are local", "[remote_cache]") {
+    REQUIRE(Endpoint::parse("127.0.0.1:7879").is_local());
+    REQUIRE(Endpoint::parse("localhost:7879").is_local());
+    REQUIRE(Endpoint::parse("[::1]:7879").is_local());
+    REQUIRE(Endpoint::parse("::1:7879").is_local());
+    REQUIRE(Endpoint::parse("unix:/tmp/worker.sock").is_local());
+
+    REQUIRE_FALSE(Endpoint::parse("0.0.0.0:7879").is_local());
+    REQUIRE_FALSE(Endpoint::parse("[::]:7879").is_local());
+    REQUIRE_FALSE(Endpoint::parse("build-host:7879").is_local());
+}
+
+TEST_CASE("Cache server only accepts valid keys and contents", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    CacheServer server(dir / "server", Endpoint::parse("127.0.0.1:0"));
+    const std::string object = ArtifactCache::object_name("contents");
+
+    REQUIRE(server.handle({"GET", "/cas/" + object, ""}).status == 404);
+    REQUIRE(server.handle({"PUT", "/cas/" + object, "other contents"}).status == 400);
+    REQUIRE(server.handle({"PUT", "/cas/" + object, "contents"}).status == 201);
+    REQUIRE(server.handle({"HEAD", "/cas/" + object, ""}).status == 200);
+    REQUIRE(server.handle({"GET", "/cas/" + object, ""}).body == "contents");
+
+    REQUIRE(server.handle({"PUT", "/ac/1f", "C 1 0\n"}).status == 400);
+    REQUIRE(server.handle({"PUT", "/ac/1f", "C 1 0\nO " + object + " 644 a.o\n"}).status == 201);
+    REQUIRE(server.handle({"PUT", "/ac/../../etc", ""}).status == 404);
+    REQUIRE(server.handle({"PUT", "/cas/x-1", "x"}).status == 404);
+    REQUIRE(server.handle({"DELETE", "/ac/1f", ""}).status == 405);
+}
+
+TEST_CASE("Remote stores are reached over TCP and Unix sockets", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    const std::string endpoint =
+        GENERATE_COPY(std::string("127.0.0.1:0"), "unix:" + (dir / "cache.sock").string());
+    RunningServer running(dir / "server", Endpoint::parse(endpoint));
+    HttpRemoteStore store(running.server.get_endpoint());
+
+    const std::string big(1 << 20, 'x');
+    const std::string object = ArtifactCache::object_name(big);
+    REQUIRE_FALSE(store.contains("cas/" + object));
+    REQUIRE_FALSE(store.get("cas/" + object).has_value());
+    store.put("cas/" + object, big);
+    REQUIRE(store.contains("cas/" + object));
+    // Requests after the first reuse the connection
+    for (int i = 0; i < 3; i++) {
+        REQUIRE(store.get("cas/" + object) == big);
+    }
+    REQUIRE_THROWS(store.put("cas/" + object, "not the contents"));
+}
+
+TEST_CASE("Unix sockets are only taken over once nothing listens on them", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    const auto path = dir / "cache.sock";
+    const std::string endpoint = "unix:" + path.string();
+    const std::string object = ArtifactCache::object_name("contents");
+
+    // A socket file nothing listens on, as left behind by a server that was killed
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    close(fd);
+
+    auto first = std::make_unique<RunningServer>(dir / "first", Endpoint::parse(endpoint));
+    REQUIRE_THROWS(CacheServer(dir / "second", Endpoint::parse(endpoint)));
+    HttpRemoteStore(Endpoint::parse(endpoint)).put("cas/" + object, "contents");
+
+    // A server bound once the first one's socket is gone keeps it's own when the first one stops
+    std::filesystem::remove(path);
+    RunningServer second(dir / "second", Endpoint::parse(endpoint));
+    first.reset();
+    REQUIRE(std::filesystem::exists(path));
+    REQUIRE_FALSE(HttpRemoteStore(Endpoint::parse(endpoint)).contains("cas/" + object));
+}
+
+TEST_CASE("Servers bound the size of requests and the connections served", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    RunningServer running(dir / "server", Endpoint::parse("127.0.0.1:0"), 1024);
+    const Endpoint& endpoint = running.server.get_endpoint();
+    const std::string small(1024, 'a');
+    const std::string large(1025, 'a');
+
+    // A body larger than the whole cache is refused before it is read
+    HttpClient client(endpoint);
+    REQUIRE(client.request({"PUT", "/cas/" + ArtifactCache::object_name(small), small}).status ==
+            201);
+    REQUIRE_THROWS(
+        HttpClient(endpoint).request({"PUT", "/cas/" + ArtifactCache::object_name(large), large}));
+
+    // One connection is still open in 'client'
+    std::vector<HttpConnection> open;
+    for (size_t i = 1; i < HttpServer::MAX_CONNECTIONS; i++) {
+        open.push_back(HttpConnection::connect(endpoint));
+        open.back().send_request({"HEAD", "/cas/missing-1", ""});
+        REQUIRE(open.back().read_response(true).status == 404);
+    }
+    HttpConnection busy = HttpConnection::connect(endpoint);
+    busy.send_request({"HEAD", "/cas/missing-1", ""});
+    REQUIRE(busy.read_response(true).status == 503);
+
+    // Connections are served again once others close
+    open.clear();
+    int status = 503;
+    for (int attempt = 0; attempt < 100 && status == 503; attempt++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        status = HttpClient(endpoint).request({"HEAD", "/cas/missing-1", ""}).status;
+    }
+    REQUIRE(status == 404);
+}
+
+TEST_CASE("Builds are shared between caches through a remote store", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    RunningServer running(dir / "server", Endpoint::parse("127.0.0.1:0"));
+    const std::string output = dir / "a.o";
+
+    // e.g. CI, which uploads everything it builds
+    ArtifactCache uploader(dir / "ci", ArtifactCache::DEFAULT_MAX_BYTES,
+                           std::make_shared<HttpRemoteStore>(running.server.get_endpoint()));
+    IO::write_file(output, "built on CI");
+    uploader.store(7, {{"a.h", 1}}, {output});
+    uploader.flush();
+    REQUIRE(uploader.stats().uploads == 1);
+
+    // e.g. a developer's machine, which has never built anything
+    ArtifactCache downloader(dir / "dev", ArtifactCache::DEFAULT_MAX_BYTES,
+                             std::make_shared<HttpRemoteStore>(running.server.get_endpoint()));
+    std::filesystem::remove(output);
+    downloader.prefetch(7);
+    downloader.prefetch(8);
+    REQUIRE(downloader.fetch(7, ALWAYS).has_value());
+    REQUIRE(FileUtils::read_all(output) == "built on CI");
+    REQUIRE_FALSE(downloader.fetch(8, ALWAYS).has_value());
+
+    const CacheStats stats = downloader.stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.remote_hits == 1);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.remote_errors == 0);
+}
+
+TEST_CASE("An unreachable remote store is given up on", "[remote_cache]") {
+    const auto dir = IO::fresh_test_dir("remote_cache");
+    ArtifactCache cache(dir / "local", ArtifactCache::DEFAULT_MAX_BYTES,
+                        std::make_shared<HttpRemoteStore>(
+                            Endpoint::parse("unix:" + (dir / "missing.sock").string())));
+
+    REQUIRE_FALSE(cache.fetch(1, ALWAYS).has_value());
+    REQUIRE_FALSE(cache.fetch(2, ALWAYS).has_value());
+    REQUIRE(cache.stats().remote_errors == 1);
+    REQUIRE(cache.stats().misses == 2);
+}
@@ -0,0 +1,157 @@
+#include <filesystem>
+#include <string>
+
+#include "catch.hpp"
+#include "mocks/mock_fs_gateway.hpp"
+#include "mocks/mock_proc_spawner.hpp"
+#include "src/errors/error.hpp"
+#include "src/history/artifact_cache.hpp"
+#include "src/io/file_utils.hpp"
+#include "src/remote/build_worker.hpp"
+#include "src/remote/http.hpp"
+#include "src/remote/remote_job.hpp"
+#include "src/remote/remote_spawner.hpp"
+#include "utils.hpp"
+
+namespace {
+/** Runs the build from a directory for the lifetime of the test, as remote paths are relative */
+struct ScopedCwd {
+    std::filesystem::path old = std::filesystem::current_path();
+
+    explicit ScopedCwd(const std::filesystem::path& dir) { std::filesystem::current_path(dir); }
+    ~ScopedCwd() { std::filesystem::current_path(old); }
+};
+
+/** Put a file's contents in a worker's store, returning the input naming it */
+RemoteInput send(BuildWorker& worker, const std::string& path, const std::string& contents) {
+    const std::string object = ArtifactCache::object_name(contents);
+    REQUIRE(worker.handle({"PUT", "/cas/" + object, contents}).status == 201);
+    return RemoteInput{path, object, std::filesystem::perms(0644)};
+}
+}  // namespace
+
+TEST_CASE("Remote jobs and results survive encoding", "[remote_exec]") {
+    const RemoteJob job{{"g++", "-c", "a b.c", ""},
+                        {"LANG=C"},
+                        {{"src/a b.c", "1f-3", std::filesystem::perms(0644)}},
+                        {"a.o", "a.o.d"}};
+    REQUIRE(decode_job(encode_job(job)) == job);
+
+    const RemoteResult result{1, "a.c:1: error\n", {{"a.o", std::string("\0\1,:", 4),
+                                                     std::filesystem::perms(0755)}}};
+    REQUIRE(decode_result(encode_result(result)) == result);
+
+    REQUIRE_THROWS(decode_job("3:abc,"));
+    REQUIRE_THROWS(decode_result(encode_result(result).substr(1)));
+}
+
+TEST_CASE("Build workers run jobs on the inputs they were sent", "[remote_exec]") {
+    const auto dir = IO::fresh_test_dir("remote_exec");
+    BuildWorker worker(dir / "worker", Endpoint::parse("127.0.0.1:0"), 2);
+
+    SECTION("Outputs the command wrote are sent back") {
+        RemoteJob job{{"sh", "-c", "cat src/in.txt > out/a.txt && echo done"},
+                      {},
+                      {send(worker, "src/in.txt", "input")},
+                      {"out/a.txt", "out/missing.txt"}};
+        const RemoteResult result = worker.run(job);
+        REQUIRE(result.status == 0);
+        REQUIRE(result.output == "done\n");
+        REQUIRE(result.files.size() == 1);
+        REQUIRE(result.files[0].path == "out/a.txt");
+        REQUIRE(result.files[0].contents == "input");
+    }
+
+    SECTION("A failing command reports it's status and output") {
+        const RemoteResult result =
+            worker.run(RemoteJob{{"sh", "-c", "echo bad; exit 3"}, {}, {}, {}});
+        REQUIRE(result.status == 3);
+        REQUIRE(result.output == "bad\n");
+    }
+
+    SECTION("Jobs can't reach outside their directory or use inputs never sent") {
+        RemoteJob escaping{{"true"}, {}, {}, {"../escaped"}};
+        REQUIRE(worker.run(escaping).status == -1);
+        escaping.outputs = {"/tmp/escaped"};
+        REQUIRE(worker.run(escaping).status == -1);
+
+        RemoteInput unsent{"a.c", ArtifactCache::object_name("never sent"),
+                           std::filesystem::perms(0644)};
+        REQUIRE(worker.run(RemoteJob{{"true"}, {}, {unsent}, {}}).status == -1);
+        REQUIRE(worker.handle({"PUT", "/cas/" + unsent.object, "other"}).status == 400);
+    }
+
+    // Nothing is left behind by any job
+    REQUIRE(std::filesystem::is_empty(dir / "worker" / "jobs"));
+}
+
+TEST_CASE("Build workers only empty their own directories", "[remote_exec]") {
+    const auto dir = IO::fresh_test_dir("remote_exec");
+    IO::write_file(dir / "worker" / "keep.txt", "mine");
+    IO::write_file(dir / "worker" / "objects" / "stale", "old");
+
+    BuildWorker worker(dir / "worker", Endpoint::parse("127.0.0.1:0"), 1);
+    REQUIRE(FileUtils::read_all(dir / "worker" / "keep.txt") == "mine");
+    REQUIRE(std::filesystem::is_empty(dir / "worker" / "objects"));
+    REQUIRE(std::filesystem::is_empty(dir / "worker" / "jobs"));
+}
+
+TEST_CASE("Commands are run on build workers over TCP and Unix sockets", "[remote_exec]") {
+    const auto dir = IO::fresh_test_dir("remote_exec");
+    const std::string endpoint =
+        GENERATE_COPY(std::string("127.0.0.1:0"), "unix:" + (dir / "worker.sock").string());
+    Net::RunningServer<BuildWorker> running(dir / "worker", Endpoint::parse(endpoint), 2);
+
+    std::filesystem::create_directories(dir / "build");
+    ScopedCwd cwd(dir / "build");
+    IO::write_file("in.txt", "from the build");
+    auto local = std::make_shared<MockProcSpawner>(std::make_shared<MockFsGateway>());
+    RemoteProcSpawner spawner(local, {running.server.get_endpoint()}, 2);
+    REQUIRE(spawner.remote_capacity() == 2);
+
+    std::vector<std::string> copy = {"sh", "-c", "mkdir -p out && cp in.txt out/copy.txt"};
+    std::vector<std::string> fail = {"sh", "-c", "echo oops; exit 2"};
+    const ProcessId copy_id = spawner.spawn_remote(copy, RemoteFiles{{"in.txt"}, {"out/copy.txt"}});
+    const ProcessId fail_id = spawner.spawn_remote(fail, RemoteFiles{{}, {}});
+
+    std::vector<ProcessResult> results;
+    while (results.size() < 2) {
+        for (ProcessResult& res : spawner.wait_any()) {
+            results.push_back(std::move(res));
+        }
+    }
+    for (const ProcessResult& res : results) {
+        if (res.id == copy_id) {
+            REQUIRE(res.err == nullptr);
+            REQUIRE(FileUtils::read_all("out/copy.txt") == "from the build");
+        } else {
+            REQUIRE(res.id == fail_id);
+            REQUIRE(res.status == 2);
+            REQUIRE(res.err != nullptr);
+            REQUIRE(res.output->size() == 5);
+        }
+    }
+}
+
+TEST_CASE("Unreachable workers fail the commands sent to them", "[remote_exec]") {
+    const auto dir = IO::fresh_test_dir("remote_exec");
+    std::filesystem::create_directories(dir / "build");
+    ScopedCwd cwd(dir / "build");
+    auto local = std::make_shared<MockProcSpawner>(std::make_shared<MockFsGateway>());
+    RemoteProcSpawner spawner(local, {Endpoint::parse("unix:" + (dir / "missing.sock").string())},
+                              1);
+
+    std::vector<std::string> cmd = {"true"};
+    const ProcessId id = spawner.spawn_remote(cmd, RemoteFiles{});
+    std::vector<ProcessResult> results;
+    while (results.empty()) {
+        results = spawner.wait_any();
+    }
+    REQUIRE(results[0].id == id);
+    REQUIRE(results[0].err != nullptr);
+
+    // Without any workers there is nowhere to send commands
+    RemoteProcSpawner no_workers(local, {}, 4);
+    REQUIRE(no_workers.remote_capacity() == 0);
+    REQUIRE_THROWS_AS(no_workers.spawn_remote(cmd, RemoteFiles{}), LogicError);
+}
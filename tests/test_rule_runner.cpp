@@ -1,9 +1,18 @@
+#include <algorithm>
+#include <filesystem>
 #include <memory>
+#include <sstream>
 
 #include "catch.hpp"
+#include "mocks/fake_load_monitor.hpp"
 #include "mocks/mock_fs_gateway.hpp"
 #include "mocks/mock_proc_spawner.hpp"
+#include "src/concurrency/jobserver.hpp"
 #include "src/dictionaries/rules.hpp"
+#include "src/errors/error.hpp"
+#include "src/io/caching_fs_gateway.hpp"
+#include "src/io/content_hash.hpp"
+#include "src/io/file_utils.hpp"
 #include "src/rule_graph.hpp"
 #include "src/rule_runner.hpp"
 #include "utils.hpp"
@@ -212,3 +221,710 @@ TEST_CASE("Single rule chained command construction. No recompile needed", "[rul
     REQUIRE(fs->get_write_count("main.o") == 1);
     REQUIRE(fs->get_write_count("prog") == 1);
 }
+
+TEST_CASE("Parallel runner builds dependencies before dependants", "[rule_runner][parallel]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>(
+        "prog", std::vector<std::string>{"a.o", "b.o", "c.o"}, Step::LINK, Location{0, 0, 0}));
+    for (const std::string obj : {"a", "b", "c"}) {
+        rules.push_back(std::make_unique<SingleRule>(
+            obj + ".o", std::vector<std::string>{obj + ".c"}, Step::COMPILE, Location{0, 0, 0}));
+    }
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {"-O2"}, {}, "test"});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("a.c", Time::past());
+    fs->touch_at("b.c", Time::past());
+    fs->touch_at("c.c", Time::past());
+
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    RunnerOptions opts;
+    opts.max_jobs = 4;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+
+    rule_runner.run_rule("prog");
+
+    const std::vector<std::string> order = spawner->get_run_order();
+    REQUIRE(order.size() == 4);
+    REQUIRE(order.back() == "prog");
+}
+
+TEST_CASE("Parallel runner only runs shared dependencies once", "[rule_runner][parallel]") {
+    /**
+     *      top
+     *     /   \
+     *   left  right
+     *     \   /
+     *     base
+     */
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("top", std::vector<std::string>{"left", "right"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("left", std::vector<std::string>{"base"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("right", std::vector<std::string>{"base", "base"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("base", std::vector<std::string>{"base.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("base.c", Time::past());
+
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    RunnerOptions opts;
+    opts.max_jobs = 8;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+
+    rule_runner.run_rule("top");
+
+    const std::vector<std::string> order = spawner->get_run_order();
+    REQUIRE(order.size() == 4);
+    REQUIRE(order.front() == "base");
+    REQUIRE(order.back() == "top");
+}
+
+TEST_CASE("Runner reports cyclical rule dependencies", "[rule_runner][parallel]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("a", std::vector<std::string>{"b"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("b", std::vector<std::string>{"a"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    RunnerOptions opts;
+    opts.max_jobs = 2;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+
+    REQUIRE_THROWS_AS(rule_runner.run_rule("a"), LogicError);
+    REQUIRE(spawner->get_run_count() == 0);
+}
+
+TEST_CASE("Rules on the longest remaining path have the highest priority",
+          "[rule_runner][priority]") {
+    /**
+     *       app
+     *      /   \
+     *   a.o    lib
+     *           |
+     *          b.o
+     */
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("app", std::vector<std::string>{"a.o", "lib"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("lib", std::vector<std::string>{"b.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("b.o", std::vector<std::string>{"b.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    auto priority_of = [](const BuildPlan& plan, const std::string& rule) {
+        auto itm = std::ranges::find(plan.rules, rule);
+        REQUIRE(itm != plan.rules.end());
+        return plan.priority[itm - plan.rules.begin()];
+    };
+
+    SECTION("Without history every rule counts equally") {
+        RuleRunner rule_runner(graph, cfg, spawner, fs);
+        const BuildPlan plan = rule_runner.plan_build("app");
+
+        REQUIRE(priority_of(plan, "app") == 1.0);
+        REQUIRE(priority_of(plan, "a.o") == 2.0);
+        REQUIRE(priority_of(plan, "b.o") == 3.0);
+        REQUIRE(priority_of(plan, "b.o") > priority_of(plan, "a.o"));
+    }
+
+    SECTION("A slow compile outweighs a longer chain") {
+        auto history = std::make_shared<DurationHistory>();
+        history->record("app", 1.0);
+        history->record("lib", 1.0);
+        history->record("b.o", 1.0);
+        history->record("a.o", 30.0);
+
+        RunnerOptions opts;
+        opts.history = history;
+        RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+        const BuildPlan plan = rule_runner.plan_build("app");
+
+        REQUIRE(priority_of(plan, "a.o") == 31.0);
+        REQUIRE(priority_of(plan, "b.o") == 3.0);
+    }
+}
+
+TEST_CASE("Runner records durations of executed rules", "[rule_runner][priority]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("prog", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("a.c", Time::past());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    auto history = std::make_shared<DurationHistory>();
+    RunnerOptions opts;
+    opts.history = history;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+    rule_runner.run_rule("prog");
+
+    REQUIRE(history->get("prog").has_value());
+}
+
+TEST_CASE("Captured job output is printed as one block after its command", "[rule_runner]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<MultiRule>("prog", std::vector<std::string>{"a.c", "b.c"},
+                                                std::vector<std::string>{"a.o", "b.o"},
+                                                Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("a.c", Time::past());
+    fs->touch_at("b.c", Time::past());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    spawner->set_output("a.o", "a.c:1: warning: unused variable\n");
+
+    std::ostringstream printed;
+    RunnerOptions opts;
+    opts.max_jobs = 2;
+    opts.job_output = &printed;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+    rule_runner.run_rule("prog");
+
+    // Silent commands print nothing
+    REQUIRE(printed.str() == "g++ a.c -o a.o\na.c:1: warning: unused variable\n");
+}
+
+namespace {
+/** app <- lib <- a.o, app <- b.o, with every source stale */
+std::shared_ptr<RuleGraph> make_failure_graph() {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("b.o", std::vector<std::string>{"b.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("lib", std::vector<std::string>{"a.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("app", std::vector<std::string>{"lib", "b.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    return std::make_shared<RuleGraph>(std::move(rules));
+}
+}  // namespace
+
+TEST_CASE("Failures stop the build unless keeping going", "[rule_runner][failure]") {
+    auto graph = make_failure_graph();
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("a.c", Time::past());
+    fs->touch_at("b.c", Time::past());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    spawner->fail_on("a.o");
+
+    RunnerOptions opts;
+    opts.max_jobs = 1;
+
+    SECTION("Fail fast") {
+        RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+        REQUIRE_THROWS_AS(rule_runner.run_rule("app"), SystemError);
+        // b.o may start before a.o if it's planner finishes first, but nothing starts after a.o
+        const std::vector<std::string> order = spawner->get_run_order();
+        REQUIRE_FALSE(order.empty());
+        REQUIRE(order.back() == "a.o");
+        REQUIRE_FALSE(fs->exists("lib"));
+    }
+
+    SECTION("Keep going") {
+        opts.keep_going = true;
+        RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+        REQUIRE_THROWS_AS(rule_runner.run_rule("app"), SystemError);
+        // Everything not depending on a.o is still built
+        std::vector<std::string> order = spawner->get_run_order();
+        std::ranges::sort(order);
+        REQUIRE(order == std::vector<std::string>{"a.o", "b.o"});
+        REQUIRE_FALSE(fs->exists("lib"));
+    }
+}
+
+TEST_CASE("Several targets are built as one schedule", "[rule_runner]") {
+    // app and tests both link the shared object
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("shared.o", std::vector<std::string>{"shared.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("app", std::vector<std::string>{"shared.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("tests", std::vector<std::string>{"shared.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("shared.c", Time::past());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.max_jobs = 2;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+
+    const BuildPlan plan = rule_runner.plan_build(std::vector<std::string>{"app", "tests", "app"});
+    REQUIRE(plan.rules.size() == 3);
+
+    rule_runner.run_rules({"app", "tests"});
+    REQUIRE(spawner->get_run_count() == 3);
+    REQUIRE(spawner->get_run_order().front() == "shared.o");
+
+    // Nothing is stale, and the shared rule checks it's source once (existence + write time)
+    const size_t queries = fs->get_query_count("shared.c");
+    rule_runner.run_rules({"app", "tests"});
+    REQUIRE(spawner->get_run_count() == 3);
+    REQUIRE(fs->get_query_count("shared.c") - queries == 2);
+}
+
+TEST_CASE("Pools limit how many of their jobs run at once", "[rule_runner][pools]") {
+    // Three independent links in the link pool, all needed by a final link
+    std::vector<std::unique_ptr<Rule>> rules;
+    for (const std::string name : {"app", "tests", "tools"}) {
+        rules.push_back(std::make_unique<SingleRule>(name, std::vector<std::string>{name + ".o"},
+                                                     Step::LINK, Location{0, 0, 0}, "link"));
+    }
+    rules.push_back(std::make_unique<SingleRule>(
+        "all", std::vector<std::string>{"app", "tests", "tools"}, Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto fs = std::make_shared<MockFsGateway>();
+    for (const std::string name : {"app.o", "tests.o", "tools.o"}) {
+        fs->touch_at(name, Time::past());
+    }
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    Config config{"cfg", "g++", {}, {}, "all"};
+    RunnerOptions opts;
+    opts.max_jobs = 4;
+
+    SECTION("A pool of one serialises it's jobs") {
+        config.pools = {{"link", 1}};
+        RuleRunner rule_runner(graph, std::make_shared<Config>(config), spawner, fs, opts);
+        rule_runner.run_rule("all");
+        REQUIRE(spawner->get_max_in_flight() == 1);
+        REQUIRE(spawner->get_run_count() == 4);
+    }
+
+    SECTION("Undefined pools are rejected") {
+        RuleRunner rule_runner(graph, std::make_shared<Config>(config), spawner, fs, opts);
+        REQUIRE_THROWS_AS(rule_runner.run_rule("all"), LogicError);
+        REQUIRE(spawner->get_run_count() == 0);
+    }
+}
+
+TEST_CASE("A load monitor holds jobs back", "[rule_runner][load]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<MultiRule>(
+        "prog", std::vector<std::string>{"a.c", "b.c", "c.c", "d.c"},
+        std::vector<std::string>{"a.o", "b.o", "c.o", "d.o"}, Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    for (const std::string src : {"a.c", "b.c", "c.c", "d.c"}) {
+        fs->touch_at(src, Time::past());
+    }
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    // A machine with no spare capacity still makes progress one job at a time
+    auto monitor = std::make_shared<FakeLoadMonitor>(0);
+    RunnerOptions opts;
+    opts.max_jobs = 4;
+    opts.load_monitor = monitor;
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+    rule_runner.run_rule("prog");
+
+    REQUIRE(spawner->get_run_count() == 4);
+    REQUIRE(spawner->get_max_in_flight() == 1);
+}
+
+TEST_CASE("A jobserver limits jobs across processes", "[rule_runner][jobserver]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<MultiRule>(
+        "prog", std::vector<std::string>{"a.c", "b.c", "c.c", "d.c"},
+        std::vector<std::string>{"a.o", "b.o", "c.o", "d.o"}, Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto fs = std::make_shared<MockFsGateway>();
+    for (const std::string src : {"a.c", "b.c", "c.c", "d.c"}) {
+        fs->touch_at(src, Time::past());
+    }
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    // The only token is held elsewhere in the build, leaving just the implicit one
+    JobServer server(2);
+    auto other_process = JobServerClient::from_makeflags(server.makeflags());
+    REQUIRE(other_process->try_acquire());
+
+    RunnerOptions opts;
+    opts.max_jobs = 8;
+    opts.jobserver = JobServerClient::from_makeflags(server.makeflags());
+    RuleRunner rule_runner(graph, cfg, spawner, fs, opts);
+    rule_runner.run_rule("prog");
+
+    REQUIRE(spawner->get_run_count() == 4);
+    REQUIRE(spawner->get_max_in_flight() == 1);
+
+    // Every token taken during the build went back once it finished
+    other_process->release();
+    REQUIRE(opts.jobserver->held() == 0);
+    REQUIRE(other_process->try_acquire());
+}
+
+TEST_CASE("Remote slots run jobs on top of the local job limit", "[rule_runner][remote]") {
+    // Three independent links, all needed by a final link
+    std::vector<std::unique_ptr<Rule>> rules;
+    for (const std::string name : {"app", "tests", "tools"}) {
+        rules.push_back(std::make_unique<SingleRule>(name, std::vector<std::string>{name + ".o"},
+                                                     Step::LINK, Location{0, 0, 0}));
+    }
+    rules.push_back(std::make_unique<SingleRule>(
+        "all", std::vector<std::string>{"app", "tests", "tools"}, Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto fs = std::make_shared<MockFsGateway>();
+    for (const std::string name : {"app.o", "tests.o", "tools.o"}) {
+        fs->touch_at(name, Time::past());
+    }
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    spawner->set_remote_capacity(2);
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "all"});
+    RunnerOptions opts;
+    opts.max_jobs = 1;
+
+    SECTION("Every job is built without exceeding either limit") {
+        RuleRunner(graph, cfg, spawner, fs, opts).run_rule("all");
+        REQUIRE(spawner->get_run_count() == 4);
+        REQUIRE(spawner->get_max_in_flight() <= 3);
+    }
+
+    SECTION("Jobs failing remotely are run again locally") {
+        spawner->fail_remote();
+        RuleRunner(graph, cfg, spawner, fs, opts).run_rule("all");
+        REQUIRE(spawner->get_run_count() == 4);
+        REQUIRE(fs->exists("all"));
+    }
+}
+
+TEST_CASE("Compiles are not run remotely until their headers are known", "[rule_runner][remote]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<MultiRule>(
+        "prog", std::vector<std::string>{"a.c", "b.c"}, std::vector<std::string>{"a.o", "b.o"},
+        Step::COMPILE, Location{0, 0, 0}));
+    for (const std::string name : {"c", "d"}) {
+        rules.push_back(std::make_unique<SingleRule>(name + ".o",
+                                                     std::vector<std::string>{name + ".c"},
+                                                     Step::COMPILE, Location{0, 0, 0}));
+    }
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test", {}, HeaderDeps::GCC});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    for (const std::string src : {"a.c", "b.c", "c.c", "d.c"}) {
+        fs->touch_at(src, Time::past());
+    }
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    spawner->set_remote_capacity(4);
+
+    RunnerOptions opts;
+    opts.max_jobs = 1;
+    opts.deps_log = std::make_shared<DepsLog>();
+    RuleRunner(graph, cfg, spawner, fs, opts).run_rules({"prog", "c.o", "d.o"});
+
+    REQUIRE(spawner->get_run_count() == 4);
+    REQUIRE(spawner->get_remote_count() == 0);
+}
+
+TEST_CASE("Cached write times are refreshed when a job writes the file",
+          "[rule_runner][fs_gateway]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("prog", std::vector<std::string>{"a.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+    auto mock_fs = std::make_shared<MockFsGateway>();
+    const auto now = std::filesystem::file_time_type::clock::now();
+    mock_fs->touch_at("a.o", now - std::chrono::seconds(30));
+    mock_fs->touch_at("prog", now - std::chrono::seconds(20));
+    mock_fs->touch_at("a.c", now - std::chrono::seconds(10));
+    auto spawner = std::make_shared<MockProcSpawner>(mock_fs);
+
+    // 'a.o' is cached as older than 'prog' while checking whether it is stale, so the link is only
+    // run if that entry is discarded once the compile rewrites it
+    auto fs = std::make_shared<CachingFSGateway>(mock_fs);
+    RuleRunner rule_runner(graph, cfg, spawner, fs);
+    rule_runner.run_rule("prog");
+
+    REQUIRE(spawner->get_run_count() == 2);
+    REQUIRE(mock_fs->get_write_count("prog") == 2);
+}
+
+TEST_CASE("Rules rerun when their command changes", "[rule_runner][build_log]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+
+    auto fs = std::make_shared<MockFsGateway>();
+    fs->touch_at("a.c", Time::past());
+    fs->touch_at("a.o", Time::future());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.build_log = std::make_shared<BuildLog>();
+    auto build = [&](std::vector<std::string> flags) {
+        auto cfg = std::make_shared<Config>(Config{"cfg", "g++", flags, {}, "test"});
+        RuleRunner(graph, cfg, spawner, fs, opts).run_rule("a.o");
+    };
+
+    // Up to date rules missing from the log are recorded as they are
+    build({"-O2"});
+    REQUIRE(spawner->get_run_count() == 0);
+    build({"-O2"});
+    REQUIRE(spawner->get_run_count() == 0);
+
+    build({"-O3"});
+    REQUIRE(spawner->get_run_count() == 1);
+    build({"-O3"});
+    REQUIRE(spawner->get_run_count() == 1);
+}
+
+TEST_CASE("Compiles rerun when a header they read changes", "[rule_runner][deps_log]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("a.o", std::vector<std::string>{"a.c"},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test", {}, HeaderDeps::GCC});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    const auto now = std::filesystem::file_time_type::clock::now();
+    fs->touch_at("a.h", now - std::chrono::seconds(40));
+    fs->touch_at("a.c", now - std::chrono::seconds(30));
+    fs->touch_at("a.o", now - std::chrono::seconds(20));
+    fs->touch_at("new.h", Time::future());
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.deps_log = std::make_shared<DepsLog>();
+    auto build = [&] { RuleRunner(graph, cfg, spawner, fs, opts).run_rule("a.o"); };
+
+    // Headers never read from a depfile are unknown, so the compile must run to find them
+    build();
+    REQUIRE(spawner->get_run_count() == 1);
+
+    opts.deps_log->record("a.o", {"a.h"});
+    build();
+    REQUIRE(spawner->get_run_count() == 1);
+
+    opts.deps_log->record("a.o", {"a.h", "new.h"});
+    build();
+    REQUIRE(spawner->get_run_count() == 2);
+
+    opts.deps_log->record("a.o", {"a.h", "removed.h"});
+    build();
+    REQUIRE(spawner->get_run_count() == 3);
+}
+
+TEST_CASE("Clean subgraphs are skipped after one dirty marking pass", "[rule_runner][dirty]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    for (const std::string name : {"a", "b"}) {
+        rules.push_back(std::make_unique<SingleRule>(name + ".o",
+                                                     std::vector<std::string>{name + ".c"},
+                                                     Step::COMPILE, Location{0, 0, 0}));
+    }
+    rules.push_back(std::make_unique<SingleRule>("lib", std::vector<std::string>{"b.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("app", std::vector<std::string>{"a.o", "lib"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    const auto now = std::filesystem::file_time_type::clock::now();
+    fs->touch_at("b.c", now - std::chrono::seconds(50));
+    fs->touch_at("b.o", now - std::chrono::seconds(40));
+    fs->touch_at("lib", now - std::chrono::seconds(30));
+    fs->touch_at("a.o", now - std::chrono::seconds(20));
+    fs->touch_at("app", now - std::chrono::seconds(10));
+    fs->touch_at("a.c", now);
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+    RuleRunner rule_runner(graph, cfg, spawner, fs);
+
+    const BuildPlan plan = rule_runner.plan_build("app");
+    const DirtySet marks = rule_runner.mark_dirty(plan);
+    auto index = [&](const std::string& name) {
+        return std::ranges::find(plan.rules, name) - plan.rules.begin();
+    };
+    REQUIRE(marks.stale[index("a.o")]);
+    REQUIRE(marks.dirty[index("a.o")]);
+    // Dirty through 'a.o' without being checked, as 'a.o' is about to change
+    REQUIRE(marks.dirty[index("app")]);
+    REQUIRE_FALSE(marks.stale[index("app")]);
+    REQUIRE(fs->get_query_count("app") == 0);
+    REQUIRE_FALSE(marks.dirty[index("b.o")]);
+    REQUIRE_FALSE(marks.dirty[index("lib")]);
+
+    // Clean rules are checked once per build, while marking, and never planned
+    const size_t source_queries = fs->get_query_count("b.c");
+    rule_runner.run_rule("app");
+    REQUIRE(spawner->get_run_order() == std::vector<std::string>{"a.o", "app"});
+    REQUIRE(fs->get_query_count("b.c") == source_queries * 2);
+}
+
+TEST_CASE("Outputs rebuilt with the same contents cut the build off", "[rule_runner][restat]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    for (const std::string name : {"a", "b"}) {
+        rules.push_back(std::make_unique<SingleRule>(name + ".o",
+                                                     std::vector<std::string>{name + ".c"},
+                                                     Step::COMPILE, Location{0, 0, 0}));
+        rules.push_back(std::make_unique<SingleRule>(name, std::vector<std::string>{name + ".o"},
+                                                     Step::LINK, Location{0, 0, 0}));
+    }
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (const std::string name : {"a", "b"}) {
+        fs->touch_at(name + ".o", now - std::chrono::seconds(30));
+        fs->touch_at(name, now - std::chrono::seconds(20));
+        fs->touch_at(name + ".c", now - std::chrono::seconds(10));
+    }
+    // Only 'a.o' is rebuilt with the same contents, e.g. after editing a comment
+    fs->set_contents("a.o", "object");
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.build_log = std::make_shared<BuildLog>();
+    opts.restat = true;
+    RuleRunner(graph, cfg, spawner, fs, opts).run_rules({"a", "b"});
+
+    std::vector<std::string> order = spawner->get_run_order();
+    std::ranges::sort(order);
+    REQUIRE(order == std::vector<std::string>{"a.o", "b", "b.o"});
+    REQUIRE(fs->last_write_time("a.o") == now - std::chrono::seconds(30));
+
+    // 'a.o' is older than 'a.c' again, but it's last run started after 'a.c' was written
+    RuleRunner(graph, cfg, spawner, fs, opts).run_rules({"a", "b"});
+    REQUIRE(spawner->get_run_count() == 3);
+}
+
+TEST_CASE("Programs are not relinked while a library's interface is unchanged",
+          "[rule_runner][restat]") {
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>("libcore.so", std::vector<std::string>{"core.o"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    rules.push_back(std::make_unique<SingleRule>("app", std::vector<std::string>{"libcore.so"},
+                                                 Step::LINK, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    auto cfg = std::make_shared<Config>(Config{"cfg", "g++", {}, {}, "test"});
+
+    auto fs = std::make_shared<MockFsGateway>();
+    const auto now = std::filesystem::file_time_type::clock::now();
+    fs->touch_at("libcore.so", now - std::chrono::seconds(30));
+    fs->touch_at("app", now - std::chrono::seconds(20));
+    fs->touch_at("core.o", now - std::chrono::seconds(10));
+    // Every write changes the library's contents, but not what it exports
+    fs->set_interface("libcore.so", "f g");
+    auto spawner = std::make_shared<MockProcSpawner>(fs);
+
+    RunnerOptions opts;
+    opts.build_log = std::make_shared<BuildLog>();
+    opts.restat = true;
+    RuleRunner(graph, cfg, spawner, fs, opts).run_rule("app");
+    REQUIRE(spawner->get_run_order() == std::vector<std::string>{"libcore.so"});
+}
+
+TEST_CASE("Outputs built before are restored from the artifact cache", "[rule_runner][cache]") {
+    const auto dir = IO::fresh_test_dir("runner_cache");
+    const std::string source = dir / "a.c";
+    const std::string header = dir / "a.h";
+    const std::string object = dir / "a.o";
+    const std::string runs = dir / "runs";
+
+    std::vector<std::unique_ptr<Rule>> rules;
+    rules.push_back(std::make_unique<SingleRule>(object, std::vector<std::string>{source},
+                                                 Step::COMPILE, Location{0, 0, 0}));
+    auto graph = std::make_shared<RuleGraph>(std::move(rules));
+    // A "compiler" that includes the header and writes a depfile: sh -c <script> a.c -o a.o -MD
+    // -MF a.o.d
+    const std::string script = "cat \"$0\" '" + header + "' > \"$2\" && echo \"$2: $0 " + header +
+                               "\" > \"$5\" && echo run >> '" + runs + "'";
+    auto cfg = std::make_shared<Config>(
+        Config{"cfg", "sh", {"-c", script}, {}, "test", {}, HeaderDeps::GCC});
+
+    RunnerOptions opts;
+    opts.build_log = std::make_shared<BuildLog>();
+    opts.deps_log = std::make_shared<DepsLog>();
+    opts.cache = std::make_shared<ArtifactCache>(dir / "cache");
+    auto spawner = std::make_shared<PosixProcSpawner>();
+    auto build = [&](const std::string& source_text, const std::string& header_text) {
+        IO::write_file(source, source_text);
+        IO::write_file(header, header_text);
+        if (std::filesystem::exists(object)) {
+            std::filesystem::last_write_time(
+                object, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+        }
+        auto fs = std::make_shared<CachingFSGateway>(std::make_shared<ProdFSGateway>());
+        RuleRunner(graph, cfg, spawner, fs, opts).run_rule(object);
+        return FileUtils::read_all(runs).size() / std::string("run\n").size();
+    };
+
+    REQUIRE(build("v1 ", "h1") == 1);
+    REQUIRE(build("v2 ", "h1") == 2);
+
+    // Switching back restores the first build without compiling
+    REQUIRE(build("v1 ", "h1") == 2);
+    REQUIRE(FileUtils::read_all(object) == "v1 h1");
+
+    // The same source built against a different header is a different build
+    REQUIRE(build("v1 ", "h2") == 3);
+    REQUIRE(build("v1 ", "h1") == 3);
+    REQUIRE(FileUtils::read_all(object) == "v1 h1");
+    REQUIRE(opts.deps_log->get(object) == std::vector<std::string>{header});
+
+    const CacheStats stats = opts.cache->stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 3);
+    REQUIRE(stats.stores == 3);
+
+    // A header that can't be read leaves the build uncached rather than ending it
+    struct UnreadableFSGateway : ProdFSGateway {
+        std::string unreadable;
+        std::optional<uint64_t> hash_contents(const std::string& filename) const override {
+            if (filename == unreadable) throw IOError("Failed to read '" + filename + "'");
+            return content_hash(FileUtils::read_all(filename));
+        }
+    };
+    IO::write_file(source, "v3 ");
+    std::filesystem::last_write_time(
+        object, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+    auto unreadable = std::make_shared<UnreadableFSGateway>();
+    unreadable->unreadable = header;
+    auto fs = std::make_shared<CachingFSGateway>(unreadable);
+    RuleRunner(graph, cfg, spawner, fs, opts).run_rule(object);
+    REQUIRE(FileUtils::read_all(object) == "v3 h1");
+    REQUIRE(opts.cache->stats().stores == 3);
+}
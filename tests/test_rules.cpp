@@ -235,4 +235,41 @@ TEST_CASE("Multi rule with link step uses link flags", "[rule_runner]") {
         // Verify link flags are used, not compilation flags
         REQUIRE_FALSE(got_arg_set.contains("-Wall"));
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Compiles write a depfile when tracking headers", "[rule_runner]") {
+    const Config cfg{"cfg", "g++", {"-O2"}, {}, "test", {}, HeaderDeps::GCC};
+    auto tail = [](const Command& cmd) { return Command(cmd.end() - 3, cmd.end()); };
+
+    SingleRule compile{"a.o", {"a.c"}, Step::COMPILE, Location{0, 0, 0}};
+    REQUIRE(compile.get_depfile_outputs(cfg) == std::vector<std::string>{"a.o"});
+    REQUIRE(tail(compile.get_commands(cfg).at(0)) == Command{"-MD", "-MF", "a.o.d"});
+
+    MultiRule multi{"objs", {"b.c", "c.c"}, {"b.o", "c.o"}, Step::COMPILE, Location{0, 0, 0}};
+    REQUIRE(multi.get_depfile_outputs(cfg) == std::vector<std::string>{"b.o", "c.o"});
+    REQUIRE(tail(multi.get_commands(cfg).at(1)) == Command{"-MD", "-MF", "c.o.d"});
+
+    // The depfile of a compile with several sources only lists the headers of the last
+    SingleRule several{"prog", {"a.c", "b.c"}, Step::COMPILE, Location{0, 0, 0}};
+    SingleRule link{"app", {"a.o"}, Step::LINK, Location{0, 0, 0}};
+    for (const SingleRule* rule : {&several, &link}) {
+        REQUIRE(rule->get_depfile_outputs(cfg).empty());
+        const Command cmd = rule->get_commands(cfg).at(0);
+        REQUIRE(std::ranges::find(cmd, "-MD") == cmd.end());
+    }
+
+    const Config untracked{"cfg", "g++", {"-O2"}, {}, "test"};
+    REQUIRE(compile.get_depfile_outputs(untracked).empty());
+    REQUIRE(compile.get_commands(untracked).at(0).size() == 5);
+}
+
+TEST_CASE("Only shared library links export an interface", "[rule_runner]") {
+    for (const std::string name : {"libcore.so", "lib/libcore.so.1.2"}) {
+        REQUIRE(SingleRule(name, {"a.o"}, Step::LINK, Location{0, 0, 0}).exports_interface());
+    }
+    REQUIRE_FALSE(SingleRule("app", {"a.o"}, Step::LINK, Location{0, 0, 0}).exports_interface());
+    REQUIRE_FALSE(
+        SingleRule("libcore.so", {"a.c"}, Step::COMPILE, Location{0, 0, 0}).exports_interface());
+    REQUIRE_FALSE(
+        SingleRule("some.solver", {"a.o"}, Step::LINK, Location{0, 0, 0}).exports_interface());
+}
@@ -124,6 +124,28 @@ TEST_CASE("ValueList concatenation with operator+=", "[value][operations]") {
     REQUIRE(count == 4);
 }
 
+TEST_CASE("Values are equal when they hold the same data", "[value][operations]") {
+    std::vector<std::unique_ptr<Value>> elems;
+    elems.push_back(std::make_unique<Value>(std::string("a.cpp")));
+    elems.push_back(std::make_unique<Value>(ScopedEnumValue{"Step", "LINK"}));
+    const Value list((ValueList(std::move(elems))));
+    Dictionary dict;
+    dict.insert("deps", list);
+
+    REQUIRE(Value(dict) == Value(dict));
+    REQUIRE(list == Value(list));
+    REQUIRE_FALSE(Value(std::string("1")) == Value(1));
+    REQUIRE_FALSE(Value(ScopedEnumValue{"Step", "LINK"}) ==
+                  Value(ScopedEnumValue{"Step", "COMPILE"}));
+
+    Value longer = list;
+    longer += list;
+    REQUIRE_FALSE(longer == list);
+    Dictionary other;
+    other.insert("deps", longer);
+    REQUIRE_FALSE(Value(dict) == Value(other));
+}
+
 // Tests for dictionaries
 
 TEST_CASE("Dictionary insert and get", "[value][dictionary]") {
@@ -0,0 +1,44 @@
+#include <atomic>
+#include <functional>
+
+#include "catch.hpp"
+#include "src/concurrency/work_stealing_pool.hpp"
+
+TEST_CASE("Pool runs every submitted task", "[pool]") {
+    WorkStealingPool pool(4);
+    std::atomic<size_t> count = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        pool.submit([&] { count++; });
+    }
+    pool.wait_idle();
+
+    REQUIRE(count == 1000);
+}
+
+TEST_CASE("Pool waits for tasks submitted by other tasks", "[pool]") {
+    WorkStealingPool pool(3);
+    std::atomic<size_t> count = 0;
+
+    // Each task fans out into two more until the depth runs out, like released rules
+    std::function<void(int)> spawn = [&](int depth) {
+        count++;
+        if (depth == 0) return;
+        pool.submit([&, depth] { spawn(depth - 1); });
+        pool.submit([&, depth] { spawn(depth - 1); });
+    };
+    pool.submit([&] { spawn(8); });
+    pool.wait_idle();
+
+    // A full binary tree of depth 8
+    REQUIRE(count == 511);
+}
+
+TEST_CASE("Pool always has at least one worker", "[pool]") {
+    WorkStealingPool pool(0);
+    REQUIRE(pool.size() == 1);
+
+    bool ran = false;
+    pool.submit([&] { ran = true; });
+    pool.wait_idle();
+    REQUIRE(ran);
+}
@@ -1,5 +1,6 @@
 #include "utils.hpp"
 
+#include <fstream>
 #include <memory>
 
 #include "src/dictionaries/config_factory.hpp"
@@ -53,4 +54,18 @@ std::filesystem::file_time_type Time::future() {
 
 std::filesystem::path IO::get_test_file_path(std::filesystem::path file) {
     return std::filesystem::path(TEST_DATA_DIR / file);
-}
\ No newline at end of file
+}
+
+std::filesystem::path IO::fresh_test_dir(const std::string& name) {
+    const auto dir = std::filesystem::temp_directory_path() / ("my_make_test_" + name);
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+void IO::write_file(const std::filesystem::path& path, const std::string& contents) {
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path());
+    }
+    std::ofstream(path, std::ios::trunc) << contents;
+}
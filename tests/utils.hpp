@@ -1,7 +1,12 @@
+#include <filesystem>
 #include <memory>
+#include <string>
+#include <thread>
+#include <utility>
 #include <unordered_map>
 
 #include "src/parsing/expr.hpp"
+#include "src/remote/http.hpp"
 #include "src/rule_graph.hpp"
 
 namespace Factories {
@@ -49,4 +54,35 @@ inline const std::string TEST_DATA_DIR = "../tests/data/files";
 
 /** Get the path of a file in the file directory of test data */
 std::filesystem::path get_test_file_path(std::filesystem::path file);
-}  // namespace IO
\ No newline at end of file
+
+/**
+ * Create an empty directory for a test in the system's temporary directory, removing anything an
+ * earlier run left there
+ * @param name Tells the directories of different tests apart
+ */
+std::filesystem::path fresh_test_dir(const std::string& name);
+
+/** Replace the contents of a file, creating it and it's parent directories if needed */
+void write_file(const std::filesystem::path& path, const std::string& contents);
+}  // namespace IO
+
+namespace Net {
+/**
+ * A server serving on a background thread for the lifetime of a test
+ * @tparam T The HttpServer being run, constructed from the arguments given
+ */
+template <typename T>
+struct RunningServer {
+    T server;
+    std::jthread thread;
+
+    template <typename... Args>
+    explicit RunningServer(Args&&... args)
+        : server(std::forward<Args>(args)...), thread([this] { server.serve(); }) {}
+
+    ~RunningServer() {
+        server.stop();
+        thread.join();
+    }
+};
+}  // namespace Net
@@ -0,0 +1,86 @@
+#include <csignal>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pthread.h"
+#include "src/remote/build_worker.hpp"
+#include "src/remote/http.hpp"
+
+/** Parse the value of '--jobs' (e.g. the "8" in "--jobs=8") */
+size_t parse_jobs(const std::string& val) {
+    size_t parsed_len = 0;
+    unsigned long jobs = 0;
+    try {
+        jobs = std::stoul(val, &parsed_len);
+    } catch (const std::exception&) {
+        parsed_len = 0;
+    }
+    if (parsed_len != val.size() || val.starts_with('-') || jobs == 0) {
+        throw std::invalid_argument("Invalid job count '" + val + "'. Must be a positive integer");
+    }
+    return jobs;
+}
+
+int main(int argc, char** argv) {
+    const std::string usage =
+        "<" + std::string(argv[0]) +
+        "> [--listen=<host:port|unix:path>] [--allow-remote] [--jobs=<N>] <dir>";
+
+    Endpoint endpoint = Endpoint::parse("127.0.0.1:7879");
+    bool allow_remote = false;
+    size_t jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.starts_with("--listen=")) {
+            endpoint = Endpoint::parse(arg.substr(arg.find('=') + 1));
+        } else if (arg == "--allow-remote") {
+            allow_remote = true;
+        } else if (arg.starts_with("--jobs=")) {
+            jobs = parse_jobs(arg.substr(arg.find('=') + 1));
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 1) {
+        throw std::invalid_argument("Invalid CLI arguments. Usage:\n " + usage);
+    }
+    // Any client that can connect can run any command, so a worker is only reachable from other
+    // machines when asked for explicitly
+    if (!endpoint.is_local() && !allow_remote) {
+        throw std::invalid_argument("Refusing to listen on " + endpoint.to_string() +
+                                    ", which other machines can reach. Jobs are run for any "
+                                    "client without authentication; pass --allow-remote to "
+                                    "listen there anyway");
+    }
+
+    // Blocked before any thread starts so every thread inherits the mask, and the signals are
+    // only ever taken by the thread waiting for them below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    BuildWorker worker(positional[0], endpoint, jobs);
+    std::jthread stopper([&] {
+        int sig;
+        sigwait(&signals, &sig);
+        worker.stop();
+    });
+
+    std::cout << "Running up to " << jobs << " job(s) in '" << positional[0] << "' on "
+              << worker.get_endpoint().to_string() << std::endl;
+    try {
+        worker.serve();
+    } catch (...) {
+        // The stopper is still waiting for a signal, and joining it would hang instead of exiting
+        pthread_kill(stopper.native_handle(), SIGTERM);
+        throw;
+    }
+    return 0;
+}